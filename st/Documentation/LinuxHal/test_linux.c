@@ -30,6 +30,7 @@
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <math.h>
 
 #define TEST_LINUX_VERSION	"1.2"
@@ -60,12 +61,17 @@
 /* Max event buffer for poll sensor */
 #define BUFFER_EVENT		256
 
+/* bench mode: poll buffer and sensors tracked */
+#define BENCH_BUFFER_EVENT	4096
+#define BENCH_MAX_HANDLES	64
+#define BENCH_MAX_SENSORS	16
+
 /* Defines to enable/disable sensors */
 #define SENSOR_ENABLE		1
 #define SENSOR_DISABLE		0
 
 /* Translate sansor index from listo to handle */
-#define HANDLE_FROM_INDEX(_i) (i + 1)
+#define HANDLE_FROM_INDEX(_i) ((_i) + 1)
 #define INVALID_HANDLE	-1
 
 #define UCF_STR_LEN		256
@@ -171,6 +177,10 @@ static const struct option long_options[] = {
 		{"cmdur",     required_argument, 0,  'x' },
 
 		{"ign_cmd",   required_argument, 0,  'I' },
+		{"capture",   required_argument, 0,  'C' },
+		{"replay",    required_argument, 0,  'R' },
+		{"realtime",  no_argument,       0,  'W' },
+		{"bench",     required_argument, 0,  'B' },
 		{"help",      no_argument,       0,  '?' },
 		{0,           0,                 0,   0  }
 	};
@@ -212,6 +222,17 @@ static int sensor_handle = -1;
 static int test_events = 0;
 static int mlc_iio_device_number = 3;
 static int mlc_wait_events_device_number = 4;
+static void *hal_lib;
+
+/* HAL test API, available when built with CONFIG_ST_HAL_CAPTURE */
+static int (*hal_capture)(const char *filename, int enable);
+static int (*hal_replay)(const char *filename, int realtime);
+
+static pthread_mutex_t replay_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t replay_events;
+static uint64_t replay_flush_complete;
+static uint64_t replay_checksum;
+static int64_t replay_last_event_ns;
 
 static float rot[3][3];
 static float location[3];
@@ -493,6 +514,8 @@ static int open_hal(char *lcl_path)
 		return -1;
 	}
 
+	hal_lib = hal;
+
 	hmi = dlsym(hal, HAL_MODULE_INFO_SYM_AS_STR);
 	if (!hmi) {
 		fprintf(stderr, "ERROR: unable to find %s entry point in HAL\n",
@@ -553,6 +576,419 @@ static void sensor_disable_all(void)
 	}
 }
 
+static int64_t monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int capture_start(const char *filename)
+{
+	int err;
+
+	hal_capture = dlsym(hal_lib, "st_hal_capture");
+	if (!hal_capture) {
+		fprintf(stderr, "ERROR: HAL built without capture support\n");
+		return -ENOSYS;
+	}
+
+	err = hal_capture(filename, 1);
+	if (err < 0) {
+		fprintf(stderr, "ERROR: unable to start capture to %s (%d)\n",
+			filename, err);
+		hal_capture = NULL;
+		return err;
+	}
+
+	tl_log("Capturing to %s", filename);
+
+	return 0;
+}
+
+/* FNV-1a of the event payload, summed so that sensors interleaving does not matter */
+static void replay_account_event(const sensors_event_t *e)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	const uint8_t *p;
+	unsigned int i;
+	struct {
+		int32_t sensor;
+		int32_t type;
+		int64_t timestamp;
+		float data[3];
+	} key;
+
+	memset(&key, 0, sizeof(key));
+	key.sensor = e->sensor;
+	key.type = e->type;
+	key.timestamp = e->timestamp;
+	memcpy(key.data, e->data, sizeof(key.data));
+
+	p = (const uint8_t *)&key;
+	for (i = 0; i < sizeof(key); i++) {
+		hash ^= p[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	replay_checksum += hash;
+	replay_events++;
+	if (e->type == SENSOR_TYPE_META_DATA)
+		replay_flush_complete++;
+}
+
+static void *replay_poll_thread(void *arg)
+{
+	sensors_event_t events[BUFFER_EVENT];
+	int i, count;
+
+	while (1) {
+		count = poll_dev->poll(&poll_dev->v0, events,
+				       sizeof(events)/sizeof(sensors_event_t));
+		if (count <= 0)
+			continue;
+
+		pthread_mutex_lock(&replay_lock);
+		for (i = 0; i < count; i++)
+			replay_account_event(&events[i]);
+		replay_last_event_ns = monotonic_ns();
+		pthread_mutex_unlock(&replay_lock);
+	}
+
+	return NULL;
+}
+
+static int replay_test(const char *filename, int realtime)
+{
+	pthread_t thread;
+	int64_t start, elapsed, idle;
+	int records;
+
+	hal_replay = dlsym(hal_lib, "st_hal_replay");
+	if (!hal_replay) {
+		fprintf(stderr, "ERROR: HAL built without capture support\n");
+		return -ENOSYS;
+	}
+
+	if (pthread_create(&thread, NULL, replay_poll_thread, NULL)) {
+		fprintf(stderr, "ERROR: unable to create poll thread\n");
+		return -ENOMEM;
+	}
+
+	start = monotonic_ns();
+	records = hal_replay(filename, realtime);
+	elapsed = monotonic_ns() - start;
+	if (records < 0) {
+		fprintf(stderr, "ERROR: replay of %s failed (%d)\n",
+			filename, records);
+		return records;
+	}
+
+	/* let the poll thread drain events still queued in the HAL */
+	do {
+		usleep(50000);
+		pthread_mutex_lock(&replay_lock);
+		idle = monotonic_ns() - replay_last_event_ns;
+		pthread_mutex_unlock(&replay_lock);
+	} while (idle < 200000000LL);
+
+	pthread_mutex_lock(&replay_lock);
+	printf("replay %s: records=%d elapsed_ms=%.3f events=%llu flush_complete=%llu checksum=%016llx\n",
+	       filename, records, (double)elapsed / 1000000.0,
+	       (unsigned long long)replay_events,
+	       (unsigned long long)replay_flush_complete,
+	       (unsigned long long)replay_checksum);
+	pthread_mutex_unlock(&replay_lock);
+
+	return 0;
+}
+
+/*
+ * struct bench_sensor: per sensor bench mode statistics
+ * @odr: requested ODR [Hz], 0 if not set by test_linux.
+ * @deltas: inter-sample timestamp differences [ns].
+ * @duplicates: samples with timestamp not after the previous one.
+ * @polls: poll() returns carrying samples of this sensor.
+ * @batch_max: max samples of this sensor in a single poll() return.
+ */
+struct bench_sensor {
+	const struct sensor_t *sensor;
+	double odr;
+	uint64_t events;
+	int64_t first_ts;
+	int64_t last_ts;
+	int64_t *deltas;
+	size_t deltas_len;
+	size_t deltas_max;
+	uint64_t duplicates;
+	uint64_t polls;
+	uint64_t batch_max;
+	uint64_t batch_cur;
+};
+
+static int cmp_int64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double bench_requested_odr(int type)
+{
+	if (batch_ns && delay_ns)
+		return 1000000000.0 / delay_ns;
+
+	switch (type) {
+	case SENSOR_TYPE_ACCELEROMETER:
+		return acc_odr;
+	case SENSOR_TYPE_GYROSCOPE:
+		return gyro_odr;
+	default:
+		return 0;
+	}
+}
+
+static void bench_add_sample(struct bench_sensor *b, int64_t timestamp)
+{
+	int64_t *deltas;
+
+	if (b->events++ == 0) {
+		b->first_ts = timestamp;
+		b->last_ts = timestamp;
+		return;
+	}
+
+	if (timestamp <= b->last_ts) {
+		b->duplicates++;
+		return;
+	}
+
+	if (b->deltas_len == b->deltas_max) {
+		deltas = realloc(b->deltas,
+				 2 * b->deltas_max * sizeof(*deltas));
+		if (!deltas)
+			return;
+
+		b->deltas = deltas;
+		b->deltas_max *= 2;
+	}
+
+	b->deltas[b->deltas_len++] = timestamp - b->last_ts;
+	b->last_ts = timestamp;
+}
+
+static void bench_report(struct bench_sensor *b, double wall_s)
+{
+	size_t i, gaps = 0;
+	int64_t period, jitter, jitter_max = 0;
+	double jitter_sum = 0, rate = 0;
+	int64_t *jitters;
+
+	if (b->deltas_len == 0) {
+		printf("bench %s: handle=%d odr_req=%.1f events=%llu\n",
+		       b->sensor->name, b->sensor->handle, b->odr,
+		       (unsigned long long)b->events);
+		return;
+	}
+
+	/* median interval is the delivered period, robust to gaps */
+	qsort(b->deltas, b->deltas_len, sizeof(*b->deltas), cmp_int64);
+	period = b->deltas[b->deltas_len / 2];
+
+	jitters = b->deltas;
+	for (i = 0; i < b->deltas_len; i++) {
+		if (b->deltas[i] * 2 > period * 3)
+			gaps++;
+
+		jitter = llabs(b->deltas[i] - period);
+		jitter_sum += jitter;
+		if (jitter > jitter_max)
+			jitter_max = jitter;
+
+		/* deltas not needed anymore, reuse storage */
+		jitters[i] = jitter;
+	}
+
+	qsort(jitters, b->deltas_len, sizeof(*jitters), cmp_int64);
+
+	rate = (double)b->deltas_len * 1000000000.0 /
+	       (double)(b->last_ts - b->first_ts);
+
+	printf("bench %s: handle=%d odr_req=%.1f rate=%.2f rate_ratio=%.4f "
+	       "events=%llu events_per_s=%.2f period_us=%.1f "
+	       "jitter_mean_us=%.1f jitter_p99_us=%.1f jitter_max_us=%.1f "
+	       "gaps=%zu duplicates=%llu polls=%llu batch_mean=%.2f batch_max=%llu\n",
+	       b->sensor->name, b->sensor->handle, b->odr, rate,
+	       b->odr > 0 ? rate / b->odr : 0,
+	       (unsigned long long)b->events,
+	       (double)b->events / wall_s,
+	       period / 1000.0,
+	       jitter_sum / b->deltas_len / 1000.0,
+	       jitters[(b->deltas_len * 99) / 100] / 1000.0,
+	       jitter_max / 1000.0,
+	       gaps, (unsigned long long)b->duplicates,
+	       (unsigned long long)b->polls,
+	       b->polls ? (double)b->events / b->polls : 0,
+	       (unsigned long long)b->batch_max);
+}
+
+static double timeval_s(struct timeval *tv)
+{
+	return tv->tv_sec + tv->tv_usec / 1000000.0;
+}
+
+/* no formatting in the poll loop, tool cost must not limit the rate */
+static int bench_test(int sindex, int notemp, int duration)
+{
+	struct bench_sensor bench[BENCH_MAX_SENSORS];
+	signed char slot[BENCH_MAX_HANDLES];
+	sensors_event_t *events;
+	struct sensor_t *sensor, *first;
+	struct rusage ru_start, ru_end;
+	uint64_t polls = 0, total = 0, batch_max = 0, meta = 0;
+	int64_t start, elapsed;
+	int i, j, k, count, num = 0, handle, err = 0;
+	struct bench_sensor *b;
+
+	events = malloc(BENCH_BUFFER_EVENT * sizeof(*events));
+	if (!events)
+		return -ENOMEM;
+
+	memset(bench, 0, sizeof(bench));
+	memset(slot, -1, sizeof(slot));
+
+	for (i = 0; test_sensor_type[i] != -1; i++) {
+		if ((sindex >= 0) && (i != sindex))
+			continue;
+
+		if (notemp && test_sensor_type[i] == SENSOR_TYPE_TEMPERATURE)
+			continue;
+
+		/* every instance of the type, boards may have several IMUs */
+		for (k = 0; k < sensor_num; k++) {
+			if (list[k].type != test_sensor_type[i])
+				continue;
+
+			sensor = (struct sensor_t *)&list[k];
+			handle = HANDLE_FROM_INDEX(k);
+			if ((handle >= BENCH_MAX_HANDLES) ||
+			    (num == BENCH_MAX_SENSORS))
+				continue;
+
+			b = &bench[num];
+			b->sensor = sensor;
+			b->odr = bench_requested_odr(sensor->type);
+
+			/* main() configured the first instance only */
+			if (get_sensor(list, sensor->type, &first) != handle) {
+				if (batch_ns && delay_ns)
+					sensor_batch(handle, delay_ns, batch_ns);
+				else if (b->odr > 0)
+					poll_dev->setDelay(&poll_dev->v0, handle,
+							   1000000000 / b->odr);
+			}
+
+			/* sized for the whole run, grown only if the HAL overshoots */
+			b->deltas_max = (b->odr > 0 ? b->odr : 1000) * duration + 1024;
+			b->deltas = malloc(b->deltas_max * sizeof(*b->deltas));
+			if (!b->deltas) {
+				err = -ENOMEM;
+				goto free_bench;
+			}
+
+			slot[handle] = num++;
+		}
+	}
+
+	if (!num) {
+		fprintf(stderr, "ERROR: no sensor to bench\n");
+		err = -ENODEV;
+		goto free_bench;
+	}
+
+	for (i = 0; i < num; i++) {
+		tl_log("Activating %s sensor (handle %d)",
+		       bench[i].sensor->name, bench[i].sensor->handle);
+		sensor_activate(bench[i].sensor->handle, SENSOR_ENABLE);
+	}
+
+	getrusage(RUSAGE_SELF, &ru_start);
+	start = monotonic_ns();
+	alarm(duration);
+
+	while (!timeout) {
+		count = poll_dev->poll(&poll_dev->v0, events,
+				       BENCH_BUFFER_EVENT);
+		if (count <= 0)
+			continue;
+
+		polls++;
+		total += count;
+		if ((uint64_t)count > batch_max)
+			batch_max = count;
+
+		for (j = 0; j < count; j++) {
+			if (events[j].type == SENSOR_TYPE_META_DATA) {
+				meta++;
+				continue;
+			}
+
+			handle = events[j].sensor;
+			if ((handle < 0) || (handle >= BENCH_MAX_HANDLES) ||
+			    (slot[handle] < 0))
+				continue;
+
+			b = &bench[(int)slot[handle]];
+			bench_add_sample(b, events[j].timestamp);
+			b->batch_cur++;
+		}
+
+		for (i = 0; i < num; i++) {
+			if (!bench[i].batch_cur)
+				continue;
+
+			bench[i].polls++;
+			if (bench[i].batch_cur > bench[i].batch_max)
+				bench[i].batch_max = bench[i].batch_cur;
+			bench[i].batch_cur = 0;
+		}
+	}
+
+	elapsed = monotonic_ns() - start;
+	getrusage(RUSAGE_SELF, &ru_end);
+	alarm(0);
+	timeout = 0;
+
+	for (i = 0; i < num; i++)
+		sensor_activate(bench[i].sensor->handle, SENSOR_DISABLE);
+
+	for (i = 0; i < num; i++)
+		bench_report(&bench[i], elapsed / 1000000000.0);
+
+	printf("bench process: wall_s=%.3f cpu_user_s=%.3f cpu_sys_s=%.3f "
+	       "cpu_pct=%.2f polls=%llu poll_batch_mean=%.2f poll_batch_max=%llu "
+	       "meta_events=%llu\n",
+	       elapsed / 1000000000.0,
+	       timeval_s(&ru_end.ru_utime) - timeval_s(&ru_start.ru_utime),
+	       timeval_s(&ru_end.ru_stime) - timeval_s(&ru_start.ru_stime),
+	       100.0 * (timeval_s(&ru_end.ru_utime) - timeval_s(&ru_start.ru_utime) +
+			timeval_s(&ru_end.ru_stime) - timeval_s(&ru_start.ru_stime)) /
+	       (elapsed / 1000000000.0),
+	       (unsigned long long)polls,
+	       polls ? (double)total / polls : 0,
+	       (unsigned long long)batch_max,
+	       (unsigned long long)meta);
+
+free_bench:
+	for (i = 0; i < BENCH_MAX_SENSORS; i++)
+		free(bench[i].deltas);
+	free(events);
+
+	return err;
+}
+
 static void alarmHandler(int dummy)
 {
 	timeout = 1;
@@ -615,6 +1051,14 @@ static void help(char *argv)
 	       long_options[index++].name);
 	printf("\t--%s:\tRun Ignition command on SensorHAL (data 0/1)\n",
 	       long_options[index++].name);
+	printf("\t--%s:\tCapture driver data and requests to file\n",
+	       long_options[index++].name);
+	printf("\t--%s:\tReplay a capture file and print events summary\n",
+	       long_options[index++].name);
+	printf("\t--%s:\tReplay with capture timing (default as fast as possible)\n",
+	       long_options[index++].name);
+	printf("\t--%s:\t\tMeasure rate and jitter for the given seconds, no events dump\n",
+	       long_options[index++].name);
 	printf("\t--%s:\t\tThis help\n", long_options[index++].name);
 
 	exit(0);
@@ -1035,6 +1479,9 @@ static void ctrlzHandler(int events)
 {
 	sensor_disable_all();
 
+	if (hal_capture)
+		hal_capture(NULL, 0);
+
 	if (events)
 		enable_events(mlc_iio_device_number, 0);
 
@@ -1270,6 +1717,10 @@ int main(int argc, char **argv)
 	unsigned int tjdur = 0;
 	unsigned int cith = 0;
 	unsigned int cmdur = 0;
+	char *capture_filename = NULL;
+	char *replay_filename = NULL;
+	int replay_realtime = 0;
+	int bench_duration = 0;
 
 #ifdef LOG_FILE
 	char *log_filename = NULL;
@@ -1374,6 +1825,18 @@ int main(int argc, char **argv)
 			find_mlc = 1;
 			info_mlc = 1;
 			break;
+		case 'C':
+			capture_filename = optarg;
+			break;
+		case 'R':
+			replay_filename = optarg;
+			break;
+		case 'W':
+			replay_realtime = 1;
+			break;
+		case 'B':
+			bench_duration = atoi(optarg);
+			break;
 		default:
 			help(argv[0]);
 		}
@@ -1464,6 +1927,14 @@ int main(int argc, char **argv)
 		exit(0);
 	}
 
+	if (replay_filename) {
+		ret = replay_test(replay_filename, replay_realtime);
+		exit(ret < 0 ? 1 : 0);
+	}
+
+	if (capture_filename && (capture_start(capture_filename) < 0))
+		exit(1);
+
 	sensor_disable_all();
 
 	if (sensor_flush)
@@ -1522,7 +1993,9 @@ int main(int argc, char **argv)
 					CRASH_MINIMUM_DURATION,
 					cmdur);
 
-	if (sensor_handle >= 0)
+	if (bench_duration > 0)
+		bench_test(sensor_handle, notemp, bench_duration);
+	else if (sensor_handle >= 0)
 		single_sensor_test(sensor_handle);
 	else
 		all_sensor_test(notemp);
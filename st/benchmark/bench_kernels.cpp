@@ -0,0 +1,421 @@
+/*
+ * STMicroelectronics SensorHAL benchmark: data structures and kernels
+ *
+ * Copyright 2021 STMicroelectronics Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "HWSensorBase.h"
+#include "LatencyHistogram.h"
+#include "TimestampEstimator.h"
+#include "ReorderWindow.h"
+#include "BatchBuffer.h"
+#include "mlc-helper.h"
+#include "benchmark.h"
+
+#define BENCH_KERNELS_ITERATIONS		(2000000)
+#define BENCH_KERNELS_SCANS			(64)
+#define BENCH_KERNELS_SCAN_SIZE			(16)
+#define BENCH_KERNELS_BUFFER_LEN		(32)
+#define BENCH_KERNELS_SYNC_BATCH		(4)
+#define BENCH_KERNELS_PIPE_BATCH		(64)
+#define BENCH_KERNELS_ODR_NS			(1000000)
+#define BENCH_KERNELS_BATCH_LEN			(1000)
+#define BENCH_KERNELS_SCALE			(0.000598f)
+
+struct bench_kernels_run {
+	struct st_bench_counters counters;
+	int64_t t0;
+};
+
+/* keeps results alive, so the compiler can not drop the measured code */
+static volatile int64_t bench_kernels_sink;
+
+static void bench_kernels_start(struct bench_kernels_run *run)
+{
+	st_bench_counters_open(&run->counters);
+	st_bench_counters_start(&run->counters);
+	run->t0 = st_bench_now_ns();
+}
+
+static void bench_kernels_stop(struct bench_kernels_run *run,
+			       const char *name, uint64_t iterations)
+{
+	struct st_bench_result result;
+	int64_t elapsed_ns = st_bench_now_ns() - run->t0;
+
+	st_bench_counters_stop(&run->counters);
+
+	memset(&result, 0, sizeof(result));
+	result.elapsed_ns = elapsed_ns;
+	result.name = name;
+	result.iterations = iterations;
+	result.counters = &run->counters;
+	st_bench_report(&result);
+	st_bench_counters_close(&run->counters);
+}
+
+static void bench_kernels_fill_channel(struct device_iio_info_channel *ch,
+				       unsigned int index, unsigned int bytes,
+				       unsigned int location, float scale)
+{
+	memset(ch, 0, sizeof(*ch));
+
+	ch->index = index;
+	ch->enabled = 1;
+	ch->scale = scale;
+	ch->bytes = bytes;
+	ch->bits_used = bytes * 8;
+	ch->mask = bytes == 8 ? ~0ULL : (1ULL << ch->bits_used) - 1;
+	ch->sign = 1;
+	ch->location = location;
+}
+
+static void bench_kernels_fill_data(SensorBaseData *data, int64_t timestamp)
+{
+	memset(data, 0, sizeof(*data));
+
+	data->raw[0] = ST_HAL_SI_TO_SAMPLE(BENCH_KERNELS_SCALE, 0.1f);
+	data->raw[1] = ST_HAL_SI_TO_SAMPLE(BENCH_KERNELS_SCALE, -0.2f);
+	data->raw[2] = ST_HAL_SI_TO_SAMPLE(BENCH_KERNELS_SCALE, 9.8f);
+	data->timestamp = timestamp;
+	data->pollrate_ns = BENCH_KERNELS_ODR_NS;
+	data->flush_event_handle = -1;
+}
+
+/* ASM330 accel/gyro scan: 3 x le:s16 channels + s64 timestamp */
+int st_bench_scan_decode(void)
+{
+	int i, j;
+	uint8_t *scan;
+	int16_t axis;
+	int64_t timestamp;
+	SensorBaseData data;
+	struct bench_kernels_run run;
+	struct device_iio_info_channel channels[4];
+	uint8_t scans[BENCH_KERNELS_SCANS * BENCH_KERNELS_SCAN_SIZE];
+
+	for (i = 0; i < 3; i++)
+		bench_kernels_fill_channel(&channels[i], i, 2, i * 2,
+					   BENCH_KERNELS_SCALE);
+	bench_kernels_fill_channel(&channels[3], 3, 8, 8, 1.0f);
+
+	for (j = 0; j < BENCH_KERNELS_SCANS; j++) {
+		scan = scans + j * BENCH_KERNELS_SCAN_SIZE;
+		axis = (int16_t)htole16((uint16_t)(j * 100));
+		memcpy(scan, &axis, sizeof(axis));
+		memcpy(scan + 2, &axis, sizeof(axis));
+		memcpy(scan + 4, &axis, sizeof(axis));
+		timestamp = (int64_t)j * BENCH_KERNELS_ODR_NS;
+		memcpy(scan + 8, &timestamp, sizeof(timestamp));
+	}
+
+	bench_kernels_start(&run);
+
+	for (i = 0; i < BENCH_KERNELS_ITERATIONS; i += BENCH_KERNELS_SCANS) {
+		for (j = 0; j < BENCH_KERNELS_SCANS; j++) {
+			ProcessScanData(scans + j * BENCH_KERNELS_SCAN_SIZE,
+					channels, 4, BENCH_KERNELS_SCALE, &data);
+			bench_kernels_sink += data.timestamp;
+		}
+	}
+
+	bench_kernels_stop(&run, "scan_decode", BENCH_KERNELS_ITERATIONS);
+
+	return 0;
+}
+
+int st_bench_circular_buffer(void)
+{
+	int i;
+	SensorBaseData in, out;
+	struct bench_kernels_run run;
+	CircularBuffer buffer(BENCH_KERNELS_BUFFER_LEN);
+
+	bench_kernels_fill_data(&in, 0);
+
+	bench_kernels_start(&run);
+
+	for (i = 0; i < BENCH_KERNELS_ITERATIONS; i++) {
+		in.timestamp = i;
+		buffer.writeElement(&in);
+		buffer.readElement(&out);
+		bench_kernels_sink += out.timestamp;
+	}
+
+	bench_kernels_stop(&run, "circular_buffer", BENCH_KERNELS_ITERATIONS);
+
+	return 0;
+}
+
+/* a consumer at 1/4 of the producer rate syncing on the newest sample */
+int st_bench_circular_buffer_sync(void)
+{
+	int i, j;
+	int64_t timestamp = 0;
+	SensorBaseData in, out;
+	struct bench_kernels_run run;
+	CircularBuffer buffer(BENCH_KERNELS_BUFFER_LEN);
+
+	bench_kernels_fill_data(&in, 0);
+
+	bench_kernels_start(&run);
+
+	for (i = 0; i < BENCH_KERNELS_ITERATIONS;
+	     i += BENCH_KERNELS_SYNC_BATCH) {
+		for (j = 0; j < BENCH_KERNELS_SYNC_BATCH; j++) {
+			timestamp += BENCH_KERNELS_ODR_NS;
+			in.timestamp = timestamp;
+			buffer.writeElement(&in);
+		}
+
+		buffer.readSyncElement(&out, timestamp - BENCH_KERNELS_ODR_NS / 2);
+		bench_kernels_sink += out.timestamp;
+	}
+
+	bench_kernels_stop(&run, "circular_buffer_sync",
+			   BENCH_KERNELS_ITERATIONS);
+
+	return 0;
+}
+
+int st_bench_odr_stack(void)
+{
+	int i;
+	int64_t pollrate;
+	struct bench_kernels_run run;
+	ChangeODRTimestampStack stack;
+
+	bench_kernels_start(&run);
+
+	for (i = 0; i < BENCH_KERNELS_ITERATIONS; i++) {
+		stack.writeElement(i, BENCH_KERNELS_ODR_NS);
+		bench_kernels_sink += stack.readLastElement(&pollrate);
+		stack.removeLastElement();
+	}
+
+	bench_kernels_stop(&run, "odr_stack", BENCH_KERNELS_ITERATIONS);
+
+	return 0;
+}
+
+int st_bench_flush_stack(void)
+{
+	int i;
+	int64_t timestamp;
+	struct bench_kernels_run run;
+	FlushBufferStack stack;
+
+	bench_kernels_start(&run);
+
+	for (i = 0; i < BENCH_KERNELS_ITERATIONS; i++) {
+		stack.writeElement(1, i);
+		bench_kernels_sink += stack.readLastElement(&timestamp);
+		stack.removeLastElement();
+	}
+
+	bench_kernels_stop(&run, "flush_stack", BENCH_KERNELS_ITERATIONS);
+
+	return 0;
+}
+
+/* includes the placement copy done for every sample */
+int st_bench_rotation_matrix(void)
+{
+	int i;
+	SensorBaseData data;
+	struct bench_kernels_run run;
+
+	bench_kernels_fill_data(&data, 0);
+
+	bench_kernels_start(&run);
+
+	for (i = 0; i < BENCH_KERNELS_ITERATIONS; i++) {
+		SensorBase::applyRotationMatrix(data);
+		bench_kernels_sink += (int64_t)data.raw[0];
+	}
+
+	bench_kernels_stop(&run, "rotation_matrix", BENCH_KERNELS_ITERATIONS);
+
+	return 0;
+}
+
+int st_bench_gravity_vector(void)
+{
+	int i;
+	float acc[3] = { 0.01f, -0.02f, 1.0f }, gvec[3];
+	stFSMSensor state;
+	struct bench_kernels_run run;
+
+	stFSMInit(&state);
+
+	bench_kernels_start(&run);
+
+	for (i = 0; i < BENCH_KERNELS_ITERATIONS; i++) {
+		/* keep measuring the accumulation, not the cached result */
+		if (computeGravityVector(&state, acc,
+					 (int64_t)i * BENCH_KERNELS_ODR_NS,
+					 gvec))
+			stFSMInit(&state);
+	}
+
+	bench_kernels_stop(&run, "gravity_vector", BENCH_KERNELS_ITERATIONS);
+
+	return 0;
+}
+
+/* data thread writes one event at a time, poll() copies out a batch */
+int st_bench_pipe_delivery(void)
+{
+	int i, j, err;
+	int pipe_fd[2];
+	sensors_event_t event;
+	struct bench_kernels_run run;
+	sensors_event_t events[BENCH_KERNELS_PIPE_BATCH];
+
+	err = pipe(pipe_fd);
+	if (err < 0)
+		return -errno;
+
+	fcntl(pipe_fd[0], F_SETFL, O_NONBLOCK);
+	memset(&event, 0, sizeof(event));
+	event.type = SENSOR_TYPE_ACCELEROMETER;
+
+	bench_kernels_start(&run);
+
+	for (i = 0; i < BENCH_KERNELS_ITERATIONS;
+	     i += BENCH_KERNELS_PIPE_BATCH) {
+		for (j = 0; j < BENCH_KERNELS_PIPE_BATCH; j++) {
+			event.timestamp = i + j;
+			if (write(pipe_fd[1], &event, sizeof(event)) <= 0)
+				break;
+		}
+
+		bench_kernels_sink += read(pipe_fd[0], events, sizeof(events));
+	}
+
+	bench_kernels_stop(&run, "pipe_delivery", BENCH_KERNELS_ITERATIONS);
+
+	close(pipe_fd[0]);
+	close(pipe_fd[1]);
+
+	return 0;
+}
+
+int st_bench_latency_histogram(void)
+{
+	int i;
+	struct bench_kernels_run run;
+	LatencyHistogram *histogram = new LatencyHistogram();
+
+	bench_kernels_start(&run);
+
+	for (i = 0; i < BENCH_KERNELS_ITERATIONS; i++)
+		histogram->Record((i & 0xffff) * 1000);
+
+	bench_kernels_stop(&run, "latency_histogram", BENCH_KERNELS_ITERATIONS);
+
+	bench_kernels_sink += histogram->GetCount();
+	delete histogram;
+
+	return 0;
+}
+
+int st_bench_timestamp_estimator(void)
+{
+	int i, j;
+	int64_t reference = 0;
+	struct bench_kernels_run run;
+	TimestampEstimator estimator;
+
+	bench_kernels_start(&run);
+
+	/* batches of 64 samples, read time jitter up to 127us */
+	for (i = 0; i < BENCH_KERNELS_ITERATIONS / BENCH_KERNELS_SCANS; i++) {
+		reference += BENCH_KERNELS_SCANS * BENCH_KERNELS_ODR_NS;
+		estimator.Update(BENCH_KERNELS_ODR_NS, BENCH_KERNELS_SCANS,
+				 reference + ((i * 7919) & 0x7f) * 1000);
+
+		for (j = 0; j < BENCH_KERNELS_SCANS; j++)
+			bench_kernels_sink += estimator.GetTimestamp(j);
+	}
+
+	bench_kernels_stop(&run, "timestamp_estimator",
+			   (BENCH_KERNELS_ITERATIONS / BENCH_KERNELS_SCANS) *
+			   BENCH_KERNELS_SCANS);
+
+	return 0;
+}
+
+int st_bench_reorder_window(void)
+{
+	int i;
+	sensors_event_t event, out;
+	struct bench_kernels_run run;
+	ReorderWindow window;
+
+	memset(&event, 0, sizeof(event));
+	window.SetWindow(20 * BENCH_KERNELS_ODR_NS);
+	if (window.Init(ReorderWindow::GetLength(20 * BENCH_KERNELS_ODR_NS,
+						 BENCH_KERNELS_ODR_NS)) < 0)
+		return -ENOMEM;
+
+	bench_kernels_start(&run);
+
+	/* every 8th sample arrives after the following one */
+	for (i = 0; i < BENCH_KERNELS_ITERATIONS; i++) {
+		event.timestamp = (int64_t)(i + 1) * BENCH_KERNELS_ODR_NS;
+		if ((i & 7) == 6)
+			event.timestamp += BENCH_KERNELS_ODR_NS;
+		else if ((i & 7) == 7)
+			event.timestamp -= BENCH_KERNELS_ODR_NS;
+
+		window.Insert(&event, event.timestamp);
+
+		while (window.PopReady(&out))
+			bench_kernels_sink += out.timestamp;
+	}
+
+	bench_kernels_stop(&run, "reorder_window", BENCH_KERNELS_ITERATIONS);
+
+	return 0;
+}
+
+int st_bench_batch_buffer(void)
+{
+	int i;
+	unsigned int num;
+	sensors_event_t event;
+	const sensors_event_t *events;
+	struct bench_kernels_run run;
+	BatchBuffer batch;
+
+	memset(&event, 0, sizeof(event));
+	if (batch.Init(BENCH_KERNELS_BATCH_LEN) < 0)
+		return -ENOMEM;
+
+	bench_kernels_start(&run);
+
+	/* released when full, as contiguous spans */
+	for (i = 0; i < BENCH_KERNELS_ITERATIONS; i++) {
+		event.timestamp = (int64_t)(i + 1) * BENCH_KERNELS_ODR_NS;
+		batch.Push(&event);
+
+		if (!batch.IsFull())
+			continue;
+
+		while ((num = batch.GetSpan(&events)) > 0) {
+			bench_kernels_sink += events[num - 1].timestamp;
+			batch.Consume(num);
+		}
+	}
+
+	bench_kernels_stop(&run, "batch_buffer", BENCH_KERNELS_ITERATIONS);
+
+	return 0;
+}
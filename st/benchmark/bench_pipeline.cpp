@@ -0,0 +1,396 @@
+/*
+ * STMicroelectronics SensorHAL benchmark: HWSensorBase scan pipeline
+ *
+ * Copyright 2021 STMicroelectronics Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "HWSensorBase.h"
+#include "benchmark.h"
+
+#define BENCH_PIPELINE_SAMPLES			(2000000)
+#define BENCH_PIPELINE_SCANS_PER_READ		(64)
+#define BENCH_PIPELINE_SCAN_SIZE		(16)
+#define BENCH_PIPELINE_HANDLE			(1)
+#define BENCH_PIPELINE_ACCEL_SCALE		(0.000598f)
+#define BENCH_PIPELINE_IMU_SAMPLES		(500000)
+#define BENCH_PIPELINE_IMU_BATCHES		(BENCH_PIPELINE_IMU_SAMPLES / \
+						 BENCH_PIPELINE_SCANS_PER_READ)
+
+/*
+ * class BenchPipelineSensor: accelerometer like sensor fed with an in
+ * memory ASM330 scan layout (3 x le:s16 + s64 timestamp). The iio char
+ * device does not exist, the pipeline never touches it.
+ */
+class BenchPipelineSensor : public HWSensorBase {
+public:
+	BenchPipelineSensor(HWSensorBaseCommonData *data) :
+			HWSensorBase(data, "bench pipeline",
+				     BENCH_PIPELINE_HANDLE,
+				     SENSOR_TYPE_ACCELEROMETER, 1, 0.0f) {
+		sensor_global_enable.store(1);
+		sensor_global_disable.store(0);
+		sensor_my_enable.store(1);
+		sensor_my_disable.store(0);
+	}
+
+	ssize_t GetScanSize() { return scan_size; }
+
+	virtual void ProcessData(SensorBaseData *data) {
+		applyRotationMatrix(*data, common_data.imu_instance);
+
+		data->processed[0] = data->raw[0];
+		data->processed[1] = data->raw[1];
+		data->processed[2] = data->raw[2];
+		data->accuracy = SENSOR_STATUS_UNRELIABLE;
+
+		sensor_event.acceleration.x = data->processed[0];
+		sensor_event.acceleration.y = data->processed[1];
+		sensor_event.acceleration.z = data->processed[2];
+		sensor_event.acceleration.status = data->accuracy;
+		sensor_event.timestamp = data->timestamp;
+
+		if (ValidDataToPush(sensor_event.timestamp)) {
+			samples_counter++;
+			if ((samples_counter % decimator) == 0) {
+				samples_counter = 0;
+				last_data_timestamp.store(sensor_event.timestamp,
+							  std::memory_order_relaxed);
+			}
+		}
+
+		SensorBase::ProcessData(data);
+	}
+
+	void Run(uint8_t *data, int read_size) {
+		ProcessScanBatch(data, read_size);
+	}
+};
+
+static void bench_pipeline_fill_channel(struct device_iio_info_channel *ch,
+					unsigned int index, unsigned int bytes,
+					float scale)
+{
+	memset(ch, 0, sizeof(*ch));
+
+	ch->index = index;
+	ch->enabled = 1;
+	ch->scale = scale;
+	ch->bytes = bytes;
+	ch->bits_used = bytes * 8;
+	ch->mask = bytes == 8 ? ~0ULL : (1ULL << ch->bits_used) - 1;
+	ch->sign = 1;
+}
+
+static void bench_pipeline_init_data(HWSensorBaseCommonData *common_data,
+				     unsigned int dev_num,
+				     unsigned int imu_instance)
+{
+	int i;
+
+	memset(common_data, 0, sizeof(*common_data));
+	common_data->device_iio_dev_num = dev_num;
+	common_data->imu_instance = imu_instance;
+	common_data->num_channels = 4;
+	for (i = 0; i < 3; i++)
+		bench_pipeline_fill_channel(&common_data->channels[i], i, 2,
+					    BENCH_PIPELINE_ACCEL_SCALE);
+	bench_pipeline_fill_channel(&common_data->channels[3], 3, 8, 1.0f);
+}
+
+static void bench_pipeline_fill_scans(uint8_t *scans, int first)
+{
+	int j;
+	uint8_t *scan;
+	int16_t axis;
+	int64_t timestamp;
+
+	for (j = 0; j < BENCH_PIPELINE_SCANS_PER_READ; j++) {
+		scan = scans + j * BENCH_PIPELINE_SCAN_SIZE;
+		axis = (int16_t)htole16((uint16_t)(first + j));
+		memcpy(scan, &axis, sizeof(axis));
+		memcpy(scan + 2, &axis, sizeof(axis));
+		memcpy(scan + 4, &axis, sizeof(axis));
+		timestamp = 1000 + (int64_t)(first + j) * 1000;
+		memcpy(scan + 8, &timestamp, sizeof(timestamp));
+	}
+}
+
+static int bench_pipeline_run(const char *name)
+{
+	int i, err;
+	uint8_t *scans;
+	int64_t t0;
+	HWSensorBaseCommonData common_data;
+	struct st_bench_result result;
+	struct st_bench_counters counters;
+	BenchPipelineSensor *sensor;
+	int read_size = BENCH_PIPELINE_SCANS_PER_READ *
+			BENCH_PIPELINE_SCAN_SIZE;
+
+	/* no such iio device: constructor only fails to open the char device */
+	bench_pipeline_init_data(&common_data, 0xffff, 0);
+	memset(&result, 0, sizeof(result));
+
+	sensor = new BenchPipelineSensor(&common_data);
+	if (sensor->GetScanSize() != BENCH_PIPELINE_SCAN_SIZE) {
+		err = -EINVAL;
+		goto free_sensor;
+	}
+
+	scans = (uint8_t *)malloc(read_size);
+	if (!scans) {
+		err = -ENOMEM;
+		goto free_sensor;
+	}
+
+	st_bench_counters_open(&counters);
+	st_bench_counters_start(&counters);
+	t0 = st_bench_now_ns();
+
+	for (i = 0; i < BENCH_PIPELINE_SAMPLES;
+	     i += BENCH_PIPELINE_SCANS_PER_READ) {
+		bench_pipeline_fill_scans(scans, i);
+
+		sensor->Run(scans, read_size);
+	}
+
+	result.elapsed_ns = st_bench_now_ns() - t0;
+	st_bench_counters_stop(&counters);
+
+	result.name = name;
+	result.iterations = BENCH_PIPELINE_SAMPLES;
+	result.counters = &counters;
+	st_bench_report(&result);
+	st_bench_counters_close(&counters);
+
+	free(scans);
+	err = 0;
+
+free_sensor:
+	delete sensor;
+
+	return err;
+}
+
+int st_bench_pipeline(void)
+{
+	return bench_pipeline_run("pipeline");
+}
+
+/*
+ * Multi IMU scaling: one data thread per IMU instance, like the HAL with
+ * several ASM330 parts. The char devices are /dev/null so sensors are
+ * valid and no error is logged, nothing reads them.
+ */
+struct bench_pipeline_imu {
+	pthread_t thread;
+	pthread_mutex_t *start;
+	BenchPipelineSensor *sensor;
+	struct st_bench_counters counters;
+	int64_t cpu_ns;
+	int64_t *batch_ns;
+};
+
+static int bench_pipeline_open_buffer(unsigned int __attribute__((unused))dev_num)
+{
+	int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+	return fd < 0 ? -errno : fd;
+}
+
+static int bench_pipeline_open_events(unsigned int __attribute__((unused))dev_num,
+				      int __attribute__((unused))buffer_fd)
+{
+	return -ENODEV;
+}
+
+static int bench_pipeline_sysfs_write(const char __attribute__((unused))*file,
+				      const char __attribute__((unused))*str)
+{
+	return 0;
+}
+
+static const struct device_iio_transport bench_pipeline_transport = {
+	"bench",
+	"/dev/null/",
+	bench_pipeline_open_buffer,
+	bench_pipeline_open_events,
+	bench_pipeline_sysfs_write,
+};
+
+static int64_t bench_pipeline_thread_cpu_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int bench_pipeline_compare_ns(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void *bench_pipeline_imu_thread(void *arg)
+{
+	int i, batch = 0;
+	int64_t t0, cpu0;
+	struct bench_pipeline_imu *imu = (struct bench_pipeline_imu *)arg;
+	uint8_t scans[BENCH_PIPELINE_SCANS_PER_READ * BENCH_PIPELINE_SCAN_SIZE];
+
+	st_bench_counters_open(&imu->counters);
+
+	/* held by the main thread until all the threads exist */
+	pthread_mutex_lock(imu->start);
+	pthread_mutex_unlock(imu->start);
+
+	st_bench_counters_start(&imu->counters);
+	cpu0 = bench_pipeline_thread_cpu_ns();
+
+	for (i = 0; i < BENCH_PIPELINE_IMU_BATCHES *
+			BENCH_PIPELINE_SCANS_PER_READ;
+	     i += BENCH_PIPELINE_SCANS_PER_READ) {
+		bench_pipeline_fill_scans(scans, i);
+
+		t0 = st_bench_now_ns();
+		imu->sensor->Run(scans, sizeof(scans));
+		imu->batch_ns[batch++] = st_bench_now_ns() - t0;
+	}
+
+	imu->cpu_ns = bench_pipeline_thread_cpu_ns() - cpu0;
+	st_bench_counters_stop(&imu->counters);
+
+	return NULL;
+}
+
+static int bench_pipeline_imus_run(const char *name, int num_imus)
+{
+	int i, c, err = 0, started = 0;
+	int64_t t0, *batch_ns;
+	HWSensorBaseCommonData common_data;
+	pthread_mutex_t start = PTHREAD_MUTEX_INITIALIZER;
+	struct st_bench_result result;
+	struct st_bench_counters counters;
+	struct bench_pipeline_imu imus[ST_HAL_IMU_MAX_INSTANCES];
+	int num_batches = num_imus * BENCH_PIPELINE_IMU_BATCHES;
+
+	if (num_imus > ST_HAL_IMU_MAX_INSTANCES)
+		return -EINVAL;
+
+	batch_ns = (int64_t *)malloc(num_batches * sizeof(*batch_ns));
+	if (!batch_ns)
+		return -ENOMEM;
+
+	memset(imus, 0, sizeof(imus));
+	device_iio_utils::set_transport(&bench_pipeline_transport);
+
+	for (i = 0; i < num_imus; i++) {
+		bench_pipeline_init_data(&common_data, i, i);
+		imus[i].sensor = new BenchPipelineSensor(&common_data);
+		imus[i].batch_ns = batch_ns + i * BENCH_PIPELINE_IMU_BATCHES;
+		imus[i].start = &start;
+		if (!imus[i].sensor->IsValidClass() ||
+		    (imus[i].sensor->GetScanSize() != BENCH_PIPELINE_SCAN_SIZE))
+			err = -EINVAL;
+	}
+
+	device_iio_utils::set_transport(NULL);
+
+	if (err < 0)
+		goto free_sensors;
+
+	pthread_mutex_lock(&start);
+
+	for (i = 0; i < num_imus; i++) {
+		err = pthread_create(&imus[i].thread, NULL,
+				     bench_pipeline_imu_thread, &imus[i]);
+		if (err) {
+			err = -err;
+			break;
+		}
+
+		started++;
+	}
+
+	t0 = st_bench_now_ns();
+	pthread_mutex_unlock(&start);
+
+	for (i = 0; i < started; i++)
+		pthread_join(imus[i].thread, NULL);
+
+	memset(&result, 0, sizeof(result));
+	result.elapsed_ns = st_bench_now_ns() - t0;
+
+	if (err < 0) {
+		for (i = 0; i < started; i++)
+			st_bench_counters_close(&imus[i].counters);
+
+		goto free_sensors;
+	}
+
+	/* counters of all the data threads, n/a if one thread has none */
+	memset(&counters, 0, sizeof(counters));
+	for (i = 0; i < num_imus; i++) {
+		result.cpu_ns += imus[i].cpu_ns;
+
+		for (c = 0; c < ST_BENCH_COUNTER_MAX; c++) {
+			if ((imus[i].counters.fd[c] < 0) ||
+			    (counters.fd[c] < 0))
+				counters.fd[c] = -1;
+			else
+				counters.value[c] += imus[i].counters.value[c];
+		}
+	}
+
+	qsort(batch_ns, num_batches, sizeof(*batch_ns),
+	      bench_pipeline_compare_ns);
+	result.batch_p50_ns = batch_ns[num_batches / 2];
+	result.batch_p99_ns = batch_ns[(num_batches * 99) / 100];
+
+	result.name = name;
+	result.iterations = (uint64_t)num_imus * BENCH_PIPELINE_IMU_BATCHES *
+			    BENCH_PIPELINE_SCANS_PER_READ;
+	result.counters = &counters;
+	st_bench_report(&result);
+
+	for (i = 0; i < num_imus; i++)
+		st_bench_counters_close(&imus[i].counters);
+
+	err = 0;
+
+free_sensors:
+	for (i = 0; i < num_imus; i++)
+		delete imus[i].sensor;
+
+	free(batch_ns);
+
+	return err;
+}
+
+int st_bench_pipeline_imus_1(void)
+{
+	return bench_pipeline_imus_run("pipeline_imus_1", 1);
+}
+
+int st_bench_pipeline_imus_2(void)
+{
+	return bench_pipeline_imus_run("pipeline_imus_2", 2);
+}
+
+int st_bench_pipeline_imus_4(void)
+{
+	return bench_pipeline_imus_run("pipeline_imus_4", 4);
+}
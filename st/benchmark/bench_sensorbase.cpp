@@ -0,0 +1,379 @@
+/*
+ * STMicroelectronics SensorHAL benchmark: SensorBase data path
+ *
+ * Copyright 2021 STMicroelectronics Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+
+#include "SensorBase.h"
+#include "benchmark.h"
+
+#define BENCH_SENSORBASE_SAMPLES		(2000000)
+#define BENCH_SENSORBASE_PRODUCER_HANDLE	(1)
+#define BENCH_SENSORBASE_CONSUMER_HANDLE	(2)
+#define BENCH_SENSORBASE_CLIENT_HANDLE		(40)
+#define BENCH_SENSORBASE_LAYOUT_SAMPLES		(20000000)
+
+/*
+ * class BenchSensorBase: runs the same per sample bookkeeping of
+ * HWSensorBaseWithPollrate::WriteDataToPipe() without the pipe write, so
+ * that the measure is not dominated by the syscall.
+ */
+class BenchSensorBase : public SensorBase {
+public:
+	BenchSensorBase(const char *name, int handle) :
+			SensorBase(name, handle, SENSOR_TYPE_ACCELEROMETER) {
+		sensor_t_data.fifoMaxEventCount = 1;
+		sensor_global_enable.store(1);
+		sensor_global_disable.store(0);
+		sensor_my_enable.store(1);
+		sensor_my_disable.store(0);
+	}
+
+	int AllocateDependencyBuffer(DependencyID id) {
+		return AllocateBufferForDependencyData(id, 1);
+	}
+
+	/* consumer side: take the sample out, as a sw sensor would do */
+	void DrainDependencyBuffer(DependencyID id, SensorBaseData *data) {
+		circular_buffer_data[id]->readElement(data);
+	}
+
+	void PushSample(SensorBaseData *data) {
+		pthread_mutex_lock(&sample_in_processing_mutex);
+		sample_in_processing_timestamp = data->timestamp;
+		pthread_mutex_unlock(&sample_in_processing_mutex);
+
+		sensor_event.acceleration.x = data->processed[0];
+		sensor_event.acceleration.y = data->processed[1];
+		sensor_event.acceleration.z = data->processed[2];
+		sensor_event.timestamp = data->timestamp;
+
+		if (ValidDataToPush(sensor_event.timestamp)) {
+			samples_counter++;
+			if ((samples_counter % decimator) == 0) {
+				samples_counter = 0;
+				last_data_timestamp.store(sensor_event.timestamp,
+							  std::memory_order_relaxed);
+			}
+		}
+
+		SensorBase::ProcessData(data);
+	}
+};
+
+struct bench_sensorbase_graph {
+	BenchSensorBase *producer;
+	BenchSensorBase *consumer;
+	std::atomic<bool> stop;
+};
+
+static void *bench_sensorbase_control_thread(void *context)
+{
+	struct bench_sensorbase_graph *graph =
+				(struct bench_sensorbase_graph *)context;
+	int64_t period = 1000000;
+
+	/* keep one client always enabled: no power on/off in the loop */
+	graph->consumer->Enable(BENCH_SENSORBASE_CLIENT_HANDLE, true, true);
+
+	while (!graph->stop.load(std::memory_order_relaxed)) {
+		graph->consumer->Enable(BENCH_SENSORBASE_CLIENT_HANDLE + 1,
+					true, true);
+		graph->consumer->SetDelay(BENCH_SENSORBASE_CLIENT_HANDLE + 1,
+					  period, 0, true);
+		graph->producer->GetStatus(true);
+		graph->consumer->Enable(BENCH_SENSORBASE_CLIENT_HANDLE + 1,
+					false, true);
+
+		period = period == 1000000 ? 2000000 : 1000000;
+	}
+
+	return NULL;
+}
+
+static int bench_sensorbase_run(const char *name, bool contended)
+{
+	int err, i;
+	pthread_t control;
+	SensorBaseData data, consumed;
+	struct st_bench_result result;
+	struct st_bench_counters counters;
+	struct bench_sensorbase_graph graph;
+	int64_t t0;
+
+	graph.producer = new BenchSensorBase("bench producer",
+					     BENCH_SENSORBASE_PRODUCER_HANDLE);
+	graph.consumer = new BenchSensorBase("bench consumer",
+					     BENCH_SENSORBASE_CONSUMER_HANDLE);
+	graph.stop.store(false);
+
+	err = graph.consumer->AddSensorDependency(graph.producer);
+	if (err < 0)
+		goto free_graph;
+
+	err = graph.consumer->AllocateDependencyBuffer((DependencyID)err);
+	if (err < 0)
+		goto free_graph;
+
+	if (contended) {
+		err = pthread_create(&control, NULL,
+				     bench_sensorbase_control_thread, &graph);
+		if (err) {
+			err = -err;
+			goto free_graph;
+		}
+	}
+
+	memset(&data, 0, sizeof(data));
+	data.flush_event_handle = -1;
+	data.processed[2] = 9.81f;
+	memset(&result, 0, sizeof(result));
+
+	st_bench_counters_open(&counters);
+	st_bench_counters_start(&counters);
+	t0 = st_bench_now_ns();
+
+	for (i = 0; i < BENCH_SENSORBASE_SAMPLES; i++) {
+		data.timestamp = 1000 + (int64_t)i * 1000;
+		data.processed[0] = (float)(i & 0xff);
+		graph.producer->PushSample(&data);
+		graph.consumer->DrainDependencyBuffer(SENSOR_DEPENDENCY_ID_0,
+						      &consumed);
+	}
+
+	result.elapsed_ns = st_bench_now_ns() - t0;
+	st_bench_counters_stop(&counters);
+
+	if (contended) {
+		graph.stop.store(true);
+		pthread_join(control, NULL);
+	}
+
+	result.name = name;
+	result.iterations = BENCH_SENSORBASE_SAMPLES;
+	result.counters = &counters;
+	st_bench_report(&result);
+	st_bench_counters_close(&counters);
+
+	err = 0;
+
+free_graph:
+	delete graph.consumer;
+	delete graph.producer;
+
+	return err;
+}
+
+int st_bench_sensorbase_data_path(void)
+{
+	return bench_sensorbase_run("sensorbase_data_path", false);
+}
+
+int st_bench_sensorbase_data_path_contended(void)
+{
+	return bench_sensorbase_run("sensorbase_data_path_contended", true);
+}
+
+/*
+ * SensorBase members touched by the data thread for every sample and by
+ * the framework thread on SetDelay/Enable, in the order SensorBase had
+ * before the hot/cold split: the per sample fields share cache lines with
+ * enable_mutex protected control data. Field types are the current ones,
+ * so that the two layouts differ only in member placement.
+ */
+struct bench_layout_baseline {
+	char android_name[SENSOR_BASE_ANDROID_NAME_MAX];
+	int write_pipe_fd, read_pipe_fd;
+	int dependencies_type_list[SENSOR_DEPENDENCY_ID_MAX];
+	pthread_mutex_t sample_in_processing_mutex;
+	int64_t sample_in_processing_timestamp;
+	int64_t current_real_pollrate;
+	int64_t current_min_pollrate;
+	int64_t current_min_timeout;
+	int64_t last_data_timestamp;
+	int64_t sensors_timeout[ST_HAL_IIO_MAX_DEVICES];
+	int64_t sensors_pollrates[ST_HAL_IIO_MAX_DEVICES];
+	std::atomic<int64_t> sensor_global_enable;
+	std::atomic<int64_t> sensor_global_disable;
+	std::atomic<int64_t> sensor_my_enable;
+	std::atomic<int64_t> sensor_my_disable;
+	uint8_t decimator;
+	uint8_t samples_counter;
+	push_data_t push_data;
+	dependencies_t dependencies;
+	pthread_mutex_t enable_mutex;
+	sensors_event_t sensor_event;
+};
+
+/* same members grouped by owner as in the current SensorBase */
+struct bench_layout_split {
+	alignas(ST_HAL_CACHE_LINE_SIZE) sensors_event_t sensor_event;
+	int64_t last_data_timestamp;
+	int64_t current_real_pollrate;
+	int write_pipe_fd;
+	uint8_t decimator;
+	uint8_t samples_counter;
+	push_data_t push_data;
+
+	alignas(ST_HAL_CACHE_LINE_SIZE) pthread_mutex_t sample_in_processing_mutex;
+	int64_t sample_in_processing_timestamp;
+
+	alignas(ST_HAL_CACHE_LINE_SIZE) std::atomic<int64_t> sensor_global_enable;
+	std::atomic<int64_t> sensor_global_disable;
+	std::atomic<int64_t> sensor_my_enable;
+	std::atomic<int64_t> sensor_my_disable;
+
+	alignas(ST_HAL_CACHE_LINE_SIZE) pthread_mutex_t enable_mutex;
+	int64_t current_min_pollrate;
+	int64_t current_min_timeout;
+	int64_t sensors_timeout[ST_HAL_IIO_MAX_DEVICES];
+	int64_t sensors_pollrates[ST_HAL_IIO_MAX_DEVICES];
+	dependencies_t dependencies;
+
+	char android_name[SENSOR_BASE_ANDROID_NAME_MAX];
+	int read_pipe_fd;
+	int dependencies_type_list[SENSOR_DEPENDENCY_ID_MAX];
+};
+
+template <typename Layout> struct bench_layout_context {
+	Layout *l;
+	std::atomic<bool> stop;
+};
+
+/* framework thread: SetDelay() and Enable() stores of a client handle */
+template <typename Layout> static void *bench_layout_control_thread(void *context)
+{
+	struct bench_layout_context<Layout> *ctx =
+				(struct bench_layout_context<Layout> *)context;
+	Layout *l = ctx->l;
+	int64_t period = 1000000, now = 0;
+
+	while (!ctx->stop.load(std::memory_order_relaxed)) {
+		pthread_mutex_lock(&l->enable_mutex);
+		l->sensors_pollrates[BENCH_SENSORBASE_CLIENT_HANDLE] = period;
+		l->sensors_timeout[BENCH_SENSORBASE_CLIENT_HANDLE] = period;
+		l->current_min_pollrate = period;
+		l->current_min_timeout = period;
+		l->sensor_my_enable.store(now++, std::memory_order_release);
+		pthread_mutex_unlock(&l->enable_mutex);
+
+		period = period == 1000000 ? 2000000 : 1000000;
+	}
+
+	return NULL;
+}
+
+/* data thread: SensorBase bookkeeping of WriteDataToPipe() */
+template <typename Layout> static inline void bench_layout_push(Layout *l,
+						SensorBaseData *data)
+{
+	pthread_mutex_lock(&l->sample_in_processing_mutex);
+	l->sample_in_processing_timestamp = data->timestamp;
+	pthread_mutex_unlock(&l->sample_in_processing_mutex);
+
+	l->sensor_event.acceleration.x = data->processed[0];
+	l->sensor_event.acceleration.y = data->processed[1];
+	l->sensor_event.acceleration.z = data->processed[2];
+	l->sensor_event.timestamp = data->timestamp;
+
+	if ((data->timestamp >
+	     l->sensor_my_enable.load(std::memory_order_acquire)) &&
+	    (data->timestamp >
+	     l->sensor_global_enable.load(std::memory_order_acquire)) &&
+	    (data->timestamp > l->last_data_timestamp)) {
+		l->samples_counter++;
+		if ((l->samples_counter % l->decimator) == 0) {
+			l->samples_counter = 0;
+			l->last_data_timestamp = l->sensor_event.timestamp;
+			l->current_real_pollrate = data->pollrate_ns;
+		}
+	}
+}
+
+template <typename Layout> static int bench_layout_run(const char *name)
+{
+	int err, i;
+	void *mem;
+	pthread_t control;
+	SensorBaseData data;
+	struct st_bench_result result;
+	struct st_bench_counters counters;
+	struct bench_layout_context<Layout> ctx;
+	int64_t t0;
+
+	err = posix_memalign(&mem, ST_HAL_CACHE_LINE_SIZE, sizeof(Layout));
+	if (err)
+		return -err;
+
+	memset(mem, 0, sizeof(Layout));
+	ctx.l = new (mem) Layout;
+	ctx.l->decimator = 1;
+	ctx.l->sensor_global_enable.store(0);
+	ctx.l->sensor_global_disable.store(0);
+	ctx.l->sensor_my_enable.store(0);
+	ctx.l->sensor_my_disable.store(0);
+	pthread_mutex_init(&ctx.l->sample_in_processing_mutex, NULL);
+	pthread_mutex_init(&ctx.l->enable_mutex, NULL);
+	ctx.stop.store(false);
+
+	err = pthread_create(&control, NULL,
+			     bench_layout_control_thread<Layout>, &ctx);
+	if (err) {
+		err = -err;
+		goto free_layout;
+	}
+
+	memset(&data, 0, sizeof(data));
+	data.processed[2] = 9.81f;
+	data.pollrate_ns = 1000000;
+	memset(&result, 0, sizeof(result));
+
+	st_bench_counters_open(&counters);
+	st_bench_counters_start(&counters);
+	t0 = st_bench_now_ns();
+
+	for (i = 0; i < BENCH_SENSORBASE_LAYOUT_SAMPLES; i++) {
+		/* keep ahead of the enable timestamps written by control */
+		data.timestamp = INT64_MAX / 2 + i;
+		data.processed[0] = (float)(i & 0xff);
+		bench_layout_push(ctx.l, &data);
+	}
+
+	result.elapsed_ns = st_bench_now_ns() - t0;
+	st_bench_counters_stop(&counters);
+
+	ctx.stop.store(true);
+	pthread_join(control, NULL);
+
+	result.name = name;
+	result.iterations = BENCH_SENSORBASE_LAYOUT_SAMPLES;
+	result.counters = &counters;
+	st_bench_report(&result);
+	st_bench_counters_close(&counters);
+
+free_layout:
+	pthread_mutex_destroy(&ctx.l->enable_mutex);
+	pthread_mutex_destroy(&ctx.l->sample_in_processing_mutex);
+	ctx.l->~Layout();
+	free(mem);
+
+	return err;
+}
+
+int st_bench_sensorbase_layout_baseline(void)
+{
+	return bench_layout_run<struct bench_layout_baseline>("sensorbase_layout_baseline");
+}
+
+int st_bench_sensorbase_layout_split(void)
+{
+	return bench_layout_run<struct bench_layout_split>("sensorbase_layout_split");
+}
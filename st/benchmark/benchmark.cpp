@@ -0,0 +1,312 @@
+/*
+ * STMicroelectronics SensorHAL benchmark harness
+ *
+ * Copyright 2021 STMicroelectronics Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "benchmark.h"
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof(*(a)))
+#endif
+
+static const struct st_bench_case bench_cases[] = {
+	{
+		.name = "sensorbase_data_path",
+		.description = "SensorBase per sample bookkeeping and fan-out",
+		.run = st_bench_sensorbase_data_path,
+	},
+	{
+		.name = "sensorbase_data_path_contended",
+		.description = "as sensorbase_data_path with a thread doing SetDelay/Enable",
+		.run = st_bench_sensorbase_data_path_contended,
+	},
+	{
+		.name = "sensorbase_layout_baseline",
+		.description = "per sample SensorBase fields against a SetDelay/Enable thread, pre split member order",
+		.run = st_bench_sensorbase_layout_baseline,
+	},
+	{
+		.name = "sensorbase_layout_split",
+		.description = "as sensorbase_layout_baseline with the hot/cold split member order",
+		.run = st_bench_sensorbase_layout_split,
+	},
+	{
+		.name = "pipeline",
+		.description = "scan decode and ProcessData() of a 64 scans read",
+		.run = st_bench_pipeline,
+	},
+	{
+		.name = "pipeline_imus_1",
+		.description = "pipeline on one data thread per IMU, 1 IMU",
+		.run = st_bench_pipeline_imus_1,
+	},
+	{
+		.name = "pipeline_imus_2",
+		.description = "as pipeline_imus_1 with 2 IMUs",
+		.run = st_bench_pipeline_imus_2,
+	},
+	{
+		.name = "pipeline_imus_4",
+		.description = "as pipeline_imus_1 with 4 IMUs",
+		.run = st_bench_pipeline_imus_4,
+	},
+	{
+		.name = "scan_decode",
+		.description = "ProcessScanData() over ASM330 scans (3 x le:s16 + s64 timestamp)",
+		.run = st_bench_scan_decode,
+	},
+	{
+		.name = "circular_buffer",
+		.description = "CircularBuffer writeElement() + readElement()",
+		.run = st_bench_circular_buffer,
+	},
+	{
+		.name = "circular_buffer_sync",
+		.description = "CircularBuffer writeElement() with readSyncElement() every 4 samples",
+		.run = st_bench_circular_buffer_sync,
+	},
+	{
+		.name = "odr_stack",
+		.description = "ChangeODRTimestampStack write/read/remove",
+		.run = st_bench_odr_stack,
+	},
+	{
+		.name = "flush_stack",
+		.description = "FlushBufferStack write/read/remove",
+		.run = st_bench_flush_stack,
+	},
+	{
+		.name = "rotation_matrix",
+		.description = "applyRotationMatrix() including placement copy",
+		.run = st_bench_rotation_matrix,
+	},
+	{
+		.name = "gravity_vector",
+		.description = "computeGravityVector() accumulation",
+		.run = st_bench_gravity_vector,
+	},
+	{
+		.name = "pipe_delivery",
+		.description = "event write to pipe, batched read as in st_hal_dev_poll()",
+		.run = st_bench_pipe_delivery,
+	},
+	{
+		.name = "latency_histogram",
+		.description = "LatencyHistogram Record()",
+		.run = st_bench_latency_histogram,
+	},
+	{
+		.name = "timestamp_estimator",
+		.description = "TimestampEstimator Update() and per sample GetTimestamp()",
+		.run = st_bench_timestamp_estimator,
+	},
+	{
+		.name = "reorder_window",
+		.description = "ReorderWindow Insert() and PopReady(), 1 in 8 samples late",
+		.run = st_bench_reorder_window,
+	},
+	{
+		.name = "batch_buffer",
+		.description = "BatchBuffer Push() and release of full batches",
+		.run = st_bench_batch_buffer,
+	},
+};
+
+static const struct {
+	uint32_t type;
+	uint64_t config;
+	const char *name;
+} bench_counters[ST_BENCH_COUNTER_MAX] = {
+	/* same order as enum st_bench_counter_id */
+	{
+		PERF_TYPE_HARDWARE,
+		PERF_COUNT_HW_CPU_CYCLES,
+		"cycles",
+	},
+	{
+		PERF_TYPE_HARDWARE,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		"instructions",
+	},
+	{
+		PERF_TYPE_HARDWARE,
+		PERF_COUNT_HW_CACHE_MISSES,
+		"cache_misses",
+	},
+	{
+		PERF_TYPE_HW_CACHE,
+		PERF_COUNT_HW_CACHE_L1D |
+		(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		(PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+		"l1d_read_misses",
+	},
+};
+
+int64_t st_bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void st_bench_counters_open(struct st_bench_counters *c)
+{
+	int i;
+	struct perf_event_attr attr;
+
+	for (i = 0; i < ST_BENCH_COUNTER_MAX; i++) {
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = bench_counters[i].type;
+		attr.config = bench_counters[i].config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		c->fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		c->value[i] = 0;
+	}
+}
+
+void st_bench_counters_start(struct st_bench_counters *c)
+{
+	int i;
+
+	for (i = 0; i < ST_BENCH_COUNTER_MAX; i++) {
+		if (c->fd[i] < 0)
+			continue;
+
+		ioctl(c->fd[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(c->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+void st_bench_counters_stop(struct st_bench_counters *c)
+{
+	int i;
+
+	for (i = 0; i < ST_BENCH_COUNTER_MAX; i++) {
+		if (c->fd[i] < 0)
+			continue;
+
+		ioctl(c->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+		if (read(c->fd[i], &c->value[i], sizeof(uint64_t)) !=
+		    sizeof(uint64_t))
+			c->value[i] = 0;
+	}
+}
+
+void st_bench_counters_close(struct st_bench_counters *c)
+{
+	int i;
+
+	for (i = 0; i < ST_BENCH_COUNTER_MAX; i++) {
+		if (c->fd[i] >= 0)
+			close(c->fd[i]);
+
+		c->fd[i] = -1;
+	}
+}
+
+/*
+ * One line per result, key=value pairs separated by spaces so that runs
+ * can be diffed or collected by scripts.
+ */
+void st_bench_report(struct st_bench_result *result)
+{
+	int i;
+	uint64_t iterations = result->iterations ? result->iterations : 1;
+
+	printf("bench=%s iterations=%llu ns_per_iter=%.2f",
+	       result->name, (unsigned long long)result->iterations,
+	       (double)result->elapsed_ns / iterations);
+
+	if (result->cpu_ns)
+		printf(" cpu_ns_per_iter=%.2f",
+		       (double)result->cpu_ns / iterations);
+
+	if (result->batch_p99_ns)
+		printf(" batch_p50_us=%.2f batch_p99_us=%.2f",
+		       result->batch_p50_ns / 1000.0,
+		       result->batch_p99_ns / 1000.0);
+
+	for (i = 0; i < ST_BENCH_COUNTER_MAX; i++) {
+		if (!result->counters || (result->counters->fd[i] < 0))
+			printf(" %s_per_iter=n/a", bench_counters[i].name);
+		else
+			printf(" %s_per_iter=%.3f", bench_counters[i].name,
+			       (double)result->counters->value[i] / iterations);
+	}
+
+	printf("\n");
+	fflush(stdout);
+}
+
+static void usage(const char *prog)
+{
+	unsigned int i;
+
+	printf("Usage: %s [-l] [case...]\n", prog);
+	printf("\t-l:\tlist available cases\n\n");
+
+	for (i = 0; i < ARRAY_SIZE(bench_cases); i++)
+		printf("\t%s:\t%s\n", bench_cases[i].name,
+		       bench_cases[i].description);
+}
+
+static int run_case(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(bench_cases); i++) {
+		if (!name || !strcmp(name, bench_cases[i].name)) {
+			if (bench_cases[i].run() < 0)
+				fprintf(stderr, "bench=%s failed\n",
+					bench_cases[i].name);
+
+			if (name)
+				return 0;
+		}
+	}
+
+	if (name) {
+		fprintf(stderr, "unknown case %s\n", name);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int i, err = 0;
+
+	if ((argc > 1) && (!strcmp(argv[1], "-l") || !strcmp(argv[1], "-h"))) {
+		usage(argv[0]);
+		return 0;
+	}
+
+	if (argc == 1)
+		return run_case(NULL) < 0 ? 1 : 0;
+
+	for (i = 1; i < argc; i++) {
+		if (run_case(argv[i]) < 0)
+			err = 1;
+	}
+
+	return err;
+}
@@ -0,0 +1,83 @@
+/*
+ * STMicroelectronics SensorHAL benchmark harness header file
+ *
+ * Copyright 2021 STMicroelectronics Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ */
+
+#ifndef ST_HAL_BENCHMARK_H
+#define ST_HAL_BENCHMARK_H
+
+#include <stdint.h>
+
+enum st_bench_counter_id {
+	ST_BENCH_COUNTER_CYCLES = 0,
+	ST_BENCH_COUNTER_INSTRUCTIONS,
+	ST_BENCH_COUNTER_CACHE_MISSES,
+	ST_BENCH_COUNTER_L1D_READ_MISSES,
+	ST_BENCH_COUNTER_MAX,
+};
+
+/*
+ * Per thread hw counters: each counter is opened on the calling thread
+ * only and may be unavailable (perf_event_paranoid, virtualization), in
+ * that case its fd is negative and it is reported as n/a.
+ */
+struct st_bench_counters {
+	int fd[ST_BENCH_COUNTER_MAX];
+	uint64_t value[ST_BENCH_COUNTER_MAX];
+};
+
+/*
+ * cpu_ns, batch_p50_ns and batch_p99_ns are reported only when set, by
+ * cases running several data threads.
+ */
+struct st_bench_result {
+	const char *name;
+	uint64_t iterations;
+	int64_t elapsed_ns;
+	int64_t cpu_ns;
+	int64_t batch_p50_ns;
+	int64_t batch_p99_ns;
+	struct st_bench_counters *counters;
+};
+
+struct st_bench_case {
+	const char *name;
+	const char *description;
+	int (*run)(void);
+};
+
+int64_t st_bench_now_ns(void);
+
+void st_bench_counters_open(struct st_bench_counters *c);
+void st_bench_counters_start(struct st_bench_counters *c);
+void st_bench_counters_stop(struct st_bench_counters *c);
+void st_bench_counters_close(struct st_bench_counters *c);
+
+void st_bench_report(struct st_bench_result *result);
+
+/* benchmark cases */
+int st_bench_sensorbase_data_path(void);
+int st_bench_sensorbase_data_path_contended(void);
+int st_bench_sensorbase_layout_baseline(void);
+int st_bench_sensorbase_layout_split(void);
+int st_bench_pipeline(void);
+int st_bench_pipeline_imus_1(void);
+int st_bench_pipeline_imus_2(void);
+int st_bench_pipeline_imus_4(void);
+int st_bench_scan_decode(void);
+int st_bench_circular_buffer(void);
+int st_bench_circular_buffer_sync(void);
+int st_bench_odr_stack(void);
+int st_bench_flush_stack(void);
+int st_bench_rotation_matrix(void);
+int st_bench_gravity_vector(void);
+int st_bench_pipe_delivery(void);
+int st_bench_latency_histogram(void);
+int st_bench_timestamp_estimator(void);
+int st_bench_reorder_window(void);
+int st_bench_batch_buffer(void);
+
+#endif /* ST_HAL_BENCHMARK_H */
@@ -15,6 +15,8 @@
 
 #define CONFIG_ST_HAL_MAX_SAMPLING_FREQUENCY 2000
 #define CONFIG_ST_HAL_DEBUG_LEVEL 2
+#define CONFIG_ST_HAL_REORDER_WINDOW_MS 0
+#define CONFIG_ST_HAL_SW_BATCH_EVENTS 0
 #define CONFIG_ST_HAL_ACCEL_ROT_MATRIX 1,0,0,0,1,0,0,0,1
 #define CONFIG_ST_HAL_ACCEL_RANGE 79
 #define CONFIG_ST_HAL_GYRO_ROT_MATRIX 1,0,0,0,1,0,0,0,1
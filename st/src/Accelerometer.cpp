@@ -84,9 +84,9 @@ void Accelerometer::calculateThresholdMLC(SensorBaseData &data)
 	case RUNNING:
 		float acc[3], gVec[3];
 
-		acc[0] = data.raw[0] / GRAVITY_EARTH;
-		acc[1] = data.raw[1] / GRAVITY_EARTH;
-		acc[2] = data.raw[2] / GRAVITY_EARTH;
+		acc[0] = ST_HAL_SAMPLE_TO_SI(sample_scale, data.raw[0]) / GRAVITY_EARTH;
+		acc[1] = ST_HAL_SAMPLE_TO_SI(sample_scale, data.raw[1]) / GRAVITY_EARTH;
+		acc[2] = ST_HAL_SAMPLE_TO_SI(sample_scale, data.raw[2]) / GRAVITY_EARTH;
 
 		if (isStatic == 0){
 			isStatic = computeGravityVector(&state, acc, data.timestamp, gVec);
@@ -145,9 +145,9 @@ void Accelerometer::calculateThresholdMLC(SensorBaseData &data)
 
 void Accelerometer::ProcessData(SensorBaseData *data)
 {
-	float tmp_raw_data[SENSOR_DATA_3AXIS];
+	sensor_sample_t tmp_raw_data[SENSOR_DATA_3AXIS];
 
-	memcpy(tmp_raw_data, data->raw, SENSOR_DATA_3AXIS * sizeof(float));
+	memcpy(tmp_raw_data, data->raw, SENSOR_DATA_3AXIS * sizeof(sensor_sample_t));
 
 	data->raw[0] = SENSOR_X_DATA(tmp_raw_data[0],
 				     tmp_raw_data[1],
@@ -164,18 +164,23 @@ void Accelerometer::ProcessData(SensorBaseData *data)
 
 	calculateThresholdMLC(*data);
 
-	applyRotationMatrix(*data);
+	applyRotationMatrix(*data, common_data.imu_instance);
 
 #if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_EXTRA_VERBOSE)
 	ALOGD("\"%s\": received new sensor data: x=%f y=%f z=%f, timestamp=%" PRIu64 "ns, deltatime=%" PRIu64 "ns (sensor type: %d).",
-	      sensor_t_data.name, data->raw[0], data->raw[1], data->raw[2],
+	      sensor_t_data.name, (float)ST_HAL_SAMPLE_TO_SI(sample_scale, data->raw[0]),
+	      (float)ST_HAL_SAMPLE_TO_SI(sample_scale, data->raw[1]),
+	      (float)ST_HAL_SAMPLE_TO_SI(sample_scale, data->raw[2]),
 	      data->timestamp, data->timestamp - sensor_event.timestamp, sensor_t_data.type);
 #endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
 
 #ifdef CONFIG_ST_HAL_FACTORY_CALIBRATION
-	data->raw[0] = (data->raw[0] - factory_offset[0]) * factory_scale[0];
-	data->raw[1] = (data->raw[1] - factory_offset[1]) * factory_scale[1];
-	data->raw[2] = (data->raw[2] - factory_offset[2]) * factory_scale[2];
+	data->raw[0] = ST_HAL_SI_TO_SAMPLE(sample_scale, (ST_HAL_SAMPLE_TO_SI(sample_scale, data->raw[0]) -
+							  factory_offset[0]) * factory_scale[0]);
+	data->raw[1] = ST_HAL_SI_TO_SAMPLE(sample_scale, (ST_HAL_SAMPLE_TO_SI(sample_scale, data->raw[1]) -
+							  factory_offset[1]) * factory_scale[1]);
+	data->raw[2] = ST_HAL_SI_TO_SAMPLE(sample_scale, (ST_HAL_SAMPLE_TO_SI(sample_scale, data->raw[2]) -
+							  factory_offset[2]) * factory_scale[2]);
 	data->accuracy = SENSOR_STATUS_ACCURACY_HIGH;
 #else /* CONFIG_ST_HAL_FACTORY_CALIBRATION */
 	data->accuracy = SENSOR_STATUS_UNRELIABLE;
@@ -187,9 +192,9 @@ void Accelerometer::ProcessData(SensorBaseData *data)
 
 	data->accuracy = SENSOR_STATUS_UNRELIABLE;
 
-	sensor_event.acceleration.x = data->processed[0];
-	sensor_event.acceleration.y = data->processed[1];
-	sensor_event.acceleration.z = data->processed[2];
+	sensor_event.acceleration.x = ST_HAL_SAMPLE_TO_SI(sample_scale, data->processed[0]);
+	sensor_event.acceleration.y = ST_HAL_SAMPLE_TO_SI(sample_scale, data->processed[1]);
+	sensor_event.acceleration.z = ST_HAL_SAMPLE_TO_SI(sample_scale, data->processed[2]);
 	sensor_event.acceleration.status = data->accuracy;
 	sensor_event.timestamp = data->timestamp;
 
@@ -78,9 +78,15 @@ LOCAL_SRC_FILES := \
 		SensorHAL.cpp \
 		utils.cpp \
 		CircularBuffer.cpp \
+		MemoryArena.cpp \
+		LatencyHistogram.cpp \
+		SensorMetrics.cpp \
 		FlushBufferStack.cpp \
 		FlushRequested.cpp \
 		ChangeODRTimestampStack.cpp \
+		TimestampEstimator.cpp \
+		ReorderWindow.cpp \
+		BatchBuffer.cpp \
 		SensorBase.cpp \
 		HWSensorBase.cpp
 
@@ -102,6 +108,26 @@ ifneq ($(or $(CONFIG_ST_HAL_ACCEL_UNCALIB_AP_EMULATED),\
 LOCAL_SRC_FILES += SWAccelerometerUncalibrated.cpp
 endif # CONFIG_ST_HAL_ACCEL_UNCALIB_AP_EMULATED
 
+ifdef CONFIG_ST_HAL_TRACE_MARKER
+LOCAL_SRC_FILES += SensorTrace.cpp
+endif # CONFIG_ST_HAL_TRACE_MARKER
+
+ifdef CONFIG_ST_HAL_STAGE_PROFILING
+LOCAL_SRC_FILES += StageProfiler.cpp
+endif # CONFIG_ST_HAL_STAGE_PROFILING
+
+ifdef CONFIG_ST_HAL_IIO_SIMULATOR
+LOCAL_SRC_FILES += IIOSimulator.cpp
+endif # CONFIG_ST_HAL_IIO_SIMULATOR
+
+ifdef CONFIG_ST_HAL_CAPTURE
+LOCAL_SRC_FILES += SensorCapture.cpp
+endif # CONFIG_ST_HAL_CAPTURE
+
+ifdef CONFIG_ST_HAL_IIO_HOTPLUG
+LOCAL_SRC_FILES += IIOHotplug.cpp
+endif # CONFIG_ST_HAL_IIO_HOTPLUG
+
 ifdef CONFIG_ST_HAL_ADDITIONAL_INFO_ENABLED
 LOCAL_SRC_FILES += SensorAdditionalInfo.cpp
 endif # CONFIG_ST_HAL_ADDITIONAL_INFO_ENABLED
@@ -0,0 +1,93 @@
+/*
+ * STMicroelectronics Batch Buffer Class
+ *
+ * Copyright 2021 STMicroelectronics Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ */
+
+#include <string.h>
+
+#include "BatchBuffer.h"
+#include "MemoryArena.h"
+
+BatchBuffer::BatchBuffer()
+{
+	events = NULL;
+	length = 0;
+	head = 0;
+	count = 0;
+}
+
+BatchBuffer::~BatchBuffer()
+{
+	MemoryArena::Free(events);
+}
+
+/**
+ * Init() - Allocate the buffer
+ * @len: number of events.
+ *
+ * Return value: 0 on success, -ENOMEM on fail.
+ **/
+int BatchBuffer::Init(unsigned int len)
+{
+	MemoryArena::Free(events);
+
+	events = (sensors_event_t *)MemoryArena::Alloc(len * sizeof(sensors_event_t));
+	length = events ? len : 0;
+	head = 0;
+	count = 0;
+
+	return events ? 0 : -ENOMEM;
+}
+
+/**
+ * Push() - Hold an event
+ * @event: event to copy.
+ *
+ * Return value: 0 on success, -ENOMEM if the buffer is full.
+ **/
+int BatchBuffer::Push(const sensors_event_t *event)
+{
+	if (count == length)
+		return -ENOMEM;
+
+	memcpy(&events[(head + count) % length], event,
+	       sizeof(sensors_event_t));
+	count++;
+
+	return 0;
+}
+
+/**
+ * GetSpan() - Get the oldest held events stored contiguously
+ * @first: oldest held event.
+ *
+ * Return value: number of events from @first, 0 if empty.
+ **/
+unsigned int BatchBuffer::GetSpan(const sensors_event_t **first)
+{
+	if (!count)
+		return 0;
+
+	*first = &events[head];
+
+	return head + count > length ? length - head : count;
+}
+
+/**
+ * Consume() - Release the oldest held events
+ * @num: number of events, at most GetSpan() ones.
+ **/
+void BatchBuffer::Consume(unsigned int num)
+{
+	if (num > count)
+		num = count;
+
+	if (!num)
+		return;
+
+	head = (head + num) % length;
+	count -= num;
+}
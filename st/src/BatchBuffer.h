@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2021 STMicroelectronics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ST_BATCH_BUFFER_H
+#define ST_BATCH_BUFFER_H
+
+#include <stdint.h>
+#include <errno.h>
+
+#include <hardware/sensors.h>
+
+/*
+ * class BatchBuffer
+ *
+ * Ring of events held in software after the hw FIFO, released together
+ * so the client wakes up once per batch. Storage comes from MemoryArena,
+ * events are released as contiguous spans to be written with few
+ * syscalls. Not thread safe, callers lock.
+ */
+class BatchBuffer {
+private:
+	sensors_event_t *events;
+	unsigned int length;
+	unsigned int head;
+	unsigned int count;
+
+public:
+	BatchBuffer();
+	~BatchBuffer();
+
+	int Init(unsigned int len);
+	int Push(const sensors_event_t *event);
+	unsigned int GetSpan(const sensors_event_t **first);
+	void Consume(unsigned int num);
+
+	unsigned int GetLength() { return length; }
+	unsigned int GetCount() { return count; }
+	bool IsFull() { return count == length; }
+
+	/* timestamp of the oldest held event, INT64_MAX if empty */
+	int64_t GetOldestTimestamp() {
+		return count ? events[head].timestamp : INT64_MAX;
+	}
+};
+
+#endif /* ST_BATCH_BUFFER_H */
@@ -9,37 +9,63 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <new>
 #include "CircularBuffer.h"
+#include "MemoryArena.h"
 
 CircularBuffer::CircularBuffer(unsigned int num_elements)
 {
-	data_sensor =
-	    (SensorBaseData *)malloc(num_elements * sizeof(SensorBaseData));
+	data_sensor = (SensorBaseData *)
+		MemoryArena::Alloc(num_elements * sizeof(SensorBaseData));
 
 	pthread_mutex_init(&data_mutex, NULL);
 
+	capacity = num_elements;
 	length = num_elements;
 	elements_available = 0;
+	overruns = 0;
 	first_free_element = &data_sensor[0];
 	first_available_element = &data_sensor[0];
 }
 
 CircularBuffer::~CircularBuffer()
 {
-	delete data_sensor;
+	MemoryArena::Free(data_sensor);
+}
+
+void *CircularBuffer::operator new(size_t size)
+{
+	void *p = MemoryArena::Alloc(size);
+
+	if (!p)
+		throw std::bad_alloc();
+
+	return p;
+}
+
+void CircularBuffer::operator delete(void *p)
+{
+	MemoryArena::Free(p);
 }
 
 int CircularBuffer::writeElement(SensorBaseData *data)
 {
+	int err = 0;
+
 	pthread_mutex_lock(&data_mutex);
 
 	if (elements_available == length) {
+		/* overwrite the oldest element */
 		first_available_element++;
 		if (first_available_element == (&data_sensor[0] + length))
 			first_available_element = &data_sensor[0];
-	}
 
-	pthread_mutex_unlock(&data_mutex);
+		overruns++;
+		err = -ENOMEM;
+	} else {
+		elements_available++;
+	}
 
 	memcpy(first_free_element, data, sizeof(SensorBaseData));
 	first_free_element++;
@@ -47,18 +73,9 @@ int CircularBuffer::writeElement(SensorBaseData *data)
 	if (first_free_element == (&data_sensor[0] + length))
 		first_free_element = &data_sensor[0];
 
-	pthread_mutex_lock(&data_mutex);
-
-	if (elements_available < length)
-		elements_available++;
-	else {
-		pthread_mutex_unlock(&data_mutex);
-		return -ENOMEM;
-	}
-
 	pthread_mutex_unlock(&data_mutex);
 
-	return 0;
+	return err;
 }
 
 int CircularBuffer::readElement(SensorBaseData *data)
@@ -156,6 +173,69 @@ int CircularBuffer::readSyncElement(SensorBaseData *data,
 	return num_remaining_elements;
 }
 
+/**
+ * resize() - Change the number of elements used, up to the allocated ones
+ * @num_elements: new length.
+ *
+ * The newest elements are kept.
+ *
+ * Return value: length applied.
+ **/
+unsigned int CircularBuffer::resize(unsigned int num_elements)
+{
+	unsigned int drop;
+
+	if (num_elements < 1)
+		num_elements = 1;
+	else if (num_elements > capacity)
+		num_elements = capacity;
+
+	pthread_mutex_lock(&data_mutex);
+
+	if (num_elements != length) {
+		/* oldest element first, at the beginning of the storage */
+		std::rotate(&data_sensor[0], first_available_element,
+			    &data_sensor[0] + length);
+
+		if (elements_available > num_elements) {
+			drop = elements_available - num_elements;
+			memmove(&data_sensor[0], &data_sensor[drop],
+				num_elements * sizeof(SensorBaseData));
+			elements_available = num_elements;
+		}
+
+		length = num_elements;
+		first_available_element = &data_sensor[0];
+		first_free_element = &data_sensor[elements_available % length];
+	}
+
+	pthread_mutex_unlock(&data_mutex);
+
+	return num_elements;
+}
+
+unsigned int CircularBuffer::getLength()
+{
+	unsigned int ret;
+
+	pthread_mutex_lock(&data_mutex);
+	ret = length;
+	pthread_mutex_unlock(&data_mutex);
+
+	return ret;
+}
+
+uint64_t CircularBuffer::getOverruns()
+{
+	uint64_t ret;
+
+	pthread_mutex_lock(&data_mutex);
+	ret = overruns;
+	pthread_mutex_unlock(&data_mutex);
+
+	return ret;
+}
+
 void CircularBuffer::resetBuffer()
 {
 	pthread_mutex_lock(&data_mutex);
@@ -24,11 +24,32 @@
 #include <time.h>
 #include <pthread.h>
 #include <errno.h>
+#include <math.h>
+
+#include "common_data.h"
+
+#ifdef CONFIG_ST_HAL_FIXED_POINT_DATA
+/*
+ * Samples are kept in LSB from the iio scan up to the event emission,
+ * scale is the sample scale of the producing sensor
+ * (SensorBase::GetSampleScale()) used to convert them to SI units.
+ * int32 leaves headroom for rotation and offset removal.
+ */
+typedef int32_t sensor_sample_t;
+
+#define ST_HAL_SAMPLE_TO_SI(scale, val)		((float)(val) * (scale))
+#define ST_HAL_SI_TO_SAMPLE(scale, val)		((sensor_sample_t)lrintf((val) / (scale)))
+#else /* CONFIG_ST_HAL_FIXED_POINT_DATA */
+typedef float sensor_sample_t;
+
+#define ST_HAL_SAMPLE_TO_SI(scale, val)		(val)
+#define ST_HAL_SI_TO_SAMPLE(scale, val)		(val)
+#endif /* CONFIG_ST_HAL_FIXED_POINT_DATA */
 
 typedef struct SensorBaseData {
-	float raw[4];
-	float offset[4];
-	float processed[4];
+	sensor_sample_t raw[4];
+	sensor_sample_t offset[4];
+	sensor_sample_t processed[4];
 	int64_t timestamp;
 	int8_t accuracy;
 	int flush_event_handle;
@@ -41,7 +62,8 @@ typedef struct SensorBaseData {
 class CircularBuffer {
 private:
 	pthread_mutex_t data_mutex;
-	unsigned int length, elements_available;
+	unsigned int capacity, length, elements_available;
+	uint64_t overruns;
 
 	SensorBaseData *data_sensor;
 	SensorBaseData *first_available_element;
@@ -51,9 +73,16 @@ public:
 	CircularBuffer(unsigned int num_elements);
 	~CircularBuffer();
 
+	/* dependency buffers live in the MemoryArena with their elements */
+	static void *operator new(size_t size);
+	static void operator delete(void *p);
+
 	int writeElement(SensorBaseData *data);
 	int readElement(SensorBaseData *data);
 	int readSyncElement(SensorBaseData *data, int64_t timestamp_sync);
+	unsigned int resize(unsigned int num_elements);
+	unsigned int getLength();
+	uint64_t getOverruns();
 	void resetBuffer();
 };
 
@@ -66,9 +66,9 @@ int Gyroscope::SetDelay(int handle, int64_t period_ns,
 
 void Gyroscope::ProcessData(SensorBaseData *data)
 {
-	float tmp_raw_data[SENSOR_DATA_3AXIS];
+	sensor_sample_t tmp_raw_data[SENSOR_DATA_3AXIS];
 
-	memcpy(tmp_raw_data, data->raw, SENSOR_DATA_3AXIS * sizeof(float));
+	memcpy(tmp_raw_data, data->raw, SENSOR_DATA_3AXIS * sizeof(sensor_sample_t));
 
 	data->raw[0] = SENSOR_X_DATA(tmp_raw_data[0],
 				     tmp_raw_data[1],
@@ -83,18 +83,23 @@ void Gyroscope::ProcessData(SensorBaseData *data)
 				     tmp_raw_data[2],
 				     CONFIG_ST_HAL_GYRO_ROT_MATRIX);
 
-	applyRotationMatrix(*data);
+	applyRotationMatrix(*data, common_data.imu_instance);
 
 #if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_EXTRA_VERBOSE)
 	ALOGD("\"%s\": received new sensor data: x=%f y=%f z=%f, timestamp=%" PRIu64 "ns, deltatime=%" PRIu64 "ns (sensor type: %d).",
-	      sensor_t_data.name, data->raw[0], data->raw[1], data->raw[2],
+	      sensor_t_data.name, (float)ST_HAL_SAMPLE_TO_SI(sample_scale, data->raw[0]),
+	      (float)ST_HAL_SAMPLE_TO_SI(sample_scale, data->raw[1]),
+	      (float)ST_HAL_SAMPLE_TO_SI(sample_scale, data->raw[2]),
 	      data->timestamp, data->timestamp - sensor_event.timestamp, sensor_t_data.type);
 #endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
 
 #ifdef CONFIG_ST_HAL_FACTORY_CALIBRATION
-	data->raw[0] = (data->raw[0] - factory_offset[0]) * factory_scale[0];
-	data->raw[1] = (data->raw[1] - factory_offset[1]) * factory_scale[1];
-	data->raw[2] = (data->raw[2] - factory_offset[2]) * factory_scale[2];
+	data->raw[0] = ST_HAL_SI_TO_SAMPLE(sample_scale, (ST_HAL_SAMPLE_TO_SI(sample_scale, data->raw[0]) -
+							  factory_offset[0]) * factory_scale[0]);
+	data->raw[1] = ST_HAL_SI_TO_SAMPLE(sample_scale, (ST_HAL_SAMPLE_TO_SI(sample_scale, data->raw[1]) -
+							  factory_offset[1]) * factory_scale[1]);
+	data->raw[2] = ST_HAL_SI_TO_SAMPLE(sample_scale, (ST_HAL_SAMPLE_TO_SI(sample_scale, data->raw[2]) -
+							  factory_offset[2]) * factory_scale[2]);
 #endif /* CONFIG_ST_HAL_FACTORY_CALIBRATION */
 
 	data->accuracy = SENSOR_STATUS_UNRELIABLE;
@@ -103,9 +108,9 @@ void Gyroscope::ProcessData(SensorBaseData *data)
 	data->processed[1] = data->raw[1] - data->offset[1];
 	data->processed[2] = data->raw[2] - data->offset[2];
 
-	sensor_event.gyro.x = data->processed[0];
-	sensor_event.gyro.y = data->processed[1];
-	sensor_event.gyro.z = data->processed[2];
+	sensor_event.gyro.x = ST_HAL_SAMPLE_TO_SI(sample_scale, data->processed[0]);
+	sensor_event.gyro.y = ST_HAL_SAMPLE_TO_SI(sample_scale, data->processed[1]);
+	sensor_event.gyro.z = ST_HAL_SAMPLE_TO_SI(sample_scale, data->processed[2]);
 	sensor_event.gyro.status = data->accuracy;
 	sensor_event.timestamp = data->timestamp;
 
@@ -11,7 +11,6 @@
 #define __STDINT_LIMITS
 #define _BSD_SOURCE
 
-#include <endian.h>
 #include <fcntl.h>
 #include <assert.h>
 #include <string.h>
@@ -26,165 +25,124 @@
  * size_from_channelarray() - Calculate the storage size of a scan
  * @channels: the channel info array.
  * @num_channels: number of channels.
+ *
+ * The iio core packs enabled channels in scan index order, the array
+ * can be in any order.
  **/
 static int size_from_channelarray(struct device_iio_info_channel *channels,
 				  int num_channels)
 {
-	int bytes = 0, i;
+	int bytes = 0, i, k, next;
 
-	for (i = 0; i < num_channels; i++) {
+	for (i = 0; i < num_channels; i++)
 		channels[i].location = 0;
 
-		if (channels[i].bytes == 0)
-			continue;
+	for (k = -1;; k = next) {
+		next = -1;
+
+		for (i = 0; i < num_channels; i++) {
+			if (!channels[i].enabled || (channels[i].bytes == 0))
+				continue;
+
+			if ((k >= 0) && (channels[i].index <= channels[k].index))
+				continue;
 
-		if (bytes % channels[i].bytes == 0)
-			channels[i].location = bytes;
+			if ((next < 0) || (channels[i].index < channels[next].index))
+				next = i;
+		}
+
+		if (next < 0)
+			break;
+
+		if (bytes % channels[next].bytes == 0)
+			channels[next].location = bytes;
 		else
-			channels[i].location = bytes -
-			  (bytes % channels[i].bytes) + channels[i].bytes;
+			channels[next].location = bytes -
+			  (bytes % channels[next].bytes) + channels[next].bytes;
 
-		bytes = channels[i].location + channels[i].bytes;
+		bytes = channels[next].location + channels[next].bytes;
 	}
 
 	return bytes;
 }
 
 /**
- * process_2byte_received() - Return channel data from 2 byte
- * @input: 2 byte of data received from buffer channel.
- * @info: information about channel structure.
+ * scan_channel_type() - Get the SENSOR_SCAN_CHANNELS_* of a channel
+ * @channel: the channel info.
+ *
+ * Like in ProcessScanData(), a signed 8 bytes channel with no scale and
+ * offset is the timestamp.
  **/
-static float process_2byte_received(int input,
-				    struct device_iio_info_channel *info)
+static unsigned int scan_channel_type(const struct device_iio_info_channel *channel)
 {
-	float res;
-	int16_t val;
-
-	if (info->be)
-		input = be16toh((uint16_t)input);
-	else
-		input = le16toh((uint16_t)input);
-
-	val = input >> info->shift;
+	if ((channel->bytes == 8) && channel->sign &&
+	    (channel->scale == 1.0f) && (channel->offset == 0.0f))
+		return SENSOR_SCAN_CHANNELS_TIMESTAMP;
 
-	if (info->sign) {
-		val &= (1 << info->bits_used) - 1;
-		val = (int16_t)(val << (16 - info->bits_used)) >> (16 - info->bits_used);
-		res = (float)val;
-	} else {
-		val &= (1 << info->bits_used) - 1;
-		res = (float)((uint16_t)val);
-	}
-
-	return ((res + info->offset) * info->scale);
+	return SENSOR_SCAN_CHANNELS_DATA;
 }
 
 /**
- * process_3byte_received() - Return channel data from 3 byte
- * @input: 3 byte of data received from buffer channel.
- * @info: information about channel structure.
+ * UpdateSampleScale() - Set the scale of the sensor samples
+ *
+ * With CONFIG_ST_HAL_FIXED_POINT_DATA samples are carried in LSB of this
+ * scale. Data channels of ST devices share the scale, if one does not it
+ * is converted to the smallest scale in ProcessScanData().
  **/
-static float process_3byte_received(int input,
-				    struct device_iio_info_channel *info)
+void HWSensorBase::UpdateSampleScale()
 {
-	float res;
-	int32_t val;
+	int i;
 
-	if (info->be)
-		input = be32toh((uint32_t)input);
-	else
-		input = le32toh((uint32_t)input);
+	sample_scale = 0.0f;
 
-	val = input >> info->shift;
-	if (info->sign) {
-		val &= (1 << info->bits_used) - 1;
-		val = (int32_t)(val << (24 - info->bits_used)) >> (24 - info->bits_used);
-		res = (float)val;
-	} else {
-		val &= (1 << info->bits_used) - 1;
-		res = (float)((uint32_t)val);
+	for (i = 0; i < common_data.num_channels; i++) {
+		if (scan_channel_type(&common_data.channels[i]) !=
+		    SENSOR_SCAN_CHANNELS_DATA)
+			continue;
+
+		if ((sample_scale == 0.0f) ||
+		    (common_data.channels[i].scale < sample_scale))
+			sample_scale = common_data.channels[i].scale;
 	}
 
-	return ((res + info->offset) * info->scale);
+	if (sample_scale <= 0.0f)
+		sample_scale = 1.0f;
+
+#ifdef CONFIG_ST_HAL_FIXED_POINT_DATA
+	for (i = 0; i < common_data.num_channels; i++) {
+		if ((scan_channel_type(&common_data.channels[i]) ==
+		     SENSOR_SCAN_CHANNELS_DATA) &&
+		    (common_data.channels[i].scale != sample_scale)) {
+			ALOGW("\"%s\": %s scale %f differs, converted to %f.",
+			      GetName(), common_data.channels[i].name,
+			      common_data.channels[i].scale, sample_scale);
+		}
+	}
+#endif /* CONFIG_ST_HAL_FIXED_POINT_DATA */
 }
 
+#ifdef CONFIG_ST_HAL_SW_TIMESTAMP
 /**
- * process_scan() - This functions use channels device information to build
- * data
+ * timestamp_location() - Get the timestamp location in a scan
+ * @channels: the channel info array.
+ * @num_channels: number of channels.
  *
- * @hw_sensor: pointer to current hardware sensor.
- * @data: sensor data of all channels read from buffer.
- * @channels: information about channel structure.
- * @num_channels: number of channels of the sensor.
+ * Return value: byte offset, -1 if the timestamp channel is disabled.
  **/
-static int ProcessScanData(uint8_t *data,
-			   struct device_iio_info_channel *channels,
-			   int num_channels,
-			   SensorBaseData *sensor_out_data)
+static int timestamp_location(const struct device_iio_info_channel *channels,
+			      int num_channels)
 {
-	int k;
+	int i;
 
-	for (k = 0; k < num_channels; k++) {
-		sensor_out_data->offset[k] = 0;
-
-		switch (channels[k].bytes) {
-		case 1:
-			sensor_out_data->raw[k] = *(uint8_t *)(data + channels[k].location);
-			break;
-		case 2:
-			sensor_out_data->raw[k] = process_2byte_received(*(uint16_t *)
-					(data + channels[k].location), &channels[k]);
-			break;
-		case 3:
-			sensor_out_data->raw[k] = process_3byte_received(*(uint32_t *)
-					(data + channels[k].location), &channels[k]);
-			break;
-		case 4:
-			uint32_t val;
-
-			if (channels[k].be)
-				val = be32toh(*(uint32_t *)
-						(data + channels[k].location));
-			else
-				val = le32toh(*(uint32_t *)
-						(data + channels[k].location));
-			val >>= channels[k].shift;
-			val &= channels[k].mask;
-			if (channels[k].sign) {
-				sensor_out_data->raw[k] = ((float)(int32_t)val +
-						channels[k].offset) * channels[k].scale;
-			} else {
-				sensor_out_data->raw[k] = ((float)val +
-						channels[k].offset) * channels[k].scale;
-			}
-
-			break;
-		case 8:
-			if (channels[k].sign) {
-				int64_t val = *(int64_t *)(data + channels[k].location);
-				if ((val >> channels[k].bits_used) & 1)
-					val = (val & channels[k].mask) | ~channels[k].mask;
-
-				if ((channels[k].scale == 1.0f) && (channels[k].offset == 0.0f)) {
-					sensor_out_data->timestamp = val;
-				} else {
-					sensor_out_data->raw[k] = (((float)val +
-							channels[k].offset) * channels[k].scale);
-				}
-			} else {
-				uint64_t val = *(uint64_t *)(data + channels[k].location);
-				sensor_out_data->raw[k] = val;
-			}
-
-			break;
-		default:
-			return -EINVAL;
-		}
+	for (i = 0; i < num_channels; i++) {
+		if (channels[i].enabled &&
+		    (scan_channel_type(&channels[i]) == SENSOR_SCAN_CHANNELS_TIMESTAMP))
+			return channels[i].location;
 	}
 
-	return num_channels;
+	return -1;
 }
+#endif /* CONFIG_ST_HAL_SW_TIMESTAMP */
 
 #if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_MARSHMALLOW_VERSION)
 static int ProcessInjectionData(float *data,
@@ -196,6 +154,9 @@ static int ProcessInjectionData(float *data,
 	int k;
 
 	for (k = 0; k < num_channels; k++) {
+		if (!channels[k].enabled)
+			continue;
+
 		switch (channels[k].bytes) {
 		case 1:
 			*(uint8_t *)(out_data + channels[k].location) = data[k];
@@ -228,9 +189,9 @@ HWSensorBase::HWSensorBase(HWSensorBaseCommonData *data,
 								 sensor_type)
 {
 	int err;
-	char *buffer_path;
 
 	memcpy(&common_data, data, sizeof(common_data));
+	UpdateSampleScale();
 
 	sensor_t_data.power = power_consumption;
 	sensor_t_data.fifoMaxEventCount = hw_fifo_len;
@@ -246,129 +207,1029 @@ HWSensorBase::HWSensorBase(HWSensorBaseCommonData *data,
 
 	scan_size = size_from_channelarray(common_data.channels,
 					   common_data.num_channels);
+	scan_channels = SENSOR_SCAN_CHANNELS_ALL;
+	pthread_mutex_init(&scan_mutex, NULL);
+#ifdef CONFIG_ST_HAL_SW_TIMESTAMP
+	timestamp_estimator_reset.store(false);
+	scan_timestamp_location = timestamp_location(common_data.channels,
+						     common_data.num_channels);
+#endif /* CONFIG_ST_HAL_SW_TIMESTAMP */
+	scan_pollrate = 0;
+	read_buffer = NULL;
+	hw_fifo_watermark = 0;
+	last_scan_timestamp = 0;
+	gaps_at_buffer_grow = 0;
+	iio_buffer_len = HW_SENSOR_BASE_DEFAULT_IIO_BUFFER_LEN;
+	timestamp_clock = CLOCK_BOOTTIME;
+	timestamp_clock_offset.store(0);
+	device_detached.store(false);
+	pthread_cond_init(&device_attached_cond, NULL);
+	threads_stop.store(false);
+	threads_stop_pipe[0] = threads_stop_pipe[1] = -1;
+#if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_MARSHMALLOW_VERSION)
+	injection_data = NULL;
+#endif /* CONFIG_ST_HAL_ANDROID_VERSION */
 
-	err = asprintf(&buffer_path,
-		       "/dev/iio:device%d",
-		       data->device_iio_dev_num);
-	if (err <= 0) {
-		ALOGE("%s: Failed to allocate iio device path string.",
-		      GetName());
+	if (pipe2(threads_stop_pipe, O_CLOEXEC) < 0) {
+		ALOGE("%s: Failed to create threads stop pipe.", GetName());
+		goto invalid_this_class;
+	}
+
+	pollfd_iio[0].fd = device_iio_utils::open_buffer(data->device_iio_dev_num);
+	if (pollfd_iio[0].fd < 0) {
+		ALOGE("%s: Failed to open iio char device (iio:device%u).",
+		      GetName(),
+		      data->device_iio_dev_num);
 		goto invalid_this_class;
 	}
 
-	pollfd_iio[0].fd = open(buffer_path, O_RDONLY | O_NONBLOCK);
-	if (pollfd_iio[0].fd < 0) {
-		ALOGE("%s: Failed to open iio char device (%s)." ,
-		      GetName(),
-		      buffer_path);
-		goto free_buffer_path;
+	pollfd_iio[0].events = POLLIN;
+
+	SetupTimestampClock();
+
+	pollfd_iio[1].fd = device_iio_utils::open_events(data->device_iio_dev_num,
+							 pollfd_iio[0].fd);
+	if (pollfd_iio[1].fd >= 0) {
+		pollfd_iio[1].events = POLLIN;
+		has_event_channels = true;
+	} else {
+		has_event_channels= false;
+	}
+
+#if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_MARSHMALLOW_VERSION)
+	err = device_iio_utils::support_injection_mode(common_data.device_iio_sysfs_path);
+	switch (err) {
+	case 0:
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
+		ALOGD("\"%s\": injection mode available, sensor is an injector.",
+		      GetName());
+#endif /* CONFIG_ST_HAL_DEBUG_INFO */
+		sensor_t_data.flags |= DATA_INJECTION_MASK;
+		injection_mode = SENSOR_INJECTOR;
+		break;
+
+	case 1:
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
+		ALOGD("\"%s\": injection mode available, sensor is injected.",
+		      GetName());
+#endif /* CONFIG_ST_HAL_DEBUG_INFO */
+		sensor_t_data.flags |= DATA_INJECTION_MASK;
+		injection_mode = SENSOR_INJECTED;
+		break;
+
+	default:
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
+		ALOGD("\"%s\": injection mode not available.", GetName());
+#endif /* CONFIG_ST_HAL_DEBUG_INFO */
+		sensor_t_data.flags &= ~DATA_INJECTION_MASK;
+		break;
+	}
+#endif /* CONFIG_ST_HAL_ANDROID_VERSION */
+
+#if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_PIE_VERSION)
+#if (CONFIG_ST_HAL_ADDITIONAL_INFO_ENABLED)
+	sensor_t_data.flags |= SENSOR_FLAG_ADDITIONAL_INFO;
+	supportsSensorAdditionalInfo = false;
+#endif /* CONFIG_ST_HAL_ADDITIONAL_INFO_ENABLED */
+#endif /* CONFIG_ST_HAL_ANDROID_VERSION */
+
+	return;
+
+invalid_this_class:
+	InvalidThisClass();
+}
+
+HWSensorBase::~HWSensorBase()
+{
+	MemoryArena::Free(read_buffer);
+#if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_MARSHMALLOW_VERSION)
+	MemoryArena::Free(injection_data);
+#endif /* CONFIG_ST_HAL_ANDROID_VERSION */
+
+	pthread_cond_destroy(&device_attached_cond);
+	pthread_mutex_destroy(&scan_mutex);
+
+	if (threads_stop_pipe[0] >= 0) {
+		close(threads_stop_pipe[0]);
+		close(threads_stop_pipe[1]);
+	}
+
+	if (!IsValidClass())
+		return;
+
+	close(pollfd_iio[0].fd);
+	close(pollfd_iio[1].fd);
+}
+
+size_t HWSensorBase::GetReadBufferLenght()
+{
+	unsigned int hw_fifo_len;
+
+	if (sensor_t_data.fifoMaxEventCount > 0)
+		hw_fifo_len = sensor_t_data.fifoMaxEventCount;
+	else
+		hw_fifo_len = 1;
+
+	return hw_fifo_len * scan_size * HW_SENSOR_BASE_DEFAULT_IIO_BUFFER_LEN;
+}
+
+size_t HWSensorBase::GetDataBufferSize()
+{
+	size_t buffer_size = 0;
+
+	if (hasDataChannels()) {
+		buffer_size += MEMORY_ARENA_ALIGN(GetReadBufferLenght());
+#if (CONFIG_ST_HAL_REORDER_WINDOW_MS > 0)
+		buffer_size += GetReorderWindowSize();
+#endif /* CONFIG_ST_HAL_REORDER_WINDOW_MS */
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+		buffer_size += GetBatchBufferSize();
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+	}
+
+#if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_MARSHMALLOW_VERSION)
+	if (injection_mode == SENSOR_INJECTOR)
+		buffer_size += MEMORY_ARENA_ALIGN(scan_size);
+#endif /* CONFIG_ST_HAL_ANDROID_VERSION */
+
+	return buffer_size;
+}
+
+int HWSensorBase::AllocateDataBuffer()
+{
+	if (hasDataChannels() && !read_buffer) {
+		read_buffer = (uint8_t *)MemoryArena::Alloc(GetReadBufferLenght());
+		if (!read_buffer) {
+			ALOGE("%s: Failed to allocate sensor data buffer (size %d).",
+			      GetName(), (int)GetReadBufferLenght());
+			return -ENOMEM;
+		}
+
+#if (CONFIG_ST_HAL_REORDER_WINDOW_MS > 0)
+		if (AllocateReorderWindow() < 0) {
+			ALOGE("%s: Failed to allocate reorder window.", GetName());
+			return -ENOMEM;
+		}
+#endif /* CONFIG_ST_HAL_REORDER_WINDOW_MS */
+
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+		if (AllocateBatchBuffer() < 0) {
+			ALOGE("%s: Failed to allocate batch buffer.", GetName());
+			return -ENOMEM;
+		}
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+	}
+
+#if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_MARSHMALLOW_VERSION)
+	/* kept until the class is destroyed: no allocation on mode switch */
+	if ((injection_mode == SENSOR_INJECTOR) && !injection_data) {
+		injection_data = (uint8_t *)MemoryArena::Alloc(scan_size);
+		if (!injection_data)
+			return -ENOMEM;
+	}
+#endif /* CONFIG_ST_HAL_ANDROID_VERSION */
+
+	return 0;
+}
+
+int HWSensorBase::WriteBufferLenght(unsigned int buf_len)
+{
+	int err;
+	unsigned int hw_buf_fifo_len;
+	int64_t sysfs_start;
+
+	if (buf_len == 0)
+		hw_buf_fifo_len = 1;
+	else
+		hw_buf_fifo_len = buf_len;
+
+	/* written to the device by AttachDevice() */
+	if (device_detached.load()) {
+		hw_fifo_watermark = hw_buf_fifo_len;
+		return 0;
+	}
+
+	sysfs_start = SysfsWriteStart();
+	err = SysfsWriteDone(sysfs_start, device_iio_utils::set_hw_fifo_watermark(
+				common_data.device_iio_sysfs_path,
+				hw_buf_fifo_len));
+	if (err < 0) {
+		ALOGE("%s: Failed to write hw fifo watermark.", GetName());
+		return err;
+	}
+
+	hw_fifo_watermark = hw_buf_fifo_len;
+
+	return 0;
+}
+
+/**
+ * WriteDeviceConfig() - Write again the current configuration to the device
+ *
+ * Called with enable_mutex held when the device is recovered.
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int HWSensorBase::WriteDeviceConfig()
+{
+	if (hw_fifo_watermark > 0)
+		return WriteBufferLenght(hw_fifo_watermark);
+
+	return 0;
+}
+
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+/**
+ * UpdateBatchSpan() - Set how long events can wait in the batch buffer
+ *
+ * Called with enable_mutex held when the rates or the hw FIFO watermark
+ * change. Without a known sampling frequency events are not batched.
+ **/
+void HWSensorBase::UpdateBatchSpan()
+{
+	batch_span.store(0, std::memory_order_relaxed);
+}
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+
+/**
+ * RecoverDevice() - Reopen the iio buffer char device and restart the buffer
+ *
+ * Called by the data thread after repeated errors or a stall: the char
+ * device is closed and opened again and, if the sensor is enabled,
+ * configuration is written again and the iio buffer disabled and
+ * enabled to restart the hw FIFO.
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int HWSensorBase::RecoverDevice()
+{
+	int err = 0;
+	int64_t sysfs_start;
+
+	pthread_mutex_lock(&enable_mutex);
+
+	metrics.Inc(SENSOR_METRIC_DEVICE_REOPENS);
+
+	if (pollfd_iio[0].fd >= 0)
+		close(pollfd_iio[0].fd);
+
+	pollfd_iio[0].fd = device_iio_utils::open_buffer(common_data.device_iio_dev_num);
+	if (pollfd_iio[0].fd < 0) {
+		err = pollfd_iio[0].fd;
+		goto unlock_mutex;
+	}
+
+	/* events thread waits for the buffer char device after an attach */
+	pthread_cond_broadcast(&device_attached_cond);
+
+	if (!GetStatus(false))
+		goto unlock_mutex;
+
+	err = WriteDeviceConfig();
+	if (err < 0)
+		goto unlock_mutex;
+
+	sysfs_start = SysfsWriteStart();
+	err = SysfsWriteDone(sysfs_start, device_iio_utils::enable_sensor(
+				common_data.device_iio_sysfs_path, false,
+				common_data.channels,
+				common_data.num_channels));
+	if (err < 0)
+		goto unlock_mutex;
+
+	sysfs_start = SysfsWriteStart();
+	err = SysfsWriteDone(sysfs_start, device_iio_utils::enable_sensor(
+				common_data.device_iio_sysfs_path, true,
+				common_data.channels,
+				common_data.num_channels));
+
+unlock_mutex:
+	pthread_mutex_unlock(&enable_mutex);
+
+	return err;
+}
+
+/**
+ * ReopenEvents() - Get a new events fd from the iio buffer char device
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int HWSensorBase::ReopenEvents()
+{
+	int err = 0;
+
+	pthread_mutex_lock(&enable_mutex);
+
+	metrics.Inc(SENSOR_METRIC_DEVICE_REOPENS);
+
+	if (pollfd_iio[1].fd >= 0)
+		close(pollfd_iio[1].fd);
+
+	/* no data thread to open the buffer char device */
+	if ((pollfd_iio[0].fd < 0) && !hasDataChannels())
+		pollfd_iio[0].fd = device_iio_utils::open_buffer(common_data.device_iio_dev_num);
+
+	pollfd_iio[1].fd = device_iio_utils::open_events(common_data.device_iio_dev_num,
+							 pollfd_iio[0].fd);
+	if (pollfd_iio[1].fd < 0)
+		err = pollfd_iio[1].fd;
+
+	pthread_mutex_unlock(&enable_mutex);
+
+	return err;
+}
+
+/**
+ * DeviceError() - Handle a poll or read error of a data or events thread
+ * @errors: consecutive errors of the thread, incremented.
+ * @events: true for the events fd, false for the buffer char device.
+ * @err: negative errno.
+ *
+ * The thread sleeps for a backoff time doubling at every consecutive
+ * error, the fd is reopened every HW_SENSOR_BASE_ERRORS_BEFORE_REOPEN
+ * errors. Errors are logged when their count is a power of two. While
+ * the device is detached errors are expected, the thread is parked.
+ **/
+void HWSensorBase::DeviceError(unsigned int *errors, bool events, int err)
+{
+	unsigned int shift, backoff_ms;
+	struct pollfd stop_pollfd;
+
+	if (device_detached.load()) {
+		WaitDeviceAttached(events);
+		*errors = 0;
+		return;
+	}
+
+	(*errors)++;
+	metrics.Inc(SENSOR_METRIC_DEVICE_ERRORS);
+
+	if (!(*errors & (*errors - 1)))
+		ALOGE("%s: iio %s error (%d), %u consecutive errors.", GetName(),
+		      events ? "events" : "buffer", err, *errors);
+
+	shift = *errors - 1;
+	if (shift > 16)
+		shift = 16;
+
+	backoff_ms = HW_SENSOR_BASE_ERROR_BACKOFF_MIN_MS << shift;
+	if (backoff_ms > HW_SENSOR_BASE_ERROR_BACKOFF_MAX_MS)
+		backoff_ms = HW_SENSOR_BASE_ERROR_BACKOFF_MAX_MS;
+
+	/* StopThreads() ends the backoff */
+	stop_pollfd.fd = threads_stop_pipe[0];
+	stop_pollfd.events = POLLIN;
+	if (poll(&stop_pollfd, 1, backoff_ms) > 0)
+		return;
+
+	if (*errors % HW_SENSOR_BASE_ERRORS_BEFORE_REOPEN)
+		return;
+
+	err = events ? ReopenEvents() : RecoverDevice();
+	if (err < 0)
+		ALOGE("%s: Failed to reopen iio %s (%d).", GetName(),
+		      events ? "events" : "buffer", err);
+}
+
+/**
+ * WaitDeviceAttached() - Park a data or events thread while the device is detached
+ * @events: true for the events thread, false for the data thread.
+ *
+ * The thread closes its fd and sleeps until AttachDevice() or
+ * StopThreads(). After an attach the data
+ * thread reopens the buffer char device and restarts the buffer, the
+ * events thread waits for the buffer char device to get a new events fd.
+ **/
+void HWSensorBase::WaitDeviceAttached(bool events)
+{
+	int err, index = events ? 1 : 0;
+
+	pthread_mutex_lock(&enable_mutex);
+
+	if (pollfd_iio[index].fd >= 0) {
+		close(pollfd_iio[index].fd);
+		pollfd_iio[index].fd = -1;
+	}
+
+	while (!threads_stop.load() && (device_detached.load() ||
+	       (events && hasDataChannels() && (pollfd_iio[0].fd < 0))))
+		pthread_cond_wait(&device_attached_cond, &enable_mutex);
+
+	pthread_mutex_unlock(&enable_mutex);
+
+	if (threads_stop.load())
+		return;
+
+	err = events ? ReopenEvents() : RecoverDevice();
+	if (err < 0)
+		ALOGE("%s: Failed to open iio %s after attach (%d).", GetName(),
+		      events ? "events" : "buffer", err);
+}
+
+/**
+ * DetachDevice() - The iio device has been removed
+ *
+ * Data and events threads park at their next poll or read error, enable,
+ * batch and flush requests are applied to the sensor state only until
+ * AttachDevice().
+ **/
+void HWSensorBase::DetachDevice()
+{
+	pthread_mutex_lock(&enable_mutex);
+	device_detached.store(true);
+	metrics.Inc(SENSOR_METRIC_DEVICE_DETACHES);
+	pthread_mutex_unlock(&enable_mutex);
+
+	ALOGW("%s: iio:device%u removed.", GetName(),
+	      common_data.device_iio_dev_num);
+}
+
+/**
+ * AttachDevice() - Bind the sensor to a new instance of its iio device
+ * @data: iio device data read from sysfs.
+ *
+ * The scan layout must not change. Sampling frequency and hw fifo
+ * watermark are written to the new device, then data and events threads
+ * are woken up to reopen their fds and enable the buffer again if the
+ * sensor is enabled.
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int HWSensorBase::AttachDevice(HWSensorBaseCommonData *data)
+{
+	int err, k;
+	int64_t sysfs_start;
+
+	pthread_mutex_lock(&enable_mutex);
+
+	if (data->num_channels != common_data.num_channels)
+		goto layout_changed;
+
+	/* keep the channels in use */
+	for (k = 0; k < data->num_channels; k++)
+		data->channels[k].enabled = common_data.channels[k].enabled;
+
+	if (size_from_channelarray(data->channels, data->num_channels) != scan_size)
+		goto layout_changed;
+
+	memcpy(&common_data, data, sizeof(common_data));
+	UpdateSampleScale();
+
+	/* a new device starts with the kernel default clock */
+	SetupTimestampClock();
+
+	device_detached.store(false);
+	metrics.Inc(SENSOR_METRIC_DEVICE_ATTACHES);
+
+	err = WriteDeviceConfig();
+
+	/* buffer length is reset when the device is discovered again */
+	if ((err >= 0) && (iio_buffer_len > HW_SENSOR_BASE_DEFAULT_IIO_BUFFER_LEN)) {
+		sysfs_start = SysfsWriteStart();
+		err = SysfsWriteDone(sysfs_start, device_iio_utils::set_buffer_length(
+					common_data.device_iio_sysfs_path,
+					sensor_t_data.fifoMaxEventCount * iio_buffer_len));
+	}
+
+	if (err < 0)
+		ALOGE("%s: Failed to write configuration to iio:device%u (%d).",
+		      GetName(), common_data.device_iio_dev_num, err);
+
+	pthread_cond_broadcast(&device_attached_cond);
+
+	pthread_mutex_unlock(&enable_mutex);
+
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
+	ALOGD("%s: attached to iio:device%u.", GetName(),
+	      common_data.device_iio_dev_num);
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
+
+	return 0;
+
+layout_changed:
+	pthread_mutex_unlock(&enable_mutex);
+
+	ALOGE("%s: iio:device%u scan layout changed.", GetName(),
+	      data->device_iio_dev_num);
+
+	return -EINVAL;
+}
+
+/**
+ * SetupTimestampClock() - Select CLOCK_BOOTTIME for iio timestamps
+ *
+ * Sample timestamps are compared with enable, disable and flush times
+ * taken with elapsedRealtimeNano(). The clock in use is read back: when
+ * it can not be changed (buffer enabled, write rejected) samples and
+ * events are moved to CLOCK_BOOTTIME by UpdateTimestampClockOffset().
+ * Kernels without current_timestamp_clock are assumed to use it.
+ **/
+void HWSensorBase::SetupTimestampClock()
+{
+	int err;
+	clockid_t clock;
+
+	err = device_iio_utils::get_timestamp_clock(common_data.device_iio_sysfs_path,
+						    &clock);
+	if (err == -ENOENT) {
+		clock = CLOCK_BOOTTIME;
+	} else if ((err < 0) || (clock != CLOCK_BOOTTIME)) {
+		device_iio_utils::set_timestamp_clock(common_data.device_iio_sysfs_path,
+						      HW_SENSOR_BASE_TIMESTAMP_CLOCK);
+
+		err = device_iio_utils::get_timestamp_clock(common_data.device_iio_sysfs_path,
+							    &clock);
+		if (err < 0) {
+			ALOGE("%s: Failed to read iio:device%u timestamp clock (%d), CLOCK_BOOTTIME assumed.",
+			      GetName(), common_data.device_iio_dev_num, err);
+			clock = CLOCK_BOOTTIME;
+		} else if (clock != CLOCK_BOOTTIME) {
+			ALOGW("%s: iio:device%u timestamp clock %d can not be changed, aligned to CLOCK_BOOTTIME.",
+			      GetName(), common_data.device_iio_dev_num,
+			      (int)clock);
+		}
+	}
+
+	timestamp_clock = clock;
+	timestamp_clock_offset.store(0);
+	UpdateTimestampClockOffset();
+}
+
+/**
+ * UpdateTimestampClockOffset() - Measure the offset from the iio timestamps
+ * clock to CLOCK_BOOTTIME
+ *
+ * Measured at every read, so steps (suspend, clock set) and drift (NTP
+ * slew) between the two clocks are followed, a measure of a preempted
+ * thread keeps the previous value.
+ *
+ * Return value: offset to add to iio timestamps [ns].
+ **/
+int64_t HWSensorBase::UpdateTimestampClockOffset()
+{
+	struct timespec ts;
+	int64_t before, device, after;
+
+	if (timestamp_clock == CLOCK_BOOTTIME)
+		return 0;
+
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+	before = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	clock_gettime(timestamp_clock, &ts);
+	device = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+	after = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+
+	if ((after - before) < HW_SENSOR_BASE_CLOCK_READ_MAX_NS)
+		timestamp_clock_offset.store(before + (after - before) / 2 - device,
+					     std::memory_order_relaxed);
+
+	return timestamp_clock_offset.load(std::memory_order_relaxed);
+}
+
+/**
+ * GetRequiredScanChannels() - Get the scan channels read by the enabled
+ * sensors: this sensor and the sensors depending on it
+ *
+ * The axes are the union of the enabled sensors needs, the timestamp
+ * channel is read unless timestamps are estimated from the read time.
+ *
+ * Return value: SENSOR_SCAN_CHANNELS_* mask, 0 if none is enabled.
+ **/
+unsigned int HWSensorBase::GetRequiredScanChannels()
+{
+	unsigned int i, channels = 0;
+
+	if (GetStatusOfHandle(sensor_t_data.handle))
+		channels |= GetScanChannels();
+
+	for (i = 0; i < push_data.num; i++) {
+		if (GetStatusOfHandle(push_data.sb[i]->GetHandle()))
+			channels |= push_data.sb[i]->GetScanChannels();
+	}
+
+	channels &= SENSOR_SCAN_CHANNELS_DATA;
+#ifndef CONFIG_ST_HAL_SW_TIMESTAMP_NO_CHANNEL
+	if (channels)
+		channels |= SENSOR_SCAN_CHANNELS_TIMESTAMP;
+#endif /* CONFIG_ST_HAL_SW_TIMESTAMP_NO_CHANNEL */
+
+	return channels;
+}
+
+/**
+ * scan_channel_mask() - Get the SENSOR_SCAN_CHANNELS_* bit of a channel
+ * @channel: the channel info.
+ * @k: position of the channel, the raw[] value it is decoded to.
+ **/
+static unsigned int scan_channel_mask(const struct device_iio_info_channel *channel,
+				      int k)
+{
+	if (scan_channel_type(channel) == SENSOR_SCAN_CHANNELS_TIMESTAMP)
+		return SENSOR_SCAN_CHANNELS_TIMESTAMP;
+
+	return SENSOR_SCAN_CHANNELS_AXIS(k);
+}
+
+/**
+ * UpdateScanChannels() - Enable only the scan channels in use
+ * @channels: SENSOR_SCAN_CHANNELS_* mask.
+ * @running: buffer is enabled and must be restarted.
+ *
+ * Called with enable_mutex held. Scan layout and size are changed with
+ * scan_mutex held, so the data thread never decodes a read with the
+ * wrong layout. Scans of the old layout still queued are processed
+ * first while the buffer is running, like GrowBufferLength() does, and
+ * counted as dropped otherwise (left over by the last session).
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int HWSensorBase::UpdateScanChannels(unsigned int channels, bool running)
+{
+	int err = 0, k, read_size;
+	int64_t sysfs_start;
+
+	if (!channels || (channels == scan_channels))
+		return 0;
+
+	pthread_mutex_lock(&scan_mutex);
+
+	if (running) {
+		sysfs_start = SysfsWriteStart();
+		err = SysfsWriteDone(sysfs_start, device_iio_utils::enable_sensor(
+					common_data.device_iio_sysfs_path, false,
+					common_data.channels,
+					common_data.num_channels));
+		if (err < 0)
+			goto unlock_mutex;
+	}
+
+	if (read_buffer && (pollfd_iio[0].fd >= 0)) {
+		while ((read_size = read(pollfd_iio[0].fd, read_buffer,
+					 GetReadBufferLenght())) > 0) {
+			if (running)
+				ProcessRead(read_size);
+			else
+				metrics.Add(SENSOR_METRIC_SAMPLES_DROPPED,
+					    read_size / scan_size);
+		}
+	}
+
+	for (k = 0; k < common_data.num_channels; k++)
+		common_data.channels[k].enabled =
+			!!(channels & scan_channel_mask(&common_data.channels[k], k));
+
+	scan_size = size_from_channelarray(common_data.channels,
+					   common_data.num_channels);
+	scan_channels = channels;
+#ifdef CONFIG_ST_HAL_SW_TIMESTAMP
+	scan_timestamp_location = timestamp_location(common_data.channels,
+						     common_data.num_channels);
+#endif /* CONFIG_ST_HAL_SW_TIMESTAMP */
+
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
+	ALOGD("%s: scan size %d bytes (channels mask 0x%x).", GetName(),
+	      (int)scan_size, channels);
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
+
+	if (running) {
+		sysfs_start = SysfsWriteStart();
+		err = SysfsWriteDone(sysfs_start, device_iio_utils::enable_sensor(
+					common_data.device_iio_sysfs_path, true,
+					common_data.channels,
+					common_data.num_channels));
+	}
+
+unlock_mutex:
+	pthread_mutex_unlock(&scan_mutex);
+
+	return err;
+}
+
+/**
+ * GrowBufferLength() - Double the iio buffer length after recurring gaps
+ *
+ * Called by the data thread. The length can only be written with the
+ * buffer disabled, scans queued before are processed first.
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int HWSensorBase::GrowBufferLength()
+{
+	int err = 0, read_size;
+	unsigned int buffer_len;
+	int64_t sysfs_start;
+
+	pthread_mutex_lock(&enable_mutex);
+
+	gaps_at_buffer_grow = metrics.Get(SENSOR_METRIC_SAMPLE_GAPS);
+
+	if ((iio_buffer_len >= HW_SENSOR_BASE_MAX_IIO_BUFFER_LEN) ||
+	    !sensor_t_data.fifoMaxEventCount || !GetStatus(false) ||
+	    device_detached.load())
+		goto unlock_mutex;
+
+	sysfs_start = SysfsWriteStart();
+	err = SysfsWriteDone(sysfs_start, device_iio_utils::enable_sensor(
+				common_data.device_iio_sysfs_path, false,
+				common_data.channels,
+				common_data.num_channels));
+	if (err < 0)
+		goto unlock_mutex;
+
+	pthread_mutex_lock(&scan_mutex);
+	while ((read_size = read(pollfd_iio[0].fd, read_buffer,
+				 GetReadBufferLenght())) > 0)
+		ProcessRead(read_size);
+	pthread_mutex_unlock(&scan_mutex);
+
+	buffer_len = iio_buffer_len * 2;
+	if (buffer_len > HW_SENSOR_BASE_MAX_IIO_BUFFER_LEN)
+		buffer_len = HW_SENSOR_BASE_MAX_IIO_BUFFER_LEN;
+
+	sysfs_start = SysfsWriteStart();
+	err = SysfsWriteDone(sysfs_start, device_iio_utils::set_buffer_length(
+				common_data.device_iio_sysfs_path,
+				sensor_t_data.fifoMaxEventCount * buffer_len));
+	if (err >= 0) {
+		iio_buffer_len = buffer_len;
+		metrics.Inc(SENSOR_METRIC_BUFFER_GROWS);
+
+		ALOGW("%s: %" PRIu64 " sample gaps, iio buffer length raised to %u samples.",
+		      GetName(), gaps_at_buffer_grow,
+		      sensor_t_data.fifoMaxEventCount * buffer_len);
+	}
+
+	/* sampling stopped meanwhile, not a gap */
+	last_scan_timestamp = 0;
+
+	sysfs_start = SysfsWriteStart();
+	err = SysfsWriteDone(sysfs_start, device_iio_utils::enable_sensor(
+				common_data.device_iio_sysfs_path, true,
+				common_data.channels,
+				common_data.num_channels));
+
+unlock_mutex:
+	pthread_mutex_unlock(&enable_mutex);
+
+	return err;
+}
+
+#ifdef CONFIG_ST_HAL_ADAPTIVE_WATERMARK
+/**
+ * WatermarkUpdate() - Account the delivery delay of a read
+ * @watermark: adaptive watermark of the data thread.
+ * @samples: number of samples of the read.
+ *
+ * Called by the data thread after the samples are delivered. The
+ * watermark is adjusted at the end of the window, the window restarts
+ * when the sampling period or the max report latency changes.
+ **/
+void HWSensorBase::WatermarkUpdate(struct hw_sensor_base_watermark *watermark,
+				   unsigned int samples)
+{
+	int64_t now, delay, timeout;
+
+	/* data thread: rates published by SetDelay() */
+	timeout = GetMinTimeoutSnapshot();
+
+	/* no hw timestamp or no batching, nothing to adapt */
+	if (!samples || !last_scan_timestamp || (scan_pollrate <= 0) ||
+	    !sensor_t_data.fifoMaxEventCount || (timeout == INT64_MAX) ||
+	    (timeout < 2 * scan_pollrate)) {
+		watermark->period = 0;
+		return;
+	}
+
+	now = elapsedRealtimeNano();
+
+	if ((watermark->period != scan_pollrate) ||
+	    (watermark->timeout != timeout)) {
+		watermark->period = scan_pollrate;
+		watermark->timeout = timeout;
+		watermark->window = HW_SENSOR_BASE_WATERMARK_WINDOW_MS * 1000000LL;
+		watermark->window_start = now;
+		watermark->delay_max = 0;
+		watermark->latency_max = 0;
+		watermark->reads = 0;
+
+		return;
+	}
+
+	delay = now - last_scan_timestamp;
+	if (delay > watermark->delay_max)
+		watermark->delay_max = delay;
+
+	delay += (samples - 1) * scan_pollrate;
+	if (delay > watermark->latency_max)
+		watermark->latency_max = delay;
+
+	watermark->reads++;
+
+	if ((now - watermark->window_start < watermark->window) ||
+	    (watermark->reads < HW_SENSOR_BASE_WATERMARK_WINDOW_READS))
+		return;
+
+	WatermarkAdjust(watermark);
+
+	watermark->window_start = now;
+	watermark->delay_max = 0;
+	watermark->latency_max = 0;
+	watermark->reads = 0;
+}
+
+/**
+ * WatermarkAdjust() - Set the watermark at the end of a window
+ * @watermark: adaptive watermark of the data thread.
+ *
+ * The oldest sample of a read waits (watermark - 1) periods in the FIFO
+ * plus the read delay, the largest watermark keeping it within the max
+ * report latency wakes the data thread (and the system) the least.
+ **/
+void HWSensorBase::WatermarkAdjust(struct hw_sensor_base_watermark *watermark)
+{
+	int64_t target, limit;
+	unsigned int current;
+	bool busy, exceeded;
+
+	limit = watermark->timeout / watermark->period;
+	if (limit > sensor_t_data.fifoMaxEventCount)
+		limit = sensor_t_data.fifoMaxEventCount;
+
+	target = (watermark->timeout - watermark->delay_max) / watermark->period + 1;
+	if (target > limit)
+		target = limit;
+	else if (target < 1)
+		target = 1;
+
+	busy = watermark->delay_max > HW_SENSOR_BASE_WATERMARK_BUSY_DELAY_US * 1000LL;
+	exceeded = watermark->latency_max > watermark->timeout;
+
+	/* fewer adjustments, and wakeups, while the CPU is busy */
+	if (busy) {
+		watermark->window *= 2;
+		if (watermark->window > HW_SENSOR_BASE_WATERMARK_MAX_BACKOFF *
+					HW_SENSOR_BASE_WATERMARK_WINDOW_MS * 1000000LL)
+			watermark->window = HW_SENSOR_BASE_WATERMARK_MAX_BACKOFF *
+					    HW_SENSOR_BASE_WATERMARK_WINDOW_MS * 1000000LL;
+	} else {
+		watermark->window = HW_SENSOR_BASE_WATERMARK_WINDOW_MS * 1000000LL;
+	}
+
+	pthread_mutex_lock(&enable_mutex);
+
+	/* configuration changed meanwhile, SetDelay() wrote the watermark */
+	if (!GetStatus(false) || device_detached.load() ||
+	    (GetMinTimeout(false) != watermark->timeout))
+		goto unlock_mutex;
+
+	current = hw_fifo_watermark;
+	if (target == current)
+		goto unlock_mutex;
+
+	if (target < current) {
+		if (!exceeded && (busy ||
+		    ((current - target) * HW_SENSOR_BASE_WATERMARK_HYSTERESIS < current)))
+			goto unlock_mutex;
+	} else {
+		if (!busy &&
+		    ((target - current) * HW_SENSOR_BASE_WATERMARK_HYSTERESIS < current))
+			goto unlock_mutex;
+	}
+
+	if (WriteBufferLenght(target) < 0)
+		goto unlock_mutex;
+
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+	/* the hw FIFO now holds more or less of the max report latency */
+	UpdateBatchSpan();
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+
+	metrics.Inc(SENSOR_METRIC_WATERMARK_UPDATES);
+
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
+	ALOGD("\"%s\": watermark %u -> %u (read delay %" PRId64 "us, latency %" PRId64 "ms of %" PRId64 "ms).",
+	      GetName(), current, (unsigned int)target,
+	      watermark->delay_max / 1000, watermark->latency_max / 1000000,
+	      watermark->timeout / 1000000);
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
+
+unlock_mutex:
+	pthread_mutex_unlock(&enable_mutex);
+}
+#endif /* CONFIG_ST_HAL_ADAPTIVE_WATERMARK */
+
+/**
+ * WatchdogTimeout() - Update the watchdog and get the data thread poll timeout
+ * @watchdog: watchdog of the data thread.
+ *
+ * The window restarts when the requested period or max report latency
+ * changes, the watchdog stops while the sensor is disabled.
+ *
+ * Return value: poll() timeout [ms], -1 when the watchdog is stopped.
+ **/
+int HWSensorBase::WatchdogTimeout(struct hw_sensor_base_watchdog *watchdog)
+{
+	int64_t period = 0, timeout = 0, latency, now, remaining;
+
+	/* data thread: atomic enable mask and rates published by SetDelay() */
+	if (GetStatus(false) && !device_detached.load()) {
+		period = GetMinPeriodSnapshot();
+		timeout = GetMinTimeoutSnapshot();
 	}
 
-	pollfd_iio[0].events = POLLIN;
+#ifdef CONFIG_ST_HAL_CAPTURE
+	/* simulated devices are muted while replaying */
+	if (SensorCapture::GetReplayTime())
+		period = 0;
+#endif /* CONFIG_ST_HAL_CAPTURE */
 
-	if (!ioctl(pollfd_iio[0].fd,
-		   _IOR('i', 0x90, int),
-		   &pollfd_iio[1].fd)) {
-		pollfd_iio[1].events = POLLIN;
-		has_event_channels = true;
-	} else {
-		has_event_channels= false;
+	if (period <= 0) {
+		watchdog->period = 0;
+		return -1;
 	}
 
-#if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_MARSHMALLOW_VERSION)
-	err = device_iio_utils::support_injection_mode(common_data.device_iio_sysfs_path);
-	switch (err) {
-	case 0:
-#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
-		ALOGD("\"%s\": injection mode available, sensor is an injector.",
-		      GetName());
-#endif /* CONFIG_ST_HAL_DEBUG_INFO */
-		sensor_t_data.flags |= DATA_INJECTION_MASK;
-		injection_mode = SENSOR_INJECTOR;
-		break;
+	now = elapsedRealtimeNano();
 
-	case 1:
-#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
-		ALOGD("\"%s\": injection mode available, sensor is injected.",
-		      GetName());
-#endif /* CONFIG_ST_HAL_DEBUG_INFO */
-		sensor_t_data.flags |= DATA_INJECTION_MASK;
-		injection_mode = SENSOR_INJECTED;
-		break;
+	if ((watchdog->period != period) || (watchdog->timeout != timeout)) {
+		latency = period;
+		if ((timeout > 0) && (timeout < INT64_MAX)) {
+			if ((sensor_t_data.fifoMaxEventCount > 0) &&
+			    (timeout / period > sensor_t_data.fifoMaxEventCount))
+				latency += period * sensor_t_data.fifoMaxEventCount;
+			else
+				latency += timeout;
+		}
 
-	default:
-#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
-		ALOGD("\"%s\": injection mode not available.", GetName());
-#endif /* CONFIG_ST_HAL_DEBUG_INFO */
-		sensor_t_data.flags &= ~DATA_INJECTION_MASK;
-		break;
-	}
-#endif /* CONFIG_ST_HAL_ANDROID_VERSION */
+		watchdog->period = period;
+		watchdog->timeout = timeout;
+		watchdog->window = HW_SENSOR_BASE_WATCHDOG_WINDOW_LATENCIES * latency;
+		if (watchdog->window < HW_SENSOR_BASE_WATCHDOG_WINDOW_MIN_MS * 1000000LL)
+			watchdog->window = HW_SENSOR_BASE_WATCHDOG_WINDOW_MIN_MS * 1000000LL;
 
-#if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_PIE_VERSION)
-#if (CONFIG_ST_HAL_ADDITIONAL_INFO_ENABLED)
-	sensor_t_data.flags |= SENSOR_FLAG_ADDITIONAL_INFO;
-	supportsSensorAdditionalInfo = false;
-#endif /* CONFIG_ST_HAL_ADDITIONAL_INFO_ENABLED */
-#endif /* CONFIG_ST_HAL_ANDROID_VERSION */
-	free(buffer_path);
+		watchdog->window_start = now;
+		watchdog->samples_start = metrics.Get(SENSOR_METRIC_SAMPLES_READ);
+		watchdog->stalls = 0;
+	}
 
-	return;
+	remaining = watchdog->window_start + watchdog->window - now;
+	if (remaining <= 0)
+		return 0;
 
-free_buffer_path:
-	free(buffer_path);
-invalid_this_class:
-	InvalidThisClass();
+	return (int)(remaining / 1000000LL) + 1;
 }
 
-HWSensorBase::~HWSensorBase()
+/**
+ * WatchdogCheck() - Check the sample rate at the end of a watchdog window
+ * @watchdog: watchdog of the data thread.
+ **/
+void HWSensorBase::WatchdogCheck(struct hw_sensor_base_watchdog *watchdog)
 {
-	if (!IsValidClass())
+	int64_t now, elapsed;
+	uint64_t samples, expected;
+	int err;
+
+	if (!watchdog->period)
 		return;
 
-	close(pollfd_iio[0].fd);
-	close(pollfd_iio[1].fd);
-}
+	now = elapsedRealtimeNano();
+	elapsed = now - watchdog->window_start;
+	if (elapsed < watchdog->window)
+		return;
 
-int HWSensorBase::WriteBufferLenght(unsigned int buf_len)
-{
-	int err;
-	unsigned int hw_buf_fifo_len;
+	samples = metrics.Get(SENSOR_METRIC_SAMPLES_READ) - watchdog->samples_start;
+	expected = elapsed / watchdog->period;
 
-	if (buf_len == 0)
-		hw_buf_fifo_len = 1;
-	else
-		hw_buf_fifo_len = buf_len;
+	if (samples * 100 < expected * HW_SENSOR_BASE_WATCHDOG_MIN_RATE_PCT) {
+		metrics.Inc(SENSOR_METRIC_WATCHDOG_STALLS);
+		watchdog->stalls++;
 
-	err = device_iio_utils::set_hw_fifo_watermark(common_data.device_iio_sysfs_path,
-						      hw_buf_fifo_len);
-	if (err < 0) {
-		ALOGE("%s: Failed to write hw fifo watermark.", GetName());
-		return err;
-	}
+		ALOGE("%s: %" PRIu64 " samples read in %" PRId64 "ms, %" PRIu64 " expected.",
+		      GetName(), samples, (int64_t)(elapsed / 1000000LL), expected);
 
-	return 0;
-}
+		if (watchdog->stalls >= HW_SENSOR_BASE_WATCHDOG_STALLS_BEFORE_RECOVERY) {
+			ALOGW("%s: iio device stalled, recovering.", GetName());
 
-static int64_t elapsedRealtimeNano()
-{
-#ifdef PLTF_LINUX_ENABLED
-    struct timespec ts;
-    int err = clock_gettime(CLOCK_BOOTTIME, &ts);
-    if (err) {
-        ALOGE("clock_gettime(CLOCK_BOOTTIME) failed: %s", strerror(errno));
-        return 0;
-    }
-    return (ts.tv_sec * 1000000000) + ts.tv_nsec;
-#else
-    return android::elapsedRealtimeNano();
-#endif
+			err = RecoverDevice();
+			if (err < 0)
+				ALOGE("%s: Failed to recover iio device (%d).",
+				      GetName(), err);
+
+			watchdog->stalls = 0;
+		}
+	} else {
+		watchdog->stalls = 0;
+	}
+
+	watchdog->window_start = now;
+	watchdog->samples_start = metrics.Get(SENSOR_METRIC_SAMPLES_READ);
 }
 
 int HWSensorBase::Enable(int handle, bool enable, bool lock_en_mutex)
 {
 	int err = 0;
 	bool old_status, old_status_no_handle;
+	int64_t sysfs_start;
 
 
 	if (lock_en_mutex)
@@ -382,31 +1243,69 @@ int HWSensorBase::Enable(int handle, bool enable, bool lock_en_mutex)
 		goto unlock_mutex;
 
 	if ((enable && !old_status) || (!enable && !old_status_no_handle)) {
-		err = device_iio_utils::enable_sensor(common_data.device_iio_sysfs_path,
-						      GetStatus(false));
+		if (enable) {
+			err = UpdateScanChannels(GetRequiredScanChannels(),
+						 false);
+			if (err < 0)
+				goto restore_status_enable;
+		}
+
+		/* buffer is enabled by the data thread once attached */
+		if (!device_detached.load()) {
+			sysfs_start = SysfsWriteStart();
+			err = SysfsWriteDone(sysfs_start, device_iio_utils::enable_sensor(
+						common_data.device_iio_sysfs_path,
+						GetStatus(false),
+						common_data.channels,
+						common_data.num_channels));
+			if (err < 0) {
+				ALOGE("%s: Failed to enable iio sensor device.", GetName());
+				goto restore_status_enable;
+			}
+		}
+
+		if (enable) {
+#ifdef CONFIG_ST_HAL_SW_TIMESTAMP
+			/* phase and period of the last session are stale */
+			timestamp_estimator_reset.store(true,
+							std::memory_order_release);
+#endif /* CONFIG_ST_HAL_SW_TIMESTAMP */
+			sensor_global_enable.store(elapsedRealtimeNano(),
+						   std::memory_order_release);
+		} else
+			sensor_global_disable.store(elapsedRealtimeNano(),
+						    std::memory_order_release);
+	} else if (old_status) {
+		/* sensors reading other channels enabled or disabled */
+		err = UpdateScanChannels(GetRequiredScanChannels(),
+					 !device_detached.load());
 		if (err < 0) {
-			ALOGE("%s: Failed to enable iio sensor device.", GetName());
+			ALOGE("%s: Failed to change iio scan channels.", GetName());
 			goto restore_status_enable;
 		}
-
-		if (enable)
-			sensor_global_enable = elapsedRealtimeNano();
-		else
-			sensor_global_disable = elapsedRealtimeNano();
 	}
 
 	if (sensor_t_data.handle == handle) {
 		if (enable) {
-			sensor_my_enable = elapsedRealtimeNano();
+			sensor_my_enable.store(elapsedRealtimeNano(),
+					       std::memory_order_release);
 #if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_PIE_VERSION)
 #if (CONFIG_ST_HAL_ADDITIONAL_INFO_ENABLED)
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_EXTRA_VERBOSE)
 			ALOGD("%s:SAINFO Report: ENABLE.", GetName());
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
 			WriteSAIReportToPipe();
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_EXTRA_VERBOSE)
 			ALOGD("%s : SAI ENABLE Report.", GetName());
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
 #endif /* CONFIG_ST_HAL_ADDITIONAL_INFO_ENABLED */
 #endif /* CONFIG_ST_HAL_ANDROID_VERSION */
 		} else {
-			sensor_my_disable = elapsedRealtimeNano();
+			sensor_my_disable.store(elapsedRealtimeNano(),
+						std::memory_order_release);
+
+			/* held samples were taken before the disable */
+			DrainHeldEvents();
 		}
 	}
 
@@ -553,13 +1452,15 @@ void HWSensorBase::ProcessEvent(struct device_iio_events *event_data)
 	if ((event_type == DEVICE_IIO_EV_TYPE_FIFO_FLUSH)  ||
 	    (event_dir == DEVICE_IIO_EV_DIR_FIFO_DATA))
 		ProcessFlushData(sensor_t_data.handle,
-				 event_data->event_timestamp);
+				 event_data->event_timestamp +
+				 UpdateTimestampClockOffset());
 }
 
 int HWSensorBase::FlushData(int handle, bool lock_en_mutex)
 {
 	int err;
 	unsigned int i;
+	int64_t sysfs_start;
 
 	if (lock_en_mutex)
 		pthread_mutex_lock(&enable_mutex);
@@ -570,11 +1471,14 @@ int HWSensorBase::FlushData(int handle, bool lock_en_mutex)
 			goto unlock_mutex;
 
 		if ((GetMinTimeout(false) > 0) &&
-		    (GetMinTimeout(false) < INT64_MAX)) {
+		    (GetMinTimeout(false) < INT64_MAX) &&
+		    !device_detached.load()) {
 			for (i = 0; i < dependencies.num; i++)
 				dependencies.sb[i]->FlushData(sensor_t_data.handle, true);
 
-			err = device_iio_utils::hw_fifo_flush(common_data.device_iio_sysfs_path);
+			sysfs_start = SysfsWriteStart();
+			err = SysfsWriteDone(sysfs_start, device_iio_utils::hw_fifo_flush(
+						common_data.device_iio_sysfs_path));
 			if (err < 0) {
 				ALOGE("%s: Failed to flush hw fifo.",
 				      GetName());
@@ -619,9 +1523,13 @@ void HWSensorBase::ProcessFlushData(int __attribute__((unused))handle,
 			WriteFlushEventToPipe();
 #if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_PIE_VERSION)
 #if (CONFIG_ST_HAL_ADDITIONAL_INFO_ENABLED)
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_EXTRA_VERBOSE)
 			ALOGD("%s:SAINFO Report: FLUSH.", GetName());
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
 			WriteSAIReportToPipe();
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_EXTRA_VERBOSE)
 			ALOGD("%s : SAI FLUSH Report.", GetName());
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
 #endif /* CONFIG_ST_HAL_ADDITIONAL_INFO_ENABLED */
 #endif /* CONFIG_ST_HAL_ANDROID_VERSION */
 		} else {
@@ -634,102 +1542,413 @@ void HWSensorBase::ProcessFlushData(int __attribute__((unused))handle,
 	pthread_mutex_unlock(&sample_in_processing_mutex);
 }
 
-void HWSensorBase::ThreadDataTask()
+/**
+ * CheckSampleGap() - Account samples missing before a scan
+ * @timestamp: hw timestamp of the scan, CLOCK_BOOTTIME.
+ *
+ * The first scan after enable, an odr switch or a buffer restart only
+ * sets the reference.
+ **/
+void HWSensorBase::CheckSampleGap(int64_t timestamp)
 {
-	uint8_t *data;
-	unsigned int hw_fifo_len;
+	int64_t delta = timestamp - last_scan_timestamp;
+	uint64_t gaps;
+
+	if ((scan_pollrate > 0) &&
+	    (last_scan_timestamp > sensor_global_enable.load(std::memory_order_relaxed)) &&
+	    (delta * 100 > scan_pollrate * HW_SENSOR_BASE_GAP_PERIOD_PCT)) {
+		metrics.Inc(SENSOR_METRIC_SAMPLE_GAPS);
+		metrics.Add(SENSOR_METRIC_SAMPLES_MISSING,
+			    (delta + scan_pollrate / 2) / scan_pollrate - 1);
+		metrics.Add(SENSOR_METRIC_SAMPLE_GAP_NS, delta - scan_pollrate);
+
+		/* rate limited: 1st, 2nd, 4th, 8th... gap */
+		gaps = metrics.Get(SENSOR_METRIC_SAMPLE_GAPS);
+		if ((gaps & (gaps - 1)) == 0)
+			ALOGW("%s: no samples for %" PRId64 "us (ODR period %" PRId64 "us), %" PRIu64 " gaps.",
+			      GetName(), delta / 1000, scan_pollrate / 1000, gaps);
+	}
+
+	last_scan_timestamp = timestamp;
+}
+
+/**
+ * ProcessScanBatch() - Decode scans read from iio buffer and push them to
+ * ProcessData()
+ * @data: scans read from iio char device.
+ * @read_size: number of bytes read.
+ **/
+void HWSensorBase::ProcessScanBatch(uint8_t *data, int read_size)
+{
+	int err, i, flush_handle;
+	unsigned int decoded = 0, dropped = 0;
 	SensorBaseData sensor_data;
-	int err, i, read_size, flush_handle;
-	int64_t timestamp_flush, timestamp_odr_switch, new_pollrate = 0;
-	int64_t old_pollrate = 0;
+	int64_t timestamp_flush, timestamp_odr_switch, new_pollrate;
+	int64_t clock_offset = UpdateTimestampClockOffset();
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+	int64_t decode_time = elapsedRealtimeNano();
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+#ifdef CONFIG_ST_HAL_SW_TIMESTAMP
+	int64_t reference;
+	unsigned int samples = read_size / scan_size;
+
+	/* set by Enable() when the sensor powers on */
+	if (timestamp_estimator_reset.exchange(false, std::memory_order_acquire))
+		timestamp_estimator.Reset();
+
+	if (samples) {
+		/* hw timestamp of the last scan, else the read time */
+		if (scan_timestamp_location >= 0)
+			reference = *(int64_t *)(data + (samples - 1) * scan_size +
+						 scan_timestamp_location) +
+				    clock_offset;
+		else
+			reference = elapsedRealtimeNano();
 
-	if (sensor_t_data.fifoMaxEventCount > 0)
-		hw_fifo_len = sensor_t_data.fifoMaxEventCount;
-	else
-		hw_fifo_len = 1;
+		/* period of the batch, an odr switch applies from its time */
+		new_pollrate = scan_pollrate;
+		if (odr_switch.readLastElement(&new_pollrate) > reference)
+			new_pollrate = scan_pollrate;
 
-	data = (uint8_t *)malloc(hw_fifo_len * scan_size * HW_SENSOR_BASE_DEFAULT_IIO_BUFFER_LEN * sizeof(uint8_t));
-	if (!data) {
-		ALOGE("%s: Failed to allocate sensor data buffer (fifo_len %d, scan_size %d).",
-		      GetName(), hw_fifo_len, (int)scan_size);
-		return;
+		if (timestamp_estimator.Update(new_pollrate, samples, reference))
+			metrics.Inc(SENSOR_METRIC_TIMESTAMP_RESYNCS);
+	}
+#endif /* CONFIG_ST_HAL_SW_TIMESTAMP */
+
+	for (i = 0; i < (read_size / scan_size); i++) {
+#ifdef CONFIG_ST_HAL_STAGE_PROFILING
+		profiler.Begin();
+#endif /* CONFIG_ST_HAL_STAGE_PROFILING */
+
+		err = ProcessScanData(data + (i * scan_size),
+				      common_data.channels,
+				      common_data.num_channels,
+				      sample_scale,
+				      &sensor_data);
+		if (err < 0) {
+			dropped++;
+			continue;
+		}
+
+#ifdef CONFIG_ST_HAL_SW_TIMESTAMP
+		sensor_data.timestamp = timestamp_estimator.GetTimestamp(i);
+#else /* CONFIG_ST_HAL_SW_TIMESTAMP */
+		/* enable, disable and flush times are CLOCK_BOOTTIME */
+		sensor_data.timestamp += clock_offset;
+#endif /* CONFIG_ST_HAL_SW_TIMESTAMP */
+
+#ifdef CONFIG_ST_HAL_STAGE_PROFILING
+		profiler.Mark(SENSOR_PROFILE_DECODE, 1);
+#endif /* CONFIG_ST_HAL_STAGE_PROFILING */
+
+		decoded++;
+
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+		RecordLatency(SENSOR_LATENCY_DECODE, sensor_data.timestamp,
+			      decode_time);
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+
+		pthread_mutex_lock(&sample_in_processing_mutex);
+		sample_in_processing_timestamp = sensor_data.timestamp;
+		pthread_mutex_unlock(&sample_in_processing_mutex);
+
+		new_pollrate = scan_pollrate;
+		timestamp_odr_switch = odr_switch.readLastElement(&new_pollrate);
+		if (sensor_data.timestamp > timestamp_odr_switch) {
+			if (new_pollrate != scan_pollrate) {
+				metrics.Inc(SENSOR_METRIC_ODR_SWITCHES);
+				last_scan_timestamp = 0;
+			}
+
+			scan_pollrate = new_pollrate;
+			odr_switch.removeLastElement();
+		}
+		sensor_data.pollrate_ns = scan_pollrate;
+
+#ifdef CONFIG_ST_HAL_SW_TIMESTAMP
+		if (scan_timestamp_location >= 0)
+			CheckSampleGap(*(int64_t *)(data + (i * scan_size) +
+						    scan_timestamp_location) +
+				       clock_offset);
+#else /* CONFIG_ST_HAL_SW_TIMESTAMP */
+		CheckSampleGap(sensor_data.timestamp);
+#endif /* CONFIG_ST_HAL_SW_TIMESTAMP */
+
+		flush_handle = flush_stack.readLastElement(&timestamp_flush);
+		if ((flush_handle >= 0) &&
+		    (timestamp_flush <= sensor_data.timestamp)) {
+			sensor_data.flush_event_handle = flush_handle;
+			flush_stack.removeLastElement();
+		} else {
+			sensor_data.flush_event_handle = -1;
+		}
+
+		ST_HAL_TRACE_BEGIN("%s ProcessData", GetName());
+		ProcessData(&sensor_data);
+		ST_HAL_TRACE_END();
 	}
 
-	while (true) {
-		err = poll(&pollfd_iio[0], 1, -1);
-		if (err <= 0)
+	metrics.Add(SENSOR_METRIC_SAMPLES_DECODED, decoded);
+	if (dropped)
+		metrics.Add(SENSOR_METRIC_SAMPLES_DROPPED, dropped);
+}
+
+/**
+ * ProcessRead() - Process the scans read in read_buffer
+ * @read_size: number of bytes read.
+ *
+ * Called with scan_mutex held.
+ **/
+void HWSensorBase::ProcessRead(int read_size)
+{
+#ifdef CONFIG_ST_HAL_CAPTURE
+	SensorCapture::Record(SENSOR_CAPTURE_SCAN, sensor_t_data.handle,
+			      read_buffer, read_size);
+#endif /* CONFIG_ST_HAL_CAPTURE */
+
+	metrics.Inc(SENSOR_METRIC_FIFO_READS);
+	metrics.Add(SENSOR_METRIC_SAMPLES_READ, read_size / scan_size);
+
+	ST_HAL_TRACE_BEGIN("%s ProcessScanData batch %d",
+			   GetName(), (int)(read_size / scan_size));
+	ProcessScanBatch(read_buffer, read_size);
+	ST_HAL_TRACE_END();
+}
+
+void HWSensorBase::ThreadDataTask()
+{
+	int err, read_size;
+	unsigned int errors = 0;
+	struct pollfd pollfd_data[2];
+	struct hw_sensor_base_watchdog watchdog;
+#ifdef CONFIG_ST_HAL_ADAPTIVE_WATERMARK
+	unsigned int samples;
+	struct hw_sensor_base_watermark watermark;
+#endif /* CONFIG_ST_HAL_ADAPTIVE_WATERMARK */
+
+	/* normally done at open time, from MemoryArena */
+	err = AllocateDataBuffer();
+	if (err < 0)
+		return;
+
+	memset(&watchdog, 0, sizeof(watchdog));
+#ifdef CONFIG_ST_HAL_ADAPTIVE_WATERMARK
+	memset(&watermark, 0, sizeof(watermark));
+#endif /* CONFIG_ST_HAL_ADAPTIVE_WATERMARK */
+
+	pollfd_data[1].fd = threads_stop_pipe[0];
+	pollfd_data[1].events = POLLIN;
+
+	while (!threads_stop.load()) {
+		if ((pollfd_iio[0].fd < 0) || device_detached.load()) {
+			DeviceError(&errors, false, -EBADF);
+			continue;
+		}
+
+		/* the buffer fd changes when the device is recovered */
+		pollfd_data[0] = pollfd_iio[0];
+
+		ST_HAL_TRACE_BEGIN("%s poll", GetName());
+		err = poll(pollfd_data, 2,
+			   HeldEventsTimeout(WatchdogTimeout(&watchdog)));
+		ST_HAL_TRACE_END();
+		if (pollfd_data[1].revents)
+			break;
+
+		if (err < 0) {
+			if (errno != EINTR)
+				DeviceError(&errors, false, -errno);
+
+			continue;
+		}
+
+		if (err == 0) {
+			ReleaseExpiredEvents();
+			WatchdogCheck(&watchdog);
 			continue;
+		}
+
+		metrics.Inc(SENSOR_METRIC_WAKEUPS);
+
+		if (pollfd_data[0].revents & POLLIN) {
+			/*
+			 * scan layout can not change until the batch is
+			 * decoded, read whole scans of the current layout
+			 */
+			pthread_mutex_lock(&scan_mutex);
 
-		if (pollfd_iio[0].revents & POLLIN) {
-			read_size = read(pollfd_iio[0].fd, data,
-					 hw_fifo_len * scan_size * HW_SENSOR_BASE_DEFAULT_IIO_BUFFER_LEN);
+			read_size = read(pollfd_iio[0].fd, read_buffer,
+					 GetReadBufferLenght());
+			ST_HAL_TRACE_COUNTER(GetName(), "read_size", read_size);
 			if (read_size <= 0) {
-				ALOGE("%s: Failed to read data from iio char device.",
-				      GetName());
-				continue;
-			}
+				pthread_mutex_unlock(&scan_mutex);
 
-			for (i = 0; i < (read_size / scan_size); i++) {
-				err = ProcessScanData(data + (i * scan_size),
-						      common_data.channels,
-						      common_data.num_channels,
-						      &sensor_data);
-				if (err < 0)
+				if ((read_size < 0) &&
+				    ((errno == EAGAIN) || (errno == EINTR)))
 					continue;
 
-				pthread_mutex_lock(&sample_in_processing_mutex);
-				sample_in_processing_timestamp = sensor_data.timestamp;
-				pthread_mutex_unlock(&sample_in_processing_mutex);
-
-				timestamp_odr_switch = odr_switch.readLastElement(&new_pollrate);
-				if (sensor_data.timestamp > timestamp_odr_switch) {
-					sensor_data.pollrate_ns = new_pollrate;
-					old_pollrate = new_pollrate;
-					odr_switch.removeLastElement();
-				} else {
-					sensor_data.pollrate_ns = old_pollrate;
-				}
-
-				flush_handle = flush_stack.readLastElement(&timestamp_flush);
-				if ((flush_handle >= 0) &&
-				    (timestamp_flush <= sensor_data.timestamp)) {
-					sensor_data.flush_event_handle = flush_handle;
-					flush_stack.removeLastElement();
-				} else {
-					sensor_data.flush_event_handle = -1;
-				}
-
-				ProcessData(&sensor_data);
+				DeviceError(&errors, false,
+					    read_size < 0 ? -errno : -ENODATA);
+				continue;
+			}
+
+			if (errors) {
+				ALOGD("%s: iio buffer recovered after %u errors.",
+				      GetName(), errors);
+				errors = 0;
 			}
+
+			ProcessRead(read_size);
+#ifdef CONFIG_ST_HAL_ADAPTIVE_WATERMARK
+			samples = read_size / scan_size;
+#endif /* CONFIG_ST_HAL_ADAPTIVE_WATERMARK */
+
+			pthread_mutex_unlock(&scan_mutex);
+
+#ifdef CONFIG_ST_HAL_ADAPTIVE_WATERMARK
+			WatermarkUpdate(&watermark, samples);
+#endif /* CONFIG_ST_HAL_ADAPTIVE_WATERMARK */
+
+			if (metrics.Get(SENSOR_METRIC_SAMPLE_GAPS) - gaps_at_buffer_grow >=
+			    HW_SENSOR_BASE_GAPS_BEFORE_BUFFER_GROW)
+				GrowBufferLength();
+		} else if (pollfd_data[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			DeviceError(&errors, false, -EIO);
+			continue;
 		}
+
+		WatchdogCheck(&watchdog);
 	}
 }
 
 void HWSensorBase::ThreadEventsTask()
 {
 	int err, i, read_size;
+	unsigned int errors = 0;
+	struct pollfd pollfd_events[2];
 	struct device_iio_events event_data[10];
 
-	while (true) {
-		err = poll(&pollfd_iio[1], 1, -1);
-		if (err <= 0)
+	pollfd_events[1].fd = threads_stop_pipe[0];
+	pollfd_events[1].events = POLLIN;
+
+	while (!threads_stop.load()) {
+		if ((pollfd_iio[1].fd < 0) || device_detached.load()) {
+			DeviceError(&errors, true, -EBADF);
+			continue;
+		}
+
+		/* the events fd changes when the device is recovered */
+		pollfd_events[0] = pollfd_iio[1];
+
+		err = poll(pollfd_events, 2, -1);
+		if (pollfd_events[1].revents)
+			break;
+
+		if (err < 0) {
+			if (errno != EINTR)
+				DeviceError(&errors, true, -errno);
+
+			continue;
+		}
+
+		if (err == 0)
 			continue;
 
-		if (pollfd_iio[1].revents & POLLIN) {
+		if (pollfd_events[0].revents & POLLIN) {
 			read_size = read(pollfd_iio[1].fd, event_data,
 					 10 * sizeof(struct device_iio_events));
 			if (read_size <= 0) {
-				ALOGE("%s: Failed to read event data from iio char device.",
-				      GetName());
+				if ((read_size < 0) &&
+				    ((errno == EAGAIN) || (errno == EINTR)))
+					continue;
+
+				DeviceError(&errors, true,
+					    read_size < 0 ? -errno : -ENODATA);
 				continue;
 			}
 
+			if (errors) {
+				ALOGD("%s: iio events recovered after %u errors.",
+				      GetName(), errors);
+				errors = 0;
+			}
+
+#ifdef CONFIG_ST_HAL_CAPTURE
+			SensorCapture::Record(SENSOR_CAPTURE_EVENTS,
+					      sensor_t_data.handle,
+					      event_data, read_size);
+#endif /* CONFIG_ST_HAL_CAPTURE */
+
 			for (i = 0; i < (int)(read_size / sizeof(struct device_iio_events)); i++)
 				ProcessEvent(&event_data[i]);
+		} else if (pollfd_events[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			DeviceError(&errors, true, -EIO);
 		}
 	}
 }
 
+/**
+ * StopThreads() - Make ThreadDataTask() and ThreadEventsTask() return
+ *
+ * Wakes the threads from poll(), from the error backoff and from
+ * WaitDeviceAttached(). The stop pipe is never read, it stays readable.
+ **/
+void HWSensorBase::StopThreads()
+{
+	char c = 0;
+
+	threads_stop.store(true);
+
+	if (write(threads_stop_pipe[1], &c, 1) != 1)
+		ALOGE("%s: Failed to stop threads.", GetName());
+
+	pthread_mutex_lock(&enable_mutex);
+	pthread_cond_broadcast(&device_attached_cond);
+	pthread_mutex_unlock(&enable_mutex);
+}
+
+#ifdef CONFIG_ST_HAL_CAPTURE
+/**
+ * ReplayScanBatch() - Process captured scans like ThreadDataTask() does
+ * @data: bytes read from the iio buffer char device.
+ * @read_size: number of bytes.
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int HWSensorBase::ReplayScanBatch(uint8_t *data, int read_size)
+{
+	if (!hasDataChannels() || (scan_size <= 0) || (read_size % scan_size))
+		return -EINVAL;
+
+	metrics.Inc(SENSOR_METRIC_FIFO_READS);
+	metrics.Add(SENSOR_METRIC_SAMPLES_READ, read_size / scan_size);
+
+	ProcessScanBatch(data, read_size);
+
+	return 0;
+}
+
+/**
+ * ReplayEvents() - Process captured events like ThreadEventsTask() does
+ * @event_data: events read from the iio events fd.
+ * @num: number of events.
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int HWSensorBase::ReplayEvents(struct device_iio_events *event_data, int num)
+{
+	int i;
+
+	if (!has_event_channels)
+		return -EINVAL;
+
+	for (i = 0; i < num; i++)
+		ProcessEvent(&event_data[i]);
+
+	return 0;
+}
+#endif /* CONFIG_ST_HAL_CAPTURE */
+
 #ifdef PLTF_LINUX_ENABLED
 int HWSensorBase::Ignition(int status)
 {
@@ -741,6 +1960,7 @@ int HWSensorBase::Ignition(int status)
 int HWSensorBase::InjectionMode(bool enable)
 {
 	int err;
+	int64_t sysfs_start;
 
 	switch (injection_mode) {
 	case SENSOR_INJECTION_NONE:
@@ -748,18 +1968,18 @@ int HWSensorBase::InjectionMode(bool enable)
 
 	case SENSOR_INJECTOR:
 		if (enable) {
-			injection_data = (uint8_t *)malloc(sizeof(uint8_t) * scan_size);
-			if (!injection_data)
-				return -ENOMEM;
-		} else
-			free(injection_data);
+			err = AllocateDataBuffer();
+			if (err < 0)
+				return err;
+		}
 
-		err = device_iio_utils::set_injection_mode(common_data.device_iio_sysfs_path,
-							   enable);
+		sysfs_start = SysfsWriteStart();
+		err = SysfsWriteDone(sysfs_start, device_iio_utils::set_injection_mode(
+					common_data.device_iio_sysfs_path,
+					enable));
 		if (err < 0) {
 			ALOGE("%s: Failed to switch injection mode.",
 			      GetName());
-			free(injection_data);
 			return err;
 		}
 
@@ -818,6 +2038,7 @@ HWSensorBaseWithPollrate::HWSensorBaseWithPollrate(HWSensorBaseCommonData *data,
 
 	memcpy(&sampling_frequency_available, sfa,
 	       sizeof(sampling_frequency_available));
+	hw_sampling_frequency = 0.0f;
 
 	for (i = 0; i < sfa->length; i++) {
 		if ((max_sampling_frequency < sfa->freq[i]) &&
@@ -848,7 +2069,7 @@ int HWSensorBaseWithPollrate::SetDelay(int handle, int64_t period_ns,
 	bool message = false;
 #endif /* CONFIG_ST_HAL_DEBUG_INFO */
 	unsigned int sampling_frequency, buf_len;
-	int64_t min_pollrate_ns, min_timeout_ns = 0, timestamp;
+	int64_t min_pollrate_ns, min_timeout_ns = 0, timestamp, sysfs_start;
 
 	if (lock_en_mutex)
 		pthread_mutex_lock(&enable_mutex);
@@ -891,13 +2112,19 @@ int HWSensorBaseWithPollrate::SetDelay(int handle, int64_t period_ns,
 		i--;
 
 	if (current_min_pollrate != min_pollrate_ns) {
-		err = device_iio_utils::set_sampling_frequency(common_data.device_iio_sysfs_path,
-							       sampling_frequency_available.freq[i]);
-		if (err < 0) {
-			ALOGE("%s: Failed to write sampling frequency to iio device.", GetName());
-			goto mutex_unlock;
+		/* written to the device by AttachDevice() */
+		if (!device_detached.load()) {
+			sysfs_start = SysfsWriteStart();
+			err = SysfsWriteDone(sysfs_start, device_iio_utils::set_sampling_frequency(
+						common_data.device_iio_sysfs_path,
+						sampling_frequency_available.freq[i]));
+			if (err < 0) {
+				ALOGE("%s: Failed to write sampling frequency to iio device.", GetName());
+				goto mutex_unlock;
+			}
 		}
 
+		hw_sampling_frequency = sampling_frequency_available.freq[i];
 		timestamp = elapsedRealtimeNano();
 
 		err = odr_switch.writeElement(timestamp,
@@ -941,6 +2168,10 @@ int HWSensorBaseWithPollrate::SetDelay(int handle, int64_t period_ns,
 		}
 	}
 
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+	UpdateBatchSpan();
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+
 #if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
 	if (message)
 		ALOGD("\"%s\": changed pollrate to %.2fHz, timeout=%" PRIu64 "ms (sensor type: %d).",
@@ -960,10 +2191,58 @@ mutex_unlock:
 	return err;
 }
 
+/**
+ * WriteDeviceConfig() - Write again sampling frequency and hw fifo watermark
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int HWSensorBaseWithPollrate::WriteDeviceConfig()
+{
+	int err;
+	int64_t sysfs_start;
+
+	if (hw_sampling_frequency > 0.0f) {
+		sysfs_start = SysfsWriteStart();
+		err = SysfsWriteDone(sysfs_start, device_iio_utils::set_sampling_frequency(
+					common_data.device_iio_sysfs_path,
+					hw_sampling_frequency));
+		if (err < 0)
+			return err;
+	}
+
+	return HWSensorBase::WriteDeviceConfig();
+}
+
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+/**
+ * UpdateBatchSpan() - Set how long events can wait in the batch buffer
+ *
+ * Events can wait the shortest max report latency of all the consumers
+ * minus the time spent in the hw FIFO. Called with enable_mutex held,
+ * after SetDelay() published the rates.
+ **/
+void HWSensorBaseWithPollrate::UpdateBatchSpan()
+{
+	int64_t span = 0, timeout = GetMinTimeoutSnapshot();
+
+	if ((timeout > 0) && (timeout < INT64_MAX) &&
+	    (hw_sampling_frequency > 0.0f)) {
+		span = timeout -
+		       (int64_t)(hw_fifo_watermark * FREQUENCY_TO_NS(hw_sampling_frequency)) -
+		       HW_SENSOR_BASE_SW_BATCH_MARGIN_MS * 1000000LL;
+		if (span < 0)
+			span = 0;
+	}
+
+	batch_span.store(span, std::memory_order_relaxed);
+}
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+
 int HWSensorBaseWithPollrate::FlushData(int handle, bool lock_en_mutex)
 {
 	int err;
 	unsigned int i;
+	int64_t sysfs_start;
 
 	if (lock_en_mutex)
 		pthread_mutex_lock(&enable_mutex);
@@ -973,11 +2252,14 @@ int HWSensorBaseWithPollrate::FlushData(int handle, bool lock_en_mutex)
 		if (err < 0)
 			goto unlock_mutex;
 
-		if ((GetMinTimeout(false) > 0) && (GetMinTimeout(false) < INT64_MAX)) {
+		if ((GetMinTimeout(false) > 0) && (GetMinTimeout(false) < INT64_MAX) &&
+		    !device_detached.load()) {
 			for (i = 0; i < dependencies.num; i++)
 				dependencies.sb[i]->FlushData(sensor_t_data.handle, true);
 
-			err = device_iio_utils::hw_fifo_flush(common_data.device_iio_sysfs_path);
+			sysfs_start = SysfsWriteStart();
+			err = SysfsWriteDone(sysfs_start, device_iio_utils::hw_fifo_flush(
+						common_data.device_iio_sysfs_path));
 			if (err < 0) {
 				ALOGE("%s: Failed to flush hw fifo.", GetName());
 				goto unlock_mutex;
@@ -1022,21 +2304,18 @@ void HWSensorBaseWithPollrate::WriteDataToPipe(int64_t hw_pollrate)
 			decimator = 1;
 
 		if (((samples_counter % decimator) == 0) || odr_changed) {
-			err = write(write_pipe_fd, &sensor_event, sizeof(sensors_event_t));
-			if (err <= 0) {
-				ALOGE("%s: Failed to write sensor data to pipe. (errno: %d)",
-				      android_name, -errno);
+			if (PushDataEvent() < 0) {
 				samples_counter--;
 				return;
 			}
 
 			samples_counter = 0;
-			last_data_timestamp = sensor_event.timestamp;
 
 #if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_EXTRA_VERBOSE)
 			ALOGD("\"%s\": pushed data to android: timestamp=%" PRIu64 "ns real_pollrate=%" PRIu64 " (sensor type: %d).",
 			      sensor_t_data.name, sensor_event.timestamp, current_real_pollrate, sensor_t_data.type);
 #endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
-		}
+		} else
+			metrics.Inc(SENSOR_METRIC_SAMPLES_DECIMATED);
 	}
 }
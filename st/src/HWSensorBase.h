@@ -20,8 +20,10 @@
 
 #include <poll.h>
 #include <math.h>
+#include <endian.h>
 
 #include "SensorBase.h"
+#include "TimestampEstimator.h"
 
 extern "C" {
 	#include "utils.h"
@@ -32,10 +34,64 @@ extern "C" {
 #define HW_SENSOR_BASE_IIO_DEVICE_NAME_MAX	(30)
 #define HW_SENSOR_BASE_MAX_CHANNELS		(8)
 
+/* iio device errors: backoff doubles from MIN to MAX, reopen every N errors */
+#define HW_SENSOR_BASE_ERROR_BACKOFF_MIN_MS	(10)
+#define HW_SENSOR_BASE_ERROR_BACKOFF_MAX_MS	(5000)
+#define HW_SENSOR_BASE_ERRORS_BEFORE_REOPEN	(3)
+
+/*
+ * sample rate watchdog: a window lasts WINDOW_LATENCIES times the max
+ * report latency (at least WINDOW_MIN_MS), it is a stall when less than
+ * MIN_RATE_PCT of the samples due at the requested rate are read, the
+ * device is recovered after STALLS_BEFORE_RECOVERY consecutive stalls.
+ */
+#define HW_SENSOR_BASE_WATCHDOG_WINDOW_MIN_MS	(1000)
+#define HW_SENSOR_BASE_WATCHDOG_WINDOW_LATENCIES	(4)
+#define HW_SENSOR_BASE_WATCHDOG_MIN_RATE_PCT	(25)
+#define HW_SENSOR_BASE_WATCHDOG_STALLS_BEFORE_RECOVERY	(2)
+
+/*
+ * iio timestamps clock: selected at open, when the device keeps another
+ * clock the offset to CLOCK_BOOTTIME is measured at every read, a
+ * measure taking more than CLOCK_READ_MAX_NS (thread preempted) is
+ * discarded.
+ */
+#define HW_SENSOR_BASE_TIMESTAMP_CLOCK		"boottime"
+#define HW_SENSOR_BASE_CLOCK_READ_MAX_NS	(20000)
+
+/*
+ * samples lost by FIFO or iio buffer overruns: a scan later than
+ * GAP_PERIOD_PCT of the period after the previous one is a gap, after
+ * GAPS_BEFORE_BUFFER_GROW gaps the iio buffer length (DEFAULT_IIO_BUFFER_LEN
+ * hw FIFOs at open) is doubled, up to MAX_IIO_BUFFER_LEN hw FIFOs.
+ */
+#define HW_SENSOR_BASE_GAP_PERIOD_PCT		(150)
+#define HW_SENSOR_BASE_GAPS_BEFORE_BUFFER_GROW	(3)
+#define HW_SENSOR_BASE_MAX_IIO_BUFFER_LEN	(16)
+
+/*
+ * adaptive watermark: at the end of a window (WINDOW_MS and WINDOW_READS
+ * reads) the watermark is set to the largest one delivering the oldest
+ * sample of a read within the max report latency, given the worst read
+ * delay of the window. Changes within 1/HYSTERESIS of the watermark are
+ * not written. A read delay over BUSY_DELAY_US means a busy CPU: the
+ * watermark only shrinks if the latency was exceeded and the window
+ * doubles, up to MAX_BACKOFF times WINDOW_MS.
+ */
+#define HW_SENSOR_BASE_WATERMARK_WINDOW_MS	(1000)
+#define HW_SENSOR_BASE_WATERMARK_WINDOW_READS	(4)
+#define HW_SENSOR_BASE_WATERMARK_HYSTERESIS	(8)
+#define HW_SENSOR_BASE_WATERMARK_BUSY_DELAY_US	(5000)
+#define HW_SENSOR_BASE_WATERMARK_MAX_BACKOFF	(8)
+
+/* sw batching: time left to the client to read a released batch */
+#define HW_SENSOR_BASE_SW_BATCH_MARGIN_MS	(100)
+
 struct HWSensorBaseCommonData {
 	char device_iio_sysfs_path[HW_SENSOR_BASE_IIO_SYSFS_PATH_MAX];
 	char device_name[HW_SENSOR_BASE_IIO_DEVICE_NAME_MAX];
 	unsigned int device_iio_dev_num;
+	unsigned int imu_instance;
 
 	int num_channels;
 	struct device_iio_info_channel channels[HW_SENSOR_BASE_MAX_CHANNELS];
@@ -43,6 +99,229 @@ struct HWSensorBaseCommonData {
 	struct device_iio_scales sa;
 } typedef HWSensorBaseCommonData;
 
+/*
+ * struct hw_sensor_base_watchdog: sample rate watchdog of the data thread
+ * @period: requested sampling period being checked, 0 when stopped.
+ * @timeout: requested max report latency being checked.
+ * @window: window length [ns].
+ * @window_start: window start timestamp.
+ * @samples_start: SENSOR_METRIC_SAMPLES_READ at window start.
+ * @stalls: consecutive windows below the expected rate.
+ */
+struct hw_sensor_base_watchdog {
+	int64_t period;
+	int64_t timeout;
+	int64_t window;
+	int64_t window_start;
+	uint64_t samples_start;
+	unsigned int stalls;
+};
+
+/*
+ * struct hw_sensor_base_watermark: adaptive watermark of the data thread
+ * @period: sampling period being controlled, 0 when stopped.
+ * @timeout: max report latency being met.
+ * @window: window length [ns].
+ * @window_start: window start timestamp.
+ * @delay_max: worst delay from the last sample of a read to its delivery.
+ * @latency_max: worst delay from the first sample of a read to its delivery.
+ * @reads: reads in the window.
+ */
+struct hw_sensor_base_watermark {
+	int64_t period;
+	int64_t timeout;
+	int64_t window;
+	int64_t window_start;
+	int64_t delay_max;
+	int64_t latency_max;
+	unsigned int reads;
+};
+
+/**
+ * process_channel_value() - Apply channel offset and scale to raw value
+ * @val: sign extended value received from buffer channel.
+ * @info: information about channel structure.
+ * @sample_scale: scale of the samples of the sensor.
+ *
+ * With CONFIG_ST_HAL_FIXED_POINT_DATA the value stays in LSB, the scale
+ * is applied when the event is sent to android. A channel with a scale
+ * other than the sensor one is converted to the sensor LSB.
+ **/
+static inline sensor_sample_t process_channel_value(int32_t val,
+						    struct device_iio_info_channel *info,
+						    float __attribute__((unused))sample_scale)
+{
+#ifdef CONFIG_ST_HAL_FIXED_POINT_DATA
+	if (info->scale != sample_scale)
+		return lrintf(((float)val + info->offset) * info->scale /
+			      sample_scale);
+
+	return val + (int32_t)lrintf(info->offset);
+#else /* CONFIG_ST_HAL_FIXED_POINT_DATA */
+	return (((float)val + info->offset) * info->scale);
+#endif /* CONFIG_ST_HAL_FIXED_POINT_DATA */
+}
+
+/**
+ * process_2byte_received() - Return channel data from 2 byte
+ * @input: 2 byte of data received from buffer channel.
+ * @info: information about channel structure.
+ * @sample_scale: scale of the samples of the sensor.
+ **/
+static inline sensor_sample_t process_2byte_received(int input,
+						     struct device_iio_info_channel *info,
+						     float sample_scale)
+{
+	int32_t res;
+	int16_t val;
+
+	if (info->be)
+		input = be16toh((uint16_t)input);
+	else
+		input = le16toh((uint16_t)input);
+
+	val = input >> info->shift;
+
+	if (info->sign) {
+		val &= (1 << info->bits_used) - 1;
+		val = (int16_t)(val << (16 - info->bits_used)) >> (16 - info->bits_used);
+		res = val;
+	} else {
+		val &= (1 << info->bits_used) - 1;
+		res = (uint16_t)val;
+	}
+
+	return process_channel_value(res, info, sample_scale);
+}
+
+/**
+ * process_3byte_received() - Return channel data from 3 byte
+ * @input: 3 byte of data received from buffer channel.
+ * @info: information about channel structure.
+ * @sample_scale: scale of the samples of the sensor.
+ **/
+static inline sensor_sample_t process_3byte_received(int input,
+						     struct device_iio_info_channel *info,
+						     float sample_scale)
+{
+	int32_t val;
+
+	if (info->be)
+		input = be32toh((uint32_t)input);
+	else
+		input = le32toh((uint32_t)input);
+
+	val = input >> info->shift;
+	if (info->sign) {
+		val &= (1 << info->bits_used) - 1;
+		val = (int32_t)(val << (24 - info->bits_used)) >> (24 - info->bits_used);
+	} else {
+		val &= (1 << info->bits_used) - 1;
+	}
+
+	return process_channel_value(val, info, sample_scale);
+}
+
+/**
+ * process_scan() - This functions use channels device information to build
+ * data
+ *
+ * @hw_sensor: pointer to current hardware sensor.
+ * @data: sensor data of all channels read from buffer.
+ * @channels: information about channel structure.
+ * @num_channels: number of channels of the sensor.
+ * @sample_scale: scale of the samples of the sensor.
+ **/
+static inline int ProcessScanData(uint8_t *data,
+				  struct device_iio_info_channel *channels,
+				  int num_channels,
+				  float sample_scale,
+				  SensorBaseData *sensor_out_data)
+{
+	int k;
+
+	for (k = 0; k < num_channels; k++) {
+		sensor_out_data->offset[k] = 0;
+
+		/* not in the scan, consumers must not see stale values */
+		if (!channels[k].enabled) {
+			sensor_out_data->raw[k] = 0;
+			continue;
+		}
+
+		switch (channels[k].bytes) {
+		case 1:
+			sensor_out_data->raw[k] = *(uint8_t *)(data + channels[k].location);
+			break;
+		case 2:
+			sensor_out_data->raw[k] = process_2byte_received(*(uint16_t *)
+					(data + channels[k].location), &channels[k],
+					sample_scale);
+			break;
+		case 3:
+			sensor_out_data->raw[k] = process_3byte_received(*(uint32_t *)
+					(data + channels[k].location), &channels[k],
+					sample_scale);
+			break;
+		case 4:
+			uint32_t val;
+
+			if (channels[k].be)
+				val = be32toh(*(uint32_t *)
+						(data + channels[k].location));
+			else
+				val = le32toh(*(uint32_t *)
+						(data + channels[k].location));
+			val >>= channels[k].shift;
+			val &= channels[k].mask;
+			if (channels[k].sign) {
+				sensor_out_data->raw[k] = process_channel_value((int32_t)val,
+										&channels[k],
+										sample_scale);
+			} else {
+#ifdef CONFIG_ST_HAL_FIXED_POINT_DATA
+				sensor_out_data->raw[k] = process_channel_value((int32_t)val,
+										&channels[k],
+										sample_scale);
+#else /* CONFIG_ST_HAL_FIXED_POINT_DATA */
+				sensor_out_data->raw[k] = ((float)val +
+						channels[k].offset) * channels[k].scale;
+#endif /* CONFIG_ST_HAL_FIXED_POINT_DATA */
+			}
+
+			break;
+		case 8:
+			if (channels[k].sign) {
+				int64_t val = *(int64_t *)(data + channels[k].location);
+				if ((val >> channels[k].bits_used) & 1)
+					val = (val & channels[k].mask) | ~channels[k].mask;
+
+				if ((channels[k].scale == 1.0f) && (channels[k].offset == 0.0f)) {
+					sensor_out_data->timestamp = val;
+				} else {
+#ifdef CONFIG_ST_HAL_FIXED_POINT_DATA
+					sensor_out_data->raw[k] = process_channel_value((int32_t)val,
+											&channels[k],
+											sample_scale);
+#else /* CONFIG_ST_HAL_FIXED_POINT_DATA */
+					sensor_out_data->raw[k] = (((float)val +
+							channels[k].offset) * channels[k].scale);
+#endif /* CONFIG_ST_HAL_FIXED_POINT_DATA */
+				}
+			} else {
+				uint64_t val = *(uint64_t *)(data + channels[k].location);
+				sensor_out_data->raw[k] = val;
+			}
+
+			break;
+		default:
+			return -EINVAL;
+		}
+	}
+
+	return num_channels;
+}
+
 
 class HWSensorBase;
 class HWSensorBaseWithPollrate;
@@ -54,6 +333,8 @@ class HWSensorBase : public SensorBase {
 private:
 protected:
 	ssize_t scan_size;
+	unsigned int scan_channels;
+	pthread_mutex_t scan_mutex;
 	struct pollfd pollfd_iio[2];
 	FlushRequested flush_requested;
 	HWSensorBaseCommonData common_data;
@@ -67,8 +348,61 @@ protected:
 	uint8_t *injection_data;
 #endif /* CONFIG_ST_HAL_ANDROID_VERSION */
 	bool has_event_channels;
+	int64_t scan_pollrate;
+#ifdef CONFIG_ST_HAL_SW_TIMESTAMP
+	TimestampEstimator timestamp_estimator;
+	std::atomic<bool> timestamp_estimator_reset;
+	int scan_timestamp_location;
+#endif /* CONFIG_ST_HAL_SW_TIMESTAMP */
+	uint8_t *read_buffer;
+	unsigned int hw_fifo_watermark;
+
+	/* gap detection and iio buffer length, in hw FIFOs */
+	int64_t last_scan_timestamp;
+	uint64_t gaps_at_buffer_grow;
+	unsigned int iio_buffer_len;
+
+	/* clock of iio timestamps, offset to CLOCK_BOOTTIME */
+	clockid_t timestamp_clock;
+	std::atomic<int64_t> timestamp_clock_offset;
+
+	/* iio device unbound, data and events threads park until attached */
+	std::atomic<bool> device_detached;
+	pthread_cond_t device_attached_cond;
+
+	/* set by StopThreads(), data and events threads return */
+	std::atomic<bool> threads_stop;
+	int threads_stop_pipe[2];
 
 	int WriteBufferLenght(unsigned int buf_len);
+	size_t GetReadBufferLenght();
+
+	virtual int WriteDeviceConfig();
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+	virtual void UpdateBatchSpan();
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+	int RecoverDevice();
+	int ReopenEvents();
+	void DeviceError(unsigned int *errors, bool events, int err);
+	int WatchdogTimeout(struct hw_sensor_base_watchdog *watchdog);
+	void WatchdogCheck(struct hw_sensor_base_watchdog *watchdog);
+#ifdef CONFIG_ST_HAL_ADAPTIVE_WATERMARK
+	void WatermarkUpdate(struct hw_sensor_base_watermark *watermark,
+			     unsigned int samples);
+	void WatermarkAdjust(struct hw_sensor_base_watermark *watermark);
+#endif /* CONFIG_ST_HAL_ADAPTIVE_WATERMARK */
+	void WaitDeviceAttached(bool events);
+	void UpdateSampleScale();
+	inline int64_t SysfsWriteStart();
+	inline int SysfsWriteDone(int64_t start, int ret);
+	void SetupTimestampClock();
+	int64_t UpdateTimestampClockOffset();
+	unsigned int GetRequiredScanChannels();
+	int UpdateScanChannels(unsigned int channels, bool running);
+	int GrowBufferLength();
+	void ProcessRead(int read_size);
+	void CheckSampleGap(int64_t timestamp);
+	void ProcessScanBatch(uint8_t *data, int read_size);
 
 public:
 	HWSensorBase(HWSensorBaseCommonData *data, const char *name,
@@ -76,6 +410,9 @@ public:
 		     float power_consumption);
 	virtual ~HWSensorBase();
 
+	virtual size_t GetDataBufferSize();
+	virtual int AllocateDataBuffer();
+
 	virtual int Enable(int handle, bool enable, bool lock_en_mute);
 	virtual int SetDelay(int handle, int64_t period_ns,
 			     int64_t timeout, bool lock_en_mute);
@@ -91,6 +428,7 @@ public:
 	virtual void ProcessFlushData(int handle, int64_t timestamp);
 	virtual void ThreadDataTask();
 	virtual void ThreadEventsTask();
+	virtual void StopThreads();
 
 #if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_MARSHMALLOW_VERSION)
 	virtual int InjectionMode(bool enable);
@@ -99,12 +437,50 @@ public:
 	bool hasEventChannels() { return has_event_channels; }
 	bool hasDataChannels() { return common_data.num_channels > 0; }
 
+	unsigned int GetDeviceNum() { return common_data.device_iio_dev_num; }
+	const char *GetDeviceName() { return common_data.device_name; }
+	unsigned int GetImuInstance() { return common_data.imu_instance; }
+	bool IsDeviceDetached() { return device_detached.load(); }
+	void DetachDevice();
+	int AttachDevice(HWSensorBaseCommonData *data);
+
+#ifdef CONFIG_ST_HAL_CAPTURE
+	virtual int ReplayScanBatch(uint8_t *data, int read_size);
+	virtual int ReplayEvents(struct device_iio_events *event_data, int num);
+#endif /* CONFIG_ST_HAL_CAPTURE */
+
 #ifdef PLTF_LINUX_ENABLED
 	/* set engine ignition status (on/off) */
 	virtual int Ignition(int val);
 #endif /* PLTF_LINUX_ENABLED */
 };
 
+/**
+ * SysfsWriteStart() - Begin a device_iio_utils sysfs write
+ *
+ * Return value: start time to pass to SysfsWriteDone().
+ **/
+inline int64_t HWSensorBase::SysfsWriteStart()
+{
+	ST_HAL_TRACE_BEGIN("sysfs write");
+
+	return elapsedRealtimeNano();
+}
+
+/**
+ * SysfsWriteDone() - Account a sysfs write in the sensor metrics
+ * @start: value returned by SysfsWriteStart().
+ * @ret: return value of the write.
+ *
+ * Return value: @ret.
+ **/
+inline int HWSensorBase::SysfsWriteDone(int64_t start, int ret)
+{
+	ST_HAL_TRACE_END();
+	metrics.RecordSysfsWrite(elapsedRealtimeNano() - start);
+
+	return ret;
+}
 
 /*
  * class HWSensorBaseWithPollrate
@@ -112,6 +488,13 @@ public:
 class HWSensorBaseWithPollrate : public HWSensorBase {
 private:
 	struct device_iio_sampling_freqs sampling_frequency_available;
+	float hw_sampling_frequency;
+
+protected:
+	virtual int WriteDeviceConfig();
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+	virtual void UpdateBatchSpan();
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
 
 public:
 	HWSensorBaseWithPollrate(HWSensorBaseCommonData *data,
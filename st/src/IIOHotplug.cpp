@@ -0,0 +1,241 @@
+/*
+ * STMicroelectronics IIO Hotplug Class
+ *
+ * Copyright 2021 STMicroelectronics Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#include "SensorBase.h"
+#include "IIOHotplug.h"
+
+#ifdef CONFIG_ST_HAL_IIO_HOTPLUG
+
+#define IIO_HOTPLUG_DEVICE_PREFIX		"iio:device"
+
+static int hotplug_socket = -1;
+static int hotplug_stop_pipe[2] = { -1, -1 };
+static pthread_t hotplug_thread;
+static iio_hotplug_callback_t hotplug_callback;
+static void *hotplug_context;
+
+/**
+ * ParseUevent() - Get action and iio:device number of a kernel uevent
+ * @buf: uevent message, "action@devpath" followed by KEY=value strings.
+ * @len: message length.
+ * @action: IIOHotplugAction.
+ * @dev_num: iio:device number.
+ *
+ * Return value: 0 for an iio:device add or remove, negative number
+ *               for any other uevent.
+ **/
+int IIOHotplug::ParseUevent(const char *buf, size_t len, int *action,
+			    unsigned int *dev_num)
+{
+	const char *key, *end = buf + len, *devpath = NULL;
+	const char *subsystem = NULL, *act = NULL, *name;
+	char *num_end;
+	unsigned long num;
+
+	for (key = buf; key < end; key += strnlen(key, end - key) + 1) {
+		if (!strncmp(key, "ACTION=", 7))
+			act = key + 7;
+		else if (!strncmp(key, "DEVPATH=", 8))
+			devpath = key + 8;
+		else if (!strncmp(key, "SUBSYSTEM=", 10))
+			subsystem = key + 10;
+	}
+
+	if (!act || !devpath || !subsystem || strcmp(subsystem, "iio"))
+		return -EINVAL;
+
+	/* iio triggers share the subsystem */
+	name = strrchr(devpath, '/');
+	name = name ? name + 1 : devpath;
+	if (strncmp(name, IIO_HOTPLUG_DEVICE_PREFIX,
+		    strlen(IIO_HOTPLUG_DEVICE_PREFIX)))
+		return -EINVAL;
+
+	num = strtoul(name + strlen(IIO_HOTPLUG_DEVICE_PREFIX), &num_end, 10);
+	if ((num_end == name + strlen(IIO_HOTPLUG_DEVICE_PREFIX)) || *num_end)
+		return -EINVAL;
+
+	if (!strcmp(act, "add"))
+		*action = IIO_HOTPLUG_ADD;
+	else if (!strcmp(act, "remove"))
+		*action = IIO_HOTPLUG_REMOVE;
+	else
+		return -EINVAL;
+
+	*dev_num = (unsigned int)num;
+
+	return 0;
+}
+
+/**
+ * iio_hotplug_thread() - Read uevents and report iio:device actions
+ * @context: unused.
+ **/
+static void *iio_hotplug_thread(void __attribute__((unused))*context)
+{
+	int err, action;
+	ssize_t len;
+	unsigned int dev_num;
+	struct sockaddr_nl addr;
+	struct pollfd pollfds[2];
+	struct iovec iov;
+	struct msghdr msg;
+	char buf[IIO_HOTPLUG_UEVENT_BUFFER_SIZE];
+
+	pollfds[0].fd = hotplug_socket;
+	pollfds[0].events = POLLIN;
+	pollfds[1].fd = hotplug_stop_pipe[0];
+	pollfds[1].events = POLLIN;
+
+	while (true) {
+		err = poll(pollfds, 2, -1);
+		if (err < 0) {
+			if (errno == EINTR)
+				continue;
+
+			ALOGE("IIO hotplug: poll failed (errno: %d).", -errno);
+			break;
+		}
+
+		if (pollfds[1].revents)
+			break;
+
+		if (!(pollfds[0].revents & POLLIN))
+			continue;
+
+		memset(&msg, 0, sizeof(msg));
+		iov.iov_base = buf;
+		iov.iov_len = sizeof(buf) - 1;
+		msg.msg_name = &addr;
+		msg.msg_namelen = sizeof(addr);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+
+		len = recvmsg(hotplug_socket, &msg, 0);
+		if (len < 0) {
+			/* uevents lost: devices keep the last known state */
+			if (errno == ENOBUFS)
+				ALOGW("IIO hotplug: uevent socket overrun.");
+
+			continue;
+		}
+
+		/* kernel messages only */
+		if ((msg.msg_namelen != sizeof(addr)) || addr.nl_pid ||
+		    (msg.msg_flags & MSG_TRUNC))
+			continue;
+
+		buf[len] = '\0';
+
+		if (IIOHotplug::ParseUevent(buf, len, &action, &dev_num) < 0)
+			continue;
+
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
+		ALOGD("IIO hotplug: iio:device%u %s.", dev_num,
+		      action == IIO_HOTPLUG_ADD ? "added" : "removed");
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
+
+		hotplug_callback(hotplug_context, action, dev_num);
+	}
+
+	return NULL;
+}
+
+/**
+ * Start() - Open the uevent socket and start the listener thread
+ * @callback: called for every iio:device add or remove.
+ * @context: @callback first argument.
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int IIOHotplug::Start(iio_hotplug_callback_t callback, void *context)
+{
+	int err, rcvbuf = IIO_HOTPLUG_SOCKET_RCVBUF;
+	struct sockaddr_nl addr;
+
+	if (hotplug_socket >= 0)
+		return -EBUSY;
+
+	hotplug_socket = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC,
+				NETLINK_KOBJECT_UEVENT);
+	if (hotplug_socket < 0)
+		return -errno;
+
+	/* bursts of uevents at module load, privileged size if allowed */
+	if (setsockopt(hotplug_socket, SOL_SOCKET, SO_RCVBUFFORCE,
+		       &rcvbuf, sizeof(rcvbuf)) < 0)
+		setsockopt(hotplug_socket, SOL_SOCKET, SO_RCVBUF,
+			   &rcvbuf, sizeof(rcvbuf));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1;
+
+	if (bind(hotplug_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		err = -errno;
+		goto close_socket;
+	}
+
+	if (pipe2(hotplug_stop_pipe, O_CLOEXEC) < 0) {
+		err = -errno;
+		goto close_socket;
+	}
+
+	hotplug_callback = callback;
+	hotplug_context = context;
+
+	err = pthread_create(&hotplug_thread, NULL, iio_hotplug_thread, NULL);
+	if (err) {
+		err = -err;
+		goto close_pipe;
+	}
+
+	return 0;
+
+close_pipe:
+	close(hotplug_stop_pipe[0]);
+	close(hotplug_stop_pipe[1]);
+	hotplug_stop_pipe[0] = hotplug_stop_pipe[1] = -1;
+close_socket:
+	close(hotplug_socket);
+	hotplug_socket = -1;
+
+	return err;
+}
+
+/**
+ * Stop() - Stop the listener thread and close the uevent socket
+ **/
+void IIOHotplug::Stop()
+{
+	char c = 0;
+
+	if (hotplug_socket < 0)
+		return;
+
+	if (write(hotplug_stop_pipe[1], &c, 1) == 1)
+		pthread_join(hotplug_thread, NULL);
+
+	close(hotplug_stop_pipe[0]);
+	close(hotplug_stop_pipe[1]);
+	hotplug_stop_pipe[0] = hotplug_stop_pipe[1] = -1;
+	close(hotplug_socket);
+	hotplug_socket = -1;
+}
+
+#endif /* CONFIG_ST_HAL_IIO_HOTPLUG */
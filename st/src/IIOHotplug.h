@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2021 STMicroelectronics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ST_IIO_HOTPLUG_H
+#define ST_IIO_HOTPLUG_H
+
+#include <stddef.h>
+
+#define IIO_HOTPLUG_UEVENT_BUFFER_SIZE		(8192)
+#define IIO_HOTPLUG_SOCKET_RCVBUF		(256 * 1024)
+
+typedef enum IIOHotplugAction {
+	IIO_HOTPLUG_ADD = 0,
+	IIO_HOTPLUG_REMOVE,
+} IIOHotplugAction;
+
+/*
+ * iio_hotplug_callback_t: called by the listener thread
+ * @context: pointer given to IIOHotplug::Start().
+ * @action: IIOHotplugAction.
+ * @dev_num: iio:device number.
+ */
+typedef void (*iio_hotplug_callback_t)(void *context, int action,
+				       unsigned int dev_num);
+
+/*
+ * class IIOHotplug
+ *
+ * Listen to kernel uevents (NETLINK_KOBJECT_UEVENT) and report iio:device
+ * add and remove actions, e.g. when the driver module is loaded late or
+ * the device is unbound and bound again after a bus error. Messages not
+ * sent by the kernel are ignored.
+ */
+class IIOHotplug {
+public:
+	static int Start(iio_hotplug_callback_t callback, void *context);
+	static void Stop();
+	static int ParseUevent(const char *buf, size_t len, int *action,
+			       unsigned int *dev_num);
+};
+
+#endif /* ST_IIO_HOTPLUG_H */
@@ -0,0 +1,800 @@
+/*
+ * STMicroelectronics IIO Simulator for SensorHAL
+ *
+ * Copyright 2021 STMicroelectronics Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <atomic>
+
+#include "IIOSimulator.h"
+
+#ifdef CONFIG_ST_HAL_IIO_SIMULATOR
+
+#define IIO_SIMULATOR_IMU_DEVICES		(3)
+#define IIO_SIMULATOR_MAX_DEVICES		(IIO_SIMULATOR_MAX_IMUS * \
+						 IIO_SIMULATOR_IMU_DEVICES)
+#define IIO_SIMULATOR_SCAN_SIZE			(16)
+/* axes only, in_timestamp_en cleared */
+#define IIO_SIMULATOR_SCAN_DATA_SIZE		(6)
+#define IIO_SIMULATOR_WAVE_PERIOD		(200)
+
+#define IIO_SIMULATOR_FLUSH_EVENT \
+		DEVICE_IIO_EVENT_CODE(DEVICE_IIO_EV_TYPE_FIFO_FLUSH, 0, 0)
+#define IIO_SIMULATOR_MLC_EVENT \
+		DEVICE_IIO_EVENT_CODE(DEVICE_IIO_EV_TYPE_CHANGE, 0, \
+				      DEVICE_IIO_EV_CHAN_ACTIVITY)
+
+/*
+ * struct iio_simulator_device_info: simulated iio:device description
+ * @suffix: appended to IIO_SIMULATOR_DEVICE_NAME to get the device name.
+ * @channel: iio channel type name, NULL if there is no buffer.
+ * @scale: default scale.
+ * @scale_available: in_<channel>_scale_available content.
+ * @offset: per axis value, SI unit.
+ * @amplitude: peak to peak of the triangular wave added on each axis.
+ */
+static const struct iio_simulator_device_info {
+	const char *suffix;
+	const char *channel;
+	float scale;
+	const char *scale_available;
+	float offset[3];
+	float amplitude;
+} iio_simulator_devices_info[IIO_SIMULATOR_IMU_DEVICES] = {
+	{
+		.suffix = ACCEL_NAME_SUFFIX_IIO,
+		.channel = "accel",
+		.scale = 0.000598f,
+		.scale_available = "0.000598 0.001196 0.002392 0.004785",
+		.offset = { 0.0f, 0.0f, 9.80665f },
+		.amplitude = 1.0f,
+	},
+	{
+		.suffix = GYRO_NAME_SUFFIX_IIO,
+		.channel = "anglvel",
+		.scale = 0.000153f,
+		.scale_available = "0.000153 0.000306 0.000611 0.001222 0.002443",
+		.offset = { 0.0f, 0.0f, 0.0f },
+		.amplitude = 0.2f,
+	},
+	{
+		.suffix = "_mlc",
+		.channel = NULL,
+	},
+};
+
+/*
+ * struct iio_simulator_device: simulated iio:device state
+ * @info: device description.
+ * @buffer_pipe: buffer char device, read end is handed to the HAL.
+ * @events_pipe: events char device, read end is handed to the HAL.
+ * @thread: samples generator thread.
+ * @lock: protects the fields below.
+ * @cond: signaled on any attribute write.
+ * @enabled: buffer/enable.
+ * @flush: hwfifo_flush requested.
+ * @scale: in_<channel>_x_scale.
+ * @scan_size: scan size, depends on in_timestamp_en.
+ * @watermark: hwfifo_watermark.
+ * @period_ns: sample period from sampling_frequency, 0 if not set.
+ * @next_ns: CLOCK_MONOTONIC time of the next sample.
+ * @clock_offset: current_timestamp_clock time minus CLOCK_MONOTONIC.
+ * @last_timestamp: timestamp of the last sample pushed.
+ * @samples: samples generated, used as wave phase.
+ * @overrun_ns: CLOCK_MONOTONIC time of the next injected overrun.
+ * @fifo: scans pushed by a single write.
+ */
+struct iio_simulator_device {
+	const struct iio_simulator_device_info *info;
+	int buffer_pipe[2];
+	int events_pipe[2];
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	bool enabled;
+	bool flush;
+	float scale;
+	unsigned int scan_size;
+	unsigned int watermark;
+	int64_t period_ns;
+	int64_t next_ns;
+	int64_t clock_offset;
+	int64_t last_timestamp;
+	uint64_t samples;
+	int64_t overrun_ns;
+	uint8_t *fifo;
+};
+
+static struct iio_simulator_config sim_config;
+static struct iio_simulator_device sim_devices[IIO_SIMULATOR_MAX_DEVICES];
+static unsigned int sim_num_devices;
+static std::atomic<bool> sim_running(false);
+static std::atomic<bool> sim_muted(false);
+
+static int64_t iio_simulator_get_time(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int64_t iio_simulator_clock_offset(clockid_t clock)
+{
+	return iio_simulator_get_time(clock) -
+	       iio_simulator_get_time(CLOCK_MONOTONIC);
+}
+
+static void iio_simulator_wait(struct iio_simulator_device *dev,
+			       int64_t deadline)
+{
+	struct timespec ts;
+
+	ts.tv_sec = deadline / 1000000000LL;
+	ts.tv_nsec = deadline % 1000000000LL;
+
+	pthread_cond_timedwait(&dev->cond, &dev->lock, &ts);
+}
+
+static int iio_simulator_write_file(const char *file, const char *str)
+{
+	FILE *fp;
+
+	fp = fopen(file, "w");
+	if (NULL == fp)
+		return -errno;
+
+	fprintf(fp, "%s", str);
+	fclose(fp);
+
+	return 0;
+}
+
+static int iio_simulator_create_attr(const char *dev_dir, const char *attr,
+				     const char *fmt, ...)
+{
+	va_list args;
+	char str[DEVICE_IIO_MAX_FILENAME_LEN];
+	char file[DEVICE_IIO_MAX_FILENAME_LEN];
+
+	snprintf(file, sizeof(file), "%s/%s", dev_dir, attr);
+
+	va_start(args, fmt);
+	vsnprintf(str, sizeof(str), fmt, args);
+	va_end(args);
+
+	return iio_simulator_write_file(file, str);
+}
+
+static int iio_simulator_create_channel(const char *dev_dir, const char *name,
+					int index, const char *type)
+{
+	int err;
+	char attr[DEVICE_IIO_MAX_NAME_LENGTH * 2];
+
+	snprintf(attr, sizeof(attr), "scan_elements/in_%s_en", name);
+	err = iio_simulator_create_attr(dev_dir, attr, "0");
+	if (err < 0)
+		return err;
+
+	snprintf(attr, sizeof(attr), "scan_elements/in_%s_index", name);
+	err = iio_simulator_create_attr(dev_dir, attr, "%d", index);
+	if (err < 0)
+		return err;
+
+	snprintf(attr, sizeof(attr), "scan_elements/in_%s_type", name);
+
+	return iio_simulator_create_attr(dev_dir, attr, "%s", type);
+}
+
+static int iio_simulator_create_device(unsigned int num)
+{
+	int err, i;
+	char name[DEVICE_IIO_MAX_NAME_LENGTH * 2];
+	char dev_dir[DEVICE_IIO_MAX_FILENAME_LEN];
+	const struct iio_simulator_device_info *info =
+			&iio_simulator_devices_info[num % IIO_SIMULATOR_IMU_DEVICES];
+
+	snprintf(dev_dir, sizeof(dev_dir), "%siio:device%u",
+		 sim_config.sysfs_dir, num);
+	if ((mkdir(dev_dir, S_IRWXU) < 0) && (errno != EEXIST))
+		return -errno;
+
+	err = iio_simulator_create_attr(dev_dir, "name", "%s%s\n",
+					IIO_SIMULATOR_DEVICE_NAME, info->suffix);
+	if (err < 0)
+		return err;
+
+	if (!info->channel) {
+		/* FSM/MLC configuration attributes */
+		iio_simulator_create_attr(dev_dir, "fsm_threshold", "0");
+		iio_simulator_create_attr(dev_dir, "towing_jack_min_duration", "0");
+		iio_simulator_create_attr(dev_dir, "crash_impact_th", "0");
+
+		return iio_simulator_create_attr(dev_dir, "crash_min_duration", "0");
+	}
+
+	strcat(dev_dir, "/buffer");
+	if ((mkdir(dev_dir, S_IRWXU) < 0) && (errno != EEXIST))
+		return -errno;
+
+	strcpy(dev_dir + strlen(dev_dir) - strlen("buffer"), "scan_elements");
+	if ((mkdir(dev_dir, S_IRWXU) < 0) && (errno != EEXIST))
+		return -errno;
+
+	dev_dir[strlen(dev_dir) - strlen("/scan_elements")] = '\0';
+
+	iio_simulator_create_attr(dev_dir, "buffer/enable", "0");
+	iio_simulator_create_attr(dev_dir, "buffer/length", "0");
+	iio_simulator_create_attr(dev_dir, "sampling_frequency", "0");
+	iio_simulator_create_attr(dev_dir, "sampling_frequency_available",
+				  "%s\n", sim_config.odr_available);
+	iio_simulator_create_attr(dev_dir, "hwfifo_enabled", "0");
+	iio_simulator_create_attr(dev_dir, "hwfifo_watermark", "1");
+	iio_simulator_create_attr(dev_dir, "hwfifo_watermark_max", "%u",
+				  sim_config.fifo_length);
+	iio_simulator_create_attr(dev_dir, "hwfifo_flush", "0");
+	iio_simulator_create_attr(dev_dir, "current_timestamp_clock", "%s\n",
+				  sim_config.timestamp_clock[0] ?
+				  sim_config.timestamp_clock :
+				  IIO_SIMULATOR_TIMESTAMP_CLOCK);
+
+	snprintf(name, sizeof(name), "in_%s_x_scale", info->channel);
+	iio_simulator_create_attr(dev_dir, name, "%f", info->scale);
+
+	snprintf(name, sizeof(name), "in_%s_scale_available", info->channel);
+	iio_simulator_create_attr(dev_dir, name, "%s\n", info->scale_available);
+
+	for (i = 0; i < 3; i++) {
+		snprintf(name, sizeof(name), "%s_%c", info->channel, 'x' + i);
+		err = iio_simulator_create_channel(dev_dir, name, i,
+						   "le:s16/16>>0");
+		if (err < 0)
+			return err;
+	}
+
+	return iio_simulator_create_channel(dev_dir, "timestamp", 3,
+					    "le:s64/64>>0");
+}
+
+static void iio_simulator_fill_scan(struct iio_simulator_device *dev,
+				    uint8_t *scan, int64_t timestamp)
+{
+	int i;
+	float wave;
+	int16_t axis;
+	unsigned int phase;
+
+	for (i = 0; i < 3; i++) {
+		/* triangular wave, axes a quarter of period apart */
+		phase = (dev->samples + i * IIO_SIMULATOR_WAVE_PERIOD / 4) %
+			IIO_SIMULATOR_WAVE_PERIOD;
+		if (phase >= IIO_SIMULATOR_WAVE_PERIOD / 2)
+			phase = IIO_SIMULATOR_WAVE_PERIOD - phase;
+
+		wave = ((float)phase / (IIO_SIMULATOR_WAVE_PERIOD / 2) - 0.5f) *
+		       dev->info->amplitude;
+
+		axis = (int16_t)htole16((uint16_t)(int16_t)
+				((dev->info->offset[i] + wave) / dev->scale));
+		memcpy(scan + i * sizeof(axis), &axis, sizeof(axis));
+	}
+
+	if (dev->scan_size < IIO_SIMULATOR_SCAN_SIZE)
+		return;
+
+	memset(scan + 3 * sizeof(axis), 0, 8 - 3 * sizeof(axis));
+	memcpy(scan + 8, &timestamp, sizeof(timestamp));
+}
+
+/*
+ * iio_simulator_push_samples() - Push samples due at @now to the buffer
+ * @dev: simulated device, locked.
+ * @now: CLOCK_MONOTONIC time.
+ */
+static void iio_simulator_push_samples(struct iio_simulator_device *dev,
+				       int64_t now)
+{
+	ssize_t len;
+	int64_t due, lost;
+	unsigned int n = 0, offset, chunk;
+	unsigned int chunk_max = (PIPE_BUF / dev->scan_size) * dev->scan_size;
+
+	if ((dev->period_ns <= 0) || (dev->next_ns > now))
+		return;
+
+	/* hw FIFO full: oldest samples are overwritten */
+	due = (now - dev->next_ns) / dev->period_ns + 1;
+	if (due > (int64_t)sim_config.fifo_length) {
+		lost = due - sim_config.fifo_length;
+		dev->next_ns += lost * dev->period_ns;
+		dev->samples += lost;
+	}
+
+	while (dev->next_ns <= now) {
+		dev->last_timestamp = dev->next_ns + dev->clock_offset;
+		iio_simulator_fill_scan(dev, dev->fifo + n * dev->scan_size,
+					dev->last_timestamp);
+		dev->next_ns += dev->period_ns;
+		dev->samples++;
+		n++;
+	}
+
+	if (sim_muted.load())
+		return;
+
+	/* injected overrun: the samples of this push are lost */
+	if (sim_config.overrun_period_ms && (now >= dev->overrun_ns)) {
+		if (dev->overrun_ns)
+			n = 0;
+
+		dev->overrun_ns = now + sim_config.overrun_period_ms * 1000000LL;
+	}
+
+	/* atomic pipe writes, the HAL never reads a partial scan */
+	for (offset = 0; offset < n * dev->scan_size; offset += chunk) {
+		chunk = n * dev->scan_size - offset;
+		if (chunk > chunk_max)
+			chunk = chunk_max;
+
+		len = write(dev->buffer_pipe[1], dev->fifo + offset, chunk);
+		if (len < 0)
+			break;
+	}
+}
+
+static void iio_simulator_push_event(struct iio_simulator_device *dev,
+				     uint64_t event_id, int64_t timestamp)
+{
+	struct device_iio_events event;
+
+	if (sim_muted.load())
+		return;
+
+	event.event_id = event_id;
+	event.event_timestamp = timestamp;
+
+	if (write(dev->events_pipe[1], &event, sizeof(event)) < 0)
+		return;
+}
+
+static void *iio_simulator_device_thread(void *arg)
+{
+	int64_t now, deadline;
+	struct iio_simulator_device *dev = (struct iio_simulator_device *)arg;
+
+	pthread_mutex_lock(&dev->lock);
+
+	while (sim_running.load()) {
+		now = iio_simulator_get_time(CLOCK_MONOTONIC);
+
+		if (dev->flush) {
+			dev->flush = false;
+
+			if (dev->enabled)
+				iio_simulator_push_samples(dev, now);
+
+			iio_simulator_push_event(dev, IIO_SIMULATOR_FLUSH_EVENT,
+						 dev->last_timestamp);
+			continue;
+		}
+
+		if (!dev->enabled || (dev->period_ns <= 0)) {
+			pthread_cond_wait(&dev->cond, &dev->lock);
+			continue;
+		}
+
+		/* FIFO interrupt fires on the sample reaching the watermark */
+		deadline = dev->next_ns +
+			   (int64_t)(dev->watermark - 1) * dev->period_ns;
+		if (now < deadline) {
+			iio_simulator_wait(dev, deadline);
+			continue;
+		}
+
+		iio_simulator_push_samples(dev, now);
+	}
+
+	pthread_mutex_unlock(&dev->lock);
+
+	return NULL;
+}
+
+static void *iio_simulator_mlc_thread(void *arg)
+{
+	int64_t deadline;
+	struct iio_simulator_device *dev = (struct iio_simulator_device *)arg;
+	struct iio_simulator_device *accel = &sim_devices[(dev - sim_devices) -
+					(dev - sim_devices) % IIO_SIMULATOR_IMU_DEVICES];
+
+	deadline = iio_simulator_get_time(CLOCK_MONOTONIC);
+
+	pthread_mutex_lock(&dev->lock);
+
+	while (sim_running.load()) {
+		deadline += (int64_t)sim_config.mlc_period_ms * 1000000LL;
+		while (sim_running.load() &&
+		       (iio_simulator_get_time(CLOCK_MONOTONIC) < deadline))
+			iio_simulator_wait(dev, deadline);
+
+		if (!sim_running.load())
+			break;
+
+		/* raised on the accelerometer, the only events channel read */
+		iio_simulator_push_event(accel, IIO_SIMULATOR_MLC_EVENT,
+					 deadline + accel->clock_offset);
+	}
+
+	pthread_mutex_unlock(&dev->lock);
+
+	return NULL;
+}
+
+static int iio_simulator_open_buffer(unsigned int dev_num)
+{
+	int fd;
+
+	if ((dev_num >= IIO_SIMULATOR_MAX_DEVICES) ||
+	    (sim_devices[dev_num].buffer_pipe[0] < 0))
+		return -ENODEV;
+
+	fd = dup(sim_devices[dev_num].buffer_pipe[0]);
+
+	return fd < 0 ? -errno : fd;
+}
+
+static int iio_simulator_open_events(unsigned int dev_num,
+				     int __attribute__((unused))buffer_fd)
+{
+	int fd;
+
+	if ((dev_num >= IIO_SIMULATOR_MAX_DEVICES) ||
+	    (sim_devices[dev_num].events_pipe[0] < 0))
+		return -ENODEV;
+
+	fd = dup(sim_devices[dev_num].events_pipe[0]);
+
+	return fd < 0 ? -errno : fd;
+}
+
+static int iio_simulator_sysfs_write(const char *file, const char *str)
+{
+	int err, len;
+	int64_t now;
+	unsigned int num;
+	const char *attr;
+	clockid_t clock = CLOCK_MONOTONIC;
+	struct iio_simulator_device *dev;
+	size_t dir_len = strlen(sim_config.sysfs_dir);
+
+	/* like the kernel, no buffer resize while enabled */
+	if (strstr(file, "/buffer/length") &&
+	    !strncmp(file, sim_config.sysfs_dir, dir_len) &&
+	    (sscanf(file + dir_len, "iio:device%u/", &num) == 1) &&
+	    (num < sim_num_devices)) {
+		pthread_mutex_lock(&sim_devices[num].lock);
+		err = sim_devices[num].enabled ? -EBUSY : 0;
+		pthread_mutex_unlock(&sim_devices[num].lock);
+		if (err < 0)
+			return err;
+	}
+
+	if (strstr(file, "/current_timestamp_clock")) {
+		/* fixed clock, like a driver rejecting the write */
+		if (sim_config.timestamp_clock[0])
+			return -EBUSY;
+
+		if (device_iio_utils::parse_timestamp_clock(str, &clock) < 0)
+			return -EINVAL;
+	}
+
+	err = iio_simulator_write_file(file, str);
+	if (err < 0)
+		return err;
+
+	if (strncmp(file, sim_config.sysfs_dir, dir_len) ||
+	    (sscanf(file + dir_len, "iio:device%u/%n", &num, &len) != 1) ||
+	    (num >= sim_num_devices) ||
+	    !sim_devices[num].info->channel)
+		return 0;
+
+	attr = file + dir_len + len;
+	dev = &sim_devices[num];
+	now = iio_simulator_get_time(CLOCK_MONOTONIC);
+
+	pthread_mutex_lock(&dev->lock);
+
+	if (!strcmp(attr, "sampling_frequency")) {
+		if (dev->enabled)
+			iio_simulator_push_samples(dev, now);
+
+		dev->period_ns = atof(str) > 0 ? 1e9 / atof(str) : 0;
+		dev->next_ns = now + dev->period_ns;
+	} else if (!strcmp(attr, "hwfifo_watermark")) {
+		dev->watermark = atoi(str);
+		if (dev->watermark < 1)
+			dev->watermark = 1;
+		if (dev->watermark > sim_config.fifo_length)
+			dev->watermark = sim_config.fifo_length;
+	} else if (!strcmp(attr, "hwfifo_flush")) {
+		dev->flush = true;
+	} else if (!strcmp(attr, "buffer/enable")) {
+		if (atoi(str) && !dev->enabled)
+			dev->next_ns = now + dev->period_ns;
+
+		dev->enabled = atoi(str);
+	} else if (!strcmp(attr, "current_timestamp_clock")) {
+		dev->clock_offset = iio_simulator_clock_offset(clock);
+	} else if (!strcmp(attr, "scan_elements/in_timestamp_en")) {
+		dev->scan_size = atoi(str) ? IIO_SIMULATOR_SCAN_SIZE :
+					     IIO_SIMULATOR_SCAN_DATA_SIZE;
+	} else if (strstr(attr, "_x_scale")) {
+		if (atof(str) > 0)
+			dev->scale = atof(str);
+	}
+
+	pthread_cond_signal(&dev->cond);
+	pthread_mutex_unlock(&dev->lock);
+
+	return 0;
+}
+
+static const struct device_iio_transport iio_simulator_transport = {
+	.name = "simulator",
+	.sysfs_dir = sim_config.sysfs_dir,
+	.open_buffer = iio_simulator_open_buffer,
+	.open_events = iio_simulator_open_events,
+	.sysfs_write = iio_simulator_sysfs_write,
+};
+
+static void iio_simulator_close_pipe(int fd[2])
+{
+	if (fd[0] >= 0)
+		close(fd[0]);
+	if (fd[1] >= 0)
+		close(fd[1]);
+
+	fd[0] = fd[1] = -1;
+}
+
+static int iio_simulator_open_pipe(int fd[2])
+{
+	if (pipe2(fd, O_NONBLOCK | O_CLOEXEC) < 0) {
+		fd[0] = fd[1] = -1;
+		return -errno;
+	}
+
+	return 0;
+}
+
+static void iio_simulator_release_devices(void)
+{
+	int i;
+
+	for (i = 0; i < IIO_SIMULATOR_MAX_DEVICES; i++) {
+		iio_simulator_close_pipe(sim_devices[i].buffer_pipe);
+		iio_simulator_close_pipe(sim_devices[i].events_pipe);
+		pthread_mutex_destroy(&sim_devices[i].lock);
+		pthread_cond_destroy(&sim_devices[i].cond);
+		free(sim_devices[i].fifo);
+		sim_devices[i].fifo = NULL;
+	}
+}
+
+/**
+ * LoadConfig() - Default configuration, overridden by environment
+ * @config: configuration to fill.
+ **/
+void IIOSimulator::LoadConfig(struct iio_simulator_config *config)
+{
+	const char *env;
+
+	memset(config, 0, sizeof(*config));
+
+	env = getenv(IIO_SIMULATOR_ENV_SYSFS_DIR);
+	snprintf(config->sysfs_dir, sizeof(config->sysfs_dir) - 1, "%s",
+		 env ? env : IIO_SIMULATOR_SYSFS_DIR);
+	if (config->sysfs_dir[strlen(config->sysfs_dir) - 1] != '/')
+		strcat(config->sysfs_dir, "/");
+
+	env = getenv(IIO_SIMULATOR_ENV_ODR_AVAILABLE);
+	snprintf(config->odr_available, sizeof(config->odr_available), "%s",
+		 env ? env : IIO_SIMULATOR_ODR_AVAILABLE);
+
+	env = getenv(IIO_SIMULATOR_ENV_FIFO_LENGTH);
+	config->fifo_length = env ? atoi(env) : IIO_SIMULATOR_FIFO_LENGTH;
+	if (config->fifo_length < 1)
+		config->fifo_length = 1;
+
+	env = getenv(IIO_SIMULATOR_ENV_MLC_PERIOD_MS);
+	config->mlc_period_ms = env ? atoi(env) : 0;
+
+	env = getenv(IIO_SIMULATOR_ENV_IMUS);
+	config->imus = env ? atoi(env) : 1;
+	if (config->imus < 1)
+		config->imus = 1;
+	else if (config->imus > IIO_SIMULATOR_MAX_IMUS)
+		config->imus = IIO_SIMULATOR_MAX_IMUS;
+
+	env = getenv(IIO_SIMULATOR_ENV_TIMESTAMP_CLOCK);
+	if (env)
+		snprintf(config->timestamp_clock,
+			 sizeof(config->timestamp_clock), "%s", env);
+
+	env = getenv(IIO_SIMULATOR_ENV_OVERRUN_PERIOD_MS);
+	config->overrun_period_ms = env ? atoi(env) : 0;
+}
+
+/**
+ * Start() - Create simulated devices and select the simulator transport
+ * @config: configuration, copied.
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int IIOSimulator::Start(const struct iio_simulator_config *config)
+{
+	int err, i;
+	clockid_t clock;
+	pthread_condattr_t attr;
+	char name[DEVICE_IIO_MAX_FILENAME_LEN];
+
+	if (sim_running.load())
+		return -EBUSY;
+
+	memcpy(&sim_config, config, sizeof(sim_config));
+	memset(sim_devices, 0, sizeof(sim_devices));
+	sim_num_devices = sim_config.imus * IIO_SIMULATOR_IMU_DEVICES;
+
+	if (device_iio_utils::parse_timestamp_clock(sim_config.timestamp_clock[0] ?
+						    sim_config.timestamp_clock :
+						    IIO_SIMULATOR_TIMESTAMP_CLOCK,
+						    &clock) < 0)
+		return -EINVAL;
+
+	if ((mkdir(sim_config.sysfs_dir, S_IRWXU) < 0) && (errno != EEXIST))
+		return -errno;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+	for (i = 0; i < IIO_SIMULATOR_MAX_DEVICES; i++) {
+		sim_devices[i].info =
+			&iio_simulator_devices_info[i % IIO_SIMULATOR_IMU_DEVICES];
+		sim_devices[i].buffer_pipe[0] = sim_devices[i].buffer_pipe[1] = -1;
+		sim_devices[i].events_pipe[0] = sim_devices[i].events_pipe[1] = -1;
+		sim_devices[i].scale = sim_devices[i].info->scale;
+		sim_devices[i].scan_size = IIO_SIMULATOR_SCAN_SIZE;
+		sim_devices[i].clock_offset = iio_simulator_clock_offset(clock);
+		sim_devices[i].watermark = 1;
+		sim_devices[i].overrun_ns = 0;
+		pthread_mutex_init(&sim_devices[i].lock, NULL);
+		pthread_cond_init(&sim_devices[i].cond, &attr);
+	}
+
+	pthread_condattr_destroy(&attr);
+
+	/* parts left by a run with more IMUs must not be discovered */
+	for (i = sim_num_devices; i < IIO_SIMULATOR_MAX_DEVICES; i++) {
+		snprintf(name, sizeof(name), "%siio:device%d/name",
+			 sim_config.sysfs_dir, i);
+		unlink(name);
+	}
+
+	for (i = 0; i < (int)sim_num_devices; i++) {
+		err = iio_simulator_create_device(i);
+		if (err < 0)
+			goto release_devices;
+
+		if (!sim_devices[i].info->channel)
+			continue;
+
+		sim_devices[i].fifo = (uint8_t *)malloc(sim_config.fifo_length *
+							IIO_SIMULATOR_SCAN_SIZE);
+		if (!sim_devices[i].fifo) {
+			err = -ENOMEM;
+			goto release_devices;
+		}
+
+		err = iio_simulator_open_pipe(sim_devices[i].buffer_pipe);
+		if (err < 0)
+			goto release_devices;
+
+		err = iio_simulator_open_pipe(sim_devices[i].events_pipe);
+		if (err < 0)
+			goto release_devices;
+	}
+
+	sim_running.store(true);
+
+	for (i = 0; i < (int)sim_num_devices; i++) {
+		if (sim_devices[i].info->channel)
+			err = pthread_create(&sim_devices[i].thread, NULL,
+					     iio_simulator_device_thread,
+					     &sim_devices[i]);
+		else if (sim_config.mlc_period_ms > 0)
+			err = pthread_create(&sim_devices[i].thread, NULL,
+					     iio_simulator_mlc_thread,
+					     &sim_devices[i]);
+		else
+			continue;
+
+		if (err) {
+			err = -err;
+			goto stop_threads;
+		}
+	}
+
+	device_iio_utils::set_transport(&iio_simulator_transport);
+
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
+	ALOGD("IIO simulator started (%s, %u IMU, fifo %u, MLC period %ums).",
+	      sim_config.sysfs_dir, sim_config.imus, sim_config.fifo_length,
+	      sim_config.mlc_period_ms);
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
+
+	return 0;
+
+stop_threads:
+	/* threads not created have a zero id */
+	Stop();
+
+	return err;
+
+release_devices:
+	iio_simulator_release_devices();
+
+	return err;
+}
+
+/**
+ * Stop() - Stop simulated devices and restore the kernel transport
+ **/
+void IIOSimulator::Stop()
+{
+	int i;
+
+	if (!sim_running.exchange(false))
+		return;
+
+	for (i = 0; i < IIO_SIMULATOR_MAX_DEVICES; i++) {
+		pthread_mutex_lock(&sim_devices[i].lock);
+		pthread_cond_broadcast(&sim_devices[i].cond);
+		pthread_mutex_unlock(&sim_devices[i].lock);
+
+		if (sim_devices[i].thread)
+			pthread_join(sim_devices[i].thread, NULL);
+
+		sim_devices[i].thread = 0;
+	}
+
+	device_iio_utils::set_transport(NULL);
+	iio_simulator_release_devices();
+}
+
+/**
+ * Mute() - Keep devices running without pushing samples and events
+ * @mute: true while something else feeds the HAL (e.g. capture replay).
+ **/
+void IIOSimulator::Mute(bool mute)
+{
+	sim_muted.store(mute);
+}
+
+#endif /* CONFIG_ST_HAL_IIO_SIMULATOR */
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2021 STMicroelectronics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ST_IIO_SIMULATOR_H
+#define ST_IIO_SIMULATOR_H
+
+#include <stdint.h>
+
+#include "utils.h"
+
+#define IIO_SIMULATOR_SYSFS_DIR			"/tmp/st_hal_iio_simulator/"
+#define IIO_SIMULATOR_ODR_AVAILABLE		"12.5 26 52 104 208 416 833"
+#define IIO_SIMULATOR_FIFO_LENGTH		(416)
+#define IIO_SIMULATOR_DEVICE_NAME		ST_SENSORS_LIST_2
+#define IIO_SIMULATOR_MAX_IMUS			ST_HAL_IMU_MAX_INSTANCES
+/* kernel default current_timestamp_clock */
+#define IIO_SIMULATOR_TIMESTAMP_CLOCK		"realtime"
+
+/* environment variables overriding the default configuration */
+#define IIO_SIMULATOR_ENV_SYSFS_DIR		"ST_HAL_IIO_SIM_DIR"
+#define IIO_SIMULATOR_ENV_ODR_AVAILABLE		"ST_HAL_IIO_SIM_ODR_AVAILABLE"
+#define IIO_SIMULATOR_ENV_FIFO_LENGTH		"ST_HAL_IIO_SIM_FIFO_LENGTH"
+#define IIO_SIMULATOR_ENV_MLC_PERIOD_MS		"ST_HAL_IIO_SIM_MLC_PERIOD_MS"
+#define IIO_SIMULATOR_ENV_IMUS			"ST_HAL_IIO_SIM_IMUS"
+#define IIO_SIMULATOR_ENV_TIMESTAMP_CLOCK	"ST_HAL_IIO_SIM_TIMESTAMP_CLOCK"
+#define IIO_SIMULATOR_ENV_OVERRUN_PERIOD_MS	"ST_HAL_IIO_SIM_OVERRUN_PERIOD_MS"
+
+/*
+ * struct iio_simulator_config: simulated device configuration
+ * @sysfs_dir: directory holding the simulated sysfs tree, '/' terminated.
+ * @odr_available: sampling_frequency_available content.
+ * @fifo_length: hwfifo_watermark_max, samples.
+ * @mlc_period_ms: MLC event period, 0 to disable MLC events.
+ * @imus: number of simulated ASM330LHHX, 1 to IIO_SIMULATOR_MAX_IMUS.
+ * @timestamp_clock: current_timestamp_clock, can not be changed when set.
+ * @overrun_period_ms: period of injected FIFO overruns, 0 to disable.
+ */
+struct iio_simulator_config {
+	char sysfs_dir[DEVICE_IIO_MAX_FILENAME_LEN / 2];
+	char odr_available[64];
+	unsigned int fifo_length;
+	unsigned int mlc_period_ms;
+	unsigned int imus;
+	char timestamp_clock[DEVICE_IIO_MAX_NAME_LENGTH];
+	unsigned int overrun_period_ms;
+};
+
+/*
+ * class IIOSimulator
+ *
+ * In-process ASM330LHHX parts replacing the kernel IIO devices, so the whole
+ * HAL can run where no sensor is available. Sysfs attributes are regular
+ * files of a directory tree that the HAL discovers as usual, writes to
+ * them go through the simulator transport that applies sampling_frequency,
+ * hwfifo_watermark, hwfifo_flush, buffer/enable, scale and
+ * current_timestamp_clock, buffer/length is rejected while enabled. Buffer and
+ * events char devices are pipes: one thread per sensor pushes the samples
+ * due every time a watermark is reached, like the hw FIFO interrupt does,
+ * followed by a FIFO flush event when a flush is requested. MLC events are
+ * periodically raised on the accelerometer events channel. Each part uses
+ * three consecutive iio:device numbers (accelerometer, gyroscope, MLC).
+ */
+class IIOSimulator {
+public:
+	static void LoadConfig(struct iio_simulator_config *config);
+	static int Start(const struct iio_simulator_config *config);
+	static void Stop();
+	static void Mute(bool mute);
+};
+
+#endif /* ST_IIO_SIMULATOR_H */
@@ -0,0 +1,173 @@
+/*
+ * STMicroelectronics Latency Histogram Class
+ *
+ * Copyright 2021 STMicroelectronics Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ */
+
+#define __STDC_FORMAT_MACROS
+
+#include <inttypes.h>
+#include <math.h>
+
+#include "LatencyHistogram.h"
+
+LatencyHistogram::LatencyHistogram()
+{
+	Reset();
+}
+
+LatencyHistogram::~LatencyHistogram()
+{
+
+}
+
+unsigned int LatencyHistogram::GetBucketIndex(int64_t value)
+{
+	unsigned int msb;
+	uint64_t v = (uint64_t)value;
+
+	if (v >= (1ULL << LATENCY_HISTOGRAM_MAX_BITS))
+		v = (1ULL << LATENCY_HISTOGRAM_MAX_BITS) - 1;
+
+	if (v < LATENCY_HISTOGRAM_SUB_BUCKETS)
+		return (unsigned int)v;
+
+	msb = 63 - __builtin_clzll(v);
+
+	return (msb - LATENCY_HISTOGRAM_SUB_BITS + 1) *
+	       LATENCY_HISTOGRAM_SUB_BUCKETS +
+	       ((v >> (msb - LATENCY_HISTOGRAM_SUB_BITS)) &
+		(LATENCY_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+int64_t LatencyHistogram::GetBucketHighestValue(unsigned int index)
+{
+	unsigned int shift;
+	uint64_t sub;
+
+	if (index < LATENCY_HISTOGRAM_SUB_BUCKETS)
+		return index;
+
+	shift = index / LATENCY_HISTOGRAM_SUB_BUCKETS - 1;
+	sub = index % LATENCY_HISTOGRAM_SUB_BUCKETS;
+
+	return (int64_t)(((LATENCY_HISTOGRAM_SUB_BUCKETS + sub) << shift) +
+			 (1ULL << shift) - 1);
+}
+
+/**
+ * Record() - Add a sample
+ * @value: latency [ns], negative values are only counted.
+ **/
+void LatencyHistogram::Record(int64_t value)
+{
+	int64_t max;
+
+	if (value < 0) {
+		negative_count.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	counts[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+	total_count.fetch_add(1, std::memory_order_relaxed);
+	total_sum.fetch_add(value, std::memory_order_relaxed);
+
+	max = max_value.load(std::memory_order_relaxed);
+	while ((value > max) &&
+	       !max_value.compare_exchange_weak(max, value,
+						std::memory_order_relaxed))
+		;
+}
+
+void LatencyHistogram::Reset()
+{
+	unsigned int i;
+
+	for (i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+		counts[i].store(0, std::memory_order_relaxed);
+
+	total_count.store(0, std::memory_order_relaxed);
+	negative_count.store(0, std::memory_order_relaxed);
+	total_sum.store(0, std::memory_order_relaxed);
+	max_value.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::GetCount()
+{
+	return total_count.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::GetMax()
+{
+	return max_value.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::GetMean()
+{
+	uint64_t count = GetCount();
+
+	if (count == 0)
+		return 0;
+
+	return total_sum.load(std::memory_order_relaxed) / (int64_t)count;
+}
+
+/**
+ * GetPercentile() - Get the value below which a percentage of samples fall
+ * @percentile: [0, 100].
+ *
+ * Return value: highest value equivalent to the bucket found, 0 if empty.
+ **/
+int64_t LatencyHistogram::GetPercentile(double percentile)
+{
+	unsigned int i;
+	uint64_t total = 0, target, cumulative = 0;
+	uint64_t snapshot[LATENCY_HISTOGRAM_BUCKETS];
+	int64_t value, max = GetMax();
+
+	for (i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+		snapshot[i] = counts[i].load(std::memory_order_relaxed);
+		total += snapshot[i];
+	}
+
+	if (total == 0)
+		return 0;
+
+	if (percentile > 100.0)
+		percentile = 100.0;
+
+	target = (uint64_t)ceil(percentile / 100.0 * total);
+	if (target == 0)
+		target = 1;
+
+	for (i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+		cumulative += snapshot[i];
+		if (cumulative >= target)
+			break;
+	}
+
+	value = GetBucketHighestValue(i);
+
+	return value > max ? max : value;
+}
+
+/**
+ * Dump() - Print a one line summary, values in microseconds
+ * @file: output stream.
+ * @name: histogram label.
+ **/
+void LatencyHistogram::Dump(FILE *file, const char *name)
+{
+	fprintf(file, "%-32s count=%" PRIu64 " negative=%" PRIu64
+		" mean=%.1f p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f\n",
+		name, GetCount(),
+		negative_count.load(std::memory_order_relaxed),
+		GetMean() / 1000.0,
+		GetPercentile(50.0) / 1000.0,
+		GetPercentile(90.0) / 1000.0,
+		GetPercentile(99.0) / 1000.0,
+		GetPercentile(99.9) / 1000.0,
+		GetMax() / 1000.0);
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2021 STMicroelectronics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ST_LATENCY_HISTOGRAM_H
+#define ST_LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+
+/*
+ * Log-linear buckets: values below 2^SUB_BITS are exact, each following
+ * power of two is split in 2^SUB_BITS linear sub-buckets, so the error
+ * is bounded to 1/16 of the value. Values are clamped to 2^MAX_BITS ns
+ * (~18 minutes).
+ */
+#define LATENCY_HISTOGRAM_SUB_BITS	(4)
+#define LATENCY_HISTOGRAM_SUB_BUCKETS	(1 << LATENCY_HISTOGRAM_SUB_BITS)
+#define LATENCY_HISTOGRAM_MAX_BITS	(40)
+#define LATENCY_HISTOGRAM_BUCKETS	((LATENCY_HISTOGRAM_MAX_BITS - \
+					  LATENCY_HISTOGRAM_SUB_BITS + 1) * \
+					 LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+/*
+ * class LatencyHistogram
+ *
+ * Record() is wait-free and may be called by any thread, readers get a
+ * consistent enough view without stopping writers.
+ */
+class LatencyHistogram {
+private:
+	std::atomic<uint64_t> counts[LATENCY_HISTOGRAM_BUCKETS];
+	std::atomic<uint64_t> total_count;
+	std::atomic<uint64_t> negative_count;
+	std::atomic<int64_t> total_sum;
+	std::atomic<int64_t> max_value;
+
+	static unsigned int GetBucketIndex(int64_t value);
+	static int64_t GetBucketHighestValue(unsigned int index);
+
+public:
+	LatencyHistogram();
+	~LatencyHistogram();
+
+	void Record(int64_t value);
+	void Reset();
+
+	uint64_t GetCount();
+	int64_t GetMax();
+	int64_t GetMean();
+	int64_t GetPercentile(double percentile);
+
+	void Dump(FILE *file, const char *name);
+};
+
+#endif /* ST_LATENCY_HISTOGRAM_H */
@@ -0,0 +1,186 @@
+/*
+ * STMicroelectronics Memory Arena Class
+ *
+ * Copyright 2021 STMicroelectronics Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "SensorBase.h"
+#include "MemoryArena.h"
+
+pthread_mutex_t MemoryArena::arena_mutex = PTHREAD_MUTEX_INITIALIZER;
+uint8_t *MemoryArena::base = NULL;
+size_t MemoryArena::size = 0;
+size_t MemoryArena::used = 0;
+bool MemoryArena::locked = false;
+bool MemoryArena::sealed = false;
+std::atomic<unsigned int> MemoryArena::heap_allocations(0);
+
+/**
+ * Init() - Allocate and prefault the arena
+ * @arena_size: bytes needed by the sensors graph.
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int MemoryArena::Init(size_t arena_size)
+{
+	void *ptr;
+
+	pthread_mutex_lock(&arena_mutex);
+
+	if (base) {
+		pthread_mutex_unlock(&arena_mutex);
+		return -EBUSY;
+	}
+
+	used = 0;
+	sealed = false;
+	heap_allocations.store(0);
+
+	if (arena_size == 0) {
+		pthread_mutex_unlock(&arena_mutex);
+		return 0;
+	}
+
+	arena_size = MEMORY_ARENA_ALIGN(arena_size);
+
+	ptr = mmap(NULL, arena_size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (ptr == MAP_FAILED) {
+		pthread_mutex_unlock(&arena_mutex);
+		ALOGE("Failed to allocate memory arena (%zu bytes).", arena_size);
+		return -ENOMEM;
+	}
+
+	/* MAP_POPULATE is best effort, touch every page */
+	memset(ptr, 0, arena_size);
+
+#ifdef CONFIG_ST_HAL_MEMORY_ARENA_MLOCK
+	if (mlock(ptr, arena_size) < 0)
+		ALOGE("Failed to lock memory arena in RAM (errno %d).", errno);
+	else
+		locked = true;
+#endif /* CONFIG_ST_HAL_MEMORY_ARENA_MLOCK */
+
+	base = (uint8_t *)ptr;
+	size = arena_size;
+
+	pthread_mutex_unlock(&arena_mutex);
+
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
+	ALOGD("Memory arena: %zu bytes%s.", arena_size,
+	      locked ? ", locked in RAM" : "");
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
+
+	return 0;
+}
+
+/**
+ * Seal() - Mark the end of the allocations expected at open time
+ **/
+void MemoryArena::Seal()
+{
+	pthread_mutex_lock(&arena_mutex);
+	sealed = true;
+	pthread_mutex_unlock(&arena_mutex);
+
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
+	ALOGD("Memory arena sealed: %zu/%zu bytes used.", used, size);
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
+}
+
+/**
+ * Release() - Give back the arena memory
+ *
+ * All the buffers allocated from the arena must be freed already.
+ **/
+void MemoryArena::Release()
+{
+	pthread_mutex_lock(&arena_mutex);
+
+	if (base) {
+		if (locked)
+			munlock(base, size);
+
+		munmap(base, size);
+	}
+
+	base = NULL;
+	size = 0;
+	used = 0;
+	locked = false;
+	sealed = false;
+
+	pthread_mutex_unlock(&arena_mutex);
+}
+
+/**
+ * Alloc() - Get a cache line aligned buffer
+ * @alloc_size: bytes requested.
+ *
+ * Return value: pointer to the buffer, NULL on fail.
+ **/
+void *MemoryArena::Alloc(size_t alloc_size)
+{
+	void *ptr;
+
+	alloc_size = MEMORY_ARENA_ALIGN(alloc_size);
+
+	pthread_mutex_lock(&arena_mutex);
+
+	if (base && (used + alloc_size <= size)) {
+		ptr = base + used;
+		used += alloc_size;
+		pthread_mutex_unlock(&arena_mutex);
+
+		return ptr;
+	}
+
+	if (sealed) {
+		heap_allocations.fetch_add(1, std::memory_order_relaxed);
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
+		ALOGD("Memory arena exhausted, %zu bytes from heap.",
+		      alloc_size);
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
+	}
+
+	pthread_mutex_unlock(&arena_mutex);
+
+	if (posix_memalign(&ptr, ST_HAL_CACHE_LINE_SIZE, alloc_size))
+		return NULL;
+
+	return ptr;
+}
+
+/**
+ * Free() - Free a buffer returned by Alloc()
+ * @ptr: buffer pointer, arena memory is given back by Release().
+ **/
+void MemoryArena::Free(void *ptr)
+{
+	uint8_t *p = (uint8_t *)ptr;
+
+	if (!p)
+		return;
+
+	if (base && (p >= base) && (p < base + size))
+		return;
+
+	free(ptr);
+}
+
+size_t MemoryArena::GetUsed()
+{
+	return used;
+}
+
+unsigned int MemoryArena::GetHeapAllocations()
+{
+	return heap_allocations.load(std::memory_order_relaxed);
+}
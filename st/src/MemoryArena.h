@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2021 STMicroelectronics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ST_MEMORY_ARENA_H
+#define ST_MEMORY_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include <atomic>
+
+#include "common_data.h"
+
+#define MEMORY_ARENA_ALIGN(size)	(((size) + ST_HAL_CACHE_LINE_SIZE - 1) & \
+					 ~((size_t)ST_HAL_CACHE_LINE_SIZE - 1))
+
+/*
+ * class MemoryArena
+ *
+ * HAL wide bump allocator for the buffers used by data threads. It is
+ * sized from the sensors graph, allocated and prefaulted when the HAL is
+ * opened and sealed before data threads start. Allocations made before
+ * Init() (or when the arena is full) fall back to the heap; once sealed
+ * each fallback is counted, so a non zero GetHeapAllocations() means the
+ * data path allocated memory.
+ */
+class MemoryArena {
+private:
+	static pthread_mutex_t arena_mutex;
+	static uint8_t *base;
+	static size_t size;
+	static size_t used;
+	static bool locked;
+	static bool sealed;
+	static std::atomic<unsigned int> heap_allocations;
+
+public:
+	static int Init(size_t arena_size);
+	static void Seal();
+	static void Release();
+
+	static void *Alloc(size_t alloc_size);
+	static void Free(void *ptr);
+
+	static size_t GetUsed();
+	static unsigned int GetHeapAllocations();
+};
+
+#endif /* ST_MEMORY_ARENA_H */
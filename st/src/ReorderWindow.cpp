@@ -0,0 +1,180 @@
+/*
+ * STMicroelectronics Reorder Window Class
+ *
+ * Copyright 2021 STMicroelectronics Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ */
+
+#include <string.h>
+
+#include "ReorderWindow.h"
+#include "MemoryArena.h"
+
+ReorderWindow::ReorderWindow()
+{
+	window = 0;
+	newest = INT64_MIN;
+	length = 0;
+	head = 0;
+	count = 0;
+	events = NULL;
+	arrival = NULL;
+}
+
+ReorderWindow::~ReorderWindow()
+{
+	MemoryArena::Free(events);
+	MemoryArena::Free(arrival);
+}
+
+/**
+ * GetLength() - Get the events a window can hold
+ * @window_ns: window length [ns].
+ * @min_period_ns: period of the fastest ODR [ns].
+ *
+ * Return value: events arriving in a window, and as many late ones.
+ **/
+unsigned int ReorderWindow::GetLength(int64_t window_ns, int64_t min_period_ns)
+{
+	if (min_period_ns <= 0)
+		return 0;
+
+	return (unsigned int)(window_ns / min_period_ns + 1) *
+	       ST_REORDER_WINDOW_LATE_FACTOR;
+}
+
+/**
+ * GetSize() - Bytes of MemoryArena used by Init()
+ * @len: number of events.
+ **/
+size_t ReorderWindow::GetSize(unsigned int len)
+{
+	return MEMORY_ARENA_ALIGN(len * sizeof(sensors_event_t)) +
+	       MEMORY_ARENA_ALIGN(len * sizeof(int64_t));
+}
+
+/**
+ * Init() - Allocate the window
+ * @len: number of events.
+ *
+ * Return value: 0 on success, -ENOMEM on fail.
+ **/
+int ReorderWindow::Init(unsigned int len)
+{
+	MemoryArena::Free(events);
+	MemoryArena::Free(arrival);
+
+	events = (sensors_event_t *)MemoryArena::Alloc(len * sizeof(sensors_event_t));
+	arrival = (int64_t *)MemoryArena::Alloc(len * sizeof(int64_t));
+	if (!events || !arrival) {
+		MemoryArena::Free(events);
+		MemoryArena::Free(arrival);
+		events = NULL;
+		arrival = NULL;
+	}
+
+	length = events ? len : 0;
+	head = 0;
+	count = 0;
+
+	return events ? 0 : -ENOMEM;
+}
+
+/**
+ * SetWindow() - Set how long events are held
+ * @window_ns: window length [ns].
+ **/
+void ReorderWindow::SetWindow(int64_t window_ns)
+{
+	window = window_ns;
+}
+
+/**
+ * Insert() - Sort an event into the window
+ * @event: event to copy.
+ * @now: arrival time [ns].
+ *
+ * Return value: number of held events newer than @event (0 when it
+ *               arrived in order), -EEXIST if an event with the same
+ *               timestamp is held, -ENOMEM if the window is full.
+ **/
+int ReorderWindow::Insert(const sensors_event_t *event, int64_t now)
+{
+	unsigned int i = count, k;
+
+	if (count == length)
+		return -ENOMEM;
+
+	/* events mostly come in order, search from the newest */
+	while ((i > 0) && (events[Index(i - 1)].timestamp > event->timestamp))
+		i--;
+
+	if ((i > 0) && (events[Index(i - 1)].timestamp == event->timestamp))
+		return -EEXIST;
+
+	for (k = count; k > i; k--) {
+		memcpy(&events[Index(k)], &events[Index(k - 1)],
+		       sizeof(sensors_event_t));
+		arrival[Index(k)] = arrival[Index(k - 1)];
+	}
+
+	memcpy(&events[Index(i)], event, sizeof(sensors_event_t));
+	arrival[Index(i)] = now;
+	count++;
+
+	if (event->timestamp > newest)
+		newest = event->timestamp;
+
+	return count - i - 1;
+}
+
+/**
+ * PopReady() - Release the oldest event if out of the window
+ * @event: released event.
+ *
+ * Return value: true if @event is valid.
+ **/
+bool ReorderWindow::PopReady(sensors_event_t *event)
+{
+	if (!count || (events[head].timestamp > newest - window))
+		return false;
+
+	return Pop(event);
+}
+
+/**
+ * PopExpired() - Release the oldest event if held for the window
+ * @event: released event.
+ * @now: current time [ns].
+ *
+ * No newer event may come for a while (ODR change, disable without
+ * flush), held events must not wait for it.
+ *
+ * Return value: true if @event is valid.
+ **/
+bool ReorderWindow::PopExpired(sensors_event_t *event, int64_t now)
+{
+	if (now < GetDeadline())
+		return false;
+
+	return Pop(event);
+}
+
+/**
+ * Pop() - Release the oldest event
+ * @event: released event.
+ *
+ * Return value: true if @event is valid.
+ **/
+bool ReorderWindow::Pop(sensors_event_t *event)
+{
+	if (!count)
+		return false;
+
+	memcpy(event, &events[head], sizeof(sensors_event_t));
+	head = (head + 1) % length;
+	count--;
+
+	return true;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2021 STMicroelectronics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ST_REORDER_WINDOW_H
+#define ST_REORDER_WINDOW_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+
+#include <hardware/sensors.h>
+
+/* events held per window of the fastest ODR, room for late ones */
+#define ST_REORDER_WINDOW_LATE_FACTOR		(2)
+
+/*
+ * class ReorderWindow
+ *
+ * Ring of events sorted by timestamp, held until an event newer by the
+ * window length is inserted or the window elapses since the oldest one
+ * arrived: a late event is sorted into place as long as the ones
+ * following it are still held. Storage comes from MemoryArena, sized for
+ * the sensor ODR. Not thread safe, callers lock.
+ */
+class ReorderWindow {
+private:
+	int64_t window;
+	int64_t newest;
+	unsigned int length;
+	unsigned int head;
+	unsigned int count;
+	sensors_event_t *events;
+	int64_t *arrival;
+
+	/* ring position of the i-th oldest held event */
+	inline unsigned int Index(unsigned int i) {
+		return (head + i) % length;
+	}
+
+public:
+	ReorderWindow();
+	~ReorderWindow();
+
+	static unsigned int GetLength(int64_t window_ns, int64_t min_period_ns);
+	static size_t GetSize(unsigned int len);
+
+	int Init(unsigned int len);
+	void SetWindow(int64_t window_ns);
+	int Insert(const sensors_event_t *event, int64_t now);
+	bool PopReady(sensors_event_t *event);
+	bool PopExpired(sensors_event_t *event, int64_t now);
+	bool Pop(sensors_event_t *event);
+
+	unsigned int GetLength() { return length; }
+	bool IsFull() { return count == length; }
+
+	/* time the oldest held event is released, INT64_MAX if empty */
+	int64_t GetDeadline() {
+		return count ? arrival[head] + window : INT64_MAX;
+	}
+};
+
+#endif /* ST_REORDER_WINDOW_H */
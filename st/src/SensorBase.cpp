@@ -16,29 +16,11 @@
 #include <string.h>
 #include <signal.h>
 #include <unistd.h>
+#include <new>
 
 #include "SensorBase.h"
 #include "iNotifyConfigMngmt.h"
 
-#if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_PIE_VERSION)
-#if (CONFIG_ST_HAL_ADDITIONAL_INFO_ENABLED)
-static int64_t elapsedRealtimeNano()
-{
-#ifdef PLTF_LINUX_ENABLED
-    struct timespec ts;
-    int err = clock_gettime(CLOCK_BOOTTIME, &ts);
-    if (err) {
-        ALOGE("clock_gettime(CLOCK_BOOTTIME) failed: %s", strerror(errno));
-        return 0;
-    }
-    return (ts.tv_sec * 1000000000) + ts.tv_nsec;
-#else
-    return android::elapsedRealtimeNano();
-#endif
-}
-#endif /* CONFIG_ST_HAL_ADDITIONAL_INFO_ENABLED */
-#endif /* CONFIG_ST_HAL_ANDROID_VERSION */
-
 #if (CONFIG_ST_HAL_ANDROID_VERSION == ST_HAL_KITKAT_VERSION)
 void atomic_init(atomic_short *atom, int num)
 {
@@ -91,8 +73,9 @@ SensorBase::SensorBase(const char *name, int handle, int type)
 	valid_class = true;
 	memset(dependencies_type_list, 0,
 	       SENSOR_DEPENDENCY_ID_MAX * sizeof(int));
-	memset(&push_data, 0, sizeof(dependencies_t));
-	memset(&dependencies, 0, sizeof(push_data_t));
+	memset(&push_data, 0, sizeof(push_data_t));
+	memset(&dependencies, 0, sizeof(dependencies_t));
+	memset(circular_buffer_data, 0, sizeof(circular_buffer_data));
 	memset(&sensor_t_data, 0, sizeof(struct sensor_t));
 	memset(&sensor_event, 0, sizeof(sensors_event_t));
 	memset(sensors_pollrates, 0,
@@ -111,7 +94,7 @@ SensorBase::SensorBase(const char *name, int handle, int type)
 	sensor_t_data.vendor = "STMicroelectronics";
 	sensor_t_data.version = 1;
 
-	last_data_timestamp = 0;
+	last_data_timestamp.store(0);
 	enabled_sensors_mask = 0;
 	current_real_pollrate = 0;
 	sample_in_processing_timestamp = 0;
@@ -121,8 +104,11 @@ SensorBase::SensorBase(const char *name, int handle, int type)
 	sensor_global_disable = 1;
 	sensor_my_enable = 0;
 	sensor_my_disable = 1;
+	min_period_snapshot.store(0);
+	min_timeout_snapshot.store(INT64_MAX);
 	decimator = 1;
 	samples_counter = 0;
+	sample_scale = 1.0f;
 
 #if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_PIE_VERSION)
 #if (CONFIG_ST_HAL_ADDITIONAL_INFO_ENABLED)
@@ -139,6 +125,14 @@ SensorBase::SensorBase(const char *name, int handle, int type)
 
 	pthread_mutex_init(&enable_mutex, NULL);
 	pthread_mutex_init(&sample_in_processing_mutex, NULL);
+#if (CONFIG_ST_HAL_REORDER_WINDOW_MS > 0)
+	pthread_mutex_init(&reorder_mutex, NULL);
+	reorder_window.SetWindow(CONFIG_ST_HAL_REORDER_WINDOW_MS * 1000000LL);
+#endif /* CONFIG_ST_HAL_REORDER_WINDOW_MS */
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+	pthread_mutex_init(&batch_mutex, NULL);
+	batch_span.store(0);
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
 
 	err = pipe(pipe_fd);
 	if (err < 0) {
@@ -163,6 +157,21 @@ SensorBase::~SensorBase()
 	close(read_pipe_fd);
 }
 
+void *SensorBase::operator new(size_t size)
+{
+	void *p;
+
+	if (posix_memalign(&p, ST_HAL_CACHE_LINE_SIZE, size))
+		throw std::bad_alloc();
+
+	return p;
+}
+
+void SensorBase::operator delete(void *p)
+{
+	free(p);
+}
+
 DependencyID SensorBase::GetDependencyIDFromHandle(int handle)
 {
 	return handle_remapping_ID[handle];
@@ -188,6 +197,26 @@ int SensorBase::CustomInit()
 	return 0;
 }
 
+/**
+ * GetDataBufferSize() - Bytes of MemoryArena used by AllocateDataBuffer()
+ **/
+size_t SensorBase::GetDataBufferSize()
+{
+	return 0;
+}
+
+/**
+ * AllocateDataBuffer() - Allocate buffers used by data thread
+ *
+ * Called at open time, before data threads start.
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int SensorBase::AllocateDataBuffer()
+{
+	return 0;
+}
+
 int SensorBase::GetHandle()
 {
 	return sensor_t_data.handle;
@@ -203,6 +232,17 @@ int SensorBase::GetMaxFifoLenght()
 	return sensor_t_data.fifoMaxEventCount;
 }
 
+/**
+ * GetDependencyBufferSize() - Bytes of MemoryArena needed by each sensor
+ * that depends on this one to buffer its data
+ **/
+size_t SensorBase::GetDependencyBufferSize()
+{
+	return MEMORY_ARENA_ALIGN(sizeof(CircularBuffer)) +
+	       MEMORY_ARENA_ALIGN(SENSOR_BASE_DEPENDENCY_BUFFER_LEN(
+			sensor_t_data.fifoMaxEventCount) * sizeof(SensorBaseData));
+}
+
 int SensorBase::GetFdPipeToRead()
 {
 	return read_pipe_fd;
@@ -210,12 +250,14 @@ int SensorBase::GetFdPipeToRead()
 
 void SensorBase::SetBitEnableMask(int handle)
 {
-	enabled_sensors_mask |= (1ULL << handle);
+	enabled_sensors_mask.fetch_or((int64_t)(1ULL << handle),
+				      std::memory_order_release);
 }
 
 void SensorBase::ResetBitEnableMask(int handle)
 {
-	enabled_sensors_mask &= ~(1ULL << handle);
+	enabled_sensors_mask.fetch_and((int64_t)~(1ULL << handle),
+				       std::memory_order_release);
 }
 
 int SensorBase::AddNewPollrate(int64_t timestamp, int64_t pollrate)
@@ -239,12 +281,14 @@ void SensorBase::DeleteLatestNewPollrate()
 
 bool SensorBase::ValidDataToPush(int64_t timestamp)
 {
-	if (sensor_my_enable > sensor_my_disable) {
-		if (timestamp > sensor_my_enable)
+	int64_t my_enable = sensor_my_enable.load(std::memory_order_acquire);
+	int64_t my_disable = sensor_my_disable.load(std::memory_order_acquire);
+
+	if (my_enable > my_disable) {
+		if (timestamp > my_enable)
 			return true;
 	} else {
-		if ((timestamp > sensor_my_enable) &&
-		    (timestamp < sensor_my_disable))
+		if ((timestamp > my_enable) && (timestamp < my_disable))
 			return true;
 	}
 
@@ -359,12 +403,14 @@ enable_unlock_mutex:
 
 bool SensorBase::GetStatusExcludeHandle(int handle)
 {
-	return (enabled_sensors_mask & ~(1ULL << handle)) > 0 ? true : false;
+	return (enabled_sensors_mask.load(std::memory_order_acquire) &
+		~(1ULL << handle)) > 0 ? true : false;
 }
 
 bool SensorBase::GetStatusOfHandle(int handle)
 {
-	return (enabled_sensors_mask & (1ULL << handle)) > 0 ? true : false;
+	return (enabled_sensors_mask.load(std::memory_order_acquire) &
+		(1ULL << handle)) > 0 ? true : false;
 }
 
 bool SensorBase::GetStatusOfHandle(int handle, bool lock_en_mutex)
@@ -374,7 +420,8 @@ bool SensorBase::GetStatusOfHandle(int handle, bool lock_en_mutex)
 	if (lock_en_mutex)
 		pthread_mutex_lock(&enable_mutex);
 
-	status = (enabled_sensors_mask & (1ULL << handle)) > 0 ? true : false;
+	status = (enabled_sensors_mask.load(std::memory_order_acquire) &
+		  (1ULL << handle)) > 0 ? true : false;
 
 	if (lock_en_mutex)
 		pthread_mutex_unlock(&enable_mutex);
@@ -389,7 +436,8 @@ bool SensorBase::GetStatus(bool lock_en_mutex)
 	if (lock_en_mutex)
 		pthread_mutex_lock(&enable_mutex);
 
-	status = enabled_sensors_mask > 0 ? true : false;
+	status = enabled_sensors_mask.load(std::memory_order_acquire) > 0 ?
+								true : false;
 
 	if (lock_en_mutex)
 		pthread_mutex_unlock(&enable_mutex);
@@ -415,6 +463,7 @@ int SensorBase::SetDelay(int handle, int64_t period_ns, int64_t timeout,
 
 	sensors_pollrates[handle] = period_ns;
 	sensors_timeout[handle] = timeout;
+	PublishRates();
 
 	for (i = 0; i < (int)dependencies.num; i++) {
 		err = dependencies.sb[i]->SetDelay(sensor_t_data.handle,
@@ -424,6 +473,13 @@ int SensorBase::SetDelay(int handle, int64_t period_ns, int64_t timeout,
 			goto restore_delay_dependencies;
 	}
 
+	for (i = 0; i < (int)dependencies.num; i++)
+		UpdateBufferLenghtForDependencyData((DependencyID)i);
+
+	/* sensors buffering our data have to follow our rates */
+	for (i = 0; i < (int)push_data.num; i++)
+		push_data.sb[i]->DependencyRatesChanged(this);
+
 	if (lock_en_mutex)
 		pthread_mutex_unlock(&enable_mutex);
 
@@ -432,6 +488,7 @@ int SensorBase::SetDelay(int handle, int64_t period_ns, int64_t timeout,
 restore_delay_dependencies:
 	sensors_pollrates[handle] = restore_min_period_ms;
 	sensors_timeout[handle] = restore_min_timeout;
+	PublishRates();
 
 	for (i--; i >= 0; i--)
 		dependencies.sb[i]->SetDelay(sensor_t_data.handle,
@@ -454,7 +511,7 @@ int SensorBase::AllocateBufferForDependencyData(DependencyID id,
 						unsigned int max_fifo_len)
 {
 	circular_buffer_data[id] =
-		new CircularBuffer(max_fifo_len < 2 ? 10 : 10 * max_fifo_len);
+		new CircularBuffer(SENSOR_BASE_DEPENDENCY_BUFFER_LEN(max_fifo_len));
 	if (!circular_buffer_data[id]) {
 		ALOGE("%s: Failed to allocate circular buffer data.",
 		      GetName());
@@ -467,6 +524,62 @@ int SensorBase::AllocateBufferForDependencyData(DependencyID id,
 void SensorBase::DeAllocateBufferForDependencyData(DependencyID id)
 {
 	delete circular_buffer_data[id];
+	circular_buffer_data[id] = NULL;
+}
+
+/**
+ * UpdateBufferLenghtForDependencyData() - Fit dependency buffer to rates
+ * @id: dependency id.
+ *
+ * The buffer has to hold the samples received from the dependency
+ * between two samples of this sensor, plus a full hw fifo watermark
+ * when the dependency is batching. Requested periods are doubled to
+ * cover the hw ODR rounded up to the next available frequency. The
+ * length is capped to the elements allocated at open time.
+ *
+ * Called when the rates of this sensor or of the dependency change, it
+ * reads the published rates of both and takes no enable_mutex.
+ **/
+void SensorBase::UpdateBufferLenghtForDependencyData(DependencyID id)
+{
+	SensorBase *p = dependencies.sb[id];
+	int64_t producer_period, consumer_period, producer_timeout;
+	int64_t len, burst;
+	unsigned int old_len;
+
+	if (!circular_buffer_data[id] || !p)
+		return;
+
+	producer_period = p->GetMinPeriodSnapshot();
+	consumer_period = GetMinPeriodSnapshot();
+
+	/* not running: keep the current length */
+	if ((producer_period <= 0) || (consumer_period <= 0))
+		return;
+
+	len = 2 * ((consumer_period + producer_period - 1) / producer_period);
+
+	producer_timeout = p->GetMinTimeoutSnapshot();
+	if ((producer_timeout > 0) && (producer_timeout < INT64_MAX)) {
+		burst = 2 * (producer_timeout / producer_period);
+		if (burst > p->GetMaxFifoLenght())
+			burst = p->GetMaxFifoLenght();
+
+		len += burst;
+	}
+
+	len += SENSOR_BASE_DEPENDENCY_BUFFER_MARGIN;
+	if (len > INT_MAX)
+		len = INT_MAX;
+
+	old_len = circular_buffer_data[id]->getLength();
+	len = circular_buffer_data[id]->resize((unsigned int)len);
+
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_VERBOSE)
+	if (len != old_len)
+		ALOGD("\"%s\": dependency \"%s\" buffer length %u -> %d.",
+		      GetName(), p->GetName(), old_len, (int)len);
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
 }
 
 int SensorBase::AddSensorToDataPush(SensorBase *t)
@@ -561,6 +674,11 @@ bool SensorBase::GetSensor_tData(struct sensor_t *data)
 {
 	memcpy(data, &sensor_t_data, sizeof(struct sensor_t));
 
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+	/* batches extend beyond the hw FIFO */
+	data->fifoMaxEventCount += batch_buffer.GetLength();
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+
 	if (sensor_t_data.type >= SENSOR_TYPE_ST_CUSTOM_NO_SENSOR)
 		return false;
 
@@ -584,6 +702,9 @@ void SensorBase::WriteFlushEventToPipe()
 	int err;
 	sensors_event_t flush_event_data;
 
+	/* samples before the flush complete event */
+	DrainHeldEvents();
+
 	memset(&flush_event_data, 0, sizeof(sensors_event_t));
 
 	flush_event_data.sensor = 0;
@@ -600,9 +721,15 @@ void SensorBase::WriteFlushEventToPipe()
 #endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
 
 	err = write(write_pipe_fd, &flush_event_data, sizeof(sensors_event_t));
-	if (err <= 0)
+	if (err <= 0) {
+		metrics.Inc(errno == EAGAIN ? SENSOR_METRIC_PIPE_EAGAIN :
+					      SENSOR_METRIC_PIPE_ERRORS);
 		ALOGE("%s: Failed to write flush event data to pipe.",
 		      android_name);
+		return;
+	}
+
+	metrics.Inc(SENSOR_METRIC_FLUSHES);
 }
 
 #if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_PIE_VERSION)
@@ -653,18 +780,23 @@ void SensorBase::WriteSensorAdditionalInfoReport(additional_info_event_t array_s
 
 }
 
+/**
+ * getSensorAdditionalInfoPayLoadFramesArray() - Get the additional info payload
+ * @array_sensorAdditionalInfoPLFrames: set to sai_placement_frame.
+ *
+ * The frame is a member, flush and enable do not allocate.
+ *
+ * Return value: number of frames.
+ **/
 int SensorBase::getSensorAdditionalInfoPayLoadFramesArray(additional_info_event_t **array_sensorAdditionalInfoPLFrames)
 {
 	int frames = 1;
 
-	*array_sensorAdditionalInfoPLFrames = (additional_info_event_t *)malloc((size_t)frames * sizeof(additional_info_event_t));
-	if (!*array_sensorAdditionalInfoPLFrames) {
-		ALOGE("%s: Failed to allocate memory.", GetName());
-		return -ENOMEM;
-	}
-
-	*array_sensorAdditionalInfoPLFrames[0] = *SensorAdditionalInfoEvent::getDefaultSensorPlacementFrameEvent();
+	sai_placement_frame = *SensorAdditionalInfoEvent::getDefaultSensorPlacementFrameEvent();
+	*array_sensorAdditionalInfoPLFrames = &sai_placement_frame;
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_EXTRA_VERBOSE)
 	ALOGD("%s: Using default SAINFO-SensorPlacement (sensor type: %d).", GetName(), GetType());
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
 	return frames;
 }
 
@@ -675,10 +807,11 @@ void SensorBase::WriteSAIReportToPipe()
 	if (supportsSensorAdditionalInfo) {
 		frames = getSensorAdditionalInfoPayLoadFramesArray(&array_sensorAdditionalInfoPLFrames);
 		if (array_sensorAdditionalInfoPLFrames) {
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_EXTRA_VERBOSE)
 			ALOGD("%s:Sending SAINFO Report.", GetName());
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
 			if (frames > 0)
 				WriteSensorAdditionalInfoReport(array_sensorAdditionalInfoPLFrames, frames);
-			free(array_sensorAdditionalInfoPLFrames);
 		}
 	}
 }
@@ -688,23 +821,20 @@ int SensorBase::UseCustomAINFOSensorPlacementPLFramesArray(
 		additional_info_event_t* customAINFO_Placement_event)
 {
 	const int frames = 1;
-	additional_info_event_t SensorAI_Placement_event;
 
 	if (!customAINFO_Placement_event) {
-		SensorAI_Placement_event = *SensorAdditionalInfoEvent::getDefaultSensorPlacementFrameEvent();
+		sai_placement_frame = *SensorAdditionalInfoEvent::getDefaultSensorPlacementFrameEvent();
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_EXTRA_VERBOSE)
 		ALOGD("%s: using Sensor Additional Info Placement default", GetName());
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
 	} else {
-		SensorAI_Placement_event = *customAINFO_Placement_event;
+		sai_placement_frame = *customAINFO_Placement_event;
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_EXTRA_VERBOSE)
 		ALOGD("%s: using Sensor Additional Info Placement custom", GetName());
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
 	}
 
-	*array_sensorAdditionalInfoPLFrames = (additional_info_event_t *)calloc((size_t)frames , sizeof(additional_info_event_t));
-	if (!array_sensorAdditionalInfoPLFrames) {
-		ALOGE("%s: Failed to allocate memory.", GetName());
-		return -ENOMEM;
-	}
-	for (int i = 0; i < frames; i++)
-		memcpy(&((*array_sensorAdditionalInfoPLFrames)[i]), &SensorAI_Placement_event, sizeof(additional_info_event_t));
+	*array_sensorAdditionalInfoPLFrames = &sai_placement_frame;
 
 	return frames;
 }
@@ -712,28 +842,475 @@ int SensorBase::UseCustomAINFOSensorPlacementPLFramesArray(
 #endif /* CONFIG_ST_HAL_ANDROID_VERSION */
 
 
-void SensorBase::WriteDataToPipe(int64_t __attribute__((unused))hw_pollrate)
+/**
+ * WriteEventToPipe() - Write a data event to the pipe read by poll()
+ * @event: event to write.
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int SensorBase::WriteEventToPipe(const sensors_event_t *event)
 {
 	int err;
 
-	if (ValidDataToPush(sensor_event.timestamp)) {
-		if (sensor_event.timestamp > last_data_timestamp) {
-			err = write(write_pipe_fd,
-				    &sensor_event,
-				    sizeof(sensors_event_t));
-			if (err <= 0) {
-				ALOGE("%s: Failed to write sensor data to pipe. (errno: %d)",
-				      android_name, -errno);
-				return;
+	ST_HAL_TRACE_BEGIN("%s WriteDataToPipe", GetName());
+	err = write(write_pipe_fd, event, sizeof(sensors_event_t));
+	ST_HAL_TRACE_END();
+	if (err <= 0) {
+		metrics.Inc(errno == EAGAIN ?
+			    SENSOR_METRIC_PIPE_EAGAIN :
+			    SENSOR_METRIC_PIPE_ERRORS);
+		metrics.Inc(SENSOR_METRIC_SAMPLES_DROPPED);
+		ALOGE("%s: Failed to write sensor data to pipe. (errno: %d)",
+		      android_name, -errno);
+		return -EIO;
+	}
+
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+	RecordLatency(SENSOR_LATENCY_PIPE, event->timestamp,
+		      elapsedRealtimeNano());
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+
+	return 0;
+}
+
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+/**
+ * WriteEventsToPipe() - Write consecutive data events to the pipe
+ * @iov: spans of events to write.
+ * @iovcnt: number of spans.
+ *
+ * The events are written with a single writev() so the reader wakes up
+ * once for all of them. The pipe is sized by AllocateBatchBuffer(), when
+ * it can not take them all at once writes are PIPE_BUF long at most, so
+ * a concurrent flush event never splits an event.
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int SensorBase::WriteEventsToPipe(const struct iovec *iov, int iovcnt)
+{
+	ssize_t len;
+	int i, queued = 0;
+	size_t size = 0, chunk, chunk_max;
+	const uint8_t *data;
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+	size_t k;
+	int64_t now;
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+
+	for (i = 0; i < iovcnt; i++)
+		size += iov[i].iov_len;
+
+	ST_HAL_TRACE_BEGIN("%s WriteDataToPipe %zu", GetName(),
+			   size / sizeof(sensors_event_t));
+
+	if ((size <= PIPE_BUF) ||
+	    ((ioctl(write_pipe_fd, FIONREAD, &queued) == 0) &&
+	     (queued + size <= batch_buffer.GetLength() * sizeof(sensors_event_t)))) {
+		len = writev(write_pipe_fd, iov, iovcnt);
+		if (len != (ssize_t)size)
+			goto write_error;
+	} else {
+		chunk_max = PIPE_BUF - PIPE_BUF % sizeof(sensors_event_t);
+
+		for (i = 0; i < iovcnt; i++) {
+			data = (const uint8_t *)iov[i].iov_base;
+
+			for (len = iov[i].iov_len; len > 0; len -= chunk) {
+				chunk = (size_t)len > chunk_max ? chunk_max : len;
+
+				if (write(write_pipe_fd, data, chunk) <= 0)
+					goto write_error;
+
+				data += chunk;
+				size -= chunk;
 			}
+		}
+	}
+	ST_HAL_TRACE_END();
+
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+	now = elapsedRealtimeNano();
+	for (i = 0; i < iovcnt; i++) {
+		for (k = 0; k < iov[i].iov_len / sizeof(sensors_event_t); k++)
+			RecordLatency(SENSOR_LATENCY_PIPE,
+				      ((const sensors_event_t *)iov[i].iov_base)[k].timestamp,
+				      now);
+	}
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+
+	return 0;
+
+write_error:
+	ST_HAL_TRACE_END();
+	metrics.Inc(errno == EAGAIN ? SENSOR_METRIC_PIPE_EAGAIN :
+				      SENSOR_METRIC_PIPE_ERRORS);
+	metrics.Add(SENSOR_METRIC_SAMPLES_DROPPED, size / sizeof(sensors_event_t));
+	ALOGE("%s: Failed to write sensor data to pipe. (errno: %d)",
+	      android_name, -errno);
+
+	return -EIO;
+}
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+
+/**
+ * DeliverEvent() - Write an event to the pipe, or batch it
+ * @event: event newer than the ones delivered before.
+ *
+ * With CONFIG_ST_HAL_SW_BATCH_EVENTS and a batch span set by SetDelay()
+ * events are held until the oldest one is older than the span, or the
+ * buffer is full, then written together. Without newer events the data
+ * thread releases them at the deadline, see HeldEventsTimeout().
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int SensorBase::DeliverEvent(const sensors_event_t *event)
+{
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+	int err = 0;
+	int64_t span;
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+
+	last_data_timestamp.store(event->timestamp, std::memory_order_relaxed);
+
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+	if (!batch_buffer.GetLength())
+		return WriteEventToPipe(event);
+
+	span = batch_span.load(std::memory_order_relaxed);
+
+	pthread_mutex_lock(&batch_mutex);
+
+	if (span <= 0) {
+		ReleaseBatch();
+		err = WriteEventToPipe(event);
+	} else {
+		batch_buffer.Push(event);
+
+		if (batch_buffer.IsFull() ||
+		    (event->timestamp >= GetBatchDeadline()))
+			ReleaseBatch();
+	}
+
+	pthread_mutex_unlock(&batch_mutex);
+
+	return err;
+#else /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+	return WriteEventToPipe(event);
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+}
+
+/**
+ * PushDataEvent() - Deliver sensor_event in timestamp order
+ *
+ * With CONFIG_ST_HAL_REORDER_WINDOW_MS events are held until one newer
+ * by the window length arrives, or for the window length, so a late
+ * event is sorted into place instead of being dropped; events not newer
+ * than the last one delivered are dropped and counted. Without a window
+ * events are delivered as they come.
+ *
+ * Return value: 0 if delivered or held, negative number if dropped.
+ **/
+int SensorBase::PushDataEvent()
+{
+#if (CONFIG_ST_HAL_REORDER_WINDOW_MS > 0)
+	int err;
+	int64_t now;
+	sensors_event_t event;
+
+	if (sensor_event.timestamp <=
+	    last_data_timestamp.load(std::memory_order_relaxed)) {
+		metrics.Inc(SENSOR_METRIC_SAMPLES_OUT_OF_ORDER);
+		return -EINVAL;
+	}
+
+	/* no window allocated (on-change sensor) */
+	if (!reorder_window.GetLength())
+		return DeliverEvent(&sensor_event);
+
+	now = elapsedRealtimeNano();
+
+	pthread_mutex_lock(&reorder_mutex);
+
+	if (reorder_window.IsFull() && reorder_window.Pop(&event))
+		DeliverEvent(&event);
+
+	/* drained meanwhile by a flush or a deadline */
+	if (sensor_event.timestamp <=
+	    last_data_timestamp.load(std::memory_order_relaxed)) {
+		err = -EINVAL;
+		goto out_of_order;
+	}
+
+	err = reorder_window.Insert(&sensor_event, now);
+	if (err < 0)
+		goto out_of_order;
+
+	if (err > 0)
+		metrics.Inc(SENSOR_METRIC_SAMPLES_REORDERED);
+
+	while (reorder_window.PopReady(&event) ||
+	       reorder_window.PopExpired(&event, now))
+		DeliverEvent(&event);
+
+	pthread_mutex_unlock(&reorder_mutex);
+
+	return 0;
+
+out_of_order:
+	metrics.Inc(SENSOR_METRIC_SAMPLES_OUT_OF_ORDER);
+	pthread_mutex_unlock(&reorder_mutex);
+
+	return err;
+#else /* CONFIG_ST_HAL_REORDER_WINDOW_MS */
+	return DeliverEvent(&sensor_event);
+#endif /* CONFIG_ST_HAL_REORDER_WINDOW_MS */
+}
+
+/**
+ * DrainHeldEvents() - Deliver the events held by PushDataEvent()
+ **/
+void SensorBase::DrainHeldEvents()
+{
+#if (CONFIG_ST_HAL_REORDER_WINDOW_MS > 0)
+	sensors_event_t event;
+
+	pthread_mutex_lock(&reorder_mutex);
+
+	while (reorder_window.Pop(&event))
+		DeliverEvent(&event);
+
+	pthread_mutex_unlock(&reorder_mutex);
+#endif /* CONFIG_ST_HAL_REORDER_WINDOW_MS */
+
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+	pthread_mutex_lock(&batch_mutex);
+	ReleaseBatch();
+	pthread_mutex_unlock(&batch_mutex);
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+}
 
-			last_data_timestamp = sensor_event.timestamp;
+/**
+ * ReleaseExpiredEvents() - Deliver the held events past their deadline
+ *
+ * Called by the data thread when no new sample came before
+ * HeldEventsTimeout().
+ **/
+void SensorBase::ReleaseExpiredEvents()
+{
+#if (CONFIG_ST_HAL_REORDER_WINDOW_MS > 0) || (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+	int64_t now = elapsedRealtimeNano();
+#endif /* CONFIG_ST_HAL_REORDER_WINDOW_MS || CONFIG_ST_HAL_SW_BATCH_EVENTS */
+#if (CONFIG_ST_HAL_REORDER_WINDOW_MS > 0)
+	sensors_event_t event;
+
+	pthread_mutex_lock(&reorder_mutex);
+
+	while (reorder_window.PopExpired(&event, now))
+		DeliverEvent(&event);
+
+	pthread_mutex_unlock(&reorder_mutex);
+#endif /* CONFIG_ST_HAL_REORDER_WINDOW_MS */
+
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+	pthread_mutex_lock(&batch_mutex);
+
+	if (now >= GetBatchDeadline())
+		ReleaseBatch();
+
+	pthread_mutex_unlock(&batch_mutex);
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+}
+
+/**
+ * HeldEventsTimeout() - Shorten a poll() timeout to the next release of
+ * held events
+ * @timeout: poll() timeout [ms], -1 for none.
+ *
+ * Return value: poll() timeout [ms].
+ **/
+int SensorBase::HeldEventsTimeout(int timeout)
+{
+#if (CONFIG_ST_HAL_REORDER_WINDOW_MS > 0) || (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+	int64_t deadline = INT64_MAX, remaining;
+
+#if (CONFIG_ST_HAL_REORDER_WINDOW_MS > 0)
+	pthread_mutex_lock(&reorder_mutex);
+	deadline = reorder_window.GetDeadline();
+	pthread_mutex_unlock(&reorder_mutex);
+#endif /* CONFIG_ST_HAL_REORDER_WINDOW_MS */
+
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+	pthread_mutex_lock(&batch_mutex);
+	remaining = GetBatchDeadline();
+	pthread_mutex_unlock(&batch_mutex);
+
+	if (remaining < deadline)
+		deadline = remaining;
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+
+	if (deadline == INT64_MAX)
+		return timeout;
+
+	remaining = deadline - elapsedRealtimeNano();
+	remaining = remaining > 0 ? remaining / 1000000LL + 1 : 0;
+
+	if ((timeout < 0) || (remaining < timeout))
+		return (int)remaining;
+#endif /* CONFIG_ST_HAL_REORDER_WINDOW_MS || CONFIG_ST_HAL_SW_BATCH_EVENTS */
+
+	return timeout;
+}
+
+#if (CONFIG_ST_HAL_REORDER_WINDOW_MS > 0)
+/**
+ * GetReorderWindowSize() - Bytes of MemoryArena used by AllocateReorderWindow()
+ *
+ * The window holds the events of CONFIG_ST_HAL_REORDER_WINDOW_MS at the
+ * fastest ODR of the sensor.
+ **/
+size_t SensorBase::GetReorderWindowSize()
+{
+	unsigned int len;
+
+	len = ReorderWindow::GetLength(CONFIG_ST_HAL_REORDER_WINDOW_MS * 1000000LL,
+				       sensor_t_data.minDelay * 1000LL);
+	if (!len)
+		return 0;
+
+	return ReorderWindow::GetSize(len);
+}
+
+/**
+ * AllocateReorderWindow() - Allocate the events held by PushDataEvent()
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int SensorBase::AllocateReorderWindow()
+{
+	unsigned int len;
+
+	if (!GetReorderWindowSize() || reorder_window.GetLength())
+		return 0;
+
+	len = ReorderWindow::GetLength(CONFIG_ST_HAL_REORDER_WINDOW_MS * 1000000LL,
+				       sensor_t_data.minDelay * 1000LL);
+
+	return reorder_window.Init(len);
+}
+#endif /* CONFIG_ST_HAL_REORDER_WINDOW_MS */
+
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+/**
+ * ReleaseBatch() - Write the batched events to the pipe
+ *
+ * Called with batch_mutex held. The events stay in the ring until the
+ * next Push(), after the write.
+ **/
+void SensorBase::ReleaseBatch()
+{
+	int iovcnt = 0;
+	unsigned int num;
+	struct iovec iov[2];
+	const sensors_event_t *events;
+
+	if (!batch_buffer.GetCount())
+		return;
+
+	metrics.Inc(SENSOR_METRIC_BATCH_RELEASES);
+
+	/* at most two spans when the ring wraps, written together */
+	while ((iovcnt < 2) && ((num = batch_buffer.GetSpan(&events)) > 0)) {
+		iov[iovcnt].iov_base = (void *)events;
+		iov[iovcnt].iov_len = num * sizeof(sensors_event_t);
+		iovcnt++;
+
+		batch_buffer.Consume(num);
+	}
+
+	WriteEventsToPipe(iov, iovcnt);
+}
+
+/**
+ * GetBatchDeadline() - Time the held batch has to be released at
+ *
+ * Called with batch_mutex held.
+ *
+ * Return value: oldest event timestamp plus the batch span, INT64_MAX
+ *               if nothing is held.
+ **/
+int64_t SensorBase::GetBatchDeadline()
+{
+	int64_t oldest = batch_buffer.GetOldestTimestamp();
+
+	if (oldest == INT64_MAX)
+		return INT64_MAX;
+
+	return oldest + batch_span.load(std::memory_order_relaxed);
+}
+
+/**
+ * GetBatchBufferSize() - Bytes of MemoryArena used by AllocateBatchBuffer()
+ **/
+size_t SensorBase::GetBatchBufferSize()
+{
+	if (!sensor_t_data.fifoMaxEventCount ||
+	    (sensor_t_data.type >= SENSOR_TYPE_ST_CUSTOM_NO_SENSOR))
+		return 0;
+
+	return MEMORY_ARENA_ALIGN(CONFIG_ST_HAL_SW_BATCH_EVENTS *
+				  sizeof(sensors_event_t));
+}
+
+/**
+ * AllocateBatchBuffer() - Allocate the events batched after the hw FIFO
+ *
+ * The pipe read by poll() is enlarged to take a whole batch without
+ * blocking the data thread, the batch is shortened when it can not.
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int SensorBase::AllocateBatchBuffer()
+{
+	int pipe_size;
+	unsigned int len = CONFIG_ST_HAL_SW_BATCH_EVENTS;
+
+	if (!GetBatchBufferSize() || batch_buffer.GetLength())
+		return 0;
+
+	pipe_size = fcntl(write_pipe_fd, F_SETPIPE_SZ,
+			  len * sizeof(sensors_event_t));
+	if (pipe_size < 0)
+		pipe_size = fcntl(write_pipe_fd, F_GETPIPE_SZ);
+	if (pipe_size < 0)
+		return -errno;
+
+	if (len > pipe_size / sizeof(sensors_event_t)) {
+		len = pipe_size / sizeof(sensors_event_t);
+		ALOGW("%s: pipe limited to %d bytes, batching %u events.",
+		      GetName(), pipe_size, len);
+	}
+
+	return batch_buffer.Init(len);
+}
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+
+void SensorBase::WriteDataToPipe(int64_t __attribute__((unused))hw_pollrate)
+{
+	if (ValidDataToPush(sensor_event.timestamp)) {
+#if (CONFIG_ST_HAL_REORDER_WINDOW_MS == 0)
+		/* sw sensors never deliver an event older than the last one */
+		if (sensor_event.timestamp <=
+		    last_data_timestamp.load(std::memory_order_relaxed))
+			return;
+#endif /* CONFIG_ST_HAL_REORDER_WINDOW_MS */
+
+		if (PushDataEvent() < 0)
+			return;
 
 #if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_EXTRA_VERBOSE)
-			ALOGD("\"%s\": pushed data to android: timestamp=%" PRIu64 "ns (sensor type: %d).",
-			      sensor_t_data.name, sensor_event.timestamp, sensor_t_data.type);
+		ALOGD("\"%s\": pushed data to android: timestamp=%" PRIu64 "ns (sensor type: %d).",
+		      sensor_t_data.name, sensor_event.timestamp, sensor_t_data.type);
 #endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
-		}
 	}
 }
 
@@ -741,69 +1318,106 @@ void SensorBase::ProcessData(SensorBaseData *data)
 {
 	unsigned int i;
 
+#ifdef CONFIG_ST_HAL_STAGE_PROFILING
+	/* derived classes process the sample before getting here */
+	profiler.Mark(SENSOR_PROFILE_PROCESS, 1);
+#endif /* CONFIG_ST_HAL_STAGE_PROFILING */
+
 	if (data->flush_event_handle == sensor_t_data.handle)
 		WriteFlushEventToPipe();
 
 	for (i = 0; i < push_data.num; i++)
 		push_data.sb[i]->ReceiveDataFromDependency(sensor_t_data.handle, data);
 
+#ifdef CONFIG_ST_HAL_STAGE_PROFILING
+	profiler.Mark(SENSOR_PROFILE_FANOUT, 1);
+#endif /* CONFIG_ST_HAL_STAGE_PROFILING */
+
 #if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_PIE_VERSION)
 #if (CONFIG_ST_HAL_ADDITIONAL_INFO_ENABLED)
 	if (data->flush_event_handle == sensor_t_data.handle) {
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_EXTRA_VERBOSE)
 		ALOGD("%s:SAINFO Report: FLUSH.", GetName());
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
 		WriteSAIReportToPipe();
 	}
 #endif /* CONFIG_ST_HAL_ADDITIONAL_INFO_ENABLED */
 #endif /* CONFIG_ST_HAL_ANDROID_VERSION */
 }
 
-void SensorBase::applyRotationMatrix(SensorBaseData& data)
+void SensorBase::applyRotationMatrix(SensorBaseData& data,
+				     unsigned int imu_instance)
 {
-	float tmp_data[4];
-	memcpy(tmp_data, data.raw, 4 * sizeof(float));
+	sensor_sample_t tmp_data[4];
+	memcpy(tmp_data, data.raw, 4 * sizeof(sensor_sample_t));
+
+	struct sensor_placement_t placement;
 
-	const struct hal_config_t config = get_config();
+	get_sensor_placement(imu_instance, &placement);
 
-	data.raw[0] = config.sensor_placement.rot[0][0] * tmp_data[0] +
-		      config.sensor_placement.rot[1][0] * tmp_data[1] +
-		      config.sensor_placement.rot[2][0] * tmp_data[2];
+#ifdef CONFIG_ST_HAL_FIXED_POINT_DATA
+	int i;
+	int64_t acc;
 
-	data.raw[1] = config.sensor_placement.rot[0][1] * tmp_data[0] +
-		      config.sensor_placement.rot[1][1] * tmp_data[1] +
-		      config.sensor_placement.rot[2][1] * tmp_data[2];
+	for (i = 0; i < 3; i++) {
+		acc = (int64_t)placement.rot_q[0][i] * tmp_data[0] +
+		      (int64_t)placement.rot_q[1][i] * tmp_data[1] +
+		      (int64_t)placement.rot_q[2][i] * tmp_data[2];
 
-	data.raw[2] = config.sensor_placement.rot[0][2] * tmp_data[0] +
-		      config.sensor_placement.rot[1][2] * tmp_data[1] +
-		      config.sensor_placement.rot[2][2] * tmp_data[2];
+		/* round to nearest */
+		data.raw[i] = (sensor_sample_t)((acc +
+				(1 << (ST_HAL_ROT_MATRIX_Q_SHIFT - 1))) >>
+				ST_HAL_ROT_MATRIX_Q_SHIFT);
+	}
+#else /* CONFIG_ST_HAL_FIXED_POINT_DATA */
+	data.raw[0] = placement.rot[0][0] * tmp_data[0] +
+		      placement.rot[1][0] * tmp_data[1] +
+		      placement.rot[2][0] * tmp_data[2];
+
+	data.raw[1] = placement.rot[0][1] * tmp_data[0] +
+		      placement.rot[1][1] * tmp_data[1] +
+		      placement.rot[2][1] * tmp_data[2];
+
+	data.raw[2] = placement.rot[0][2] * tmp_data[0] +
+		      placement.rot[1][2] * tmp_data[1] +
+		      placement.rot[2][2] * tmp_data[2];
+#endif /* CONFIG_ST_HAL_FIXED_POINT_DATA */
 }
 
 void SensorBase::ReceiveDataFromDependency(int handle, SensorBaseData *data)
 {
-#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_EXTRA_VERBOSE)
 	int err;
-#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
+	uint64_t overruns;
 	bool fill_buffer = false;
+	int64_t global_enable, global_disable;
+	CircularBuffer *buffer;
 
-	if (sensor_global_enable > sensor_global_disable) {
-		if (data->timestamp > sensor_global_enable)
+	global_enable = sensor_global_enable.load(std::memory_order_acquire);
+	global_disable = sensor_global_disable.load(std::memory_order_acquire);
+
+	if (global_enable > global_disable) {
+		if (data->timestamp > global_enable)
 			fill_buffer = true;
 	} else {
-		if ((data->timestamp > sensor_global_enable) &&
-		    (data->timestamp < sensor_global_disable))
+		if ((data->timestamp > global_enable) &&
+		    (data->timestamp < global_disable))
 			fill_buffer = true;
 	}
 
 	if (fill_buffer) {
-#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_EXTRA_VERBOSE)
-		err =
-		  circular_buffer_data[GetDependencyIDFromHandle(handle)]->writeElement(data);
-		if (err < 0)
-			ALOGE("%s: Circular Buffer override, increase CircularBuffer size. Receiving data from dependency %d.",
-			      GetName(),
-			      GetDependencyIDFromHandle(handle));
-#else /* CONFIG_ST_HAL_DEBUG_LEVEL */
-		circular_buffer_data[GetDependencyIDFromHandle(handle)]->writeElement(data);
-#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
+		buffer = circular_buffer_data[GetDependencyIDFromHandle(handle)];
+
+		err = buffer->writeElement(data);
+		if (err < 0) {
+			metrics.Inc(SENSOR_METRIC_BUFFER_OVERRUNS);
+			overruns = buffer->getOverruns();
+
+			/* rate limited: 1st, 2nd, 4th, 8th... overrun */
+			if ((overruns & (overruns - 1)) == 0)
+				ALOGE("%s: Circular Buffer override (%" PRIu64 " samples lost, length %u). Receiving data from dependency %d.",
+				      GetName(), overruns, buffer->getLength(),
+				      GetDependencyIDFromHandle(handle));
+		}
 	}
 
 	return;
@@ -834,6 +1448,39 @@ int64_t SensorBase::GetMinTimeout(bool lock_en_mutex)
 	return min;
 }
 
+/**
+ * PublishRates() - Update min_period_snapshot and min_timeout_snapshot
+ *
+ * Called with enable_mutex held every time sensors_pollrates[] or
+ * sensors_timeout[] change.
+ **/
+void SensorBase::PublishRates()
+{
+	min_period_snapshot.store(GetMinPeriod(false),
+				  std::memory_order_release);
+	min_timeout_snapshot.store(GetMinTimeout(false),
+				   std::memory_order_release);
+}
+
+int64_t SensorBase::GetMinPeriodSnapshot()
+{
+	return min_period_snapshot.load(std::memory_order_acquire);
+}
+
+int64_t SensorBase::GetMinTimeoutSnapshot()
+{
+	return min_timeout_snapshot.load(std::memory_order_acquire);
+}
+
+/**
+ * DependencyRatesChanged() - Refit the buffer of a dependency to its rates
+ * @p: the dependency, called from its SetDelay().
+ **/
+void SensorBase::DependencyRatesChanged(SensorBase *p)
+{
+	UpdateBufferLenghtForDependencyData(GetDependencyIDFromHandle(p->GetHandle()));
+}
+
 int64_t SensorBase::GetMinPeriod(bool lock_en_mutex)
 {
 	int i;
@@ -881,6 +1528,15 @@ void SensorBase::ThreadEventsTask()
 	pthread_exit(NULL);
 }
 
+/**
+ * StopThreads() - Make ThreadDataTask() and ThreadEventsTask() return
+ *
+ * Called by close before the threads are joined.
+ **/
+void SensorBase::StopThreads()
+{
+}
+
 #ifdef PLTF_LINUX_ENABLED
 	/* set engine ignition status (on/off) */
 int SensorBase::Ignition(int val)
@@ -901,6 +1557,47 @@ int SensorBase::InjectSensorData(const sensors_event_t __attribute__((unused))*d
 }
 #endif /* CONFIG_ST_HAL_ANDROID_VERSION */
 
+SensorMetrics *SensorBase::GetMetrics()
+{
+	return &metrics;
+}
+
+#ifdef CONFIG_ST_HAL_STAGE_PROFILING
+StageProfiler *SensorBase::GetProfiler()
+{
+	return &profiler;
+}
+#endif /* CONFIG_ST_HAL_STAGE_PROFILING */
+
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+LatencyHistogram *SensorBase::GetLatencyHistogram(SensorLatencyStage stage)
+{
+	if (stage >= SENSOR_LATENCY_MAX)
+		return NULL;
+
+	return &latency[stage];
+}
+
+/**
+ * DumpLatency() - Print latency histograms of every stage
+ * @file: output stream.
+ **/
+void SensorBase::DumpLatency(FILE *file)
+{
+	char label[SENSOR_BASE_ANDROID_NAME_MAX + 16];
+	static const char *stage_names[SENSOR_LATENCY_MAX] = {
+		"decode", "pipe", "delivery",
+	};
+	int i;
+
+	for (i = 0; i < SENSOR_LATENCY_MAX; i++) {
+		snprintf(label, sizeof(label), "%s/%s", android_name,
+			 stage_names[i]);
+		latency[i].Dump(file, label);
+	}
+}
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+
 bool SensorBase::hasEventChannels()
 {
 	return false;
@@ -910,3 +1607,29 @@ bool SensorBase::hasDataChannels()
 {
 	return false;
 }
+
+/**
+ * GetScanChannels() - Get the iio scan channels read by the sensor
+ *
+ * Samples come with their timestamp whatever its source, the timestamp
+ * channel is up to the hw sensor. A sensor reading only some axes of
+ * its dependencies overrides it, none of the sensors built today does.
+ *
+ * Return value: SENSOR_SCAN_CHANNELS_* mask.
+ **/
+unsigned int SensorBase::GetScanChannels()
+{
+	return SENSOR_SCAN_CHANNELS_DATA;
+}
+
+#ifdef CONFIG_ST_HAL_CAPTURE
+int SensorBase::ReplayScanBatch(uint8_t *data, int read_size)
+{
+	return -EINVAL;
+}
+
+int SensorBase::ReplayEvents(struct device_iio_events *event_data, int num)
+{
+	return -EINVAL;
+}
+#endif /* CONFIG_ST_HAL_CAPTURE */
@@ -27,10 +27,13 @@
 #include <string.h>
 #include <time.h>
 #include <pthread.h>
+#include <sys/uio.h>
 #include <errno.h>
 #include <float.h>
 #include <stdlib.h>
 
+#include <atomic>
+
 #include <hardware/sensors.h>
 
 #ifndef PLTF_LINUX_ENABLED
@@ -54,6 +57,20 @@
 #include <FlushBufferStack.h>
 #include <FlushRequested.h>
 #include <ChangeODRTimestampStack.h>
+#include <MemoryArena.h>
+#include <SensorMetrics.h>
+#include <ReorderWindow.h>
+#include <BatchBuffer.h>
+#include <SensorTrace.h>
+#ifdef CONFIG_ST_HAL_STAGE_PROFILING
+#include <StageProfiler.h>
+#endif /* CONFIG_ST_HAL_STAGE_PROFILING */
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+#include <LatencyHistogram.h>
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+#ifdef CONFIG_ST_HAL_CAPTURE
+#include <SensorCapture.h>
+#endif /* CONFIG_ST_HAL_CAPTURE */
 
 #if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_PIE_VERSION)
 #if (CONFIG_ST_HAL_ADDITIONAL_INFO_ENABLED)
@@ -80,15 +97,52 @@ int atomic_load(atomic_short *counter);
 #define SENSOR_DATA_3AXIS			(3)
 #define SENSOR_DATA_4AXIS			(4)
 
+/*
+ * iio scan channels read by a sensor from its hw sensor: one bit for
+ * each value of SensorBaseData raw[], the timestamp channel last
+ */
+#define SENSOR_SCAN_CHANNELS_AXIS(n)		(1U << (n))
+#define SENSOR_SCAN_CHANNELS_TIMESTAMP		(1U << 31)
+#define SENSOR_SCAN_CHANNELS_DATA		(SENSOR_SCAN_CHANNELS_TIMESTAMP - 1)
+#define SENSOR_SCAN_CHANNELS_ALL		(SENSOR_SCAN_CHANNELS_DATA | \
+						 SENSOR_SCAN_CHANNELS_TIMESTAMP)
+
 #define SENSOR_BASE_ANDROID_NAME_MAX		(40)
 
+/* samples buffered by a sensor for each of its dependencies */
+#define SENSOR_BASE_DEPENDENCY_BUFFER_LEN(fifo_len) \
+					((fifo_len) < 2 ? 10 : 10 * (fifo_len))
+#define SENSOR_BASE_DEPENDENCY_BUFFER_MARGIN	(2)
+
 #define NS_TO_MS(x)				(x / 1E6)
 #define NS_TO_FREQUENCY(x)			(1E9 / x)
 #define FREQUENCY_TO_NS(x)			(1E9 / x)
 #define FREQUENCY_TO_US(x)			(1E6 / x)
 
+/* same time base used by iio scan timestamps and sensors_event_t */
+static inline int64_t elapsedRealtimeNano()
+{
+#ifdef CONFIG_ST_HAL_CAPTURE
+	/* replay runs on the clock of the capture */
+	int64_t replay_time = SensorCapture::GetReplayTime();
+	if (replay_time)
+		return replay_time;
+#endif /* CONFIG_ST_HAL_CAPTURE */
+#ifdef PLTF_LINUX_ENABLED
+	struct timespec ts;
+	int err = clock_gettime(CLOCK_BOOTTIME, &ts);
+	if (err) {
+		ALOGE("clock_gettime(CLOCK_BOOTTIME) failed: %s", strerror(errno));
+		return 0;
+	}
+	return (ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+#else
+	return android::elapsedRealtimeNano();
+#endif
+}
 
 class SensorBase;
+struct device_iio_events;
 
 typedef enum DependencyID {
 	SENSOR_DEPENDENCY_ID_0 = 0,
@@ -111,6 +165,16 @@ typedef struct dependencies {
 	SensorBase *sb[SENSOR_DEPENDENCY_ID_MAX];
 } dependencies_t;
 
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+/* latency from hw timestamp to the end of each stage */
+typedef enum SensorLatencyStage {
+	SENSOR_LATENCY_DECODE = 0,
+	SENSOR_LATENCY_PIPE,
+	SENSOR_LATENCY_DELIVERY,
+	SENSOR_LATENCY_MAX
+} SensorLatencyStage;
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+
 typedef enum InjectionModeID {
 	SENSOR_INJECTION_NONE = 0,
 	SENSOR_INJECTOR,
@@ -122,7 +186,8 @@ class SensorBase {
 private:
 	bool valid_class;
 
-	int64_t enabled_sensors_mask;
+	/* written by framework threads, read lock-free by data threads */
+	alignas(ST_HAL_CACHE_LINE_SIZE) std::atomic<int64_t> enabled_sensors_mask;
 
 	ChangeODRTimestampStack odr_stack;
 	DependencyID handle_remapping_ID[ST_HAL_IIO_MAX_DEVICES];
@@ -139,42 +204,85 @@ private:
 #endif /* CONFIG_ST_HAL_ANDROID_VERSION */
 
 protected:
-	char android_name[SENSOR_BASE_ANDROID_NAME_MAX];
-
-	int write_pipe_fd, read_pipe_fd;
-	int dependencies_type_list[SENSOR_DEPENDENCY_ID_MAX];
-
-	pthread_mutex_t sample_in_processing_mutex;
-	volatile int64_t sample_in_processing_timestamp;
+	/*
+	 * Hot data: touched for every sample by the data thread only, keep it
+	 * on its own cache lines.
+	 */
+	alignas(ST_HAL_CACHE_LINE_SIZE) sensors_event_t sensor_event;
+	std::atomic<int64_t> last_data_timestamp;
+	int64_t current_real_pollrate;
+	int write_pipe_fd;
+	uint8_t decimator;
+	uint8_t samples_counter;
 
-#if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_MARSHMALLOW_VERSION)
-	InjectionModeID injection_mode;
-#endif /* CONFIG_ST_HAL_ANDROID_VERSION */
+	push_data_t push_data;
+	CircularBuffer *circular_buffer_data[SENSOR_DEPENDENCY_ID_MAX];
 
-	int64_t current_real_pollrate;
+	/* per sample handshake between data thread and events thread */
+	alignas(ST_HAL_CACHE_LINE_SIZE) pthread_mutex_t sample_in_processing_mutex;
+	int64_t sample_in_processing_timestamp;
+
+	/*
+	 * Enable/disable timestamps: written by framework threads, read by
+	 * data threads without holding enable_mutex.
+	 */
+	alignas(ST_HAL_CACHE_LINE_SIZE) std::atomic<int64_t> sensor_global_enable;
+	std::atomic<int64_t> sensor_global_disable;
+	std::atomic<int64_t> sensor_my_enable;
+	std::atomic<int64_t> sensor_my_disable;
+
+	/*
+	 * GetMinPeriod()/GetMinTimeout() as of the last SetDelay(), for
+	 * readers not holding enable_mutex.
+	 */
+	std::atomic<int64_t> min_period_snapshot;
+	std::atomic<int64_t> min_timeout_snapshot;
+
+	/* control data: framework threads only, protected by enable_mutex */
+	alignas(ST_HAL_CACHE_LINE_SIZE) pthread_mutex_t enable_mutex;
 	int64_t current_min_pollrate;
 	int64_t current_min_timeout;
-	int64_t last_data_timestamp;
 	int64_t sensors_timeout[ST_HAL_IIO_MAX_DEVICES];
 	int64_t sensors_pollrates[ST_HAL_IIO_MAX_DEVICES];
-	volatile int64_t sensor_global_enable;
-	volatile int64_t sensor_global_disable;
-	volatile int64_t sensor_my_enable;
-	volatile int64_t sensor_my_disable;
-	uint8_t decimator;
-	uint8_t samples_counter;
-
-	push_data_t push_data;
 	dependencies_t dependencies;
 
-	pthread_mutex_t enable_mutex;
-
 	FlushBufferStack flush_stack;
 
-	sensors_event_t sensor_event;
+	/* written lock-free by data, framework and poll threads */
+	alignas(ST_HAL_CACHE_LINE_SIZE) SensorMetrics metrics;
+
+#if (CONFIG_ST_HAL_REORDER_WINDOW_MS > 0)
+	/* data events not delivered yet: data thread, drained on flush/disable/deadline */
+	alignas(ST_HAL_CACHE_LINE_SIZE) pthread_mutex_t reorder_mutex;
+	ReorderWindow reorder_window;
+#endif /* CONFIG_ST_HAL_REORDER_WINDOW_MS */
+
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+	/* events batched after the hw FIFO: data thread, released on span/flush/disable */
+	alignas(ST_HAL_CACHE_LINE_SIZE) pthread_mutex_t batch_mutex;
+	BatchBuffer batch_buffer;
+	std::atomic<int64_t> batch_span;
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+	/* written lock-free by data and poll threads */
+	alignas(ST_HAL_CACHE_LINE_SIZE) LatencyHistogram latency[SENSOR_LATENCY_MAX];
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+
+#ifdef CONFIG_ST_HAL_STAGE_PROFILING
+	alignas(ST_HAL_CACHE_LINE_SIZE) StageProfiler profiler;
+#endif /* CONFIG_ST_HAL_STAGE_PROFILING */
+
+	/* cold data: set up at probe time */
+	char android_name[SENSOR_BASE_ANDROID_NAME_MAX];
+	int read_pipe_fd;
+	int dependencies_type_list[SENSOR_DEPENDENCY_ID_MAX];
 	struct sensor_t sensor_t_data;
+	float sample_scale;
 
-	CircularBuffer *circular_buffer_data[SENSOR_DEPENDENCY_ID_MAX];
+#if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_MARSHMALLOW_VERSION)
+	InjectionModeID injection_mode;
+#endif /* CONFIG_ST_HAL_ANDROID_VERSION */
 
 	void InvalidThisClass();
 	bool GetStatusExcludeHandle(int handle);
@@ -182,15 +290,35 @@ protected:
 	bool GetStatusOfHandle(int handle, bool lock_en_mutex);
 	int64_t GetMinTimeout(bool lock_en_mutex);
 	int64_t GetMinPeriod(bool lock_en_mutex);
+	void PublishRates();
 	DependencyID GetDependencyIDFromHandle(int handle);
 
 	int AllocateBufferForDependencyData(DependencyID id,
 					    unsigned int max_fifo_len);
 	void DeAllocateBufferForDependencyData(DependencyID id);
+	void UpdateBufferLenghtForDependencyData(DependencyID id);
 
 	void SetBitEnableMask(int handle);
 	void ResetBitEnableMask(int handle);
 
+	int WriteEventToPipe(const sensors_event_t *event);
+	int DeliverEvent(const sensors_event_t *event);
+	int PushDataEvent();
+	void DrainHeldEvents();
+	void ReleaseExpiredEvents();
+	int HeldEventsTimeout(int timeout);
+#if (CONFIG_ST_HAL_REORDER_WINDOW_MS > 0)
+	size_t GetReorderWindowSize();
+	int AllocateReorderWindow();
+#endif /* CONFIG_ST_HAL_REORDER_WINDOW_MS */
+#if (CONFIG_ST_HAL_SW_BATCH_EVENTS > 0)
+	int WriteEventsToPipe(const struct iovec *iov, int iovcnt);
+	void ReleaseBatch();
+	int64_t GetBatchDeadline();
+	size_t GetBatchBufferSize();
+	int AllocateBatchBuffer();
+#endif /* CONFIG_ST_HAL_SW_BATCH_EVENTS */
+
 	int AddNewPollrate(int64_t timestamp, int64_t pollrate);
 	int CheckLatestNewPollrate(int64_t *timestamp, int64_t *pollrate);
 	void DeleteLatestNewPollrate();
@@ -199,6 +327,8 @@ protected:
 #if (CONFIG_ST_HAL_ADDITIONAL_INFO_ENABLED)
 
 	bool supportsSensorAdditionalInfo;
+	/* payload of the additional info report, written on flush and enable */
+	additional_info_event_t sai_placement_frame;
 
 	void WriteSensorAdditionalInfoFrameToPipe(additional_info_event_t *p_additional_info_event);
 	virtual int getSensorAdditionalInfoPayLoadFramesArray(additional_info_event_t **array_sensorAdditionalInfoPLFrames);
@@ -213,19 +343,31 @@ public:
 	SensorBase(const char *name, int handle, int type);
 	virtual ~SensorBase();
 
+	/* cache line alignment is not honoured by plain new before c++17 */
+	static void *operator new(size_t size);
+	static void operator delete(void *p);
+
 	bool IsValidClass();
 
 	virtual int CustomInit();
+	virtual size_t GetDataBufferSize();
+	virtual int AllocateDataBuffer();
 
 	int GetType();
 	char* GetName();
+	/* SI units per sample LSB, see ST_HAL_SAMPLE_TO_SI() */
+	float GetSampleScale() { return sample_scale; }
 	int GetHandle();
 	int GetFdPipeToRead();
 	int GetMaxFifoLenght();
+	size_t GetDependencyBufferSize();
 	bool GetSensor_tData(struct sensor_t *data);
 	void GetDepenciesTypeList(int type[SENSOR_DEPENDENCY_ID_MAX]);
 	bool ValidDataToPush(int64_t timestamp);
 	bool GetDependencyMaxRange(int type, float *maxRange);
+	int64_t GetMinPeriodSnapshot();
+	int64_t GetMinTimeoutSnapshot();
+	void DependencyRatesChanged(SensorBase *p);
 
 	virtual int AddSensorDependency(SensorBase *p);
 	virtual void RemoveSensorDependency(SensorBase *p);
@@ -250,13 +392,15 @@ public:
 	virtual int GetLatestValidDataFromDependency(int dependency_id,
 						     SensorBaseData *data,
 						     int64_t timesync);
-	static void applyRotationMatrix(SensorBaseData& data);
+	static void applyRotationMatrix(SensorBaseData& data,
+					unsigned int imu_instance = 0);
 
 	static void *ThreadDataWork(void *context);
 	virtual void ThreadDataTask();
 
 	static void *ThreadEventsWork(void *context);
 	virtual void ThreadEventsTask();
+	virtual void StopThreads();
 
 #if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_MARSHMALLOW_VERSION)
 	virtual int InjectionMode(bool enable);
@@ -268,8 +412,30 @@ public:
 	virtual int Ignition(int val);
 #endif /* PLTF_LINUX_ENABLED */
 
+	SensorMetrics *GetMetrics();
+
+#ifdef CONFIG_ST_HAL_STAGE_PROFILING
+	StageProfiler *GetProfiler();
+#endif /* CONFIG_ST_HAL_STAGE_PROFILING */
+
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+	inline void RecordLatency(SensorLatencyStage stage, int64_t timestamp,
+				  int64_t now) {
+		latency[stage].Record(now - timestamp);
+	}
+	LatencyHistogram *GetLatencyHistogram(SensorLatencyStage stage);
+	void DumpLatency(FILE *file);
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+
 	virtual bool hasEventChannels();
 	virtual bool hasDataChannels();
+	virtual unsigned int GetScanChannels();
+
+#ifdef CONFIG_ST_HAL_CAPTURE
+	/* feed captured driver data as read by data and events threads */
+	virtual int ReplayScanBatch(uint8_t *data, int read_size);
+	virtual int ReplayEvents(struct device_iio_events *event_data, int num);
+#endif /* CONFIG_ST_HAL_CAPTURE */
 };
 
 #endif /* ST_SENSOR_BASE_H */
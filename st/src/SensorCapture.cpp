@@ -0,0 +1,171 @@
+/*
+ * STMicroelectronics Sensor Capture Class
+ *
+ * Copyright 2021 STMicroelectronics Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "SensorBase.h"
+#include "SensorCapture.h"
+
+#ifdef CONFIG_ST_HAL_CAPTURE
+
+#define SENSOR_CAPTURE_FILE_BUFFER		(64 * 1024)
+
+FILE *SensorCapture::file = NULL;
+std::mutex SensorCapture::file_lock;
+std::atomic<bool> SensorCapture::active(false);
+std::atomic<int64_t> SensorCapture::replay_time(0);
+
+/**
+ * Start() - Create capture file and start recording
+ * @filename: capture file.
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int SensorCapture::Start(const char *filename)
+{
+	struct sensor_capture_header header;
+	std::lock_guard<std::mutex> lock(file_lock);
+
+	if (file)
+		return -EBUSY;
+
+	file = fopen(filename, "wb");
+	if (!file)
+		return -errno;
+
+	/* records are small, keep writes off the data threads as much as possible */
+	setvbuf(file, NULL, _IOFBF, SENSOR_CAPTURE_FILE_BUFFER);
+
+	memcpy(header.magic, SENSOR_CAPTURE_MAGIC, sizeof(header.magic));
+	header.version = SENSOR_CAPTURE_VERSION;
+	header.reserved = 0;
+
+	if (fwrite(&header, sizeof(header), 1, file) != 1) {
+		fclose(file);
+		file = NULL;
+		return -EIO;
+	}
+
+	active.store(true);
+
+	return 0;
+}
+
+/**
+ * Stop() - Stop recording and close capture file
+ **/
+void SensorCapture::Stop()
+{
+	std::lock_guard<std::mutex> lock(file_lock);
+
+	active.store(false);
+
+	if (file) {
+		fclose(file);
+		file = NULL;
+	}
+}
+
+/**
+ * Write() - Append a record to the capture file
+ * @type: SensorCaptureRecordType.
+ * @handle: Android sensor handle, -1 if none.
+ * @payload: record data.
+ * @len: record data length.
+ **/
+void SensorCapture::Write(uint16_t type, int handle,
+			  const void *payload, uint32_t len)
+{
+	struct sensor_capture_record record;
+	std::lock_guard<std::mutex> lock(file_lock);
+
+	if (!file)
+		return;
+
+	record.type = type;
+	record.handle = (int16_t)handle;
+	record.len = len;
+	record.timestamp = elapsedRealtimeNano();
+
+	if ((fwrite(&record, sizeof(record), 1, file) != 1) ||
+	    (len && (fwrite(payload, len, 1, file) != 1))) {
+		ALOGE("Failed to write capture record, capture stopped.");
+		active.store(false);
+		fclose(file);
+		file = NULL;
+	}
+}
+
+/**
+ * OpenReplay() - Open a capture file and check its header
+ * @filename: capture file.
+ * @replay_file: opened file, positioned on the first record.
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int SensorCapture::OpenReplay(const char *filename, FILE **replay_file)
+{
+	FILE *f;
+	struct sensor_capture_header header;
+
+	f = fopen(filename, "rb");
+	if (!f)
+		return -errno;
+
+	if ((fread(&header, sizeof(header), 1, f) != 1) ||
+	    memcmp(header.magic, SENSOR_CAPTURE_MAGIC, sizeof(header.magic)) ||
+	    (header.version != SENSOR_CAPTURE_VERSION)) {
+		fclose(f);
+		return -EINVAL;
+	}
+
+	*replay_file = f;
+
+	return 0;
+}
+
+/**
+ * ReadRecord() - Read next record of a capture file
+ * @replay_file: file opened by OpenReplay().
+ * @record: record header.
+ * @payload: payload buffer, grown with realloc() when needed.
+ * @payload_size: size of @payload.
+ *
+ * Return value: 1 if a record was read, 0 at end of file, negative
+ *               number on fail.
+ **/
+int SensorCapture::ReadRecord(FILE *replay_file,
+			      struct sensor_capture_record *record,
+			      uint8_t **payload, size_t *payload_size)
+{
+	uint8_t *buf;
+
+	if (fread(record, sizeof(*record), 1, replay_file) != 1)
+		return feof(replay_file) ? 0 : -EIO;
+
+	if (record->type >= SENSOR_CAPTURE_MAX)
+		return -EINVAL;
+
+	if (record->len > *payload_size) {
+		buf = (uint8_t *)realloc(*payload, record->len);
+		if (!buf)
+			return -ENOMEM;
+
+		*payload = buf;
+		*payload_size = record->len;
+	}
+
+	if (record->len && (fread(*payload, record->len, 1, replay_file) != 1))
+		return -EIO;
+
+	return 1;
+}
+
+#endif /* CONFIG_ST_HAL_CAPTURE */
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2021 STMicroelectronics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ST_SENSOR_CAPTURE_H
+#define ST_SENSOR_CAPTURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <mutex>
+
+#define SENSOR_CAPTURE_MAGIC			"STHALCAP"
+#define SENSOR_CAPTURE_VERSION			(1)
+#define SENSOR_CAPTURE_NAME_MAX			(40)
+
+typedef enum SensorCaptureRecordType {
+	/* struct sensor_capture_sensor, one per sensor at capture start */
+	SENSOR_CAPTURE_SENSOR = 0,
+	/* bytes returned by read() on the iio buffer char device */
+	SENSOR_CAPTURE_SCAN,
+	/* struct device_iio_events array read from the events fd */
+	SENSOR_CAPTURE_EVENTS,
+	/* int32_t enable */
+	SENSOR_CAPTURE_ACTIVATE,
+	/* struct sensor_capture_batch */
+	SENSOR_CAPTURE_BATCH,
+	/* no payload */
+	SENSOR_CAPTURE_FLUSH,
+	/* content of the configuration file */
+	SENSOR_CAPTURE_CONFIG,
+	SENSOR_CAPTURE_MAX
+} SensorCaptureRecordType;
+
+/*
+ * struct sensor_capture_header: capture file header
+ * @magic: SENSOR_CAPTURE_MAGIC, not terminated.
+ * @version: SENSOR_CAPTURE_VERSION.
+ * @reserved: zero.
+ */
+struct sensor_capture_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+};
+
+/*
+ * struct sensor_capture_record: record header, followed by len bytes
+ * @type: SensorCaptureRecordType.
+ * @handle: Android sensor handle, -1 if not related to a sensor.
+ * @len: payload length.
+ * @timestamp: elapsedRealtimeNano() when the record was taken.
+ */
+struct sensor_capture_record {
+	uint16_t type;
+	int16_t handle;
+	uint32_t len;
+	int64_t timestamp;
+};
+
+struct sensor_capture_sensor {
+	int32_t type;
+	char name[SENSOR_CAPTURE_NAME_MAX];
+};
+
+struct sensor_capture_batch {
+	int64_t period_ns;
+	int64_t timeout;
+};
+
+/*
+ * class SensorCapture
+ *
+ * Records what the HAL receives from drivers and framework in a binary
+ * file (host endianness, no padding between records), so that a session
+ * can be replayed through the same code later. Record() is a single
+ * relaxed load when capture is not running. During replay the record
+ * timestamps drive elapsedRealtimeNano().
+ */
+class SensorCapture {
+private:
+	static FILE *file;
+	static std::mutex file_lock;
+	static std::atomic<bool> active;
+	static std::atomic<int64_t> replay_time;
+
+	static void Write(uint16_t type, int handle,
+			  const void *payload, uint32_t len);
+
+public:
+	static int Start(const char *filename);
+	static void Stop();
+
+	static inline bool IsActive() {
+		return active.load(std::memory_order_relaxed);
+	}
+
+	static inline void Record(uint16_t type, int handle,
+				  const void *payload, uint32_t len) {
+		if (active.load(std::memory_order_relaxed))
+			Write(type, handle, payload, len);
+	}
+
+	static int OpenReplay(const char *filename, FILE **replay_file);
+	static int ReadRecord(FILE *replay_file,
+			      struct sensor_capture_record *record,
+			      uint8_t **payload, size_t *payload_size);
+
+	/* non zero while replaying, see elapsedRealtimeNano() */
+	static inline int64_t GetReplayTime() {
+		return replay_time.load(std::memory_order_relaxed);
+	}
+
+	static inline void SetReplayTime(int64_t timestamp) {
+		replay_time.store(timestamp, std::memory_order_relaxed);
+	}
+};
+
+#endif /* ST_SENSOR_CAPTURE_H */
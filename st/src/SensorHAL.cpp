@@ -26,6 +26,12 @@
 #include "SWGyroscopeUncalibrated.h"
 #include "SWAccelerometerUncalibrated.h"
 #include "iNotifyConfigMngmt.h"
+#ifdef CONFIG_ST_HAL_IIO_SIMULATOR
+#include "IIOSimulator.h"
+#endif /* CONFIG_ST_HAL_IIO_SIMULATOR */
+#ifdef CONFIG_ST_HAL_IIO_HOTPLUG
+#include "IIOHotplug.h"
+#endif /* CONFIG_ST_HAL_IIO_HOTPLUG */
 
 /*
  * STSensorHAL_device_iio_devices_data: informations related to the IIO devices,
@@ -35,6 +41,8 @@
  * @device_name: IIO device name.
  * @android_name: name showed in Android OS.
  * @dev_id: iio:device device id.
+ * @imu_instance: IMU instance, devices of the same sensor type are numbered
+ *                by iio:device number.
  * @sensor_type: Android sensor type.
  * @wake_up_sensor: is a wake-up sensor.
  * @num_channels: number of channels.
@@ -49,6 +57,7 @@ struct STSensorHAL_device_iio_devices_data {
 	char *device_name;
 	char *android_name;
 	unsigned int dev_id;
+	unsigned int imu_instance;
 	int sensor_type;
 
 	bool wake_up_sensor;
@@ -106,6 +115,31 @@ static const struct ST_sensors_supported {
 				    0.01f)
 };
 
+/*
+ * ST_sensors_channels: iio channels read by each sensor type
+ * @device_iio_sensor_type: iio device type of ST_sensors_supported.
+ * @channels: scan_elements names, NULL terminated, the axes in the order
+ *	      of the decoded data and the timestamp last. Their position in
+ *	      the scan is read from scan_elements/<name>_index. The other
+ *	      channels of the device (e.g. temperature) are ignored and stay
+ *	      disabled, out of the scan.
+ */
+static const struct ST_sensors_channels {
+	device_iio_chan_type_t device_iio_sensor_type;
+	const char *channels[HW_SENSOR_BASE_MAX_CHANNELS + 1];
+} ST_sensors_channels[] = {
+	{
+		.device_iio_sensor_type = DEVICE_IIO_ACC,
+		.channels = { "in_accel_x", "in_accel_y", "in_accel_z",
+			      "in_timestamp", NULL },
+	},
+	{
+		.device_iio_sensor_type = DEVICE_IIO_GYRO,
+		.channels = { "in_anglvel_x", "in_anglvel_y", "in_anglvel_z",
+			      "in_timestamp", NULL },
+	},
+};
+
 /*
  * ST_virtual_sensors_list: ST virtual sensors available
  * @sensor_type: Android sensor type.
@@ -174,6 +208,41 @@ static SensorBase* st_hal_create_virtual_class_sensor(int sensor_type, int handl
 	return sb->IsValidClass() ? sb : NULL;
 }
 
+/*
+ * st_hal_fill_class_data() - Fill hardware sensor class data
+ * @data: iio:device data.
+ * @class_data: HWSensorBase common data.
+ *
+ * Return value: 0 on success, negative number on fail.
+ */
+static int st_hal_fill_class_data(STSensorHAL_device_iio_devices_data *data,
+				  struct HWSensorBaseCommonData *class_data)
+{
+	if ((strlen(data->device_iio_sysfs_path) + 1 > HW_SENSOR_BASE_IIO_SYSFS_PATH_MAX) ||
+	    (strlen(data->device_name) + 1 > HW_SENSOR_BASE_IIO_DEVICE_NAME_MAX) ||
+	    (data->num_channels > HW_SENSOR_BASE_MAX_CHANNELS))
+		return -EINVAL;
+
+	memcpy(class_data->device_name,
+	       data->device_name,
+	       strlen(data->device_name) + 1);
+	memcpy(class_data->device_iio_sysfs_path,
+	       data->device_iio_sysfs_path,
+	       strlen(data->device_iio_sysfs_path) + 1);
+	memcpy(&class_data->sa,
+	       &data->sa,
+	       sizeof(class_data->sa));
+	memcpy(class_data->channels,
+	       data->channels,
+	       data->num_channels * sizeof(class_data->channels[0]));
+
+	class_data->device_iio_dev_num = data->dev_id;
+	class_data->imu_instance = data->imu_instance;
+	class_data->num_channels = data->num_channels;
+
+	return 0;
+}
+
 /*
  * st_hal_create_class_sensor() - Istance hardware sensor class
  * @data: iio:device data.
@@ -194,27 +263,9 @@ static SensorBase* st_hal_create_class_sensor(STSensorHAL_device_iio_devices_dat
 	(void)custom_data;
 #endif /* CONFIG_ST_HAL_FACTORY_CALIBRATION */
 
-	if ((strlen(data->device_iio_sysfs_path) + 1 > HW_SENSOR_BASE_IIO_SYSFS_PATH_MAX) ||
-	    (strlen(data->device_name) + 1 > HW_SENSOR_BASE_IIO_DEVICE_NAME_MAX) ||
-	    (data->num_channels > HW_SENSOR_BASE_MAX_CHANNELS))
+	if (st_hal_fill_class_data(data, &class_data) < 0)
 		return NULL;
 
-	memcpy(class_data.device_name,
-	       data->device_name,
-	       strlen(data->device_name) + 1);
-	memcpy(class_data.device_iio_sysfs_path,
-	       data->device_iio_sysfs_path,
-	       strlen(data->device_iio_sysfs_path) + 1);
-	memcpy(&class_data.sa,
-	       &data->sa,
-	       sizeof(class_data.sa));
-	memcpy(class_data.channels,
-	       data->channels,
-	       data->num_channels * sizeof(class_data.channels[0]));
-
-	class_data.device_iio_dev_num = data->dev_id;
-	class_data.num_channels = data->num_channels;
-
 	switch (data->sensor_type) {
 #ifdef CONFIG_ST_HAL_ACCEL_ENABLED
 	case SENSOR_TYPE_ACCELEROMETER:
@@ -319,34 +370,125 @@ static int st_hal_set_fullscale(char *device_iio_sysfs_path, int sensor_type,
 }
 
 /*
- * st_hal_load_gyro_data() - Read iio gyro data from sysfs
+ * st_hal_free_device_iio_devices_data() - Free iio devices data
+ * @data: iio device data.
+ * @num_devices: number of allocated devices.
+ */
+static void st_hal_free_device_iio_devices_data(STSensorHAL_device_iio_devices_data *data,
+						unsigned int num_devices)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_devices; i++) {
+		free(data[i].android_name);
+		free(data[i].device_name);
+		free(data[i].channels);
+		free(data[i].device_iio_sysfs_path);
+	}
+}
+
+/*
+ * st_hal_load_channels() - Build the channels table of a sensor
+ * @stsensor: ST_sensors_supported.
+ * @data: iio device data, device_iio_sysfs_path set.
+ *
+ * Return value: 0 on success, negative number on fail.
+ */
+static int st_hal_load_channels(const struct ST_sensors_supported *stsensor,
+				STSensorHAL_device_iio_devices_data *data)
+{
+	int i, c, num, err = 0;
+	const char * const *names = NULL;
+	struct device_iio_info_channel *channel, *scan_elements;
+
+	for (i = 0; i < (int)ARRAY_SIZE(ST_sensors_channels); i++) {
+		if (ST_sensors_channels[i].device_iio_sensor_type ==
+		    stsensor->device_iio_sensor_type) {
+			names = ST_sensors_channels[i].channels;
+			break;
+		}
+	}
+
+	if (!names)
+		return -EINVAL;
+
+	num = device_iio_utils::get_scan_elements(data->device_iio_sysfs_path,
+						  &scan_elements);
+	if (num < 0)
+		return num;
+
+	data->channels = (struct device_iio_info_channel *)malloc(sizeof(struct device_iio_info_channel) *
+								  HW_SENSOR_BASE_MAX_CHANNELS);
+	if (!data->channels) {
+		err = -ENOMEM;
+		goto free_scan_elements;
+	}
+
+	/*
+	 * channels keep the order of the names, the decoded values follow
+	 * it; the scan layout comes from the scan index of each channel
+	 */
+	for (c = 0; names[c]; c++) {
+		for (i = 0; i < num; i++) {
+			if (!strcmp(names[c], scan_elements[i].name))
+				break;
+		}
+
+		if (i == num) {
+			ALOGE("\"%s\": %s channel not found.",
+			      stsensor->driver_name, names[c]);
+			err = -ENODEV;
+			goto free_channels;
+		}
+
+		channel = &data->channels[c];
+		*channel = scan_elements[i];
+		channel->offset = 0.0f;
+		channel->enabled = 1;
+
+		/* timestamp not support scale */
+		if (names[c + 1])
+			device_iio_utils::get_scale(data->device_iio_sysfs_path,
+						    &channel->scale,
+						    stsensor->device_iio_sensor_type);
+		else
+			channel->scale = 1.0f;
+	}
+
+	data->num_channels = c;
+
+	free(scan_elements);
+
+	return 0;
+
+free_channels:
+	free(data->channels);
+	data->channels = NULL;
+free_scan_elements:
+	free(scan_elements);
+
+	return err;
+}
+
+/*
+ * st_hal_load_data() - Read iio data of a supported sensor from sysfs
  * @stsensor: ST_sensors_supported.
+ * @dev_num: iio:device number.
+ * @imu_instance: IMU instance.
  * @data: iio device data.
  *
  * Return value: 1 for succes, 0 in case of error
  */
-static int st_hal_load_gyro_data(const struct ST_sensors_supported *stsensor,
-				 STSensorHAL_device_iio_devices_data *data)
+static int st_hal_load_data(const struct ST_sensors_supported *stsensor,
+			    int dev_num, unsigned int imu_instance,
+			    STSensorHAL_device_iio_devices_data *data)
 {
 	int err;
-	int gyro_num;
-	const char *name_channel_gyro[] = {
-			"in_anglvel_x",
-			"in_anglvel_y",
-			"in_anglvel_z",
-			"in_timestamp"
-			};
-
-	gyro_num = device_iio_utils::get_device_by_name(stsensor->driver_name);
-	if (gyro_num < 0) {
-		ALOGE("No IIO sensors found into /sys/bus/iio/devices/ folder.");
-
-		return 0;
-	}
 
 	err = asprintf(&data->device_iio_sysfs_path,
-		       "/sys/bus/iio/devices/iio:device%d",
-		       gyro_num);
+		       "%siio:device%d",
+		       device_iio_utils::get_sysfs_dir(),
+		       dev_num);
 	if (err < 0) {
 		ALOGE("Unable to allocate sysfs path.");
 
@@ -355,28 +497,16 @@ static int st_hal_load_gyro_data(const struct ST_sensors_supported *stsensor,
 
 	data->power_consumption = stsensor->power_consumption;
 
-	/* Add channels to Gyroscope */
-	data->num_channels = 4;
-	data->channels =
-		(struct device_iio_info_channel *)malloc(sizeof(struct device_iio_info_channel) * (data->num_channels));
-	for (int index = 0; index < data->num_channels; index++) {
-		device_iio_utils::get_type(&data->channels[index],
-			data->device_iio_sysfs_path,
-			name_channel_gyro[index],
-			"in");
-
-		data->channels[index].index = index;
-		data->channels[index].offset = 0.0f;
-		/* timestamp not support scale */
-		if (index == 3)
-			data->channels[index].scale = 1.0f;
-		else
-			device_iio_utils::get_scale(data->device_iio_sysfs_path,
-						    &data->channels[index].scale,
-						    DEVICE_IIO_GYRO);
-		}
+	err = st_hal_load_channels(stsensor, data);
+	if (err < 0) {
+		ALOGE("\"%s\": unable to read scan elements. (errno: %d)",
+		      stsensor->driver_name, err);
+
+		goto st_hal_load_free_sysfs_path;
+	}
 
-	err = device_iio_utils::enable_sensor(data->device_iio_sysfs_path, false);
+	err = device_iio_utils::enable_sensor(data->device_iio_sysfs_path, false,
+					      NULL, 0);
 	if (err < 0) {
 		ALOGE("Unable to disable sensor.");
 
@@ -386,16 +516,19 @@ static int st_hal_load_gyro_data(const struct ST_sensors_supported *stsensor,
 	err = device_iio_utils::get_sampling_frequency_available(data->device_iio_sysfs_path,
 								 &data->sfa);
 	if (err < 0) {
-		ALOGE("Unable to get sampling frequency availability. (errno: %d)", err);
+		ALOGE("\"%s\": unable to get sampling frequency availability. (errno: %d)",
+		      stsensor->driver_name, err);
 
 		goto st_hal_load_free_device_iio_channels;
 	}
 
-	err = device_iio_utils::get_scale_available(data->device_iio_sysfs_path, &data->sa,
+	err = device_iio_utils::get_scale_available(data->device_iio_sysfs_path,
+						    &data->sa,
 						    stsensor->device_iio_sensor_type);
 	if (err < 0) {
 		ALOGE("\"%s\": unable to get scale availability. (errno: %d)",
 		      stsensor->driver_name, err);
+
 		goto st_hal_load_free_device_iio_channels;
 	}
 
@@ -408,6 +541,7 @@ static int st_hal_load_gyro_data(const struct ST_sensors_supported *stsensor,
 		if (err < 0) {
 			ALOGE("\"%s\": failed to set device full-scale. (errno: %d)",
 			      stsensor->driver_name, err);
+
 			goto st_hal_load_free_device_iio_channels;
 		}
 	}
@@ -416,15 +550,21 @@ static int st_hal_load_gyro_data(const struct ST_sensors_supported *stsensor,
 	if (err < 0)
 		goto st_hal_load_free_device_iio_channels;
 
-	err = asprintf(&data->android_name, "%s", stsensor->android_name);
+	if (imu_instance)
+		err = asprintf(&data->android_name, "%s %u",
+			       stsensor->android_name, imu_instance + 1);
+	else
+		err = asprintf(&data->android_name, "%s",
+			       stsensor->android_name);
 	if (err < 0)
 		goto st_hal_load_free_device_name;
 
-
-	data->hw_fifo_len = device_iio_utils::get_fifo_length(data[0].device_iio_sysfs_path);
+	data->hw_fifo_len =
+		device_iio_utils::get_fifo_length(data->device_iio_sysfs_path);
 
 	data->sensor_type = stsensor->android_sensor_type;
-	data->dev_id = gyro_num;
+	data->dev_id = dev_num;
+	data->imu_instance = imu_instance;
 	data->wake_up_sensor = 0;
 
 	return 1;
@@ -434,153 +574,285 @@ st_hal_load_free_device_name:
 
 st_hal_load_free_device_iio_channels:
 	free(data->channels);
+
+st_hal_load_free_sysfs_path:
 	free(data->device_iio_sysfs_path);
 
 	return 0;
 }
 
 /*
- * st_hal_load_acc_data() - Read iio acc data from sysfs
- * @stsensor: ST_sensors_supported.
- * @data: iio device data.
+ * st_hal_load_devices_data() - Discover all supported iio devices
+ * @data: iio devices data.
+ * @max_devices: @data size.
  *
- * Return value: acc number for succes, 0 in case of error
+ * Every iio device matching a supported name is loaded, a board can
+ * mount the same IMU more than once. Devices of the same sensor type get
+ * consecutive IMU instances in iio:device number order, so the
+ * accelerometer and gyroscope of a part share the instance.
+ *
+ * Return value: number of devices loaded.
  */
-static int st_hal_load_acc_data(const struct ST_sensors_supported *stsensor,
-				STSensorHAL_device_iio_devices_data *data)
+static int st_hal_load_devices_data(STSensorHAL_device_iio_devices_data *data,
+				    int max_devices)
 {
-	int err;
-	int acc_num;
-	const char *name_channel_acc[] = {
-			"in_accel_x",
-			"in_accel_y",
-			"in_accel_z",
-			"in_timestamp"
-			};
-
-	acc_num = device_iio_utils::get_device_by_name(stsensor->driver_name);
-	if (acc_num < 0) {
-		ALOGE("No ACC sensors found into /sys/bus/iio/devices/ folder.");
+	int i, k, n, found = 0;
+	int dev_nums[ST_HAL_IMU_MAX_INSTANCES];
+	unsigned int acc_instances = 0, gyro_instances = 0, *instances;
+
+	for (i = 0; i < (int)ARRAY_SIZE(ST_sensors_supported); i++) {
+		n = device_iio_utils::get_devices_by_name(ST_sensors_supported[i].driver_name,
+							  dev_nums,
+							  ST_HAL_IMU_MAX_INSTANCES);
+		if (n < 0)
+			continue;
 
-		return 0;
-	}
+		if (ST_sensors_supported[i].device_iio_sensor_type == DEVICE_IIO_GYRO)
+			instances = &gyro_instances;
+		else
+			instances = &acc_instances;
+
+		for (k = 0; k < n; k++) {
+			if ((found == max_devices) ||
+			    (*instances == ST_HAL_IMU_MAX_INSTANCES)) {
+				ALOGW("\"%s\": iio:device%d ignored, too many devices.",
+				      ST_sensors_supported[i].driver_name,
+				      dev_nums[k]);
+				continue;
+			}
 
-	/* save path to acc. iio device in sysfs */
-	err = asprintf(&data->device_iio_sysfs_path,
-		       "/sys/bus/iio/devices/iio:device%d",
-		       acc_num);
-	if (err < 0) {
-		ALOGE("Unable to allocate sysfs path.");
+			if (!st_hal_load_data(&ST_sensors_supported[i],
+					      dev_nums[k], *instances,
+					      &data[found]))
+				continue;
 
-		return 0;
+			(*instances)++;
+			found++;
+		}
 	}
 
-	data->power_consumption = stsensor->power_consumption;
+	if (!found)
+		ALOGE("No IIO sensors found into %s folder.",
+		      device_iio_utils::get_sysfs_dir());
 
-	/* Add channels to Accelerometer */
-	data->num_channels = 4;
-	data->channels =
-		(struct device_iio_info_channel *)malloc(sizeof(struct device_iio_info_channel) * (data->num_channels));
-	for (int index = 0; index < data->num_channels; index++) {
-		device_iio_utils::get_type(&data->channels[index],
-					   data->device_iio_sysfs_path,
-					   name_channel_acc[index],
-					   "in");
-
-		data->channels[index].index = index;
-		data->channels[index].offset = 0.0f;
-		/* timestamp not support scale */
-		if (index == 3)
-			data->channels[index].scale = 1.0f;
-		else
-			device_iio_utils::get_scale(data->device_iio_sysfs_path,
-						    &data->channels[index].scale,
-						    DEVICE_IIO_ACC);
+	return found;
+}
+
+#ifdef CONFIG_ST_HAL_IIO_HOTPLUG
+/*
+ * st_hal_hotplug_attach() - Bind detached sensors to an added iio device
+ * @hal_data: SensorHAL data.
+ * @dev_num: iio:device number.
+ *
+ * Only sensors created at open time can be bound again: the Android
+ * sensors list can not change once published, a device first seen after
+ * open is ignored. The sensor last
+ * bound to @dev_num is preferred, otherwise the first detached sensor of
+ * the same iio device name is used, it keeps its IMU instance.
+ */
+static void st_hal_hotplug_attach(STSensorHAL_data *hal_data,
+				  unsigned int dev_num)
+{
+	int i, k, n, handle, found;
+	HWSensorBase *hw_sensor, *detached;
+	struct HWSensorBaseCommonData class_data;
+	STSensorHAL_device_iio_devices_data data;
+	int dev_nums[ST_HAL_IIO_MAX_DEVICES];
+
+	for (i = 0; i < (int)ARRAY_SIZE(ST_sensors_supported); i++) {
+		n = device_iio_utils::get_devices_by_name(ST_sensors_supported[i].driver_name,
+							  dev_nums,
+							  ST_HAL_IIO_MAX_DEVICES);
+		for (k = 0; k < n; k++) {
+			if (dev_nums[k] == (int)dev_num)
+				break;
 		}
 
-	err = device_iio_utils::enable_sensor(data->device_iio_sysfs_path, false);
-	if (err < 0) {
-		ALOGE("Unable to disable sensor.");
+		if (k >= n)
+			continue;
 
-		goto st_hal_load_free_device_iio_channels;
-	}
+		hw_sensor = NULL;
+		detached = NULL;
 
-	err = device_iio_utils::get_sampling_frequency_available(data->device_iio_sysfs_path,
-								 &data->sfa);
-	if (err < 0) {
-		ALOGE("Unable to get sampling frequency availability for accel. (errno: %d)",
-		      err);
+		for (handle = 1; handle <= hal_data->last_handle; handle++) {
+			if (!hal_data->sensor_classes[handle] ||
+			    (hal_data->sensor_classes[handle]->GetType() != ST_sensors_supported[i].android_sensor_type))
+				continue;
 
-		goto st_hal_load_free_device_iio_channels;
-	}
+			hw_sensor = (HWSensorBase *)hal_data->sensor_classes[handle];
+			if (strcmp(hw_sensor->GetDeviceName(),
+				   ST_sensors_supported[i].driver_name)) {
+				hw_sensor = NULL;
+				continue;
+			}
 
-	err = device_iio_utils::get_scale_available(data->device_iio_sysfs_path,
-						    &data->sa,
-						    stsensor->device_iio_sensor_type);
-	if (err < 0) {
-		ALOGE("\"%s\": unable to get scale availability. (errno: %d)",
-		      stsensor->driver_name, err);
-		goto st_hal_load_free_device_iio_channels;
+			if (hw_sensor->GetDeviceNum() == dev_num)
+				break;
+
+			if (!detached && hw_sensor->IsDeviceDetached())
+				detached = hw_sensor;
+
+			hw_sensor = NULL;
+		}
+
+		if (!hw_sensor)
+			hw_sensor = detached;
+
+		if (!hw_sensor) {
+			ALOGW("\"%s\": iio:device%u not in use, restart the HAL to add it.",
+			      ST_sensors_supported[i].driver_name, dev_num);
+			continue;
+		}
+
+		/* already bound to it */
+		if (!hw_sensor->IsDeviceDetached())
+			continue;
+
+		memset(&data, 0, sizeof(data));
+
+		found = st_hal_load_data(&ST_sensors_supported[i], dev_num,
+					 hw_sensor->GetImuInstance(), &data);
+		if (!found)
+			continue;
+
+		if ((st_hal_fill_class_data(&data, &class_data) < 0) ||
+		    (hw_sensor->AttachDevice(&class_data) < 0))
+			ALOGE("\"%s\": failed to attach iio:device%u.",
+			      hw_sensor->GetName(), dev_num);
+
+		st_hal_free_device_iio_devices_data(&data, 1);
 	}
+}
 
-	if (data[0].sa.length > 0) {
-		err = st_hal_set_fullscale(data[0].device_iio_sysfs_path,
-					   stsensor->android_sensor_type,
-					   &data[0].sa,
-					   data[0].channels,
-					   data[0].num_channels);
-		if (err < 0) {
-			ALOGE("\"%s\": failed to set device full-scale. (errno: %d)",
-			      stsensor->driver_name, err);
+/*
+ * st_hal_hotplug_event() - Handle an iio device added or removed
+ * @context: SensorHAL data.
+ * @action: IIOHotplugAction.
+ * @dev_num: iio:device number.
+ *
+ * Sensor classes, handles and dependencies are kept: a removed device
+ * detaches the sensors using it, the device added again is attached to
+ * them with the active rates and batching. Until open completes added
+ * devices are only counted, for st_hal_hotplug_wait_devices().
+ */
+static void st_hal_hotplug_event(void *context, int action,
+				 unsigned int dev_num)
+{
+	int i, handle;
+	HWSensorBase *hw_sensor;
+	STSensorHAL_data *hal_data = (STSensorHAL_data *)context;
 
-			goto st_hal_load_free_device_iio_channels;
+	pthread_mutex_lock(&hal_data->hotplug_mutex);
+
+	if (!hal_data->hotplug_ready) {
+		if (action == IIO_HOTPLUG_ADD) {
+			hal_data->hotplug_adds++;
+			pthread_cond_signal(&hal_data->hotplug_cond);
 		}
+
+		goto unlock_mutex;
 	}
 
-	err = asprintf(&data[0].device_name, "%s", stsensor->driver_name);
-	if (err < 0)
-		goto st_hal_load_free_device_iio_channels;
+	if (action == IIO_HOTPLUG_ADD) {
+		st_hal_hotplug_attach(hal_data, dev_num);
+		goto unlock_mutex;
+	}
 
-	err = asprintf(&data[0].android_name, "%s", stsensor->android_name);
-	if (err < 0)
-		goto st_hal_load_free_device_name;
+	for (handle = 1; handle <= hal_data->last_handle; handle++) {
+		if (!hal_data->sensor_classes[handle])
+			continue;
 
-	data[0].hw_fifo_len =
-		device_iio_utils::get_fifo_length(data[0].device_iio_sysfs_path);
+		for (i = 0; i < (int)ARRAY_SIZE(ST_sensors_supported); i++) {
+			if (hal_data->sensor_classes[handle]->GetType() == ST_sensors_supported[i].android_sensor_type)
+				break;
+		}
 
-	data[0].sensor_type = stsensor->android_sensor_type;
-	data[0].dev_id = acc_num;
-	data[0].wake_up_sensor = 0;
+		if (i == (int)ARRAY_SIZE(ST_sensors_supported))
+			continue;
 
-	return 1;
+		hw_sensor = (HWSensorBase *)hal_data->sensor_classes[handle];
+		if ((hw_sensor->GetDeviceNum() == dev_num) &&
+		    !hw_sensor->IsDeviceDetached())
+			hw_sensor->DetachDevice();
+	}
 
-st_hal_load_free_device_name:
-	free(data[0].device_name);
+unlock_mutex:
+	pthread_mutex_unlock(&hal_data->hotplug_mutex);
+}
 
-st_hal_load_free_device_iio_channels:
-	free(data[0].channels);
-	free(data[0].device_iio_sysfs_path);
+static int64_t st_hal_hotplug_time(void)
+{
+	struct timespec ts;
 
-	return 0;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
 }
 
 /*
- * st_hal_free_device_iio_devices_data() - Free iio devices data
- * @data: iio device data.
- * @num_devices: number of allocated devices.
+ * st_hal_hotplug_wait_devices() - Discover the sensors of late iio devices
+ * @hal_data: SensorHAL data.
+ * @data: iio devices data, filled by st_hal_load_devices_data().
+ *
+ * Called when no supported iio device exists at open, e.g. the driver
+ * module is loaded after the HAL. Wait up to ST_HAL_HOTPLUG_PROBE_TIMEOUT_MS
+ * for iio devices to be added, and ST_HAL_HOTPLUG_SETTLE_MS after the last
+ * one so all the devices of the driver are discovered together.
+ *
+ * Return value: number of iio devices found, 0 on timeout.
  */
-static void st_hal_free_device_iio_devices_data(STSensorHAL_device_iio_devices_data *data,
-						unsigned int num_devices)
+static int st_hal_hotplug_wait_devices(STSensorHAL_data *hal_data,
+				       STSensorHAL_device_iio_devices_data *data)
 {
-	unsigned int i;
+	int found = 0;
+	struct timespec ts;
+	unsigned int adds;
+	int64_t deadline, settle, wake;
 
-	for (i = 0; i < num_devices; i++) {
-		free(data[i].android_name);
-		free(data[i].device_name);
-		free(data[i].channels);
-		free(data[i].device_iio_sysfs_path);
+	deadline = st_hal_hotplug_time() +
+		   ST_HAL_HOTPLUG_PROBE_TIMEOUT_MS * 1000000LL;
+
+	ALOGW("No IIO sensors at open, waiting up to %dms for the driver.",
+	      ST_HAL_HOTPLUG_PROBE_TIMEOUT_MS);
+
+	pthread_mutex_lock(&hal_data->hotplug_mutex);
+
+	while (!found) {
+		adds = hal_data->hotplug_adds;
+		settle = INT64_MAX;
+
+		while (true) {
+			wake = settle < deadline ? settle : deadline;
+			if (st_hal_hotplug_time() >= wake)
+				break;
+
+			ts.tv_sec = wake / 1000000000LL;
+			ts.tv_nsec = wake % 1000000000LL;
+
+			pthread_cond_timedwait(&hal_data->hotplug_cond,
+					       &hal_data->hotplug_mutex, &ts);
+
+			/* restart settle time on every added device */
+			if (hal_data->hotplug_adds != adds) {
+				adds = hal_data->hotplug_adds;
+				settle = st_hal_hotplug_time() +
+					 ST_HAL_HOTPLUG_SETTLE_MS * 1000000LL;
+			}
+		}
+
+		if (settle == INT64_MAX)
+			break;
+
+		pthread_mutex_unlock(&hal_data->hotplug_mutex);
+		found = st_hal_load_devices_data(data, ST_HAL_IIO_MAX_DEVICES);
+		pthread_mutex_lock(&hal_data->hotplug_mutex);
 	}
+
+	pthread_mutex_unlock(&hal_data->hotplug_mutex);
+
+	return found > 0 ? found : 0;
 }
+#endif /* CONFIG_ST_HAL_IIO_HOTPLUG */
 
 static inline int st_hal_get_handle(STSensorHAL_data *hal_data, int handle)
 {
@@ -603,6 +875,11 @@ static int st_hal_dev_flush(struct sensors_poll_device_1 *dev, int handle)
 	unsigned int index;
 
 	index = st_hal_get_handle(hal_data, handle);
+
+#ifdef CONFIG_ST_HAL_CAPTURE
+	SensorCapture::Record(SENSOR_CAPTURE_FLUSH, handle, NULL, 0);
+#endif /* CONFIG_ST_HAL_CAPTURE */
+
 	return hal_data->sensor_classes[index]->FlushData(handle, true);
 }
 
@@ -661,12 +938,46 @@ static int st_hal_dev_batch(struct sensors_poll_device_1 *dev, int handle,
 	      period_ns);
 #endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
 
+#ifdef CONFIG_ST_HAL_CAPTURE
+	hal_data->capture_batch[index].period_ns = period_ns;
+	hal_data->capture_batch[index].timeout = timeout;
+	SensorCapture::Record(SENSOR_CAPTURE_BATCH, handle,
+			      &hal_data->capture_batch[index],
+			      sizeof(struct sensor_capture_batch));
+#endif /* CONFIG_ST_HAL_CAPTURE */
+
 	return hal_data->sensor_classes[index]->SetDelay(handle,
 							 period_ns,
 							 timeout,
 							 true);
 }
 
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+/**
+ * st_hal_record_delivery_latency() - Account events handed to the framework
+ * @hal_data: HAL private data.
+ * @data: events copied out.
+ * @num: number of events.
+ */
+static void st_hal_record_delivery_latency(STSensorHAL_data *hal_data,
+					   sensors_event_t *data, int num)
+{
+	int i;
+	int64_t now = elapsedRealtimeNano();
+
+	for (i = 0; i < num; i++) {
+		if ((data[i].type == SENSOR_TYPE_META_DATA) ||
+		    (data[i].type == SENSOR_TYPE_ADDITIONAL_INFO))
+			continue;
+
+		hal_data->sensor_classes[st_hal_get_handle(hal_data,
+					 data[i].sensor)]->RecordLatency(
+					SENSOR_LATENCY_DELIVERY,
+					data[i].timestamp, now);
+	}
+}
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+
 /**
  * st_hal_dev_poll() - Poll new sensors data
  * @dev: sensors device structure.
@@ -679,6 +990,7 @@ static int st_hal_dev_poll(struct sensors_poll_device_t *dev,
 			   sensors_event_t *data, int count)
 {
 	unsigned int i;
+	SensorBase *sb;
 	int err, read_size, remaining_event = count, event_read;
 	STSensorHAL_data *hal_data = (STSensorHAL_data *)dev;
 
@@ -688,13 +1000,31 @@ static int st_hal_dev_poll(struct sensors_poll_device_t *dev,
 
 	for (i = 0; i < hal_data->sensor_available; i++) {
 		if (hal_data->android_pollfd[i].revents & POLLIN) {
+			sb = hal_data->sensor_classes[hal_data->sensor_t_list[i].handle];
+
+#ifdef CONFIG_ST_HAL_STAGE_PROFILING
+			sb->GetProfiler()->Begin();
+#endif /* CONFIG_ST_HAL_STAGE_PROFILING */
+			ST_HAL_TRACE_BEGIN("%s copy-out",
+					   hal_data->sensor_t_list[i].name);
 			read_size = read(hal_data->android_pollfd[i].fd,
 					 data,
 					 remaining_event * sizeof(sensors_event_t));
+			ST_HAL_TRACE_END();
 			if (read_size <= 0)
 				continue;
 
 			event_read = (read_size / sizeof(sensors_event_t));
+#ifdef CONFIG_ST_HAL_STAGE_PROFILING
+			sb->GetProfiler()->Mark(SENSOR_PROFILE_DELIVERY,
+						event_read);
+#endif /* CONFIG_ST_HAL_STAGE_PROFILING */
+			sb->GetMetrics()->Add(SENSOR_METRIC_EVENTS_DELIVERED,
+					      event_read);
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+			st_hal_record_delivery_latency(hal_data, data,
+						       event_read);
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
 			remaining_event -= event_read;
 			data += event_read;
 
@@ -726,6 +1056,16 @@ static int st_hal_dev_setDelay(struct sensors_poll_device_t *dev,
 #endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
 
 	index = st_hal_get_handle(hal_data, handle);
+
+#ifdef CONFIG_ST_HAL_CAPTURE
+	/* same as batch() with no timeout */
+	hal_data->capture_batch[index].period_ns = ns;
+	hal_data->capture_batch[index].timeout = 0;
+	SensorCapture::Record(SENSOR_CAPTURE_BATCH, handle,
+			      &hal_data->capture_batch[index],
+			      sizeof(struct sensor_capture_batch));
+#endif /* CONFIG_ST_HAL_CAPTURE */
+
 	return hal_data->sensor_classes[index]->SetDelay(handle, ns, 0, true);
 }
 
@@ -749,6 +1089,12 @@ static int st_hal_dev_activate(struct sensors_poll_device_t *dev,
 
 	index = st_hal_get_handle(hal_data, handle);
 
+#ifdef CONFIG_ST_HAL_CAPTURE
+	hal_data->capture_enabled[index] = enabled;
+	SensorCapture::Record(SENSOR_CAPTURE_ACTIVATE, handle,
+			      &enabled, sizeof(enabled));
+#endif /* CONFIG_ST_HAL_CAPTURE */
+
 	return  hal_data->sensor_classes[index]->Enable(handle, (bool)enabled, true);
 }
 
@@ -763,14 +1109,48 @@ static int st_hal_dev_close(struct hw_device_t *dev)
 	unsigned int i;
 	STSensorHAL_data *hal_data = (STSensorHAL_data *)dev;
 
+#ifdef CONFIG_ST_HAL_IIO_HOTPLUG
+	IIOHotplug::Stop();
+	pthread_cond_destroy(&hal_data->hotplug_cond);
+	pthread_mutex_destroy(&hal_data->hotplug_mutex);
+#endif /* CONFIG_ST_HAL_IIO_HOTPLUG */
+
+#ifdef CONFIG_ST_HAL_CAPTURE
+	SensorCapture::Stop();
+#endif /* CONFIG_ST_HAL_CAPTURE */
+
+	/* threads use the classes and their arena buffers until joined */
+	for (i = 1; i < ST_HAL_IIO_MAX_DEVICES; i++) {
+		if (hal_data->sensor_classes[i])
+			hal_data->sensor_classes[i]->StopThreads();
+	}
+
+	for (i = 0; i < hal_data->data_threads_num; i++)
+		pthread_join(hal_data->data_threads[i], NULL);
+
+	for (i = 0; i < hal_data->events_threads_num; i++)
+		pthread_join(hal_data->events_threads[i], NULL);
+
+	/* hidden classes are indexed by handle too, after last_handle */
+	for (i = 1; i < ST_HAL_IIO_MAX_DEVICES; i++)
+		delete hal_data->sensor_classes[i];
+
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
+	ALOGD("Memory arena: %u heap allocations after open.",
+	      MemoryArena::GetHeapAllocations());
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
+
+#ifdef CONFIG_ST_HAL_IIO_SIMULATOR
+	IIOSimulator::Stop();
+#endif /* CONFIG_ST_HAL_IIO_SIMULATOR */
+
+	MemoryArena::Release();
+
 	free(hal_data->data_threads);
 	free(hal_data->events_threads);
 	free(hal_data->sensor_t_list);
 	free(hal_data);
 
-	for (i = 0; i < hal_data->sensor_available; i++)
-		delete hal_data->sensor_classes[i];
-
 	return 0;
 }
 
@@ -842,6 +1222,45 @@ static void st_hal_set_default_private_data(struct st_hal_private_data *priv_dat
 }
 #endif /* CONFIG_ST_HAL_FACTORY_CALIBRATION */
 
+/**
+ * st_hal_memory_arena_size() - Bytes of MemoryArena needed by sensors graph
+ * @sensor_classes: sensor classes created.
+ * @sensor_class_valid: valid flag of each sensor class.
+ * @classes_available: number of sensor classes.
+ *
+ * Return value: arena size in bytes.
+ */
+static size_t st_hal_memory_arena_size(SensorBase **sensor_classes,
+				       bool *sensor_class_valid,
+				       int classes_available)
+{
+	size_t arena_size = 0;
+	int type_dependencies[SENSOR_DEPENDENCY_ID_MAX];
+	int i, c, type_index;
+
+	for (i = 0; i < classes_available; i++) {
+		if (!sensor_class_valid[i])
+			continue;
+
+		arena_size += sensor_classes[i]->GetDataBufferSize();
+
+		sensor_classes[i]->GetDepenciesTypeList(type_dependencies);
+
+		for (type_index = 0; (type_index < SENSOR_DEPENDENCY_ID_MAX) &&
+		     (type_dependencies[type_index] > 0); type_index++) {
+			for (c = 0; c < classes_available; c++) {
+				if ((type_dependencies[type_index] == sensor_classes[c]->GetType()) &&
+				    (sensor_class_valid[c])) {
+					arena_size += sensor_classes[c]->GetDependencyBufferSize();
+					break;
+				}
+			}
+		}
+	}
+
+	return arena_size;
+}
+
 /**
  * open_sensors() - Open sensor device
  * see Android documentation.
@@ -860,6 +1279,12 @@ static int st_hal_open_sensors(const struct hw_module_t *module,
 #ifdef CONFIG_ST_HAL_FACTORY_CALIBRATION
 	struct st_hal_private_data private_data;
 #endif /* CONFIG_ST_HAL_FACTORY_CALIBRATION */
+#ifdef CONFIG_ST_HAL_IIO_SIMULATOR
+	struct iio_simulator_config sim_config;
+#endif /* CONFIG_ST_HAL_IIO_SIMULATOR */
+#ifdef CONFIG_ST_HAL_IIO_HOTPLUG
+	pthread_condattr_t hotplug_cond_attr;
+#endif /* CONFIG_ST_HAL_IIO_HOTPLUG */
 	bool sensor_class_valid[ST_HAL_IIO_MAX_DEVICES];
 	int type_dependencies[SENSOR_DEPENDENCY_ID_MAX], type_index;
 	SensorBase *sensor_class, *temp_sensor_class[ST_HAL_IIO_MAX_DEVICES];
@@ -899,19 +1324,41 @@ static int st_hal_open_sensors(const struct hw_module_t *module,
 	}
 #endif /* CONFIG_ST_HAL_FACTORY_CALIBRATION */
 
-	device_found_num = st_hal_load_acc_data(&ST_sensors_supported[0],
-						&device_iio_devices_data[0]);
-	device_found_num += st_hal_load_acc_data(&ST_sensors_supported[1],
-						&device_iio_devices_data[0]);
-	device_found_num += st_hal_load_gyro_data(&ST_sensors_supported[2],
-						  &device_iio_devices_data[1]);
-	device_found_num += st_hal_load_gyro_data(&ST_sensors_supported[3],
-						  &device_iio_devices_data[1]);
-	if (device_found_num <= 0) {
-		err = device_found_num;
+#ifdef CONFIG_ST_HAL_IIO_SIMULATOR
+	IIOSimulator::LoadConfig(&sim_config);
+	err = IIOSimulator::Start(&sim_config);
+	if (err < 0) {
+		ALOGE("Failed to start IIO simulator (errno: %d).", err);
 
 		goto free_hal_data;
 	}
+#endif /* CONFIG_ST_HAL_IIO_SIMULATOR */
+
+#ifdef CONFIG_ST_HAL_IIO_HOTPLUG
+	/* listen before discovery: no device added meanwhile is missed */
+	pthread_condattr_init(&hotplug_cond_attr);
+	pthread_condattr_setclock(&hotplug_cond_attr, CLOCK_MONOTONIC);
+	pthread_mutex_init(&hal_data->hotplug_mutex, NULL);
+	pthread_cond_init(&hal_data->hotplug_cond, &hotplug_cond_attr);
+	pthread_condattr_destroy(&hotplug_cond_attr);
+
+	err = IIOHotplug::Start(st_hal_hotplug_event, hal_data);
+	if (err < 0)
+		ALOGW("Failed to start IIO hotplug listener (errno: %d).", err);
+#endif /* CONFIG_ST_HAL_IIO_HOTPLUG */
+
+	device_found_num = st_hal_load_devices_data(device_iio_devices_data,
+						    ST_HAL_IIO_MAX_DEVICES);
+#ifdef CONFIG_ST_HAL_IIO_HOTPLUG
+	if ((device_found_num <= 0) && (err >= 0))
+		device_found_num = st_hal_hotplug_wait_devices(hal_data,
+							       device_iio_devices_data);
+#endif /* CONFIG_ST_HAL_IIO_HOTPLUG */
+	if (device_found_num <= 0) {
+		err = -ENODEV;
+
+		goto stop_hotplug;
+	}
 
 	for (i = 0; i < device_found_num; i++) {
 #ifdef CONFIG_ST_HAL_FACTORY_CALIBRATION
@@ -978,6 +1425,12 @@ static int st_hal_open_sensors(const struct hw_module_t *module,
 		classes_available++;
 	}
 
+	err = MemoryArena::Init(st_hal_memory_arena_size(temp_sensor_class,
+							 sensor_class_valid,
+							 classes_available));
+	if (err < 0)
+		goto destroy_classes;
+
 	for (i = 0; i < classes_available; i++) {
 		temp_sensor_class[i]->GetDepenciesTypeList(type_dependencies);
 		type_index = 0;
@@ -1026,6 +1479,9 @@ failed_to_add_dependency:
 	for (i = 0; i < classes_available; i++) {
 		if (sensor_class_valid[i]) {
 			err = temp_sensor_class[i]->CustomInit();
+			if (err >= 0)
+				err = temp_sensor_class[i]->AllocateDataBuffer();
+
 			if (err < 0) {
 				sensor_class_valid_num--;
 				sensor_class_valid[i] = false;
@@ -1034,6 +1490,9 @@ failed_to_add_dependency:
 		}
 	}
 
+	/* from now on data path buffers must come from the arena */
+	MemoryArena::Seal();
+
 	hal_data->sensor_t_list = (struct sensor_t *)malloc((sensor_class_valid_num + 1) * sizeof(struct sensor_t));
 	if (!hal_data->sensor_t_list) {
 		err = -ENOMEM;
@@ -1096,10 +1555,18 @@ failed_to_add_dependency:
 	}
 
 	hal_data->sensor_available = n;
+	hal_data->data_threads_num = j;
+	hal_data->events_threads_num = k;
 
 	st_hal_free_device_iio_devices_data(device_iio_devices_data,
 					    device_found_num);
 
+#ifdef CONFIG_ST_HAL_IIO_HOTPLUG
+	pthread_mutex_lock(&hal_data->hotplug_mutex);
+	hal_data->hotplug_ready = true;
+	pthread_mutex_unlock(&hal_data->hotplug_mutex);
+#endif /* CONFIG_ST_HAL_IIO_HOTPLUG */
+
 #if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
 	ALOGD("%d sensors available and ready.", hal_data->sensor_available);
 #endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
@@ -1114,9 +1581,20 @@ destroy_classes:
 	for (i = 0; i < classes_available; i ++)
 		delete temp_sensor_class[i];
 
+	MemoryArena::Release();
+
 	st_hal_free_device_iio_devices_data(device_iio_devices_data,
 					    device_found_num);
+stop_hotplug:
+#ifdef CONFIG_ST_HAL_IIO_HOTPLUG
+	IIOHotplug::Stop();
+	pthread_cond_destroy(&hal_data->hotplug_cond);
+	pthread_mutex_destroy(&hal_data->hotplug_mutex);
+#endif /* CONFIG_ST_HAL_IIO_HOTPLUG */
+#ifdef CONFIG_ST_HAL_IIO_SIMULATOR
+	IIOSimulator::Stop();
 free_hal_data:
+#endif /* CONFIG_ST_HAL_IIO_SIMULATOR */
 	free(hal_data);
 
 	return err;
@@ -1186,6 +1664,306 @@ static int st_ignition_on_off(int val)
 }
 #endif /* PLTF_LINUX_ENABLED */
 
+/**
+ * st_hal_metrics_dump() - Write counters of all sensors
+ * @filename: output file, NULL for stdout.
+ *
+ * Return value: 0 on success, negative number on fail.
+ */
+int st_hal_metrics_dump(const char *filename)
+{
+	unsigned int i;
+	SensorBase *sb;
+	FILE *file = stdout;
+	STSensorHAL_data *hal_data =
+		(STSensorHAL_data *)HAL_MODULE_INFO_SYM.common.dso;
+
+	if (!hal_data)
+		return -ENODEV;
+
+	if (filename) {
+		file = fopen(filename, "w");
+		if (!file)
+			return -errno;
+	}
+
+	fprintf(file, "hal.heap_allocations %u\n",
+		MemoryArena::GetHeapAllocations());
+
+	for (i = 0; i < hal_data->sensor_available; i++) {
+		sb = hal_data->sensor_classes[hal_data->sensor_t_list[i].handle];
+		sb->GetMetrics()->Dump(file, sb->GetHandle(), sb->GetName());
+#ifdef CONFIG_ST_HAL_STAGE_PROFILING
+		sb->GetProfiler()->Dump(file, sb->GetHandle());
+#endif /* CONFIG_ST_HAL_STAGE_PROFILING */
+	}
+
+	if (filename)
+		fclose(file);
+
+	return 0;
+}
+
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+/**
+ * st_hal_latency_dump() - Write latency histograms of all sensors
+ * @filename: output file, NULL for stdout.
+ *
+ * Return value: 0 on success, negative number on fail.
+ */
+int st_hal_latency_dump(const char *filename)
+{
+	unsigned int i;
+	FILE *file = stdout;
+	STSensorHAL_data *hal_data =
+		(STSensorHAL_data *)HAL_MODULE_INFO_SYM.common.dso;
+
+	if (!hal_data)
+		return -ENODEV;
+
+	if (filename) {
+		file = fopen(filename, "w");
+		if (!file)
+			return -errno;
+	}
+
+	for (i = 0; i < hal_data->sensor_available; i++)
+		hal_data->sensor_classes[hal_data->sensor_t_list[i].handle]->DumpLatency(file);
+
+	if (filename)
+		fclose(file);
+
+	return 0;
+}
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+
+#ifdef CONFIG_ST_HAL_CAPTURE
+/**
+ * st_hal_capture() - Start or stop capture of driver data and requests
+ * @filename: capture file.
+ * @enable: start/ stop flag.
+ *
+ * Return value: 0 on success, negative number on fail.
+ */
+int st_hal_capture(const char *filename, int enable)
+{
+	int err;
+	unsigned int i;
+	SensorBase *sb;
+	int handle;
+	struct sensor_capture_sensor sensor;
+	STSensorHAL_data *hal_data =
+		(STSensorHAL_data *)HAL_MODULE_INFO_SYM.common.dso;
+
+	if (!hal_data)
+		return -ENODEV;
+
+	if (!enable) {
+		SensorCapture::Stop();
+		return 0;
+	}
+
+	err = SensorCapture::Start(filename);
+	if (err < 0)
+		return err;
+
+	/* sensor list, used by replay to check the HAL is the same */
+	for (i = 0; i < hal_data->sensor_available; i++) {
+		handle = hal_data->sensor_t_list[i].handle;
+		sb = hal_data->sensor_classes[handle];
+
+		memset(&sensor, 0, sizeof(sensor));
+		sensor.type = sb->GetType();
+		strncpy(sensor.name, sb->GetName(), sizeof(sensor.name) - 1);
+		SensorCapture::Record(SENSOR_CAPTURE_SENSOR, handle,
+				      &sensor, sizeof(sensor));
+	}
+
+	/* requests made before capture started */
+	for (i = 0; i < hal_data->sensor_available; i++) {
+		handle = hal_data->sensor_t_list[i].handle;
+		if (!hal_data->capture_enabled[handle])
+			continue;
+
+		SensorCapture::Record(SENSOR_CAPTURE_BATCH, handle,
+				      &hal_data->capture_batch[handle],
+				      sizeof(struct sensor_capture_batch));
+		SensorCapture::Record(SENSOR_CAPTURE_ACTIVATE, handle,
+				      &enable, sizeof(enable));
+	}
+
+	return 0;
+}
+
+/**
+ * st_hal_replay_wait() - Sleep until a record is due in real time replay
+ * @start: CLOCK_MONOTONIC time replay started.
+ * @delta: time of the record from the first one.
+ */
+static void st_hal_replay_wait(int64_t start, int64_t delta)
+{
+	struct timespec ts;
+	int64_t deadline = start + delta;
+
+	ts.tv_sec = deadline / 1000000000LL;
+	ts.tv_nsec = deadline % 1000000000LL;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+/**
+ * st_hal_replay() - Feed a capture through the sensors graph
+ * @filename: capture file.
+ * @realtime: 0 to replay as fast as possible, 1 to keep capture timing.
+ *
+ * Records are processed on the caller thread, in file order, with
+ * elapsedRealtimeNano() returning the time of the record being replayed,
+ * so output events are the same for every run. Events are delivered to
+ * poll() as usual, the client must keep reading while replay runs.
+ * Sensors left enabled by the capture are disabled at the end.
+ *
+ * Return value: number of records replayed, negative number on fail.
+ */
+int st_hal_replay(const char *filename, int realtime)
+{
+	int err, handle, records = 0;
+	unsigned int i;
+	FILE *file;
+	SensorBase *sb = NULL;
+	uint8_t *payload = NULL;
+	size_t payload_size = 0;
+	int64_t start = 0, first = 0;
+	struct timespec ts;
+	struct sensor_capture_record record;
+	struct sensor_capture_sensor *sensor;
+	struct sensor_capture_batch *batch;
+	STSensorHAL_data *hal_data =
+		(STSensorHAL_data *)HAL_MODULE_INFO_SYM.common.dso;
+
+	if (!hal_data)
+		return -ENODEV;
+
+	if (SensorCapture::IsActive())
+		return -EBUSY;
+
+	err = SensorCapture::OpenReplay(filename, &file);
+	if (err < 0)
+		return err;
+
+#ifdef CONFIG_ST_HAL_IIO_SIMULATOR
+	/* simulated devices keep running for sysfs, but the capture is the only source */
+	IIOSimulator::Mute(true);
+#endif /* CONFIG_ST_HAL_IIO_SIMULATOR */
+
+	while ((err = SensorCapture::ReadRecord(file, &record,
+						&payload, &payload_size)) > 0) {
+		if (records == 0) {
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			start = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+			first = record.timestamp;
+		}
+
+		if (realtime)
+			st_hal_replay_wait(start, record.timestamp - first);
+
+		SensorCapture::SetReplayTime(record.timestamp);
+
+		if (record.type != SENSOR_CAPTURE_CONFIG) {
+			if ((record.handle < 0) ||
+			    (record.handle >= ST_HAL_IIO_MAX_DEVICES) ||
+			    !hal_data->sensor_classes[record.handle]) {
+				err = -ENODEV;
+				break;
+			}
+
+			sb = hal_data->sensor_classes[record.handle];
+		}
+
+		switch (record.type) {
+		case SENSOR_CAPTURE_SENSOR:
+			sensor = (struct sensor_capture_sensor *)payload;
+			if ((record.len != sizeof(*sensor)) ||
+			    (sensor->type != sb->GetType())) {
+				ALOGE("Capture sensor %d (%.*s) not available.",
+				      record.handle, (int)sizeof(sensor->name),
+				      sensor->name);
+				err = -ENODEV;
+			}
+			break;
+
+		case SENSOR_CAPTURE_SCAN:
+			err = sb->ReplayScanBatch(payload, record.len);
+			break;
+
+		case SENSOR_CAPTURE_EVENTS:
+			err = sb->ReplayEvents((struct device_iio_events *)payload,
+					       record.len / sizeof(struct device_iio_events));
+			break;
+
+		/* requests failing now failed at capture time too */
+		case SENSOR_CAPTURE_ACTIVATE:
+			if (record.len == sizeof(int32_t))
+				st_hal_dev_activate(&hal_data->poll_device.v0,
+						    record.handle,
+						    *(int32_t *)payload);
+			break;
+
+		case SENSOR_CAPTURE_BATCH:
+			batch = (struct sensor_capture_batch *)payload;
+			if (record.len == sizeof(*batch))
+				st_hal_dev_batch(&hal_data->poll_device,
+						 record.handle, 0,
+						 batch->period_ns,
+						 batch->timeout);
+			break;
+
+		case SENSOR_CAPTURE_FLUSH:
+			st_hal_dev_flush(&hal_data->poll_device, record.handle);
+			break;
+
+		case SENSOR_CAPTURE_CONFIG:
+#if CONFIG_ST_HAL_CONFIG_INOTIFY_ENABLED
+			err = load_config_data((const char *)payload, record.len);
+#endif /* CONFIG_ST_HAL_CONFIG_INOTIFY_ENABLED */
+			break;
+
+		default:
+			break;
+		}
+
+		if (err < 0)
+			break;
+
+		records++;
+	}
+
+	/* stop sensors left running, simulated data must not follow the capture */
+	for (i = 0; i < hal_data->sensor_available; i++) {
+		handle = hal_data->sensor_t_list[i].handle;
+		if (hal_data->capture_enabled[handle])
+			st_hal_dev_activate(&hal_data->poll_device.v0, handle, 0);
+	}
+
+	SensorCapture::SetReplayTime(0);
+
+#ifdef CONFIG_ST_HAL_IIO_SIMULATOR
+	IIOSimulator::Mute(false);
+#endif /* CONFIG_ST_HAL_IIO_SIMULATOR */
+
+	free(payload);
+	fclose(file);
+
+	if (err < 0) {
+		ALOGE("Replay of %s stopped at record %d (%d).",
+		      filename, records, err);
+		return err;
+	}
+
+	return records;
+}
+#endif /* CONFIG_ST_HAL_CAPTURE */
+
 #if (CONFIG_ST_HAL_ANDROID_VERSION >= ST_HAL_MARSHMALLOW_VERSION)
 /**
  * st_hal_set_operation_mode() - Set HAL mode
@@ -1237,6 +2015,13 @@ __attribute__((constructor)) void init(void)
 	STSensorHAL_data *hal_data =
 		     (STSensorHAL_data *)HAL_MODULE_INFO_SYM.common.dso;
 	init_notify_loop(HAL_CONFIGURATION_PATH, hal_data);
+	set_metrics_dump_handler(st_hal_metrics_dump);
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+	set_latency_dump_handler(st_hal_latency_dump);
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+#ifdef CONFIG_ST_HAL_CAPTURE
+	set_capture_handler(st_hal_capture);
+#endif /* CONFIG_ST_HAL_CAPTURE */
 }
 
 __attribute__((destructor)) void fini(void)
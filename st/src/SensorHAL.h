@@ -65,11 +65,22 @@
 #define ST_HAL_IIO_DEVICE_API_VERSION		SENSORS_DEVICE_API_VERSION_1_1
 #endif /* CONFIG_ST_HAL_ANDROID_VERSION */
 
+#ifdef CONFIG_ST_HAL_IIO_HOTPLUG
+/*
+ * No IIO device at open: wait for the driver to add one, then for the
+ * other devices it adds, before discovering the sensors.
+ */
+#define ST_HAL_HOTPLUG_PROBE_TIMEOUT_MS		(10000)
+#define ST_HAL_HOTPLUG_SETTLE_MS		(500)
+#endif /* CONFIG_ST_HAL_IIO_HOTPLUG */
+
 struct STSensorHAL_data {
 	sensors_poll_device_1 poll_device;
 
 	pthread_t *data_threads;
 	pthread_t *events_threads;
+	unsigned int data_threads_num;
+	unsigned int events_threads_num;
 	SensorBase *sensor_classes[ST_HAL_IIO_MAX_DEVICES];
 
 	int last_handle;
@@ -78,6 +89,42 @@ struct STSensorHAL_data {
 	struct sensor_t *sensor_t_list;
 
 	struct pollfd android_pollfd[ST_HAL_IIO_MAX_DEVICES];
+
+#ifdef CONFIG_ST_HAL_IIO_HOTPLUG
+	/* uevents are held until open completes, open waits for them */
+	pthread_mutex_t hotplug_mutex;
+	pthread_cond_t hotplug_cond;
+	bool hotplug_ready;
+	unsigned int hotplug_adds;
+#endif /* CONFIG_ST_HAL_IIO_HOTPLUG */
+
+#ifdef CONFIG_ST_HAL_CAPTURE
+	/* framework requests in force, recorded when a capture starts */
+	bool capture_enabled[ST_HAL_IIO_MAX_DEVICES];
+	struct sensor_capture_batch capture_batch[ST_HAL_IIO_MAX_DEVICES];
+#endif /* CONFIG_ST_HAL_CAPTURE */
 } typedef STSensorHAL_data;
 
+#define ST_HAL_METRICS_DATA_FILENAME		CONCATENATE_STRING(ST_HAL_DATA_PATH, "/metrics.txt")
+
+/* test API, also triggered by metrics_dump in the configuration file */
+extern "C" int st_hal_metrics_dump(const char *filename);
+
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+#define ST_HAL_LATENCY_DATA_FILENAME		CONCATENATE_STRING(ST_HAL_DATA_PATH, "/latency.txt")
+
+/* test API, also triggered by latency_dump in the configuration file */
+extern "C" int st_hal_latency_dump(const char *filename);
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+
+#ifdef CONFIG_ST_HAL_CAPTURE
+#define ST_HAL_CAPTURE_DATA_FILENAME		CONCATENATE_STRING(ST_HAL_DATA_PATH, "/capture.bin")
+
+/* test API, also triggered by capture in the configuration file */
+extern "C" int st_hal_capture(const char *filename, int enable);
+
+/* test API, returns the number of records replayed */
+extern "C" int st_hal_replay(const char *filename, int realtime);
+#endif /* CONFIG_ST_HAL_CAPTURE */
+
 #endif /* ST_SENSOR_HAL_H */
@@ -0,0 +1,425 @@
+/*
+ * STMicroelectronics SensorHAL asynchronous log backend
+ *
+ * Copyright 2021 STMicroelectronics Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <mutex>
+
+#include "common_data.h"
+
+#ifdef CONFIG_ST_HAL_ASYNC_LOG
+
+#define SENSOR_LOG_RING_FREE			(0)
+#define SENSOR_LOG_RING_USED			(1)
+#define SENSOR_LOG_RING_RELEASED		(2)
+
+#define SENSOR_LOG_LINE_SIZE			(512)
+#define SENSOR_LOG_SPEC_SIZE			(32)
+
+static struct sensor_log_ring sensor_log_rings[SENSOR_LOG_MAX_THREADS];
+
+/* records of threads that found no free ring */
+static std::atomic<uint32_t> sensor_log_no_ring_dropped(0);
+
+/* serializes drain thread and Flush() */
+static std::mutex sensor_log_drain_lock;
+
+static const char *sensor_log_level_string[] = {
+	"VERBOSE",	/* SENSOR_LOG_VERBOSE */
+	"DEBUG",	/* SENSOR_LOG_DEBUG */
+	"WARNING",	/* SENSOR_LOG_WARNING */
+	"ERROR",	/* SENSOR_LOG_ERROR */
+};
+
+/*
+ * struct sensor_log_thread: ring owned by a thread, handed back to the
+ * drain thread when the thread exits.
+ */
+struct sensor_log_thread {
+	struct sensor_log_ring *ring;
+	bool no_ring;
+
+	~sensor_log_thread() {
+		if (ring)
+			ring->state.store(SENSOR_LOG_RING_RELEASED,
+					  std::memory_order_release);
+	}
+};
+
+static thread_local struct sensor_log_thread sensor_log_thread_data;
+
+/**
+ * GetRing() - Get the ring of the calling thread
+ *
+ * Return value: ring pointer, NULL if all rings are in use.
+ **/
+struct sensor_log_ring *SensorLog::GetRing()
+{
+	struct sensor_log_thread *thread = &sensor_log_thread_data;
+	int state;
+
+	if (thread->ring || thread->no_ring)
+		return thread->ring;
+
+	for (int i = 0; i < SENSOR_LOG_MAX_THREADS; i++) {
+		state = SENSOR_LOG_RING_FREE;
+		if (sensor_log_rings[i].state.compare_exchange_strong(state,
+						SENSOR_LOG_RING_USED,
+						std::memory_order_acquire)) {
+			thread->ring = &sensor_log_rings[i];
+			return thread->ring;
+		}
+	}
+
+	thread->no_ring = true;
+
+	return NULL;
+}
+
+/**
+ * Reserve() - Get next free record of the calling thread ring
+ * @level: SensorLogLevel.
+ *
+ * Return value: record to fill and Commit(), NULL if the record is dropped.
+ **/
+struct sensor_log_record *SensorLog::Reserve(int level)
+{
+	struct sensor_log_ring *ring = GetRing();
+	struct sensor_log_record *record;
+	struct timespec ts;
+	uint32_t head;
+
+	if (!ring) {
+		sensor_log_no_ring_dropped.fetch_add(1, std::memory_order_relaxed);
+		return NULL;
+	}
+
+	head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tail.load(std::memory_order_acquire) >=
+						SENSOR_LOG_RING_RECORDS) {
+		ring->dropped.fetch_add(1, std::memory_order_relaxed);
+		return NULL;
+	}
+
+	/* vDSO, no syscall */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	record = &ring->records[head % SENSOR_LOG_RING_RECORDS];
+	record->timestamp = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	record->level = (uint8_t)level;
+	record->nargs = 0;
+	record->strings_len = 0;
+
+	return record;
+}
+
+/**
+ * Commit() - Make a record filled after Reserve() visible to the drain thread
+ * @record: record returned by Reserve().
+ **/
+void SensorLog::Commit(struct sensor_log_record *record)
+{
+	struct sensor_log_ring *ring = sensor_log_thread_data.ring;
+
+	(void)record;
+
+	ring->head.store(ring->head.load(std::memory_order_relaxed) + 1,
+			 std::memory_order_release);
+}
+
+/**
+ * sensor_log_format() - Format a record message
+ * @record: log record.
+ * @out: output buffer.
+ * @size: output buffer size.
+ *
+ * Conversion specifications are rebuilt one at a time with the length
+ * modifier matching the stored argument (int64_t or double).
+ *
+ * Return value: number of characters written in @out.
+ **/
+static int sensor_log_format(const struct sensor_log_record *record,
+			     char *out, int size)
+{
+	const char *fmt = record->fmt, *start;
+	char spec[SENSOR_LOG_SPEC_SIZE];
+	int len = 0, slen, n, arg = 0;
+	char conv;
+
+	while (*fmt && (len < size - 1)) {
+		if (*fmt != '%') {
+			out[len++] = *fmt++;
+			continue;
+		}
+
+		start = fmt++;
+		if (*fmt == '%') {
+			out[len++] = *fmt++;
+			continue;
+		}
+
+		slen = 0;
+		spec[slen++] = '%';
+
+		while (*fmt && strchr("-+ #0'", *fmt) &&
+		       (slen < SENSOR_LOG_SPEC_SIZE - 24))
+			spec[slen++] = *fmt++;
+
+		/* width and precision: '*' takes the value from the arguments */
+		while (*fmt && (strchr("0123456789.*", *fmt)) &&
+		       (slen < SENSOR_LOG_SPEC_SIZE - 24)) {
+			if (*fmt == '*') {
+				if ((arg < record->nargs) &&
+				    (record->type[arg] == SENSOR_LOG_ARG_INT))
+					slen += snprintf(&spec[slen], 12, "%d",
+							 (int)record->arg[arg].i);
+				arg++;
+				fmt++;
+			} else {
+				spec[slen++] = *fmt++;
+			}
+		}
+
+		while (*fmt && strchr("hlLqjzt", *fmt))
+			fmt++;
+
+		conv = *fmt;
+		if (!conv || (arg >= record->nargs)) {
+			/* malformed or missing argument, copy as it is */
+			n = snprintf(&out[len], size - len, "%.*s",
+				     (int)(fmt - start + (conv ? 1 : 0)), start);
+			len += (n < size - len) ? n : size - len - 1;
+			if (conv)
+				fmt++;
+
+			continue;
+		}
+
+		fmt++;
+
+		switch (conv) {
+		case 'd':
+		case 'i':
+			spec[slen++] = 'l';
+			spec[slen++] = 'l';
+			spec[slen++] = conv;
+			spec[slen] = '\0';
+			n = snprintf(&out[len], size - len, spec,
+				     (long long)record->arg[arg].i);
+			break;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			spec[slen++] = 'l';
+			spec[slen++] = 'l';
+			spec[slen++] = conv;
+			spec[slen] = '\0';
+			n = snprintf(&out[len], size - len, spec,
+				     (unsigned long long)record->arg[arg].i);
+			break;
+		case 'c':
+			spec[slen++] = conv;
+			spec[slen] = '\0';
+			n = snprintf(&out[len], size - len, spec,
+				     (int)record->arg[arg].i);
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			spec[slen++] = conv;
+			spec[slen] = '\0';
+			n = snprintf(&out[len], size - len, spec,
+				     (record->type[arg] == SENSOR_LOG_ARG_DOUBLE) ?
+				     record->arg[arg].d :
+				     (double)record->arg[arg].i);
+			break;
+		case 's':
+			spec[slen++] = conv;
+			spec[slen] = '\0';
+			n = snprintf(&out[len], size - len, spec,
+				     (record->type[arg] == SENSOR_LOG_ARG_STRING) ?
+				     &record->strings[record->arg[arg].i] : "(?)");
+			break;
+		case 'p':
+			spec[slen++] = conv;
+			spec[slen] = '\0';
+			n = snprintf(&out[len], size - len, spec,
+				     record->arg[arg].p);
+			break;
+		default:
+			n = 0;
+			break;
+		}
+
+		arg++;
+		if (n > 0)
+			len += (n < size - len) ? n : size - len - 1;
+	}
+
+	out[len] = '\0';
+
+	return len;
+}
+
+/**
+ * sensor_log_print() - Write a record to stdout, or stderr for errors
+ * @record: log record.
+ **/
+static void sensor_log_print(const struct sensor_log_record *record)
+{
+	char line[SENSOR_LOG_LINE_SIZE];
+	const char *level = "?";
+
+	if (record->level <= SENSOR_LOG_ERROR)
+		level = sensor_log_level_string[record->level];
+
+	sensor_log_format(record, line, sizeof(line));
+
+	fprintf((record->level == SENSOR_LOG_ERROR) ? stderr : stdout,
+		"[%s] %s(%u): %s\n", level, record->function,
+		record->line, line);
+}
+
+/**
+ * sensor_log_drain() - Write pending records of all rings in timestamp order
+ **/
+static void sensor_log_drain(void)
+{
+	struct sensor_log_ring *ring, *oldest;
+	struct sensor_log_record *record;
+	uint32_t tail, dropped;
+	int64_t timestamp;
+	int i, state;
+
+	for (;;) {
+		oldest = NULL;
+		timestamp = INT64_MAX;
+
+		for (i = 0; i < SENSOR_LOG_MAX_THREADS; i++) {
+			ring = &sensor_log_rings[i];
+			if (ring->state.load(std::memory_order_acquire) ==
+							SENSOR_LOG_RING_FREE)
+				continue;
+
+			tail = ring->tail.load(std::memory_order_relaxed);
+			if (tail == ring->head.load(std::memory_order_acquire))
+				continue;
+
+			record = &ring->records[tail % SENSOR_LOG_RING_RECORDS];
+			if (record->timestamp < timestamp) {
+				timestamp = record->timestamp;
+				oldest = ring;
+			}
+		}
+
+		if (!oldest)
+			break;
+
+		tail = oldest->tail.load(std::memory_order_relaxed);
+		sensor_log_print(&oldest->records[tail % SENSOR_LOG_RING_RECORDS]);
+		oldest->tail.store(tail + 1, std::memory_order_release);
+	}
+
+	for (i = 0; i < SENSOR_LOG_MAX_THREADS; i++) {
+		ring = &sensor_log_rings[i];
+		state = ring->state.load(std::memory_order_acquire);
+		if (state == SENSOR_LOG_RING_FREE)
+			continue;
+
+		dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+		if (dropped)
+			fprintf(stderr, "[WARNING] SensorLog: %u records dropped\n",
+				dropped);
+
+		/* owner exited and everything has been written */
+		if ((state == SENSOR_LOG_RING_RELEASED) &&
+		    (ring->tail.load(std::memory_order_relaxed) ==
+		     ring->head.load(std::memory_order_acquire))) {
+			ring->head.store(0, std::memory_order_relaxed);
+			ring->tail.store(0, std::memory_order_relaxed);
+			ring->state.store(SENSOR_LOG_RING_FREE,
+					  std::memory_order_release);
+		}
+	}
+
+	dropped = sensor_log_no_ring_dropped.exchange(0, std::memory_order_relaxed);
+	if (dropped)
+		fprintf(stderr, "[WARNING] SensorLog: %u records dropped, "
+			"more than %d threads logging\n", dropped,
+			SENSOR_LOG_MAX_THREADS);
+
+	fflush(stdout);
+	fflush(stderr);
+}
+
+/**
+ * Flush() - Write all pending records from the calling thread
+ **/
+void SensorLog::Flush()
+{
+	std::lock_guard<std::mutex> lock(sensor_log_drain_lock);
+
+	sensor_log_drain();
+}
+
+/*
+ * class SensorLogDrain
+ *
+ * Drain thread, started when the library is loaded and stopped, after
+ * a last drain, when it is unloaded or the process exits.
+ */
+static class SensorLogDrain {
+private:
+	pthread_t thread;
+	bool running;
+	std::atomic<bool> stop;
+
+	static void *ThreadWork(void *context) {
+		SensorLogDrain *drain = (SensorLogDrain *)context;
+		struct timespec period;
+
+		period.tv_sec = 0;
+		period.tv_nsec = SENSOR_LOG_DRAIN_PERIOD_MS * 1000000L;
+
+		while (!drain->stop.load(std::memory_order_relaxed)) {
+			nanosleep(&period, NULL);
+			SensorLog::Flush();
+		}
+
+		return NULL;
+	}
+
+public:
+	SensorLogDrain() : running(false), stop(false) {
+		if (pthread_create(&thread, NULL, ThreadWork, this) == 0)
+			running = true;
+		else
+			fprintf(stderr, "[ERROR] SensorLog: failed to start "
+				"drain thread, logs will not be written\n");
+	}
+
+	~SensorLogDrain() {
+		if (running) {
+			stop.store(true);
+			pthread_join(thread, NULL);
+		}
+
+		SensorLog::Flush();
+	}
+} sensor_log_drain_thread;
+
+#endif /* CONFIG_ST_HAL_ASYNC_LOG */
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2021 STMicroelectronics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ST_SENSOR_LOG_H
+#define ST_SENSOR_LOG_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <type_traits>
+
+#define SENSOR_LOG_MAX_ARGS			(16)
+#define SENSOR_LOG_STRING_SIZE			(128)
+#define SENSOR_LOG_RING_RECORDS			(128)
+#define SENSOR_LOG_MAX_THREADS			(32)
+#define SENSOR_LOG_DRAIN_PERIOD_MS		(10)
+
+typedef enum SensorLogLevel {
+	SENSOR_LOG_VERBOSE = 0,
+	SENSOR_LOG_DEBUG,
+	SENSOR_LOG_WARNING,
+	SENSOR_LOG_ERROR,
+} SensorLogLevel;
+
+typedef enum SensorLogArgType {
+	SENSOR_LOG_ARG_INT = 0,
+	SENSOR_LOG_ARG_DOUBLE,
+	SENSOR_LOG_ARG_POINTER,
+	SENSOR_LOG_ARG_STRING,
+} SensorLogArgType;
+
+/*
+ * struct sensor_log_record: log call, formatted by the drain thread
+ * @timestamp: CLOCK_MONOTONIC when the call was made.
+ * @fmt: format string, string literal.
+ * @function: __FUNCTION__ of the caller.
+ * @line: __LINE__ of the caller.
+ * @level: SensorLogLevel.
+ * @nargs: number of arguments.
+ * @strings_len: bytes used in @strings.
+ * @type: SensorLogArgType of each argument.
+ * @arg: argument values, offset in @strings for SENSOR_LOG_ARG_STRING.
+ * @strings: copy of string arguments, NUL terminated.
+ */
+struct sensor_log_record {
+	int64_t timestamp;
+	const char *fmt;
+	const char *function;
+	uint16_t line;
+	uint8_t level;
+	uint8_t nargs;
+	uint8_t strings_len;
+	uint8_t type[SENSOR_LOG_MAX_ARGS];
+	union {
+		int64_t i;
+		double d;
+		const void *p;
+	} arg[SENSOR_LOG_MAX_ARGS];
+	char strings[SENSOR_LOG_STRING_SIZE];
+};
+
+/*
+ * struct sensor_log_ring: single producer single consumer record ring
+ * @head: next record written by the owner thread.
+ * @dropped: records lost because the ring was full.
+ * @tail: next record formatted by the drain thread.
+ * @state: SENSOR_LOG_RING_FREE/USED/RELEASED.
+ */
+struct sensor_log_ring {
+	alignas(64) std::atomic<uint32_t> head;
+	std::atomic<uint32_t> dropped;
+	alignas(64) std::atomic<uint32_t> tail;
+	std::atomic<int> state;
+	struct sensor_log_record records[SENSOR_LOG_RING_RECORDS];
+};
+
+/*
+ * class SensorLog
+ *
+ * Asynchronous logging backend of the Linux build. Every thread owns a
+ * ring taken from a static pool the first time it logs, ALOG* macros
+ * copy format pointer and raw arguments in the next record of the ring
+ * and return: no lock, no allocation, no syscall. Records are formatted
+ * and written to stdout/stderr by a background thread, in timestamp
+ * order across threads. When a ring is full the record is dropped and
+ * counted, the count is reported by the drain thread.
+ */
+class SensorLog {
+private:
+	static struct sensor_log_ring *GetRing();
+
+public:
+	static struct sensor_log_record *Reserve(int level);
+	static void Commit(struct sensor_log_record *record);
+	static void Flush();
+};
+
+static inline void SensorLogPackArg(struct sensor_log_record *record,
+				    const char *value)
+{
+	size_t len, room;
+	uint8_t i = record->nargs++;
+
+	record->type[i] = SENSOR_LOG_ARG_STRING;
+
+	/* no room left: point to the terminator of the previous string */
+	if (record->strings_len >= SENSOR_LOG_STRING_SIZE) {
+		record->arg[i].i = SENSOR_LOG_STRING_SIZE - 1;
+		return;
+	}
+
+	record->arg[i].i = record->strings_len;
+
+	room = SENSOR_LOG_STRING_SIZE - record->strings_len - 1;
+	len = value ? strnlen(value, room) : 0;
+	if (value)
+		memcpy(&record->strings[record->strings_len], value, len);
+
+	record->strings[record->strings_len + len] = '\0';
+	record->strings_len += len + 1;
+}
+
+static inline void SensorLogPackArg(struct sensor_log_record *record,
+				    char *value)
+{
+	SensorLogPackArg(record, (const char *)value);
+}
+
+template<typename T>
+static inline typename std::enable_if<std::is_integral<T>::value ||
+				      std::is_enum<T>::value>::type
+SensorLogPackArg(struct sensor_log_record *record, T value)
+{
+	uint8_t i = record->nargs++;
+
+	record->type[i] = SENSOR_LOG_ARG_INT;
+	record->arg[i].i = (int64_t)value;
+}
+
+template<typename T>
+static inline typename std::enable_if<std::is_floating_point<T>::value>::type
+SensorLogPackArg(struct sensor_log_record *record, T value)
+{
+	uint8_t i = record->nargs++;
+
+	record->type[i] = SENSOR_LOG_ARG_DOUBLE;
+	record->arg[i].d = (double)value;
+}
+
+template<typename T>
+static inline void SensorLogPackArg(struct sensor_log_record *record,
+				    const T *value)
+{
+	uint8_t i = record->nargs++;
+
+	record->type[i] = SENSOR_LOG_ARG_POINTER;
+	record->arg[i].p = value;
+}
+
+static inline void SensorLogPack(struct sensor_log_record *record)
+{
+	(void)record;
+}
+
+template<typename T, typename... Args>
+static inline void SensorLogPack(struct sensor_log_record *record,
+				 T value, Args... args)
+{
+	SensorLogPackArg(record, value);
+	SensorLogPack(record, args...);
+}
+
+template<typename... Args>
+static inline void SensorLogWrite(int level, const char *function,
+				  unsigned int line, const char *fmt,
+				  Args... args)
+{
+	struct sensor_log_record *record;
+
+	static_assert(sizeof...(args) <= SENSOR_LOG_MAX_ARGS,
+		      "too many log arguments");
+
+	record = SensorLog::Reserve(level);
+	if (!record)
+		return;
+
+	record->fmt = fmt;
+	record->function = function;
+	record->line = (uint16_t)line;
+	SensorLogPack(record, args...);
+
+	SensorLog::Commit(record);
+}
+
+/* never called, keeps printf format checking of the log calls */
+static inline void SensorLogCheckFormat(const char *fmt, ...)
+		__attribute__((format(printf, 1, 2)));
+static inline void SensorLogCheckFormat(const char *fmt, ...)
+{
+	(void)fmt;
+}
+
+#endif /* ST_SENSOR_LOG_H */
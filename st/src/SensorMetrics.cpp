@@ -0,0 +1,106 @@
+/*
+ * STMicroelectronics Sensor Metrics Class
+ *
+ * Copyright 2021 STMicroelectronics Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ */
+
+#define __STDC_FORMAT_MACROS
+
+#include <inttypes.h>
+
+#include "SensorMetrics.h"
+
+static const char *metric_names[SENSOR_METRIC_MAX] = {
+	"wakeups",
+	"fifo_reads",
+	"samples_read",
+	"samples_decoded",
+	"samples_decimated",
+	"samples_dropped",
+	"buffer_overruns",
+	"pipe_eagain",
+	"pipe_errors",
+	"odr_switches",
+	"device_errors",
+	"device_reopens",
+	"watchdog_stalls",
+	"timestamp_resyncs",
+	"samples_reordered",
+	"samples_out_of_order",
+	"sample_gaps",
+	"samples_missing",
+	"sample_gap_ns",
+	"buffer_grows",
+	"watermark_updates",
+	"batch_releases",
+	"flushes",
+	"sysfs_writes",
+	"sysfs_write_ns",
+	"sysfs_write_max_ns",
+	"device_detaches",
+	"device_attaches",
+	"events_delivered",
+};
+
+SensorMetrics::SensorMetrics()
+{
+	Reset();
+}
+
+SensorMetrics::~SensorMetrics()
+{
+
+}
+
+/**
+ * RecordSysfsWrite() - Account a sysfs attribute write
+ * @duration: time spent in the write [ns].
+ **/
+void SensorMetrics::RecordSysfsWrite(int64_t duration)
+{
+	uint64_t max;
+
+	if (duration < 0)
+		duration = 0;
+
+	Inc(SENSOR_METRIC_SYSFS_WRITES);
+	Add(SENSOR_METRIC_SYSFS_WRITE_NS, duration);
+
+	max = Value(SENSOR_METRIC_SYSFS_WRITE_MAX_NS).load(std::memory_order_relaxed);
+	while (((uint64_t)duration > max) &&
+	       !Value(SENSOR_METRIC_SYSFS_WRITE_MAX_NS).compare_exchange_weak(max,
+				duration, std::memory_order_relaxed))
+		;
+}
+
+uint64_t SensorMetrics::Get(SensorMetricID id)
+{
+	return Value(id).load(std::memory_order_relaxed);
+}
+
+void SensorMetrics::Reset()
+{
+	int i;
+
+	for (i = 0; i < SENSOR_METRIC_MAX; i++)
+		Value((SensorMetricID)i).store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Dump() - Print all counters, one "handle.metric value" per line
+ * @file: output stream.
+ * @handle: sensor handle.
+ * @name: sensor name.
+ **/
+void SensorMetrics::Dump(FILE *file, int handle, const char *name)
+{
+	int i;
+
+	fprintf(file, "# %d %s\n", handle, name);
+
+	for (i = 0; i < SENSOR_METRIC_MAX; i++)
+		fprintf(file, "%d.%s %" PRIu64 "\n", handle, metric_names[i],
+			Get((SensorMetricID)i));
+}
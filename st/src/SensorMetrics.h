@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2021 STMicroelectronics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ST_SENSOR_METRICS_H
+#define ST_SENSOR_METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+
+#include "common_data.h"
+
+/* grouped by writer, each group on its own cache lines */
+typedef enum SensorMetricID {
+	/* data thread */
+	SENSOR_METRIC_WAKEUPS = 0,
+	SENSOR_METRIC_FIFO_READS,
+	SENSOR_METRIC_SAMPLES_READ,
+	SENSOR_METRIC_SAMPLES_DECODED,
+	SENSOR_METRIC_SAMPLES_DECIMATED,
+	SENSOR_METRIC_SAMPLES_DROPPED,
+	SENSOR_METRIC_BUFFER_OVERRUNS,
+	SENSOR_METRIC_PIPE_EAGAIN,
+	SENSOR_METRIC_PIPE_ERRORS,
+	SENSOR_METRIC_ODR_SWITCHES,
+	SENSOR_METRIC_DEVICE_ERRORS,
+	SENSOR_METRIC_DEVICE_REOPENS,
+	SENSOR_METRIC_WATCHDOG_STALLS,
+	SENSOR_METRIC_TIMESTAMP_RESYNCS,
+	SENSOR_METRIC_SAMPLES_REORDERED,
+	SENSOR_METRIC_SAMPLES_OUT_OF_ORDER,
+	SENSOR_METRIC_SAMPLE_GAPS,
+	SENSOR_METRIC_SAMPLES_MISSING,
+	SENSOR_METRIC_SAMPLE_GAP_NS,
+	SENSOR_METRIC_BUFFER_GROWS,
+	SENSOR_METRIC_WATERMARK_UPDATES,
+	SENSOR_METRIC_BATCH_RELEASES,
+	/* framework and hotplug threads */
+	SENSOR_METRIC_FLUSHES,
+	SENSOR_METRIC_SYSFS_WRITES,
+	SENSOR_METRIC_SYSFS_WRITE_NS,
+	SENSOR_METRIC_SYSFS_WRITE_MAX_NS,
+	SENSOR_METRIC_DEVICE_DETACHES,
+	SENSOR_METRIC_DEVICE_ATTACHES,
+	/* poll thread */
+	SENSOR_METRIC_EVENTS_DELIVERED,
+	SENSOR_METRIC_MAX
+} SensorMetricID;
+
+#define SENSOR_METRIC_CONTROL_FIRST		SENSOR_METRIC_FLUSHES
+#define SENSOR_METRIC_POLL_FIRST		SENSOR_METRIC_EVENTS_DELIVERED
+
+/*
+ * class SensorMetrics
+ *
+ * Always-on per sensor counters. Updates are relaxed atomics (hot path
+ * callers add once per batch, not per sample), snapshots are taken
+ * without stopping the writers. Counters written by different threads
+ * do not share cache lines.
+ */
+class SensorMetrics {
+private:
+	alignas(ST_HAL_CACHE_LINE_SIZE) std::atomic<uint64_t> data_value[SENSOR_METRIC_CONTROL_FIRST];
+	alignas(ST_HAL_CACHE_LINE_SIZE) std::atomic<uint64_t> control_value[SENSOR_METRIC_POLL_FIRST -
+									    SENSOR_METRIC_CONTROL_FIRST];
+	alignas(ST_HAL_CACHE_LINE_SIZE) std::atomic<uint64_t> poll_value[SENSOR_METRIC_MAX -
+									 SENSOR_METRIC_POLL_FIRST];
+
+	inline std::atomic<uint64_t> &Value(SensorMetricID id) {
+		if (id < SENSOR_METRIC_CONTROL_FIRST)
+			return data_value[id];
+
+		if (id < SENSOR_METRIC_POLL_FIRST)
+			return control_value[id - SENSOR_METRIC_CONTROL_FIRST];
+
+		return poll_value[id - SENSOR_METRIC_POLL_FIRST];
+	}
+
+public:
+	SensorMetrics();
+	~SensorMetrics();
+
+	inline void Add(SensorMetricID id, uint64_t n) {
+		Value(id).fetch_add(n, std::memory_order_relaxed);
+	}
+
+	inline void Inc(SensorMetricID id) {
+		Value(id).fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void RecordSysfsWrite(int64_t duration);
+	uint64_t Get(SensorMetricID id);
+	void Reset();
+
+	void Dump(FILE *file, int handle, const char *name);
+};
+
+#endif /* ST_SENSOR_METRICS_H */
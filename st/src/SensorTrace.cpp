@@ -0,0 +1,112 @@
+/*
+ * STMicroelectronics SensorHAL ftrace trace points
+ *
+ * Copyright 2021 STMicroelectronics Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ */
+
+#define __STDC_FORMAT_MACROS
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "SensorTrace.h"
+
+#ifdef CONFIG_ST_HAL_TRACE_MARKER
+
+/*
+ * trace_marker fd, opened by each thread the first time it traces:
+ * -1 not opened yet, -2 not available.
+ */
+static thread_local int trace_fd = -1;
+
+static int st_hal_trace_get_fd(void)
+{
+	if (trace_fd == -1) {
+		trace_fd = open(ST_HAL_TRACE_MARKER_PATH, O_WRONLY | O_CLOEXEC);
+		if (trace_fd < 0)
+			trace_fd = open(ST_HAL_TRACE_MARKER_PATH_OLD,
+					O_WRONLY | O_CLOEXEC);
+		if (trace_fd < 0)
+			trace_fd = -2;
+	}
+
+	return trace_fd;
+}
+
+static void st_hal_trace_write(const char *buf, int len)
+{
+	int fd = st_hal_trace_get_fd();
+
+	if ((fd < 0) || (len <= 0))
+		return;
+
+	if (len > ST_HAL_TRACE_MESSAGE_MAX - 1)
+		len = ST_HAL_TRACE_MESSAGE_MAX - 1;
+
+	if (write(fd, buf, len) < 0)
+		return;
+}
+
+/**
+ * st_hal_trace_begin() - Open a slice on the calling thread
+ * @fmt: slice name, printf format.
+ **/
+void st_hal_trace_begin(const char *fmt, ...)
+{
+	int len;
+	va_list args;
+	char buf[ST_HAL_TRACE_MESSAGE_MAX];
+
+	if (st_hal_trace_get_fd() < 0)
+		return;
+
+	len = snprintf(buf, sizeof(buf), "B|%d|", getpid());
+
+	va_start(args, fmt);
+	len += vsnprintf(buf + len, sizeof(buf) - len, fmt, args);
+	va_end(args);
+
+	st_hal_trace_write(buf, len);
+}
+
+/**
+ * st_hal_trace_end() - Close the last slice opened by the calling thread
+ **/
+void st_hal_trace_end(void)
+{
+	int len;
+	char buf[ST_HAL_TRACE_MESSAGE_MAX];
+
+	if (st_hal_trace_get_fd() < 0)
+		return;
+
+	len = snprintf(buf, sizeof(buf), "E|%d", getpid());
+	st_hal_trace_write(buf, len);
+}
+
+/**
+ * st_hal_trace_counter() - Set a counter track value
+ * @name: sensor name.
+ * @counter: counter name.
+ * @value: new value.
+ **/
+void st_hal_trace_counter(const char *name, const char *counter,
+			  int64_t value)
+{
+	int len;
+	char buf[ST_HAL_TRACE_MESSAGE_MAX];
+
+	if (st_hal_trace_get_fd() < 0)
+		return;
+
+	len = snprintf(buf, sizeof(buf), "C|%d|%s %s|%" PRId64,
+		       getpid(), name, counter, value);
+	st_hal_trace_write(buf, len);
+}
+
+#endif /* CONFIG_ST_HAL_TRACE_MARKER */
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2021 STMicroelectronics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ST_SENSOR_TRACE_H
+#define ST_SENSOR_TRACE_H
+
+#include <stdint.h>
+
+#include "common_data.h"
+
+/*
+ * Trace points written to ftrace trace_marker in the atrace text format
+ * ("B|pid|name", "E|pid", "C|pid|name|value"), so that perfetto and
+ * systrace show them next to the kernel iio and irq events. Compiled
+ * out unless CONFIG_ST_HAL_TRACE_MARKER is set.
+ */
+#ifdef CONFIG_ST_HAL_TRACE_MARKER
+#define ST_HAL_TRACE_MARKER_PATH	"/sys/kernel/tracing/trace_marker"
+#define ST_HAL_TRACE_MARKER_PATH_OLD	"/sys/kernel/debug/tracing/trace_marker"
+#define ST_HAL_TRACE_MESSAGE_MAX	(128)
+
+void st_hal_trace_begin(const char *fmt, ...)
+			__attribute__((format(printf, 1, 2)));
+void st_hal_trace_end(void);
+void st_hal_trace_counter(const char *name, const char *counter,
+			  int64_t value);
+
+#define ST_HAL_TRACE_BEGIN(...)			st_hal_trace_begin(__VA_ARGS__)
+#define ST_HAL_TRACE_END()			st_hal_trace_end()
+#define ST_HAL_TRACE_COUNTER(name, counter, value) \
+			st_hal_trace_counter(name, counter, value)
+#else /* CONFIG_ST_HAL_TRACE_MARKER */
+#define ST_HAL_TRACE_BEGIN(...)			do { } while (0)
+#define ST_HAL_TRACE_END()			do { } while (0)
+#define ST_HAL_TRACE_COUNTER(name, counter, value) \
+			do { } while (0)
+#endif /* CONFIG_ST_HAL_TRACE_MARKER */
+
+#endif /* ST_SENSOR_TRACE_H */
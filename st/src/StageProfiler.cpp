@@ -0,0 +1,244 @@
+/*
+ * STMicroelectronics Stage Profiler Class
+ *
+ * Copyright 2021 STMicroelectronics Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "SensorBase.h"
+#include "StageProfiler.h"
+
+#ifdef CONFIG_ST_HAL_STAGE_PROFILING
+
+static const struct {
+	uint32_t type;
+	uint64_t config;
+	const char *name;
+} profile_counters[SENSOR_PROFILE_COUNTER_MAX] = {
+	/* same order as enum SensorProfileCounter, first is group leader */
+	{
+		PERF_TYPE_SOFTWARE,
+		PERF_COUNT_SW_TASK_CLOCK,
+		"task_clock_ns",
+	},
+	{
+		PERF_TYPE_HARDWARE,
+		PERF_COUNT_HW_CPU_CYCLES,
+		"cycles",
+	},
+	{
+		PERF_TYPE_HARDWARE,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		"instructions",
+	},
+	{
+		PERF_TYPE_HARDWARE,
+		PERF_COUNT_HW_CACHE_MISSES,
+		"cache_misses",
+	},
+	{
+		PERF_TYPE_SOFTWARE,
+		PERF_COUNT_SW_CONTEXT_SWITCHES,
+		"context_switches",
+	},
+};
+
+static const char *profile_stage_names[SENSOR_PROFILE_STAGE_MAX] = {
+	"decode", "process", "fanout", "delivery",
+};
+
+/*
+ * struct stage_profiler_thread: perf counters group of a thread
+ * @state: 0 not opened yet, 1 opened, -1 not available.
+ * @group_fd: group leader fd.
+ * @nr: counters in the group.
+ * @index: position of each counter in the group read, -1 if missing.
+ * @last: counters values at the last stage boundary.
+ */
+struct stage_profiler_thread {
+	int state;
+	int group_fd;
+	unsigned int nr;
+	int index[SENSOR_PROFILE_COUNTER_MAX];
+	uint64_t last[SENSOR_PROFILE_COUNTER_MAX];
+};
+
+static thread_local struct stage_profiler_thread profiler_thread;
+
+std::atomic<unsigned int> StageProfiler::available_counters(0);
+
+static int stage_profiler_open_counter(int i, int group_fd)
+{
+	int fd;
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = profile_counters[i].type;
+	attr.config = profile_counters[i].config;
+	attr.read_format = PERF_FORMAT_GROUP;
+	attr.exclude_hv = 1;
+
+	/* syscalls are part of the cost, count kernel time if allowed */
+	fd = syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+	if ((fd < 0) && ((errno == EACCES) || (errno == EPERM))) {
+		attr.exclude_kernel = 1;
+		fd = syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+	}
+
+	return fd;
+}
+
+static bool stage_profiler_open_thread(std::atomic<unsigned int> *available)
+{
+	int i, fd;
+	struct stage_profiler_thread *pt = &profiler_thread;
+
+	pt->group_fd = stage_profiler_open_counter(0, -1);
+	if (pt->group_fd < 0) {
+		pt->state = -1;
+		ALOGE("Stage profiling not available (errno %d).", errno);
+		return false;
+	}
+
+	pt->index[0] = 0;
+	pt->nr = 1;
+
+	for (i = 1; i < SENSOR_PROFILE_COUNTER_MAX; i++) {
+		fd = stage_profiler_open_counter(i, pt->group_fd);
+		if (fd < 0) {
+			pt->index[i] = -1;
+			continue;
+		}
+
+		pt->index[i] = pt->nr++;
+	}
+
+	for (i = 0; i < SENSOR_PROFILE_COUNTER_MAX; i++) {
+		if (pt->index[i] >= 0)
+			available->fetch_or(1U << i, std::memory_order_relaxed);
+	}
+
+	pt->state = 1;
+
+	return true;
+}
+
+bool StageProfiler::ReadThreadCounters(uint64_t counters[SENSOR_PROFILE_COUNTER_MAX])
+{
+	int i;
+	ssize_t len;
+	uint64_t buf[1 + SENSOR_PROFILE_COUNTER_MAX];
+	struct stage_profiler_thread *pt = &profiler_thread;
+
+	if (pt->state == 0)
+		stage_profiler_open_thread(&available_counters);
+
+	if (pt->state < 0)
+		return false;
+
+	len = read(pt->group_fd, buf, (1 + pt->nr) * sizeof(uint64_t));
+	if (len != (ssize_t)((1 + pt->nr) * sizeof(uint64_t)))
+		return false;
+
+	for (i = 0; i < SENSOR_PROFILE_COUNTER_MAX; i++)
+		counters[i] = pt->index[i] < 0 ? 0 : buf[1 + pt->index[i]];
+
+	return true;
+}
+
+StageProfiler::StageProfiler()
+{
+	Reset();
+}
+
+StageProfiler::~StageProfiler()
+{
+
+}
+
+/**
+ * Begin() - Mark the start of a stage on the calling thread
+ **/
+void StageProfiler::Begin()
+{
+	ReadThreadCounters(profiler_thread.last);
+}
+
+/**
+ * Mark() - Charge the counters since the last boundary to a stage
+ * @stage: stage just completed.
+ * @num_samples: samples handled by the stage.
+ **/
+void StageProfiler::Mark(SensorProfileStage stage, unsigned int num_samples)
+{
+	int i;
+	uint64_t now[SENSOR_PROFILE_COUNTER_MAX];
+
+	if (!ReadThreadCounters(now))
+		return;
+
+	for (i = 0; i < SENSOR_PROFILE_COUNTER_MAX; i++) {
+		value[stage][i].fetch_add(now[i] - profiler_thread.last[i],
+					  std::memory_order_relaxed);
+		profiler_thread.last[i] = now[i];
+	}
+
+	samples[stage].fetch_add(num_samples, std::memory_order_relaxed);
+}
+
+void StageProfiler::Reset()
+{
+	int i, j;
+
+	for (i = 0; i < SENSOR_PROFILE_STAGE_MAX; i++) {
+		samples[i].store(0, std::memory_order_relaxed);
+
+		for (j = 0; j < SENSOR_PROFILE_COUNTER_MAX; j++)
+			value[i][j].store(0, std::memory_order_relaxed);
+	}
+}
+
+/**
+ * Dump() - Print cost per sample of each stage
+ * @file: output stream.
+ * @handle: sensor handle.
+ **/
+void StageProfiler::Dump(FILE *file, int handle)
+{
+	int i, j;
+	uint64_t n;
+	unsigned int available =
+			available_counters.load(std::memory_order_relaxed);
+
+	for (i = 0; i < SENSOR_PROFILE_STAGE_MAX; i++) {
+		n = samples[i].load(std::memory_order_relaxed);
+
+		fprintf(file, "%d.profile.%s.samples %llu\n", handle,
+			profile_stage_names[i], (unsigned long long)n);
+
+		for (j = 0; j < SENSOR_PROFILE_COUNTER_MAX; j++) {
+			if (!(available & (1U << j)) || (n == 0)) {
+				fprintf(file, "%d.profile.%s.%s_per_sample n/a\n",
+					handle, profile_stage_names[i],
+					profile_counters[j].name);
+				continue;
+			}
+
+			fprintf(file, "%d.profile.%s.%s_per_sample %.3f\n",
+				handle, profile_stage_names[i],
+				profile_counters[j].name,
+				(double)value[i][j].load(std::memory_order_relaxed) / n);
+		}
+	}
+}
+
+#endif /* CONFIG_ST_HAL_STAGE_PROFILING */
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2021 STMicroelectronics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ST_STAGE_PROFILER_H
+#define ST_STAGE_PROFILER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+
+typedef enum SensorProfileStage {
+	SENSOR_PROFILE_DECODE = 0,
+	SENSOR_PROFILE_PROCESS,
+	SENSOR_PROFILE_FANOUT,
+	SENSOR_PROFILE_DELIVERY,
+	SENSOR_PROFILE_STAGE_MAX
+} SensorProfileStage;
+
+typedef enum SensorProfileCounter {
+	SENSOR_PROFILE_TASK_CLOCK = 0,
+	SENSOR_PROFILE_CYCLES,
+	SENSOR_PROFILE_INSTRUCTIONS,
+	SENSOR_PROFILE_CACHE_MISSES,
+	SENSOR_PROFILE_CONTEXT_SWITCHES,
+	SENSOR_PROFILE_COUNTER_MAX
+} SensorProfileCounter;
+
+/*
+ * class StageProfiler
+ *
+ * Per sensor CPU cost of the data path stages. Counters are opened with
+ * perf_event_open() for each thread that runs a stage, the first time
+ * it does, and read as a group at each stage boundary: Begin() marks the
+ * start of a stage, Mark() charges the counters elapsed since the last
+ * boundary of the calling thread to a stage.
+ */
+class StageProfiler {
+private:
+	std::atomic<uint64_t> samples[SENSOR_PROFILE_STAGE_MAX];
+	std::atomic<uint64_t> value[SENSOR_PROFILE_STAGE_MAX][SENSOR_PROFILE_COUNTER_MAX];
+
+	static std::atomic<unsigned int> available_counters;
+
+	static bool ReadThreadCounters(uint64_t counters[SENSOR_PROFILE_COUNTER_MAX]);
+
+public:
+	StageProfiler();
+	~StageProfiler();
+
+	void Begin();
+	void Mark(SensorProfileStage stage, unsigned int num_samples);
+	void Reset();
+
+	void Dump(FILE *file, int handle);
+};
+
+#endif /* ST_STAGE_PROFILER_H */
@@ -0,0 +1,143 @@
+/*
+ * STMicroelectronics Timestamp Estimator Class
+ *
+ * Copyright 2021 STMicroelectronics Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ */
+
+#include <math.h>
+
+#include "TimestampEstimator.h"
+
+TimestampEstimator::TimestampEstimator()
+{
+	Reset();
+}
+
+TimestampEstimator::~TimestampEstimator()
+{
+
+}
+
+/**
+ * Reset() - Forget the learned period and phase
+ **/
+void TimestampEstimator::Reset()
+{
+	nominal_period = 0;
+	period = 0.0;
+	last = 0.0;
+	batch_start = 0.0;
+	step = 0.0;
+	synced = false;
+}
+
+/**
+ * Resync() - Restart the estimation from a reference time
+ * @samples: number of samples of the batch.
+ * @reference: time of the last sample of the batch.
+ **/
+void TimestampEstimator::Resync(unsigned int samples, int64_t reference)
+{
+	double start = (double)reference - samples * period;
+
+	/* keep timestamps monotonic across the restart */
+	if (synced && (start < last))
+		start = last;
+
+	batch_start = start;
+	if ((double)reference > start)
+		step = ((double)reference - start) / samples;
+	else
+		step = 1.0;
+
+	last = batch_start + step * samples;
+	synced = true;
+}
+
+/**
+ * Update() - Estimate the timestamps of a new batch of samples
+ * @nominal: requested sampling period [ns].
+ * @samples: number of samples of the batch.
+ * @reference: time of the last sample of the batch [ns].
+ *
+ * Return value: true if the estimation restarted from @reference.
+ **/
+bool TimestampEstimator::Update(int64_t nominal, unsigned int samples,
+				int64_t reference)
+{
+	double predicted, error, next;
+
+	if (!samples)
+		return false;
+
+	/*
+	 * nothing to learn yet: spread the samples over the time since the
+	 * previous reference, 1ns apart for the first batch
+	 */
+	if (nominal <= 0) {
+		if ((last > 0.0) && ((double)reference > last)) {
+			batch_start = last;
+			step = ((double)reference - last) / samples;
+		} else {
+			batch_start = (double)reference - samples;
+			step = 1.0;
+		}
+
+		last = (double)reference;
+		synced = false;
+
+		return true;
+	}
+
+	if (!synced || (nominal != nominal_period)) {
+		nominal_period = nominal;
+		period = (double)nominal;
+		Resync(samples, reference);
+
+		return true;
+	}
+
+	predicted = last + samples * period;
+	error = (double)reference - predicted;
+
+	if (fabs(error) > TIMESTAMP_ESTIMATOR_RESYNC_PERIODS * period) {
+		Resync(samples, reference);
+
+		return true;
+	}
+
+	period += TIMESTAMP_ESTIMATOR_PERIOD_GAIN * error / samples;
+	if (period > nominal_period * (1.0 + TIMESTAMP_ESTIMATOR_PERIOD_TOLERANCE))
+		period = nominal_period * (1.0 + TIMESTAMP_ESTIMATOR_PERIOD_TOLERANCE);
+	else if (period < nominal_period * (1.0 - TIMESTAMP_ESTIMATOR_PERIOD_TOLERANCE))
+		period = nominal_period * (1.0 - TIMESTAMP_ESTIMATOR_PERIOD_TOLERANCE);
+
+	/* a sample can not be timestamped after its reference */
+	next = predicted + TIMESTAMP_ESTIMATOR_PHASE_GAIN * error;
+	if (next > (double)reference)
+		next = (double)reference;
+
+	if (next <= last) {
+		Resync(samples, reference);
+
+		return true;
+	}
+
+	batch_start = last;
+	step = (next - last) / samples;
+	last = next;
+
+	return false;
+}
+
+/**
+ * GetPeriod() - Get the learned sampling period
+ *
+ * Return value: period [ns], 0 if not synced.
+ **/
+int64_t TimestampEstimator::GetPeriod()
+{
+	return synced ? (int64_t)period : 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2021 STMicroelectronics
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ST_TIMESTAMP_ESTIMATOR_H
+#define ST_TIMESTAMP_ESTIMATOR_H
+
+#include <stdint.h>
+
+/* loop gains: phase error corrected per batch, period learned slowly */
+#define TIMESTAMP_ESTIMATOR_PHASE_GAIN		(0.125)
+#define TIMESTAMP_ESTIMATOR_PERIOD_GAIN		(0.015625)
+
+/* learned period bounds, ratio of the nominal period */
+#define TIMESTAMP_ESTIMATOR_PERIOD_TOLERANCE	(0.1)
+
+/* phase error, in periods, restarting the estimation (gap, overrun) */
+#define TIMESTAMP_ESTIMATOR_RESYNC_PERIODS	(8)
+
+/*
+ * class TimestampEstimator
+ *
+ * Per sensor software timestamps. For every batch read from the FIFO the
+ * number of samples and a reference time of the last one (its hw
+ * timestamp, or the read time when the timestamp channel is disabled)
+ * feed a second order loop: the phase error moves the estimated time of
+ * the last sample, its average over samples tunes the period, so the
+ * real ODR of the part is learned. Samples of a batch are evenly spaced
+ * from the previous estimate, timestamps are monotonic and never later
+ * than the reference. Until the period is known samples are spread over
+ * the time elapsed since the previous reference.
+ *
+ * Used by the data thread only.
+ */
+class TimestampEstimator {
+private:
+	int64_t nominal_period;
+	double period;
+	double last;
+	double batch_start;
+	double step;
+	bool synced;
+
+	void Resync(unsigned int samples, int64_t reference);
+
+public:
+	TimestampEstimator();
+	~TimestampEstimator();
+
+	void Reset();
+	bool Update(int64_t nominal, unsigned int samples, int64_t reference);
+	int64_t GetPeriod();
+
+	/* timestamp of sample @i of the last batch */
+	inline int64_t GetTimestamp(unsigned int i) {
+		return (int64_t)(batch_start + step * (i + 1));
+	}
+};
+
+#endif /* ST_TIMESTAMP_ESTIMATOR_H */
@@ -45,6 +45,11 @@
 
 #define ST_HAL_IIO_MAX_DEVICES			(50)
 
+/* same IMU part mounted more than once on the board */
+#define ST_HAL_IMU_MAX_INSTANCES		(4)
+
+#define ST_HAL_CACHE_LINE_SIZE			(64)
+
 #define SENSOR_DATA_X(datax, datay, dataz, x1, y1, z1, x2, y2, z2, x3, y3, z3) \
 		     ((x1 == 1 ? datax : (x1 == -1 ? -datax : 0)) + \
 		      (x2 == 1 ? datay : (x2 == -1 ? -datay : 0)) + \
@@ -70,10 +75,39 @@
 
 /* Overrite default log utility */
 #ifdef PLTF_LINUX_ENABLED
-#define ALOGV(fmt, ...) fprintf(stdout, "[VERBOSE] %s(%u): " fmt "\n", __FUNCTION__, __LINE__, ##__VA_ARGS__)
-#define ALOGD(fmt, ...) fprintf(stdout, "[DEBUG] %s(%u): " fmt "\n", __FUNCTION__, __LINE__, ##__VA_ARGS__)
-#define ALOGW(fmt, ...) fprintf(stdout, "[WARNING] %s(%u): " fmt "\n", __FUNCTION__, __LINE__, ##__VA_ARGS__)
-#define ALOGE(fmt,...)  fprintf(stderr, "[ERROR] %s(%u): " fmt "\n", __FUNCTION__, __LINE__, ##__VA_ARGS__)
+#ifdef CONFIG_ST_HAL_ASYNC_LOG
+#include "SensorLog.h"
+
+#define ST_HAL_LOG(level, label, file, fmt, ...) \
+	do { \
+		if (0) \
+			SensorLogCheckFormat(fmt, ##__VA_ARGS__); \
+		SensorLogWrite(level, __FUNCTION__, __LINE__, fmt, ##__VA_ARGS__); \
+	} while (0)
+#else /* CONFIG_ST_HAL_ASYNC_LOG */
+#define ST_HAL_LOG(level, label, file, fmt, ...) \
+	fprintf(file, "[" label "] %s(%u): " fmt "\n", __FUNCTION__, __LINE__, ##__VA_ARGS__)
+#endif /* CONFIG_ST_HAL_ASYNC_LOG */
+
+/* calls below CONFIG_ST_HAL_DEBUG_LEVEL are removed, format is still checked */
+#define ST_HAL_LOG_DISCARD(fmt, ...) \
+	do { \
+		if (0) \
+			fprintf(stdout, fmt, ##__VA_ARGS__); \
+	} while (0)
+
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_VERBOSE)
+#define ALOGV(fmt, ...) ST_HAL_LOG(SENSOR_LOG_VERBOSE, "VERBOSE", stdout, fmt, ##__VA_ARGS__)
+#else
+#define ALOGV(fmt, ...) ST_HAL_LOG_DISCARD(fmt, ##__VA_ARGS__)
+#endif
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_INFO)
+#define ALOGD(fmt, ...) ST_HAL_LOG(SENSOR_LOG_DEBUG, "DEBUG", stdout, fmt, ##__VA_ARGS__)
+#else
+#define ALOGD(fmt, ...) ST_HAL_LOG_DISCARD(fmt, ##__VA_ARGS__)
 #endif
+#define ALOGW(fmt, ...) ST_HAL_LOG(SENSOR_LOG_WARNING, "WARNING", stdout, fmt, ##__VA_ARGS__)
+#define ALOGE(fmt, ...) ST_HAL_LOG(SENSOR_LOG_ERROR, "ERROR", stderr, fmt, ##__VA_ARGS__)
+#endif /* PLTF_LINUX_ENABLED */
 
 #endif /* ANDROID_SENSOR_HAL_COMMON_DATA */
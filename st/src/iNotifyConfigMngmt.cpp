@@ -34,11 +34,25 @@ static const char *parsing_strings[] = {
 	"algo_crash_impact_th = ",
 	"algo_crash_min_duration = ",
 	"ignition_off = ",
+	"metrics_dump = ",
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+	"latency_dump = ",
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+#ifdef CONFIG_ST_HAL_CAPTURE
+	"capture = ",
+#endif /* CONFIG_ST_HAL_CAPTURE */
 };
 
 static volatile int run = 1;
 static struct hal_config_t hal_config;
 static std::mutex configMutex;
+static int (*metrics_dump_handler)(const char *filename);
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+static int (*latency_dump_handler)(const char *filename);
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+#ifdef CONFIG_ST_HAL_CAPTURE
+static int (*capture_handler)(const char *filename, int enable);
+#endif /* CONFIG_ST_HAL_CAPTURE */
 
 static void sig_callback(int sig)
 {
@@ -53,73 +67,116 @@ static void sig_callback(int sig)
 
 static int show_sensor_placement(struct hal_config_t *config)
 {
-	ALOGD("Rotation Matrix: \t%5.2f %5.2f %5.2f %6.2f\n\t\t\t%5.2f %5.2f %5.2f %6.2f\n\t\t\t%5.2f %5.2f %5.2f %6.2f\n",
-		config->sensor_placement.rot[0][0],
-		config->sensor_placement.rot[0][1],
-		config->sensor_placement.rot[0][2],
-		config->sensor_placement.location[0],
-		config->sensor_placement.rot[1][0],
-		config->sensor_placement.rot[1][1],
-		config->sensor_placement.rot[1][2],
-		config->sensor_placement.location[1],
-		config->sensor_placement.rot[2][0],
-		config->sensor_placement.rot[2][1],
-		config->sensor_placement.rot[2][2],
-		config->sensor_placement.location[2]);
+	int imu;
+	struct sensor_placement_t *placement;
+
+	for (imu = 0; imu < ST_HAL_IMU_MAX_INSTANCES; imu++) {
+		placement = &config->sensor_placement[imu];
+
+		ALOGD("IMU %d Rotation Matrix: \t%5.2f %5.2f %5.2f %6.2f\n\t\t\t%5.2f %5.2f %5.2f %6.2f\n\t\t\t%5.2f %5.2f %5.2f %6.2f\n",
+			imu + 1,
+			placement->rot[0][0],
+			placement->rot[0][1],
+			placement->rot[0][2],
+			placement->location[0],
+			placement->rot[1][0],
+			placement->rot[1][1],
+			placement->rot[1][2],
+			placement->location[1],
+			placement->rot[2][0],
+			placement->rot[2][1],
+			placement->rot[2][2],
+			placement->location[2]);
+	}
 
 	return 0;
 }
 
+static void update_rotation_matrix_q(struct sensor_placement_t *placement)
+{
+#ifdef CONFIG_ST_HAL_FIXED_POINT_DATA
+	int i, j;
+
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 3; j++) {
+			placement->rot_q[i][j] =
+				lrintf(placement->rot[i][j] *
+				       (1 << ST_HAL_ROT_MATRIX_Q_SHIFT));
+		}
+	}
+#else /* CONFIG_ST_HAL_FIXED_POINT_DATA */
+	(void)placement;
+#endif /* CONFIG_ST_HAL_FIXED_POINT_DATA */
+}
+
 static void init_hal_config(struct hal_config_t *config)
 {
 	std::lock_guard<std::mutex> lock(configMutex);
+	struct sensor_placement_t *placement;
+	int imu;
 
-	config->sensor_placement.rot[0][0] = 1;
-	config->sensor_placement.rot[0][1] = 0;
-	config->sensor_placement.rot[0][2] = 0;
+	for (imu = 0; imu < ST_HAL_IMU_MAX_INSTANCES; imu++) {
+		placement = &config->sensor_placement[imu];
 
-	config->sensor_placement.rot[1][0] = 0;
-	config->sensor_placement.rot[1][1] = 1;
-	config->sensor_placement.rot[1][2] = 0;
+		placement->rot[0][0] = 1;
+		placement->rot[0][1] = 0;
+		placement->rot[0][2] = 0;
 
-	config->sensor_placement.rot[2][0] = 0;
-	config->sensor_placement.rot[2][1] = 0;
-	config->sensor_placement.rot[2][2] = 1;
+		placement->rot[1][0] = 0;
+		placement->rot[1][1] = 1;
+		placement->rot[1][2] = 0;
 
-	config->sensor_placement.location[0] = 0;
-	config->sensor_placement.location[1] = 0;
-	config->sensor_placement.location[2] = 0;
+		placement->rot[2][0] = 0;
+		placement->rot[2][1] = 0;
+		placement->rot[2][2] = 1;
+		update_rotation_matrix_q(placement);
+
+		placement->location[0] = 0;
+		placement->location[1] = 0;
+		placement->location[2] = 0;
+	}
 
 	config->algo_towing_jack_delta_th = 25; //25mg
 	config->algo_towing_jack_min_duration = 0;
 	config->algo_crash_impact_th = 0;
 	config->algo_crash_min_duration = 0;
+	config->metrics_dump = 0;
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+	config->latency_dump = 0;
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+#ifdef CONFIG_ST_HAL_CAPTURE
+	config->capture = 0;
+#endif /* CONFIG_ST_HAL_CAPTURE */
 }
 
-static void update_rotation_matrix(struct hal_config_t *config, float yawd, float pitchd, float rolld)
+static void update_rotation_matrix(struct sensor_placement_t *placement,
+				   float yawd, float pitchd, float rolld)
 {
 	float yaw = (yawd / 10.0f) * M_PI / 180.0f;
 	float pitch = (pitchd / 10.0f) * M_PI / 180.0f;
 	float roll = (rolld / 10.0f) * M_PI / 180.0f;
 
-	config->sensor_placement.rot[0][0] = cos(yaw) * cos(roll) - sin(yaw) * sin(pitch) * sin(roll);
-	config->sensor_placement.rot[0][1] = -sin(yaw) * cos(pitch);
-	config->sensor_placement.rot[0][2] = cos(yaw) * sin(roll) + sin(yaw) * sin(pitch) * cos(roll);
+	placement->rot[0][0] = cos(yaw) * cos(roll) - sin(yaw) * sin(pitch) * sin(roll);
+	placement->rot[0][1] = -sin(yaw) * cos(pitch);
+	placement->rot[0][2] = cos(yaw) * sin(roll) + sin(yaw) * sin(pitch) * cos(roll);
 
-	config->sensor_placement.rot[1][0] = sin(yaw) * cos(roll) + cos(yaw) * sin(pitch) * sin(roll);
-	config->sensor_placement.rot[1][1] = cos(yaw) * cos(pitch);
-	config->sensor_placement.rot[1][2] = sin(yaw) * sin(roll) - cos(yaw) * sin(pitch) * cos(roll);
+	placement->rot[1][0] = sin(yaw) * cos(roll) + cos(yaw) * sin(pitch) * sin(roll);
+	placement->rot[1][1] = cos(yaw) * cos(pitch);
+	placement->rot[1][2] = sin(yaw) * sin(roll) - cos(yaw) * sin(pitch) * cos(roll);
 
-	config->sensor_placement.rot[2][0] = -cos(pitch) * sin(roll);
-	config->sensor_placement.rot[2][1] = sin(pitch);
-	config->sensor_placement.rot[2][2] = cos(pitch) * cos(roll);
+	placement->rot[2][0] = -cos(pitch) * sin(roll);
+	placement->rot[2][1] = sin(pitch);
+	placement->rot[2][2] = cos(pitch) * cos(roll);
+	update_rotation_matrix_q(placement);
 }
 
 static int update_sensor_placement(struct hal_config_t *config,
+				   unsigned int imu,
 				   enum PARSING_STRING_INDEX index,
 				   char *data, int len)
 {
 	std::lock_guard<std::mutex> lock(configMutex);
+	struct sensor_placement_t *placement = &config->sensor_placement[imu];
 	int roll = 0, pitch = 0, yaw = 0;
 	int x = 0, y = 0, z = 0;
 
@@ -129,16 +186,16 @@ static int update_sensor_placement(struct hal_config_t *config,
 			return -EINVAL;
 		}
 
-		config->sensor_placement.location[0] = x;
-		config->sensor_placement.location[1] = y;
-		config->sensor_placement.location[2] = z;
+		placement->location[0] = x;
+		placement->location[1] = y;
+		placement->location[2] = z;
 		break;
 	case IMU_SENSOR_EULER_ANGLES_INDEX:
 		if (sscanf(data, "[%d,%d,%d]", &roll, &pitch, &yaw) != 3) {
 			return -EINVAL;
 		}
 
-		update_rotation_matrix(config, yaw, pitch, roll);
+		update_rotation_matrix(placement, yaw, pitch, roll);
 		break;
 	default:
 		return 0;
@@ -370,61 +427,131 @@ static int ignition_off_check_and_run(struct hal_config_t *config,
 	return ret;
 }
 
-static int update_file_data(const char *file, char *path)
+static int update_metrics_dump(struct hal_config_t *config,
+			       enum PARSING_STRING_INDEX index,
+			       char *data, int len)
 {
-	char *file_path_name = NULL;
-	char *buffer_string = NULL;
-	FILE *fd_config = NULL;
-	struct stat st;
-	int err = 0;
-	int len = 0;
-	char *ptr;
-	int size;
+	std::lock_guard<std::mutex> lock(configMutex);
+	uint32_t metrics_dump;
 
-	file_path_name = (char *)calloc(strlen(path) + strlen(file) + 2, 1);
-	if (!file_path_name) {
-		return -ENOMEM;
+	if (sscanf(data, "%u", &metrics_dump) != 1) {
+		return -EINVAL;
 	}
 
-	sprintf(file_path_name, "%s/%s", path, file);
-	stat(file_path_name, &st);
-	size = st.st_size;
-	if (size == 0) {
-		ALOGE("Zero len file %s\n", file_path_name);
+	config->metrics_dump = metrics_dump;
 
-		goto err_out;
+	return 0;
+}
+
+static int metrics_dump_check_and_run(struct hal_config_t *config)
+{
+	std::lock_guard<std::mutex> lock(configMutex);
+	int ret = 0;
+
+	if (config->metrics_dump && metrics_dump_handler) {
+		ret = metrics_dump_handler(ST_HAL_METRICS_DATA_FILENAME);
+		if (ret < 0)
+			ALOGE("Failed to write %s (%d)",
+			      ST_HAL_METRICS_DATA_FILENAME, ret);
+		config->metrics_dump = 0;
 	}
 
-	fd_config = fopen(file_path_name, "r");
-	if (!fd_config) {
-		err = -errno;
-		ALOGE("Filed to open %s (errno %d)\n", file_path_name, err);
+	return ret;
+}
 
-		goto err_out;
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+static int update_latency_dump(struct hal_config_t *config,
+			       enum PARSING_STRING_INDEX index,
+			       char *data, int len)
+{
+	std::lock_guard<std::mutex> lock(configMutex);
+	uint32_t latency_dump;
+
+	if (sscanf(data, "%u", &latency_dump) != 1) {
+		return -EINVAL;
 	}
 
-	buffer_string = (char *)calloc(size + 1, 1);
-	if (!buffer_string) {
-		goto err_out;
+	config->latency_dump = latency_dump;
+
+	return 0;
+}
+
+static int latency_dump_check_and_run(struct hal_config_t *config)
+{
+	std::lock_guard<std::mutex> lock(configMutex);
+	int ret = 0;
+
+	if (config->latency_dump && latency_dump_handler) {
+		ret = latency_dump_handler(ST_HAL_LATENCY_DATA_FILENAME);
+		if (ret < 0)
+			ALOGE("Failed to write %s (%d)",
+			      ST_HAL_LATENCY_DATA_FILENAME, ret);
+		config->latency_dump = 0;
 	}
 
-	len = fread(buffer_string, 1, size, fd_config);
-	if (!len) {
-		goto err_out;
+	return ret;
+}
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+
+#ifdef CONFIG_ST_HAL_CAPTURE
+static int update_capture(struct hal_config_t *config,
+			  enum PARSING_STRING_INDEX index,
+			  char *data, int len)
+{
+	std::lock_guard<std::mutex> lock(configMutex);
+	uint32_t capture;
+
+	if (sscanf(data, "%u", &capture) != 1) {
+		return -EINVAL;
 	}
 
-	ptr = strstr(buffer_string, parsing_strings[IMU_SENSOR_PLACEMENT_INDEX]);
-	if (ptr) {
-		ptr += strlen(parsing_strings[IMU_SENSOR_PLACEMENT_INDEX]);
+	config->capture = capture ? 1 : 0;
+
+	return 0;
+}
+#endif /* CONFIG_ST_HAL_CAPTURE */
 
-		update_sensor_placement(&hal_config, IMU_SENSOR_PLACEMENT_INDEX, ptr, ptr - buffer_string);
+/*
+ * imu_parsing_string() - Placement key of an IMU instance
+ * @key: IMU_INSTANCE_PARSING_STRING_MAX bytes buffer.
+ * @index: IMU_SENSOR_PLACEMENT_INDEX or IMU_SENSOR_EULER_ANGLES_INDEX.
+ * @imu: IMU instance, the first one keeps the "imu_" prefix.
+ */
+static void imu_parsing_string(char *key, enum PARSING_STRING_INDEX index,
+			       int imu)
+{
+	if (imu == 0) {
+		snprintf(key, IMU_INSTANCE_PARSING_STRING_MAX, "%s",
+			 parsing_strings[index]);
+		return;
 	}
 
-	ptr = strstr(buffer_string, parsing_strings[IMU_SENSOR_EULER_ANGLES_INDEX]);
-	if (ptr) {
-		ptr += strlen(parsing_strings[IMU_SENSOR_EULER_ANGLES_INDEX]);
+	snprintf(key, IMU_INSTANCE_PARSING_STRING_MAX, "imu%d%s", imu + 1,
+		 parsing_strings[index] + strlen("imu"));
+}
+
+static void parse_config_data(char *buffer_string)
+{
+	char key[IMU_INSTANCE_PARSING_STRING_MAX];
+	char *ptr;
+	int imu;
+
+	for (imu = 0; imu < ST_HAL_IMU_MAX_INSTANCES; imu++) {
+		imu_parsing_string(key, IMU_SENSOR_PLACEMENT_INDEX, imu);
+		ptr = strstr(buffer_string, key);
+		if (ptr) {
+			ptr += strlen(key);
+
+			update_sensor_placement(&hal_config, imu, IMU_SENSOR_PLACEMENT_INDEX, ptr, ptr - buffer_string);
+		}
+
+		imu_parsing_string(key, IMU_SENSOR_EULER_ANGLES_INDEX, imu);
+		ptr = strstr(buffer_string, key);
+		if (ptr) {
+			ptr += strlen(key);
 
-		update_sensor_placement(&hal_config, IMU_SENSOR_EULER_ANGLES_INDEX, ptr, ptr - buffer_string);
+			update_sensor_placement(&hal_config, imu, IMU_SENSOR_EULER_ANGLES_INDEX, ptr, ptr - buffer_string);
+		}
 	}
 
 	ptr = strstr(buffer_string, parsing_strings[ALGO_TOWING_JACK_DELTA_TH_INDEX]);
@@ -462,6 +589,80 @@ static int update_file_data(const char *file, char *path)
 		update_ignition_off(&hal_config, IGNITION_OFF_INDEX, ptr, ptr - buffer_string);
 	}
 
+	ptr = strstr(buffer_string, parsing_strings[METRICS_DUMP_INDEX]);
+	if (ptr) {
+		ptr += strlen(parsing_strings[METRICS_DUMP_INDEX]);
+
+		update_metrics_dump(&hal_config, METRICS_DUMP_INDEX, ptr, ptr - buffer_string);
+	}
+
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+	ptr = strstr(buffer_string, parsing_strings[LATENCY_DUMP_INDEX]);
+	if (ptr) {
+		ptr += strlen(parsing_strings[LATENCY_DUMP_INDEX]);
+
+		update_latency_dump(&hal_config, LATENCY_DUMP_INDEX, ptr, ptr - buffer_string);
+	}
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+
+#ifdef CONFIG_ST_HAL_CAPTURE
+	ptr = strstr(buffer_string, parsing_strings[CAPTURE_INDEX]);
+	if (ptr) {
+		ptr += strlen(parsing_strings[CAPTURE_INDEX]);
+
+		update_capture(&hal_config, CAPTURE_INDEX, ptr, ptr - buffer_string);
+	}
+#endif /* CONFIG_ST_HAL_CAPTURE */
+}
+
+static int update_file_data(const char *file, char *path)
+{
+	char *file_path_name = NULL;
+	char *buffer_string = NULL;
+	FILE *fd_config = NULL;
+	struct stat st;
+	int err = 0;
+	int len = 0;
+	int size;
+
+	file_path_name = (char *)calloc(strlen(path) + strlen(file) + 2, 1);
+	if (!file_path_name) {
+		return -ENOMEM;
+	}
+
+	sprintf(file_path_name, "%s/%s", path, file);
+	stat(file_path_name, &st);
+	size = st.st_size;
+	if (size == 0) {
+		ALOGE("Zero len file %s\n", file_path_name);
+
+		goto err_out;
+	}
+
+	fd_config = fopen(file_path_name, "r");
+	if (!fd_config) {
+		err = -errno;
+		ALOGE("Filed to open %s (errno %d)\n", file_path_name, err);
+
+		goto err_out;
+	}
+
+	buffer_string = (char *)calloc(size + 1, 1);
+	if (!buffer_string) {
+		goto err_out;
+	}
+
+	len = fread(buffer_string, 1, size, fd_config);
+	if (!len) {
+		goto err_out;
+	}
+
+#ifdef CONFIG_ST_HAL_CAPTURE
+	SensorCapture::Record(SENSOR_CAPTURE_CONFIG, -1, buffer_string, len);
+#endif /* CONFIG_ST_HAL_CAPTURE */
+
+	parse_config_data(buffer_string);
+
 err_out:
 	if (fd_config) {
 		fclose(fd_config);
@@ -478,6 +679,36 @@ err_out:
 	return err;
 }
 
+#ifdef CONFIG_ST_HAL_CAPTURE
+static int capture_check_and_run(struct hal_config_t *config, char *path)
+{
+	static uint32_t capture_running;
+	int ret;
+
+	{
+		std::lock_guard<std::mutex> lock(configMutex);
+
+		/* start or stop only when the requested state changes */
+		if ((config->capture == capture_running) || !capture_handler)
+			return 0;
+
+		ret = capture_handler(ST_HAL_CAPTURE_DATA_FILENAME,
+				      config->capture);
+		if (ret < 0)
+			ALOGE("Failed to %s capture to %s (%d)",
+			      config->capture ? "start" : "stop",
+			      ST_HAL_CAPTURE_DATA_FILENAME, ret);
+		capture_running = config->capture;
+	}
+
+	/* record the configuration in use, replay starts from it */
+	if ((ret == 0) && capture_running)
+		ret = update_file_data(HAL_CONFIGURATION_FILE, path);
+
+	return ret;
+}
+#endif /* CONFIG_ST_HAL_CAPTURE */
+
 static int is_directory(const char *path)
 {
 	struct stat path_stat;
@@ -552,9 +783,11 @@ static void *hal_configuration_thread(void *parm)
 					if (event->mask & IN_CLOSE_WRITE) {
 						ALOGD("Configuration file %s closed for write", event->name);
 						if (strcmp(event->name, HAL_CONFIGURATION_FILE) == 0) {
+							ST_HAL_TRACE_BEGIN("config reload");
 							update_file_data(HAL_CONFIGURATION_FILE, thread_params->pathname);
 							write_algos_parameters_to_driver(&hal_config);
 							show_sensor_placement(&hal_config);
+							ST_HAL_TRACE_END();
 						}
 					}
 				}
@@ -565,6 +798,13 @@ static void *hal_configuration_thread(void *parm)
 
 		ignition_off_check_and_run(&hal_config,
 					   thread_params->hal_data);
+		metrics_dump_check_and_run(&hal_config);
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+		latency_dump_check_and_run(&hal_config);
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+#ifdef CONFIG_ST_HAL_CAPTURE
+		capture_check_and_run(&hal_config, thread_params->pathname);
+#endif /* CONFIG_ST_HAL_CAPTURE */
 	}
 
 	if (fd >= 0) {
@@ -620,6 +860,68 @@ int init_notify_loop(char *pathname, STSensorHAL_data *hal_data)
 	return 0;
 }
 
+void set_metrics_dump_handler(int (*handler)(const char *filename))
+{
+	std::lock_guard<std::mutex> lock(configMutex);
+
+	metrics_dump_handler = handler;
+}
+
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+void set_latency_dump_handler(int (*handler)(const char *filename))
+{
+	std::lock_guard<std::mutex> lock(configMutex);
+
+	latency_dump_handler = handler;
+}
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+
+#ifdef CONFIG_ST_HAL_CAPTURE
+void set_capture_handler(int (*handler)(const char *filename, int enable))
+{
+	std::lock_guard<std::mutex> lock(configMutex);
+
+	capture_handler = handler;
+}
+
+/**
+ * load_config_data() - Apply configuration file content, used by replay
+ * @data: configuration file content.
+ * @len: content length.
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int load_config_data(const char *data, size_t len)
+{
+	char *buffer_string;
+	uint32_t capture;
+
+	buffer_string = (char *)calloc(len + 1, 1);
+	if (!buffer_string)
+		return -ENOMEM;
+
+	memcpy(buffer_string, data, len);
+
+	configMutex.lock();
+	capture = hal_config.capture;
+	configMutex.unlock();
+
+	parse_config_data(buffer_string);
+
+	/* a replayed file must not start or stop a capture */
+	configMutex.lock();
+	hal_config.capture = capture;
+	configMutex.unlock();
+
+	write_algos_parameters_to_driver(&hal_config);
+	show_sensor_placement(&hal_config);
+
+	free(buffer_string);
+
+	return 0;
+}
+#endif /* CONFIG_ST_HAL_CAPTURE */
+
 const struct hal_config_t get_config(void)
 {
 	configMutex.lock();
@@ -628,3 +930,21 @@ const struct hal_config_t get_config(void)
 
 	return tmp;
 }
+
+/**
+ * get_sensor_placement() - Get the placement of an IMU instance
+ * @imu_instance: IMU instance, out of range instances use the first one.
+ * @placement: placement copy.
+ *
+ * Called for every sample, copies only the placement under the lock.
+ **/
+void get_sensor_placement(unsigned int imu_instance,
+			  struct sensor_placement_t *placement)
+{
+	if (imu_instance >= ST_HAL_IMU_MAX_INSTANCES)
+		imu_instance = 0;
+
+	configMutex.lock();
+	*placement = hal_config.sensor_placement[imu_instance];
+	configMutex.unlock();
+}
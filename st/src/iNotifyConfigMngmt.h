@@ -23,6 +23,13 @@ enum PARSING_STRING_INDEX {
 	ALGO_CRASH_IMPACT_TH_INDEX,
 	ALGO_CRASH_MIN_DURATION_INDEX,
 	IGNITION_OFF_INDEX,
+	METRICS_DUMP_INDEX,
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+	LATENCY_DUMP_INDEX,
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+#ifdef CONFIG_ST_HAL_CAPTURE
+	CAPTURE_INDEX,
+#endif /* CONFIG_ST_HAL_CAPTURE */
 };
 
 struct thread_params_t {
@@ -30,23 +37,54 @@ struct thread_params_t {
 	STSensorHAL_data *hal_data;
 };
 
+#ifdef CONFIG_ST_HAL_FIXED_POINT_DATA
+#define ST_HAL_ROT_MATRIX_Q_SHIFT	(14)
+#endif /* CONFIG_ST_HAL_FIXED_POINT_DATA */
+
 struct sensor_placement_t {
 	float rot[3][3];
 	float location[3];
+#ifdef CONFIG_ST_HAL_FIXED_POINT_DATA
+	/* rot in Q14, cached for the fixed point data path */
+	int32_t rot_q[3][3];
+#endif /* CONFIG_ST_HAL_FIXED_POINT_DATA */
 };
 
+/* "imu<N>_sensor_placement = ", "imu<N>_sensor_euler_angles = " for N > 1 */
+#define IMU_INSTANCE_PARSING_STRING_MAX	(32)
+
 struct hal_config_t {
-	struct sensor_placement_t sensor_placement;
+	struct sensor_placement_t sensor_placement[ST_HAL_IMU_MAX_INSTANCES];
 	uint16_t algo_towing_jack_delta_th;
 	uint32_t algo_towing_jack_min_duration;
 	uint16_t algo_crash_impact_th;
 	uint32_t algo_crash_min_duration;
 	uint32_t ignition_off;
+	uint32_t metrics_dump;
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+	uint32_t latency_dump;
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+#ifdef CONFIG_ST_HAL_CAPTURE
+	uint32_t capture;
+#endif /* CONFIG_ST_HAL_CAPTURE */
 	int loglevel;
 };
 
 int init_notify_loop(char *pathname, STSensorHAL_data *hal_data);
 
+void set_metrics_dump_handler(int (*handler)(const char *filename));
+
+#ifdef CONFIG_ST_HAL_LATENCY_HISTOGRAM
+void set_latency_dump_handler(int (*handler)(const char *filename));
+#endif /* CONFIG_ST_HAL_LATENCY_HISTOGRAM */
+
+#ifdef CONFIG_ST_HAL_CAPTURE
+void set_capture_handler(int (*handler)(const char *filename, int enable));
+int load_config_data(const char *data, size_t len);
+#endif /* CONFIG_ST_HAL_CAPTURE */
+
 const struct hal_config_t get_config(void);
+void get_sensor_placement(unsigned int imu_instance,
+			  struct sensor_placement_t *placement);
 
 #endif /* __HAL_INOTIFY_CONFIGURATION */
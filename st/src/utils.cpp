@@ -15,11 +15,12 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "utils.h"
 
 /* IIO Device SYSFS interface */
-static const char *device_iio_dir = "/sys/bus/iio/devices/";
 static const char *device_iio_sfa_filename = "sampling_frequency_available";
 static const char *device_iio_sf_filename = "sampling_frequency";
 static const char *device_iio_hw_fifo_enabled = "hwfifo_enabled";
@@ -36,22 +37,46 @@ static const char *device_iio_fsm_jack_min_duration = "towing_jack_min_duration"
 static const char *device_iio_fsm_crash_impact_th = "crash_impact_th";
 static const char *device_iio_fsm_crash_min_duration = "crash_min_duration";
 static const char *device_iio_mlc_device_type = "mlc";
+static const char *device_iio_timestamp_clock = "current_timestamp_clock";
+
+/* current_timestamp_clock values */
+static const struct {
+	const char *name;
+	clockid_t clock;
+} device_iio_timestamp_clocks[] = {
+	{ "realtime", CLOCK_REALTIME },
+	{ "monotonic", CLOCK_MONOTONIC },
+	{ "monotonic_raw", CLOCK_MONOTONIC_RAW },
+	{ "realtime_coarse", CLOCK_REALTIME_COARSE },
+	{ "monotonic_coarse", CLOCK_MONOTONIC_COARSE },
+	{ "boottime", CLOCK_BOOTTIME },
+	{ "tai", CLOCK_TAI },
+};
+
+static int device_iio_sysfs_open_buffer(unsigned int dev_num)
+{
+	int fd;
+	char buffer_path[DEVICE_IIO_MAX_FILENAME_LEN];
 
-int device_iio_utils::sysfs_write_int(char *file, int val)
+	snprintf(buffer_path, sizeof(buffer_path), "/dev/iio:device%u", dev_num);
+
+	fd = open(buffer_path, O_RDONLY | O_NONBLOCK);
+
+	return fd < 0 ? -errno : fd;
+}
+
+static int device_iio_sysfs_open_events(unsigned int __attribute__((unused))dev_num,
+					int buffer_fd)
 {
-	FILE *fp;
+	int fd;
 
-	fp = fopen(file, "w");
-	if (NULL == fp)
+	if (ioctl(buffer_fd, _IOR('i', 0x90, int), &fd) < 0)
 		return -errno;
 
-	fprintf(fp, "%d", val);
-	fclose(fp);
-
-	return 0;
+	return fd;
 }
 
-int device_iio_utils::sysfs_write_scale(char *file, float val)
+static int device_iio_sysfs_write(const char *file, const char *str)
 {
 	FILE *fp;
 
@@ -59,12 +84,68 @@ int device_iio_utils::sysfs_write_scale(char *file, float val)
 	if (NULL == fp)
 		return -errno;
 
-	fprintf(fp, "%f", val);
+	fprintf(fp, "%s", str);
 	fclose(fp);
 
 	return 0;
 }
 
+/* IIO devices exposed by the kernel */
+static const struct device_iio_transport device_iio_sysfs_transport = {
+	.name = "sysfs",
+	.sysfs_dir = "/sys/bus/iio/devices/",
+	.open_buffer = device_iio_sysfs_open_buffer,
+	.open_events = device_iio_sysfs_open_events,
+	.sysfs_write = device_iio_sysfs_write,
+};
+
+const struct device_iio_transport *device_iio_utils::transport =
+						&device_iio_sysfs_transport;
+
+/**
+ * set_transport() - Select the IIO devices backend
+ * @t: transport, NULL to restore the kernel sysfs one.
+ *
+ * Must be called before sensors are discovered.
+ **/
+void device_iio_utils::set_transport(const struct device_iio_transport *t)
+{
+	transport = t ? t : &device_iio_sysfs_transport;
+}
+
+const char *device_iio_utils::get_sysfs_dir(void)
+{
+	return transport->sysfs_dir;
+}
+
+int device_iio_utils::open_buffer(unsigned int dev_num)
+{
+	return transport->open_buffer(dev_num);
+}
+
+int device_iio_utils::open_events(unsigned int dev_num, int buffer_fd)
+{
+	return transport->open_events(dev_num, buffer_fd);
+}
+
+int device_iio_utils::sysfs_write_int(char *file, int val)
+{
+	char str[16];
+
+	snprintf(str, sizeof(str), "%d", val);
+
+	return transport->sysfs_write(file, str);
+}
+
+int device_iio_utils::sysfs_write_scale(char *file, float val)
+{
+	char str[32];
+
+	snprintf(str, sizeof(str), "%f", val);
+
+	return transport->sysfs_write(file, str);
+}
+
 int device_iio_utils::sysfs_read_scale(char *file, float *val)
 {
 	FILE *fp;
@@ -81,20 +162,11 @@ int device_iio_utils::sysfs_read_scale(char *file, float *val)
 
 int device_iio_utils::sysfs_write_str(char *file, char *str)
 {
-	FILE *fp;
-
-ALOGD("sysfs_write_str: write to file ret %s data %s", file, str);
-
-	fp = fopen(file, "w");
-	if (NULL == fp)
-		return -errno;
+#if (CONFIG_ST_HAL_DEBUG_LEVEL >= ST_HAL_DEBUG_EXTRA_VERBOSE)
+	ALOGD("sysfs_write_str: %s <- %s", file, str);
+#endif /* CONFIG_ST_HAL_DEBUG_LEVEL */
 
-ALOGD("sysfs_write_str: 111 write to file ret %s data %s", file, str);
-
-	fprintf(fp, "%s", str);
-	fclose(fp);
-
-	return 0;
+	return transport->sysfs_write(file, str);
 }
 
 int device_iio_utils::sysfs_read_str(char *file, char *str, int len)
@@ -136,13 +208,25 @@ int device_iio_utils::check_file(char *filename)
 	return stat(filename, &info);
 }
 
-int device_iio_utils::enable_channels(const char *device_dir, bool enable)
+/*
+ * enable_channels() - Write all scan_elements <name>_en files
+ * @device_dir: iio:device sysfs path.
+ * @enable: false disables all channels.
+ * @channels: channels with enabled set are enabled, the others and the
+ *	      channels not listed are disabled.
+ * @num_channels: @channels size.
+ */
+int device_iio_utils::enable_channels(const char *device_dir, bool enable,
+				      const struct device_iio_info_channel *channels,
+				      int num_channels)
 {
 	char dir[DEVICE_IIO_MAX_FILENAME_LEN + 1];
 	char filename[DEVICE_IIO_MAX_FILENAME_LEN + 1];
 	const struct dirent *ent;
-	FILE *sysfsfp;
+	size_t len;
+	bool en;
 	DIR *dp;
+	int err, i;
 
 	if (strlen(device_dir) +
 		strlen("scan_elements") + 1 > DEVICE_IIO_MAX_FILENAME_LEN)
@@ -154,22 +238,31 @@ int device_iio_utils::enable_channels(const char *device_dir, bool enable)
 		return -errno;
 
 	while (ent = readdir(dp), ent != NULL) {
-	if (strlen(dir) +
-		strlen(ent->d_name) > DEVICE_IIO_MAX_FILENAME_LEN)
-		continue;
+		if (strlen(dir) +
+			strlen(ent->d_name) > DEVICE_IIO_MAX_FILENAME_LEN)
+			continue;
 
-		if (!strcmp(ent->d_name + strlen(ent->d_name) - strlen("_en"),
-			    "_en")) {
-			snprintf(filename, DEVICE_IIO_MAX_FILENAME_LEN,
-					 "%s/%s", dir, ent->d_name);
-			sysfsfp = fopen(filename, "r+");
-			if (!sysfsfp) {
-				closedir(dp);
-				return -errno;
+		len = strlen(ent->d_name);
+		if ((len <= strlen("_en")) ||
+		    strcmp(ent->d_name + len - strlen("_en"), "_en"))
+			continue;
+
+		/* channels not read by the sensor are left out of the scan */
+		len -= strlen("_en");
+		for (i = 0, en = false; enable && (i < num_channels); i++) {
+			if ((strlen(channels[i].name) == len) &&
+			    !strncmp(channels[i].name, ent->d_name, len)) {
+				en = channels[i].enabled;
+				break;
 			}
+		}
 
-			fprintf(sysfsfp, "%d", enable);
-			fclose(sysfsfp);
+		snprintf(filename, DEVICE_IIO_MAX_FILENAME_LEN,
+			 "%s/%s", dir, ent->d_name);
+		err = sysfs_write_int(filename, en);
+		if (err < 0) {
+			closedir(dp);
+			return err;
 		}
 	}
 
@@ -178,7 +271,16 @@ int device_iio_utils::enable_channels(const char *device_dir, bool enable)
 	return 0;
 }
 
-int device_iio_utils::get_device_by_name(const char *name)
+/**
+ * get_devices_by_name() - Get all iio devices with the same name
+ * @name: iio device name.
+ * @dev_nums: iio:device numbers found, lowest first.
+ * @max: @dev_nums size.
+ *
+ * Return value: number of devices found, -ENODEV if none.
+ **/
+int device_iio_utils::get_devices_by_name(const char *name, int *dev_nums,
+					  int max)
 {
 	struct dirent *ent;
 	int number, numstrlen;
@@ -186,10 +288,10 @@ int device_iio_utils::get_device_by_name(const char *name)
 	DIR *dp;
 	char dname[DEVICE_IIO_MAX_NAME_LENGTH];
 	char dfilename[DEVICE_IIO_MAX_FILENAME_LEN + 1];
-	int ret;
+	int ret, i, count = 0;
 	int fnamelen;
 
-	dp = opendir(device_iio_dir);
+	dp = opendir(transport->sysfs_dir);
 	if (NULL == dp)
 		return -ENODEV;
 
@@ -204,14 +306,14 @@ int device_iio_utils::get_device_by_name(const char *name)
 			numstrlen = sscanf(ent->d_name +
 					   strlen(device_iio_device_name),
 					   "%d", &number);
-			fnamelen = numstrlen + strlen(device_iio_dir) +
+			fnamelen = numstrlen + strlen(transport->sysfs_dir) +
 				   strlen(device_iio_device_name);
 			if (fnamelen > DEVICE_IIO_MAX_FILENAME_LEN)
 				continue;
 
 			sprintf(dfilename,
 				"%s%s%d/name",
-				device_iio_dir,
+				transport->sysfs_dir,
 				device_iio_device_name,
 				number);
 			devilceFile = fopen(dfilename, "r");
@@ -225,21 +327,40 @@ int device_iio_utils::get_device_by_name(const char *name)
 				break;
 			}
 
-			if (strncmp(name, dname, strlen(dname)) == 0 &&
-			    strlen(name) == strlen(dname)) {
-				fclose(devilceFile);
-				closedir(dp);
+			fclose(devilceFile);
 
-				return number;
+			if (strncmp(name, dname, strlen(dname)) != 0 ||
+			    strlen(name) != strlen(dname))
+				continue;
+
+			/* readdir order is not defined, keep the list sorted */
+			for (i = count; i > 0 && dev_nums[i - 1] > number; i--) {
+				if (i < max)
+					dev_nums[i] = dev_nums[i - 1];
 			}
 
-		fclose(devilceFile);
+			if (i < max)
+				dev_nums[i] = number;
+
+			if (count < max)
+				count++;
 		}
 	}
 
 	closedir(dp);
 
-	return -ENODEV;
+	return count > 0 ? count : -ENODEV;
+}
+
+int device_iio_utils::get_device_by_name(const char *name)
+{
+	int dev_num, err;
+
+	err = get_devices_by_name(name, &dev_num, 1);
+	if (err < 0)
+		return err;
+
+	return dev_num;
 }
 
 int device_iio_utils::get_device_by_type(const char *type)
@@ -253,7 +374,7 @@ int device_iio_utils::get_device_by_type(const char *type)
 	int ret;
 	int fnamelen;
 
-	dp = opendir(device_iio_dir);
+	dp = opendir(transport->sysfs_dir);
 	if (NULL == dp)
 		return -ENODEV;
 
@@ -268,14 +389,14 @@ int device_iio_utils::get_device_by_type(const char *type)
 			numstrlen = sscanf(ent->d_name +
 					   strlen(device_iio_device_name),
 					   "%d", &number);
-			fnamelen = numstrlen + strlen(device_iio_dir) +
+			fnamelen = numstrlen + strlen(transport->sysfs_dir) +
 				   strlen(device_iio_device_name);
 			if (fnamelen > DEVICE_IIO_MAX_FILENAME_LEN)
 				continue;
 
 			sprintf(dfilename,
 				"%s%s%d/name",
-				device_iio_dir,
+				transport->sysfs_dir,
 				device_iio_device_name,
 				number);
 			devilceFile = fopen(dfilename, "r");
@@ -307,18 +428,39 @@ int device_iio_utils::get_device_by_type(const char *type)
 	return -ENODEV;
 }
 
-int device_iio_utils::enable_sensor(char *device_dir, bool enable)
+/**
+ * enable_sensor() - Enable or disable the iio device buffer
+ * @device_dir: iio:device sysfs path.
+ * @enable: buffer state.
+ * @channels: channels in the scan when enabled, see enable_channels().
+ * @num_channels: @channels size.
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int device_iio_utils::enable_sensor(char *device_dir, bool enable,
+				    const struct device_iio_info_channel *channels,
+				    int num_channels)
 {
 	char enable_file[DEVICE_IIO_MAX_FILENAME_LEN + 1];
 	int err;
 
-	err = enable_channels(device_dir, enable);
+	sprintf(enable_file, "%s/%s", device_dir, device_iio_buffer_enable);
+
+	/* scan elements can not be changed while the buffer is enabled */
+	if (!enable) {
+		err = sysfs_write_int(enable_file, 0);
+		if (err < 0)
+			return err;
+
+		return enable_channels(device_dir, false, channels,
+				       num_channels);
+	}
+
+	err = enable_channels(device_dir, true, channels, num_channels);
 	if (err < 0)
 		return err;
 
-	sprintf(enable_file, "%s/%s", device_dir, device_iio_buffer_enable);
-
-	return sysfs_write_int(enable_file, enable);
+	return sysfs_write_int(enable_file, 1);
 }
 
 int device_iio_utils::get_sampling_frequency_available(char *device_dir,
@@ -400,6 +542,19 @@ out:
 	return len;
 }
 
+int device_iio_utils::set_buffer_length(const char *device_dir,
+					unsigned int length)
+{
+	int ret;
+	char tmp_filaname[DEVICE_IIO_MAX_FILENAME_LEN];
+
+	/* write "length" -> <iio:devicex>/buffer/length, buffer disabled */
+	ret = snprintf(tmp_filaname, DEVICE_IIO_MAX_FILENAME_LEN,
+		       "%s/%s", device_dir, device_iio_buffer_length);
+
+	return ret < 0 ? -ENOMEM : sysfs_write_int(tmp_filaname, length);
+}
+
 int device_iio_utils::set_sampling_frequency(char *device_dir,
 					     unsigned int frequency)
 {
@@ -440,6 +595,82 @@ int device_iio_utils::hw_fifo_flush(char *device_dir)
 	return ret < 0 ? -ENOMEM : sysfs_write_int(tmp_filaname, 1);
 }
 
+/**
+ * parse_timestamp_clock() - Get the clock of a current_timestamp_clock value
+ * @name: clock name, may end with a newline.
+ * @clock: clock id.
+ *
+ * Return value: 0 on success, -EINVAL if @name is unknown.
+ **/
+int device_iio_utils::parse_timestamp_clock(const char *name, clockid_t *clock)
+{
+	int i;
+	size_t len = strcspn(name, "\n");
+
+	for (i = 0; i < ARRAY_SIZE(device_iio_timestamp_clocks); i++) {
+		if ((strlen(device_iio_timestamp_clocks[i].name) == len) &&
+		    !strncmp(device_iio_timestamp_clocks[i].name, name, len)) {
+			*clock = device_iio_timestamp_clocks[i].clock;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+/**
+ * set_timestamp_clock() - Select the clock of scan and event timestamps
+ * @device_dir: iio:device sysfs path.
+ * @name: clock name, e.g. "boottime".
+ *
+ * The kernel rejects the write while the buffer is enabled and write
+ * errors may be lost, read the clock back with get_timestamp_clock().
+ *
+ * Return value: 0 on success, negative number on fail.
+ **/
+int device_iio_utils::set_timestamp_clock(const char *device_dir,
+					  const char *name)
+{
+	int ret;
+	char tmp_filaname[DEVICE_IIO_MAX_FILENAME_LEN];
+
+	/* write "name" -> <iio:devicex>/current_timestamp_clock */
+	ret = snprintf(tmp_filaname, DEVICE_IIO_MAX_FILENAME_LEN,
+		       "%s/%s", device_dir, device_iio_timestamp_clock);
+	if (ret < 0)
+		return -ENOMEM;
+
+	return sysfs_write_str(tmp_filaname, (char *)name);
+}
+
+/**
+ * get_timestamp_clock() - Read the clock of scan and event timestamps
+ * @device_dir: iio:device sysfs path.
+ * @clock: clock id.
+ *
+ * Return value: 0 on success, negative number on fail (-ENOENT on
+ *               kernels without current_timestamp_clock).
+ **/
+int device_iio_utils::get_timestamp_clock(const char *device_dir,
+					  clockid_t *clock)
+{
+	int ret;
+	char name[DEVICE_IIO_MAX_NAME_LENGTH] = "";
+	char tmp_filaname[DEVICE_IIO_MAX_FILENAME_LEN];
+
+	/* read <iio:devicex>/current_timestamp_clock */
+	ret = snprintf(tmp_filaname, DEVICE_IIO_MAX_FILENAME_LEN,
+		       "%s/%s", device_dir, device_iio_timestamp_clock);
+	if (ret < 0)
+		return -ENOMEM;
+
+	ret = sysfs_read_str(tmp_filaname, name, sizeof(name));
+	if (ret < 0)
+		return ret;
+
+	return parse_timestamp_clock(name, clock);
+}
+
 int device_iio_utils::set_scale(const char *device_dir,
 				float value,
 				device_iio_chan_type_t device_type)
@@ -564,6 +795,100 @@ int device_iio_utils::get_type(struct device_iio_info_channel *channel,
 	return 0;
 }
 
+/**
+ * get_scan_elements() - Read index and type of all scan elements
+ * @device_dir: iio:device sysfs path.
+ * @channels: channels found, in scan index order, to be freed by the
+ *	      caller.
+ *
+ * Every scan_elements/<name>_index file is a channel the device can push
+ * in its buffer (axes, temperature, timestamp, ...), the array grows with
+ * the number of channels of the device.
+ *
+ * Return value: number of channels found, negative number on fail.
+ **/
+int device_iio_utils::get_scan_elements(const char *device_dir,
+					struct device_iio_info_channel **channels)
+{
+	DIR *dp;
+	size_t len;
+	int err, index, i, num = 0, max = 0;
+	const struct dirent *ent;
+	struct device_iio_info_channel channel, *tmp;
+	char dir[DEVICE_IIO_MAX_FILENAME_LEN + 1];
+	char filename[DEVICE_IIO_MAX_FILENAME_LEN + 1];
+
+	*channels = NULL;
+
+	if (strlen(device_dir) +
+	    strlen("scan_elements") + 1 > DEVICE_IIO_MAX_FILENAME_LEN)
+		return -ENAMETOOLONG;
+
+	sprintf(dir, "%s/scan_elements", device_dir);
+	dp = opendir(dir);
+	if (!dp)
+		return -errno;
+
+	while (ent = readdir(dp), ent != NULL) {
+		len = strlen(ent->d_name);
+		if ((len <= strlen("_index")) ||
+		    strcmp(ent->d_name + len - strlen("_index"), "_index"))
+			continue;
+
+		len -= strlen("_index");
+		if (len + 1 > DEVICE_IIO_MAX_NAME_LENGTH)
+			continue;
+
+		if (snprintf(filename, sizeof(filename), "%s/%s", dir,
+			     ent->d_name) >= (int)sizeof(filename))
+			continue;
+
+		memset(&channel, 0, sizeof(channel));
+		memcpy(channel.name, ent->d_name, len);
+		channel.name[len] = '\0';
+		channel.scale = 1.0f;
+
+		if (sysfs_read_int(filename, &index) != 1)
+			continue;
+
+		channel.index = index;
+
+		err = get_type(&channel, device_dir, channel.name, "in");
+		if ((err < 0) || !channel.bytes)
+			continue;
+
+		if (num == max) {
+			max += DEVICE_IIO_SCAN_ELEMENTS_STEP;
+			tmp = (struct device_iio_info_channel *)realloc(*channels,
+						max * sizeof(**channels));
+			if (!tmp) {
+				err = -ENOMEM;
+				goto free_channels;
+			}
+
+			*channels = tmp;
+		}
+
+		/* readdir order is random */
+		for (i = num; (i > 0) && ((*channels)[i - 1].index > channel.index); i--)
+			(*channels)[i] = (*channels)[i - 1];
+
+		(*channels)[i] = channel;
+		num++;
+	}
+
+	closedir(dp);
+
+	return num;
+
+free_channels:
+	closedir(dp);
+	free(*channels);
+	*channels = NULL;
+
+	return err;
+}
+
 int device_iio_utils::get_scale_available(const char *device_dir,
 				   struct device_iio_scales *sa,
 				   device_iio_chan_type_t device_type)
@@ -730,7 +1055,7 @@ int device_iio_utils::update_fsm_thresholds(char *threshold_data)
 	ret = snprintf(fsm_thresholds_filename,
 		       DEVICE_IIO_MAX_FILENAME_LEN,
 		       "%s%s%d/%s",
-		       device_iio_dir,
+		       transport->sysfs_dir,
 		       device_iio_device_name,
 		       number,
 		       device_iio_fsm_threshold_filename);
@@ -759,7 +1084,7 @@ int device_iio_utils::update_fsm_jack_min_duration(char *min_duration)
 	ret = snprintf(min_duration_filename,
 		       DEVICE_IIO_MAX_FILENAME_LEN,
 		       "%s%s%d/%s",
-		       device_iio_dir,
+		       transport->sysfs_dir,
 		       device_iio_device_name,
 		       number,
 		       device_iio_fsm_jack_min_duration);
@@ -788,7 +1113,7 @@ int device_iio_utils::update_crash_impact_th(char *crash_impact_th)
 	ret = snprintf(crash_impact_th_filename,
 		       DEVICE_IIO_MAX_FILENAME_LEN,
 		       "%s%s%d/%s",
-		       device_iio_dir,
+		       transport->sysfs_dir,
 		       device_iio_device_name,
 		       number,
 		       device_iio_fsm_crash_impact_th);
@@ -817,7 +1142,7 @@ int device_iio_utils::update_crash_min_duration(char *crash_min_duration)
 	ret = snprintf(crash_min_duration_filename,
 		       DEVICE_IIO_MAX_FILENAME_LEN,
 		       "%s%s%d/%s",
-		       device_iio_dir,
+		       transport->sysfs_dir,
 		       device_iio_device_name,
 		       number,
 		       device_iio_fsm_crash_min_duration);
@@ -23,6 +23,7 @@
 #include <linux/ioctl.h>
 #include <linux/types.h>
 #include <stdint.h>
+#include <time.h>
 
 #include "SensorHAL.h"
 
@@ -31,6 +32,7 @@
 #define DEVICE_IIO_MAX_SAMPLINGFREQ_LENGTH	32
 #define DEVICE_IIO_MAX_SAMP_FREQ_AVAILABLE	10
 #define DEVICE_IIO_SCALE_AVAILABLE		10
+#define DEVICE_IIO_SCAN_ELEMENTS_STEP		16
 
 /*
  * To fill values for following define please refer to ASM330LHH
@@ -45,6 +47,12 @@ typedef enum {
 
 #define DEVICE_IIO_EV_DIR_FIFO_DATA		0x05
 #define DEVICE_IIO_EV_TYPE_FIFO_FLUSH		0x06
+#define DEVICE_IIO_EV_TYPE_CHANGE		0x05
+#define DEVICE_IIO_EV_CHAN_ACTIVITY		0x13
+
+#define DEVICE_IIO_EVENT_CODE(type, dir, chan_type) \
+			(((uint64_t)(type) << 56) | ((uint64_t)(dir) << 48) | \
+			 ((uint64_t)(chan_type) << 32))
 
 struct device_iio_events {
 	uint64_t event_id;
@@ -61,9 +69,33 @@ struct device_iio_sampling_freqs {
 	unsigned int length;
 };
 
+/*
+ * struct device_iio_transport: access to IIO devices
+ * @name: transport name.
+ * @sysfs_dir: IIO devices sysfs directory, '/' terminated.
+ * @open_buffer: open buffer char device of iio:device<dev_num>,
+ *		 return fd or negative errno.
+ * @open_events: get events fd of iio:device<dev_num>, return fd or
+ *		 negative errno.
+ * @sysfs_write: write a string to a sysfs attribute, return 0 or
+ *		 negative errno.
+ */
+struct device_iio_transport {
+	const char *name;
+	const char *sysfs_dir;
+	int (*open_buffer)(unsigned int dev_num);
+	int (*open_events)(unsigned int dev_num, int buffer_fd);
+	int (*sysfs_write)(const char *file, const char *str);
+};
+
+/*
+ * struct device_iio_info_channel: iio scan element
+ * @name: scan_elements name without suffix, e.g. "in_accel_x".
+ * @index: scan index, channels are stored in a scan by index.
+ * @enabled: channel stored in the scan, disabled channels are skipped.
+ */
 struct device_iio_info_channel {
-	char *name;
-	char *type_name;
+	char name[DEVICE_IIO_MAX_NAME_LENGTH];
 	unsigned int index;
 	unsigned int enabled;
 	float scale;
@@ -79,27 +111,48 @@ struct device_iio_info_channel {
 
 class device_iio_utils {
 	private:
+		static const struct device_iio_transport *transport;
+
 		static int sysfs_write_int(char *file, int val);
 		static int sysfs_write_str(char *file, char *str);
 		static int sysfs_read_str(char *file, char *str, int len);
 		static int sysfs_read_int(char *file, int *val);
 		static int sysfs_write_scale(char *file, float val);
 		static int sysfs_read_scale(char *file, float *val);
-		static int enable_channels(const char *device_dir, bool enable);
+		static int enable_channels(const char *device_dir, bool enable,
+					   const struct device_iio_info_channel *channels,
+					   int num_channels);
 		static int check_file(char *filename);
 
 	public:
+		static void set_transport(const struct device_iio_transport *t);
+		static const char *get_sysfs_dir(void);
+		static int open_buffer(unsigned int dev_num);
+		static int open_events(unsigned int dev_num, int buffer_fd);
+
 		static int get_device_by_name(const char *name);
+		static int get_devices_by_name(const char *name, int *dev_nums,
+					       int max);
 		static int get_device_by_type(const char *type);
-		static int enable_sensor(char *device_dir, bool enable);
+		static int enable_sensor(char *device_dir, bool enable,
+					 const struct device_iio_info_channel *channels,
+					 int num_channels);
 		static int get_sampling_frequency_available(char *device_dir,
 				struct device_iio_sampling_freqs *sfa);
 		static int get_fifo_length(const char *device_dir);
+		static int set_buffer_length(const char *device_dir,
+					     unsigned int length);
 		static int set_sampling_frequency(char *device_dir,
 						  unsigned int frequency);
 		static int set_hw_fifo_watermark(char *device_dir,
 						 unsigned int watermark);
 		static int hw_fifo_flush(char *device_dir);
+		static int parse_timestamp_clock(const char *name,
+						 clockid_t *clock);
+		static int set_timestamp_clock(const char *device_dir,
+					       const char *name);
+		static int get_timestamp_clock(const char *device_dir,
+					       clockid_t *clock);
 		static int set_scale(const char *device_dir, float value,
 				     device_iio_chan_type_t device_type);
 		static int get_scale(const char *device_dir, float *value,
@@ -107,6 +160,8 @@ class device_iio_utils {
 		static int get_type(struct device_iio_info_channel *channel,
 				    const char *device_dir, const char *name,
 				    const char *post);
+		static int get_scan_elements(const char *device_dir,
+					     struct device_iio_info_channel **channels);
 
 		static int get_scale_available(const char *device_dir,
 					       struct device_iio_scales *sa,